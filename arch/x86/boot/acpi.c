@@ -0,0 +1,61 @@
+#include <stdint.h>
+
+#include <tianole/boot_info.h>
+
+#include "acpi.h"
+#include "efi.h"
+
+static int efi_guid_equal(const efi_guid_t *left, const efi_guid_t *right)
+{
+	uint32_t i;
+
+	if (left->data1 != right->data1 || left->data2 != right->data2 ||
+		left->data3 != right->data3) {
+		return 0;
+	}
+
+	for (i = 0; i < 8; i++) {
+		if (left->data4[i] != right->data4[i]) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * boot_capture_acpi_rsdp() - Record the firmware ACPI RSDP in boot_info.
+ * @system_table: UEFI system table whose configuration tables are searched.
+ * @boot_info: Kernel handoff structure updated on success.
+ *
+ * The ACPI 2.0 entry is preferred because its RSDP carries the XSDT; the
+ * ACPI 1.0 entry is only used when firmware publishes nothing newer.
+ */
+void boot_capture_acpi_rsdp(
+	efi_system_table_t *system_table, boot_info_t *boot_info)
+{
+	const efi_configuration_table_t *tables;
+	efi_guid_t acpi_20_guid = efi_acpi_20_table_guid();
+	efi_guid_t acpi_guid = efi_acpi_table_guid();
+	uint64_t i;
+
+	if (system_table == 0 || boot_info == 0 ||
+		system_table->configuration_table == 0) {
+		return;
+	}
+
+	tables = (const efi_configuration_table_t *)
+		system_table->configuration_table;
+	for (i = 0; i < system_table->number_of_table_entries; i++) {
+		if (efi_guid_equal(&tables[i].vendor_guid, &acpi_20_guid)) {
+			boot_info->acpi_rsdp =
+				(uint64_t)(uintptr_t)tables[i].vendor_table;
+			return;
+		}
+
+		if (efi_guid_equal(&tables[i].vendor_guid, &acpi_guid)) {
+			boot_info->acpi_rsdp =
+				(uint64_t)(uintptr_t)tables[i].vendor_table;
+		}
+	}
+}
@@ -0,0 +1,19 @@
+#ifndef X86_BOOT_ACPI_H
+#define X86_BOOT_ACPI_H
+
+#include <tianole/boot_info.h>
+
+#include "efi.h"
+
+/**
+ * boot_capture_acpi_rsdp() - Record the firmware ACPI RSDP in boot_info.
+ * @system_table: UEFI system table whose configuration tables are searched.
+ * @boot_info: Kernel handoff structure updated on success.
+ *
+ * Failure is non-fatal for boot. Without an RSDP the kernel cannot find the
+ * MADT and runs on the boot CPU only.
+ */
+void boot_capture_acpi_rsdp(
+	efi_system_table_t *system_table, boot_info_t *boot_info);
+
+#endif
@@ -1,5 +1,6 @@
 #include <tianole/boot_info.h>
 
+#include "acpi.h"
 #include "debug_log.h"
 #include "efi.h"
 #include "elf_loader.h"
@@ -26,6 +27,7 @@ efi_status EFIAPI efi_main(
 		system_table->con_out, boot_banner_text);
 	boot_debug_log_puts("Tianole x86 bootloader loaded.\n");
 	(void)boot_capture_framebuffer(system_table, &boot_info);
+	boot_capture_acpi_rsdp(system_table, &boot_info);
 
 	status = boot_read_file(image_handle,
 		system_table,
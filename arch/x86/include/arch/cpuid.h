@@ -0,0 +1,60 @@
+#ifndef ARCH_X86_CPUID_H
+#define ARCH_X86_CPUID_H
+
+#include <stdint.h>
+
+#define X86_CPUID_FEATURES 0x00000001u
+#define X86_CPUID_ECX_PCID (1u << 17)
+
+#define X86_CPUID_EXTENDED_FEATURES 0x00000007u
+#define X86_CPUID_EBX_ERMS (1u << 9)
+#define X86_CPUID_EBX_INVPCID (1u << 10)
+
+#define X86_CPUID_EXT_MAX 0x80000000u
+#define X86_CPUID_EXT_FEATURES 0x80000001u
+#define X86_CPUID_EDX_PDPE1GB (1u << 26)
+
+/**
+ * struct cpuid_regs - Registers returned by one CPUID query.
+ * @eax: EAX output.
+ * @ebx: EBX output.
+ * @ecx: ECX output.
+ * @edx: EDX output.
+ */
+struct cpuid_regs {
+	uint32_t eax;
+	uint32_t ebx;
+	uint32_t ecx;
+	uint32_t edx;
+};
+
+/**
+ * cpuid() - Execute CPUID for one leaf and subleaf.
+ * @leaf: Value loaded into EAX.
+ * @subleaf: Value loaded into ECX.
+ * @regs: Receives the four output registers.
+ */
+static inline void cpuid(uint32_t leaf, uint32_t subleaf,
+	struct cpuid_regs *regs)
+{
+	__asm__ volatile("cpuid"
+		: "=a"(regs->eax), "=b"(regs->ebx), "=c"(regs->ecx),
+		"=d"(regs->edx)
+		: "a"(leaf), "c"(subleaf));
+}
+
+/**
+ * cpuid_max_leaf() - Return the highest leaf in a CPUID range.
+ * @base: 0 for basic leaves or X86_CPUID_EXT_MAX for extended leaves.
+ *
+ * Return: Highest supported leaf in the range starting at @base.
+ */
+static inline uint32_t cpuid_max_leaf(uint32_t base)
+{
+	struct cpuid_regs regs;
+
+	cpuid(base, 0, &regs);
+	return regs.eax;
+}
+
+#endif
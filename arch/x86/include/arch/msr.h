@@ -0,0 +1,45 @@
+#ifndef ARCH_X86_MSR_H
+#define ARCH_X86_MSR_H
+
+#include <stdint.h>
+
+#define X86_MSR_APIC_BASE 0x0000001bu
+#define X86_MSR_EFER 0xc0000080u
+#define X86_MSR_GS_BASE 0xc0000101u
+
+#define X86_APIC_BASE_BSP (1ull << 8)
+#define X86_APIC_BASE_X2APIC (1ull << 10)
+#define X86_APIC_BASE_ENABLE (1ull << 11)
+#define X86_APIC_BASE_MASK 0x000ffffffffff000ull
+
+#define X86_EFER_LMA (1ull << 10)
+
+/**
+ * rdmsr() - Read a model-specific register.
+ * @msr: Register number loaded into ECX.
+ *
+ * Return: 64-bit register value from EDX:EAX.
+ */
+static inline uint64_t rdmsr(uint32_t msr)
+{
+	uint32_t low;
+	uint32_t high;
+
+	__asm__ volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+	return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * wrmsr() - Write a model-specific register.
+ * @msr: Register number loaded into ECX.
+ * @value: 64-bit value split into EDX:EAX.
+ */
+static inline void wrmsr(uint32_t msr, uint64_t value)
+{
+	__asm__ volatile("wrmsr"
+		:
+		: "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32))
+		: "memory");
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef ARCH_X86_SMP_H
+#define ARCH_X86_SMP_H
+
+#include <stdint.h>
+
+#include <tianole/smp.h>
+
+/*
+ * SMP plumbing shared between arch/x86/kernel, which owns the local APIC
+ * and CPU startup, and arch/x86/mm, which owns the TLB.
+ */
+
+struct vm_space;
+
+/**
+ * struct x86_cpu - Architecture state of one logical CPU.
+ * @id: Logical CPU number. Kept first: GS points at the running CPU's
+ *      entry, so smp_processor_id() is a single %gs:0 load.
+ * @apic_id: Local APIC ID used to address IPIs.
+ * @current_space: Address space loaded in this CPU's CR3.
+ * @pcid_generation: PCID generation of the tag loaded in CR3, or 0 while
+ *                   the kernel space's fixed PCID 0 is loaded.
+ */
+struct x86_cpu {
+	uint32_t id;
+	uint32_t apic_id;
+	struct vm_space *current_space;
+	uint64_t pcid_generation;
+};
+
+/* Indexed by logical CPU number; entry.S points the boot CPU's GS here. */
+extern struct x86_cpu x86_cpus[NR_CPUS];
+
+/**
+ * smp_send_tlb_flush() - Interrupt another CPU so it flushes its TLB.
+ * @cpu: Online CPU other than the caller.
+ *
+ * The target runs tlb_flush_pending() from the interrupt.
+ */
+void smp_send_tlb_flush(uint32_t cpu);
+
+/**
+ * kernel_page_table_root() - Physical address of the kernel PML4.
+ *
+ * Application processors load it before enabling paging, so it must lie
+ * below 4 GiB; the kernel image is linked low, which guarantees that.
+ */
+uint64_t kernel_page_table_root(void);
+
+/**
+ * tlb_init_ap() - Match the boot CPU's TLB features on this CPU.
+ *
+ * Sets the CR4 global-page and PCID bits tlb_init() chose. Must run with
+ * PCID 0 loaded in CR3.
+ */
+void tlb_init_ap(void);
+
+/**
+ * tlb_flush_pending() - Complete a TLB shootdown aimed at this CPU.
+ *
+ * Called from the TLB flush IPI and from arch_cpu_relax(), so a CPU that
+ * spins with interrupts off still answers shootdowns. Must run with
+ * interrupts disabled.
+ */
+void tlb_flush_pending(void);
+
+#endif
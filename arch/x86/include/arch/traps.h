@@ -72,6 +72,22 @@ void trap_dispatch(struct trap_frame *frame);
  */
 void handle_irq(struct trap_frame *frame);
 
+/**
+ * handle_tick_wakeup() - Take the boot CPU's local timer interrupt.
+ *
+ * The boot CPU runs its local APIC timer only as the NO_HZ idle wakeup;
+ * an interrupt from a wakeup that was since cancelled is ignored.
+ */
+void handle_tick_wakeup(void);
+
+/**
+ * resolve_page_fault() - Silently back a demand-faulted kernel page.
+ * @frame: Trap frame for vector 14.
+ *
+ * Return: Non-zero if the faulting access may be retried.
+ */
+int resolve_page_fault(struct trap_frame *frame);
+
 /**
  * handle_page_fault() - Diagnose and handle an x86 page fault.
  * @frame: Trap frame for vector 14.
@@ -32,11 +32,43 @@ typedef uint64_t efi_physical_address_t;
 #define EFI_GRAPHICS_OUTPUT_PROTOCOL_GUID_A 0x9042a9de
 #define EFI_GRAPHICS_OUTPUT_PROTOCOL_GUID_B 0x23dc
 #define EFI_GRAPHICS_OUTPUT_PROTOCOL_GUID_C 0x4a38
+#define EFI_ACPI_20_TABLE_GUID_A 0x8868e871
+#define EFI_ACPI_20_TABLE_GUID_B 0xe4f1
+#define EFI_ACPI_20_TABLE_GUID_C 0x11d3
+#define EFI_ACPI_TABLE_GUID_A 0xeb9d2d30
+#define EFI_ACPI_TABLE_GUID_B 0x2d88
+#define EFI_ACPI_TABLE_GUID_C 0x11d3
 
 #if defined(__x86_64__)
 #define EFIAPI __attribute__((ms_abi))
 #else
 #define EFIAPI
+/**
+ * efi_acpi_20_table_guid() - Return the ACPI 2.0 RSDP configuration GUID.
+ */
+static inline efi_guid_t efi_acpi_20_table_guid(void)
+{
+	return (efi_guid_t){
+		.data1 = EFI_ACPI_20_TABLE_GUID_A,
+		.data2 = EFI_ACPI_20_TABLE_GUID_B,
+		.data3 = EFI_ACPI_20_TABLE_GUID_C,
+		.data4 = {0xbc, 0x22, 0x00, 0x80, 0xc7, 0x3c, 0x88, 0x81},
+	};
+}
+
+/**
+ * efi_acpi_table_guid() - Return the ACPI 1.0 RSDP configuration GUID.
+ */
+static inline efi_guid_t efi_acpi_table_guid(void)
+{
+	return (efi_guid_t){
+		.data1 = EFI_ACPI_TABLE_GUID_A,
+		.data2 = EFI_ACPI_TABLE_GUID_B,
+		.data3 = EFI_ACPI_TABLE_GUID_C,
+		.data4 = {0x9a, 0x16, 0x00, 0x90, 0x27, 0x3f, 0xc1, 0x4d},
+	};
+}
+
 #endif
 
 /**
@@ -257,6 +289,16 @@ struct efi_system_table {
 	void *configuration_table;
 };
 
+/**
+ * struct efi_configuration_table_t - One system table configuration entry.
+ * @vendor_guid: GUID naming the table.
+ * @vendor_table: Firmware pointer to the table.
+ */
+typedef struct {
+	efi_guid_t vendor_guid;
+	void *vendor_table;
+} efi_configuration_table_t;
+
 /**
  * efi_file_info_guid() - Return the EFI_FILE_INFO protocol GUID.
  */
@@ -309,4 +351,30 @@ static inline efi_guid_t efi_graphics_output_protocol_guid(void)
 	};
 }
 
+/**
+ * efi_acpi_20_table_guid() - Return the ACPI 2.0 RSDP configuration GUID.
+ */
+static inline efi_guid_t efi_acpi_20_table_guid(void)
+{
+	return (efi_guid_t){
+		.data1 = EFI_ACPI_20_TABLE_GUID_A,
+		.data2 = EFI_ACPI_20_TABLE_GUID_B,
+		.data3 = EFI_ACPI_20_TABLE_GUID_C,
+		.data4 = {0xbc, 0x22, 0x00, 0x80, 0xc7, 0x3c, 0x88, 0x81},
+	};
+}
+
+/**
+ * efi_acpi_table_guid() - Return the ACPI 1.0 RSDP configuration GUID.
+ */
+static inline efi_guid_t efi_acpi_table_guid(void)
+{
+	return (efi_guid_t){
+		.data1 = EFI_ACPI_TABLE_GUID_A,
+		.data2 = EFI_ACPI_TABLE_GUID_B,
+		.data3 = EFI_ACPI_TABLE_GUID_C,
+		.data4 = {0x9a, 0x16, 0x00, 0x90, 0x27, 0x3f, 0xc1, 0x4d},
+	};
+}
+
 #endif
@@ -0,0 +1,270 @@
+#include <stdint.h>
+
+#include <tianole/errno.h>
+#include <tianole/mm.h>
+
+#include "acpi.h"
+
+#define ACPI_RSDP_V1_LENGTH 20u
+#define ACPI_MADT_LOCAL_APIC 0u
+#define ACPI_MADT_LAPIC_ENABLED (1u << 0)
+
+/**
+ * struct acpi_rsdp - Root System Description Pointer.
+ * @signature: "RSD PTR ".
+ * @checksum: Makes the first 20 bytes sum to zero.
+ * @oem_id: Firmware vendor.
+ * @revision: 0 for ACPI 1.0, 2 or later when the XSDT fields exist.
+ * @rsdt_address: Physical address of the RSDT.
+ * @length: Length of the whole structure from revision 2.
+ * @xsdt_address: Physical address of the XSDT from revision 2.
+ * @extended_checksum: Makes @length bytes sum to zero.
+ * @reserved: Padding.
+ */
+struct acpi_rsdp {
+	char signature[8];
+	uint8_t checksum;
+	char oem_id[6];
+	uint8_t revision;
+	uint32_t rsdt_address;
+	uint32_t length;
+	uint64_t xsdt_address;
+	uint8_t extended_checksum;
+	uint8_t reserved[3];
+} __attribute__((packed));
+
+/**
+ * struct acpi_table_header - Header shared by every system description table.
+ * @signature: Four-character table name.
+ * @length: Length of the table including this header.
+ * @revision: Table revision.
+ * @checksum: Makes @length bytes sum to zero.
+ * @oem_id: Firmware vendor.
+ * @oem_table_id: Vendor table name.
+ * @oem_revision: Vendor table revision.
+ * @creator_id: Tool that built the table.
+ * @creator_revision: Version of that tool.
+ */
+struct acpi_table_header {
+	char signature[4];
+	uint32_t length;
+	uint8_t revision;
+	uint8_t checksum;
+	char oem_id[6];
+	char oem_table_id[8];
+	uint32_t oem_revision;
+	uint32_t creator_id;
+	uint32_t creator_revision;
+} __attribute__((packed));
+
+/**
+ * struct acpi_madt - Multiple APIC Description Table header.
+ * @header: Common table header with signature "APIC".
+ * @lapic_address: Physical local APIC address, superseded by the MSR.
+ * @flags: PC-AT compatibility flags.
+ *
+ * Variable-length interrupt controller entries follow.
+ */
+struct acpi_madt {
+	struct acpi_table_header header;
+	uint32_t lapic_address;
+	uint32_t flags;
+} __attribute__((packed));
+
+/**
+ * struct acpi_madt_lapic - MADT Processor Local APIC entry.
+ * @type: ACPI_MADT_LOCAL_APIC.
+ * @length: Entry length, 8.
+ * @processor_id: ACPI processor UID.
+ * @apic_id: Local APIC ID.
+ * @flags: ACPI_MADT_LAPIC_* bits.
+ */
+struct acpi_madt_lapic {
+	uint8_t type;
+	uint8_t length;
+	uint8_t processor_id;
+	uint8_t apic_id;
+	uint32_t flags;
+} __attribute__((packed));
+
+/**
+ * acpi_map() - Reach firmware table memory through the direct map.
+ * @phys: Physical address of the first byte.
+ * @length: Bytes that must be readable.
+ *
+ * ACPI reclaim and NVS memory are part of the direct map, but a corrupt
+ * pointer could aim at a hole, so both ends are checked.
+ *
+ * Return: Kernel pointer to @phys, or NULL if the range is not mapped.
+ */
+static const void *acpi_map(phys_addr_t phys, uint64_t length)
+{
+	phys_addr_t mapped;
+
+	if (length == 0 || phys >= physmap_limit ||
+		length > physmap_limit - phys) {
+		return 0;
+	}
+
+	if (virt_to_phys((virt_addr_t)(uintptr_t)phys_to_virt(phys),
+		    &mapped) != 0 ||
+		virt_to_phys((virt_addr_t)(uintptr_t)phys_to_virt(
+				     phys + length - 1),
+			&mapped) != 0) {
+		return 0;
+	}
+
+	return phys_to_virt(phys);
+}
+
+static int acpi_checksum_ok(const void *table, uint64_t length)
+{
+	const uint8_t *bytes = table;
+	uint8_t sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < length; i++) {
+		sum = (uint8_t)(sum + bytes[i]);
+	}
+
+	return sum == 0;
+}
+
+static int acpi_signature_equal(const char *signature, const char *name,
+	uint32_t length)
+{
+	uint32_t i;
+
+	for (i = 0; i < length; i++) {
+		if (signature[i] != name[i]) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * acpi_map_table() - Map and validate one system description table.
+ * @phys: Physical address of the table header.
+ *
+ * Return: Table with a valid checksum, or NULL.
+ */
+static const struct acpi_table_header *acpi_map_table(phys_addr_t phys)
+{
+	const struct acpi_table_header *header =
+		acpi_map(phys, sizeof(*header));
+
+	if (header == 0 || header->length < sizeof(*header)) {
+		return 0;
+	}
+
+	header = acpi_map(phys, header->length);
+	if (header == 0 || !acpi_checksum_ok(header, header->length)) {
+		return 0;
+	}
+
+	return header;
+}
+
+/**
+ * acpi_find_table() - Look a table up through the RSDP.
+ * @signature: Four-character table name.
+ *
+ * The XSDT is used when the RSDP is revision 2 or later; the RSDT holds
+ * 32-bit pointers and is the fallback for ACPI 1.0 firmware.
+ *
+ * Return: Validated table, or NULL if it cannot be found.
+ */
+static const struct acpi_table_header *acpi_find_table(const char *signature)
+{
+	phys_addr_t rsdp_phys = mm_boot_info()->acpi_rsdp;
+	const struct acpi_rsdp *rsdp;
+	const struct acpi_table_header *root;
+	uint32_t entry_size;
+	uint32_t count;
+	uint32_t i;
+
+	rsdp = acpi_map(rsdp_phys, ACPI_RSDP_V1_LENGTH);
+	if (rsdp == 0 ||
+		!acpi_signature_equal(rsdp->signature, "RSD PTR ", 8) ||
+		!acpi_checksum_ok(rsdp, ACPI_RSDP_V1_LENGTH)) {
+		return 0;
+	}
+
+	if (rsdp->revision >= 2) {
+		rsdp = acpi_map(rsdp_phys, sizeof(*rsdp));
+		if (rsdp == 0 || rsdp->length < sizeof(*rsdp) ||
+			acpi_map(rsdp_phys, rsdp->length) == 0 ||
+			!acpi_checksum_ok(rsdp, rsdp->length)) {
+			return 0;
+		}
+
+		root = acpi_map_table(rsdp->xsdt_address);
+		entry_size = sizeof(uint64_t);
+	} else {
+		root = acpi_map_table(rsdp->rsdt_address);
+		entry_size = sizeof(uint32_t);
+	}
+
+	if (root == 0) {
+		return 0;
+	}
+
+	count = (root->length - (uint32_t)sizeof(*root)) / entry_size;
+	for (i = 0; i < count; i++) {
+		const uint8_t *entry =
+			(const uint8_t *)(root + 1) + i * entry_size;
+		const struct acpi_table_header *table;
+		phys_addr_t phys;
+
+		if (entry_size == sizeof(uint64_t)) {
+			phys = *(const uint64_t *)(const void *)entry;
+		} else {
+			phys = *(const uint32_t *)(const void *)entry;
+		}
+
+		table = acpi_map_table(phys);
+		if (table != 0 &&
+			acpi_signature_equal(table->signature, signature, 4)) {
+			return table;
+		}
+	}
+
+	return 0;
+}
+
+int acpi_for_each_lapic(acpi_lapic_fn_t fn, void *data)
+{
+	const struct acpi_table_header *table;
+	const uint8_t *entry;
+	const uint8_t *end;
+	int count = 0;
+
+	if (mm_boot_info()->acpi_rsdp == 0) {
+		return -ENOENT;
+	}
+
+	table = acpi_find_table("APIC");
+	if (table == 0 || table->length < sizeof(struct acpi_madt)) {
+		return -ENOENT;
+	}
+
+	entry = (const uint8_t *)table + sizeof(struct acpi_madt);
+	end = (const uint8_t *)table + table->length;
+	while (end - entry >= 2 && entry[1] >= 2 && entry[1] <= end - entry) {
+		const struct acpi_madt_lapic *lapic =
+			(const struct acpi_madt_lapic *)(const void *)entry;
+
+		if (entry[0] == ACPI_MADT_LOCAL_APIC &&
+			entry[1] >= sizeof(*lapic) &&
+			(lapic->flags & ACPI_MADT_LAPIC_ENABLED) != 0) {
+			fn(lapic->apic_id, data);
+			count++;
+		}
+
+		entry += entry[1];
+	}
+
+	return count;
+}
@@ -0,0 +1,27 @@
+#ifndef X86_KERNEL_ACPI_H
+#define X86_KERNEL_ACPI_H
+
+#include <stdint.h>
+
+/**
+ * typedef acpi_lapic_fn_t - Callback for one processor listed in the MADT.
+ * @apic_id: Local APIC ID of the processor.
+ * @data: Context passed to acpi_for_each_lapic().
+ */
+typedef void (*acpi_lapic_fn_t)(uint32_t apic_id, void *data);
+
+/**
+ * acpi_for_each_lapic() - Visit every enabled processor in the MADT.
+ * @fn: Callback invoked once per processor, in table order.
+ * @data: Context passed to @fn.
+ *
+ * Tables are found through the RSDP the bootloader recorded and read
+ * through the direct map. Only xAPIC entries are visited; processors
+ * listed with x2APIC entries alone need x2APIC mode.
+ *
+ * Return: Number of processors visited, or -ENOENT if there is no RSDP,
+ * a table fails its checksum or the MADT is missing.
+ */
+int acpi_for_each_lapic(acpi_lapic_fn_t fn, void *data);
+
+#endif
@@ -0,0 +1,285 @@
+#include <stdint.h>
+
+#include <arch/cpuid.h>
+#include <arch/msr.h>
+#include <arch/smp.h>
+#include <arch/traps.h>
+
+#include <tianole/arch.h>
+#include <tianole/errno.h>
+#include <tianole/printk.h>
+#include <tianole/sched.h>
+#include <tianole/smp.h>
+#include <tianole/timer.h>
+
+#include "apic.h"
+#include "trap_vectors.h"
+
+#define LAPIC_ID 0x020u
+#define LAPIC_TPR 0x080u
+#define LAPIC_EOI 0x0b0u
+#define LAPIC_SVR 0x0f0u
+#define LAPIC_ICR_LOW 0x300u
+#define LAPIC_ICR_HIGH 0x310u
+#define LAPIC_LVT_TIMER 0x320u
+#define LAPIC_LVT_LINT0 0x350u
+#define LAPIC_LVT_LINT1 0x360u
+#define LAPIC_TIMER_INITIAL 0x380u
+#define LAPIC_TIMER_CURRENT 0x390u
+#define LAPIC_TIMER_DIVIDE 0x3e0u
+
+#define LAPIC_SVR_ENABLE (1u << 8)
+#define LAPIC_ICR_PENDING (1u << 12)
+#define LAPIC_ICR_INIT 0x00004500u
+#define LAPIC_ICR_STARTUP 0x00004600u
+#define LAPIC_LVT_NMI 0x00000400u
+#define LAPIC_LVT_EXTINT 0x00000700u
+#define LAPIC_LVT_MASKED (1u << 16)
+#define LAPIC_TIMER_PERIODIC (1u << 17)
+#define LAPIC_TIMER_DIVIDE_16 0x3u
+
+#define X86_CPUID_EDX_APIC (1u << 9)
+
+/* Ticks the APIC timer is measured over, and a bound on waiting for each. */
+#define LAPIC_CALIBRATE_TICKS 5u
+#define LAPIC_CALIBRATE_SPINS 100000000u
+
+static volatile uint8_t *lapic_regs;
+static uint32_t lapic_timer_period;
+static uint64_t cycles_per_tick;
+static uint64_t cycles_per_us;
+
+static uint32_t lapic_read(uint32_t reg)
+{
+	return *(volatile uint32_t *)(lapic_regs + reg);
+}
+
+static void lapic_write(uint32_t reg, uint32_t value)
+{
+	*(volatile uint32_t *)(lapic_regs + reg) = value;
+}
+
+static void lapic_eoi(void)
+{
+	lapic_write(LAPIC_EOI, 0);
+}
+
+int lapic_init(void)
+{
+	struct cpuid_regs regs;
+	uint64_t base;
+
+	cpuid(X86_CPUID_FEATURES, 0, &regs);
+	if ((regs.edx & X86_CPUID_EDX_APIC) == 0) {
+		return -ENODEV;
+	}
+
+	/* x2APIC mode disables the MMIO window; leaving it needs a reset. */
+	base = rdmsr(X86_MSR_APIC_BASE);
+	if ((base & X86_APIC_BASE_X2APIC) != 0) {
+		return -ENODEV;
+	}
+
+	if ((base & X86_APIC_BASE_ENABLE) == 0) {
+		base |= X86_APIC_BASE_ENABLE;
+		wrmsr(X86_MSR_APIC_BASE, base);
+	}
+
+	lapic_regs = (volatile uint8_t *)(uintptr_t)(base & X86_APIC_BASE_MASK);
+	lapic_write(LAPIC_TPR, 0);
+	lapic_write(LAPIC_LVT_TIMER,
+		LAPIC_LVT_MASKED | X86_LOCAL_TIMER_VECTOR);
+	lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | X86_SPURIOUS_APIC_VECTOR);
+
+	/*
+	 * Virtual wire mode: the 8259 PIC reaches the boot CPU through LINT0,
+	 * and enabling a disabled APIC left that line masked.
+	 */
+	if ((base & X86_APIC_BASE_BSP) != 0) {
+		lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_EXTINT);
+	} else {
+		lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+	}
+
+	lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_NMI);
+	return 0;
+}
+
+uint32_t lapic_id(void)
+{
+	return lapic_read(LAPIC_ID) >> 24;
+}
+
+/**
+ * lapic_send_icr() - Write one command to the interrupt command register.
+ * @apic_id: Local APIC ID of the target.
+ * @command: Low ICR word with delivery mode and vector.
+ *
+ * Interrupts stay off between the two register writes, so an IPI sent
+ * from an interrupt handler cannot retarget this one.
+ */
+static void lapic_send_icr(uint32_t apic_id, uint32_t command)
+{
+	uint64_t flags = arch_irq_save();
+
+	while ((lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING) != 0) {
+		arch_cpu_relax();
+	}
+
+	lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+	lapic_write(LAPIC_ICR_LOW, command);
+	arch_irq_restore(flags);
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector)
+{
+	lapic_send_icr(apic_id, vector);
+}
+
+void lapic_send_init(uint32_t apic_id)
+{
+	lapic_send_icr(apic_id, LAPIC_ICR_INIT);
+}
+
+void lapic_send_startup(uint32_t apic_id, uint32_t page)
+{
+	lapic_send_icr(apic_id, LAPIC_ICR_STARTUP | (page & 0xffu));
+}
+
+/**
+ * wait_for_tick() - Spin until timer_ticks() moves past a value.
+ * @tick: Last tick seen.
+ *
+ * Return: 0 once the tick advanced, or -EIO if it never did.
+ */
+static int wait_for_tick(uint64_t tick)
+{
+	uint32_t spins;
+
+	for (spins = 0; spins < LAPIC_CALIBRATE_SPINS; spins++) {
+		if (timer_ticks() != tick) {
+			return 0;
+		}
+
+		arch_cpu_relax();
+	}
+
+	return -EIO;
+}
+
+int lapic_timer_calibrate(void)
+{
+	uint64_t tick;
+	uint64_t cycles;
+	uint32_t index;
+	uint32_t counted;
+
+	/* Start on a tick edge so the span is whole ticks. */
+	if (wait_for_tick(timer_ticks()) != 0) {
+		return -EIO;
+	}
+
+	lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+	lapic_write(LAPIC_LVT_TIMER,
+		LAPIC_LVT_MASKED | X86_LOCAL_TIMER_VECTOR);
+	lapic_write(LAPIC_TIMER_INITIAL, 0xffffffffu);
+	cycles = arch_read_cycle_counter();
+
+	for (index = 0; index < LAPIC_CALIBRATE_TICKS; index++) {
+		tick = timer_ticks();
+		if (wait_for_tick(tick) != 0) {
+			lapic_write(LAPIC_TIMER_INITIAL, 0);
+			return -EIO;
+		}
+	}
+
+	counted = 0xffffffffu - lapic_read(LAPIC_TIMER_CURRENT);
+	cycles = arch_read_cycle_counter() - cycles;
+	lapic_write(LAPIC_TIMER_INITIAL, 0);
+
+	cycles_per_tick = cycles / LAPIC_CALIBRATE_TICKS;
+	cycles_per_us = cycles * X86_TICK_HZ /
+		(LAPIC_CALIBRATE_TICKS * 1000000ull);
+	if (counted / LAPIC_CALIBRATE_TICKS == 0 || cycles_per_tick == 0) {
+		return -EIO;
+	}
+
+	lapic_timer_period = counted / LAPIC_CALIBRATE_TICKS;
+
+	if (cycles_per_us == 0) {
+		cycles_per_us = 1;
+	}
+
+	pr_info("lapic: timer %u counts per tick\n", lapic_timer_period);
+	return 0;
+}
+
+void lapic_timer_start(void)
+{
+	lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+	lapic_write(LAPIC_LVT_TIMER,
+		LAPIC_TIMER_PERIODIC | X86_LOCAL_TIMER_VECTOR);
+	lapic_write(LAPIC_TIMER_INITIAL, lapic_timer_period);
+}
+
+void lapic_timer_oneshot(uint32_t count)
+{
+	lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+	lapic_write(LAPIC_LVT_TIMER, X86_LOCAL_TIMER_VECTOR);
+	lapic_write(LAPIC_TIMER_INITIAL, count);
+}
+
+void lapic_timer_stop(void)
+{
+	lapic_write(LAPIC_TIMER_INITIAL, 0);
+}
+
+uint32_t lapic_timer_tick_counts(void)
+{
+	return lapic_timer_period;
+}
+
+uint64_t lapic_tick_cycles(void)
+{
+	return cycles_per_tick;
+}
+
+void lapic_delay_us(uint32_t us)
+{
+	uint64_t start = arch_read_cycle_counter();
+	uint64_t cycles = (uint64_t)us * cycles_per_us;
+
+	while (arch_read_cycle_counter() - start < cycles) {
+		arch_cpu_relax();
+	}
+}
+
+void handle_apic_interrupt(struct trap_frame *frame)
+{
+	switch (frame->vector) {
+	case X86_LOCAL_TIMER_VECTOR:
+		lapic_eoi();
+		if (smp_processor_id() == 0) {
+			handle_tick_wakeup();
+		} else {
+			sched_cpu_tick();
+		}
+		return;
+	case X86_TLB_FLUSH_VECTOR:
+		tlb_flush_pending();
+		lapic_eoi();
+		return;
+	case X86_RESCHEDULE_VECTOR:
+		/* The need-resched flag is acted on at IRQ exit. */
+		lapic_eoi();
+		return;
+	case X86_SPURIOUS_APIC_VECTOR:
+		/* Spurious interrupts are not in service and take no EOI. */
+		return;
+	default:
+		pr_err("unexpected apic vector=%llu\n",
+			(unsigned long long)frame->vector);
+		lapic_eoi();
+		return;
+	}
+}
@@ -0,0 +1,117 @@
+#ifndef X86_KERNEL_APIC_H
+#define X86_KERNEL_APIC_H
+
+#include <stdint.h>
+
+#include <arch/traps.h>
+
+/**
+ * X86_TICK_HZ - Rate of the PIT tick and of every local APIC timer.
+ */
+#define X86_TICK_HZ 100u
+
+/**
+ * lapic_init() - Enable the running CPU's local APIC in xAPIC mode.
+ *
+ * Masks the local timer and installs the spurious vector. Uses the
+ * firmware identity mapping of the APIC registers.
+ *
+ * Return: 0 on success, or -ENODEV if the CPU has no local APIC or
+ * firmware left it in x2APIC mode.
+ */
+int lapic_init(void);
+
+/**
+ * lapic_id() - Read the running CPU's local APIC ID.
+ *
+ * Return: xAPIC ID of the running CPU.
+ */
+uint32_t lapic_id(void);
+
+/**
+ * lapic_send_ipi() - Send a fixed interrupt to another CPU.
+ * @apic_id: Local APIC ID of the target.
+ * @vector: Vector raised on the target.
+ */
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector);
+
+/**
+ * lapic_send_init() - Send an INIT IPI, resetting the target CPU.
+ * @apic_id: Local APIC ID of the target.
+ */
+void lapic_send_init(uint32_t apic_id);
+
+/**
+ * lapic_send_startup() - Send a STARTUP IPI.
+ * @apic_id: Local APIC ID of the target.
+ * @page: Physical page number below 1 MiB where the target starts in real
+ *        mode.
+ */
+void lapic_send_startup(uint32_t apic_id, uint32_t page);
+
+/**
+ * lapic_timer_calibrate() - Measure the local APIC timer against the tick.
+ *
+ * Called once by arch_timer_init() on the boot CPU, with the periodic
+ * tick running and interrupts enabled. Also measures the cycle counter
+ * for lapic_delay_us() and the NO_HZ idle path.
+ *
+ * Return: 0 on success, or -EIO if the tick or the APIC timer did not
+ * advance.
+ */
+int lapic_timer_calibrate(void);
+
+/**
+ * lapic_timer_start() - Start the running CPU's periodic local timer.
+ *
+ * Fires at X86_TICK_HZ once lapic_timer_calibrate() has run. Application
+ * processors run it only while they have work; see arch_cpu_tick_start().
+ */
+void lapic_timer_start(void);
+
+/**
+ * lapic_timer_oneshot() - Raise one local timer interrupt after a delay.
+ * @count: Local timer counts at divide 16, non-zero.
+ *
+ * Replaces whatever the running CPU's local timer was doing.
+ */
+void lapic_timer_oneshot(uint32_t count);
+
+/**
+ * lapic_timer_stop() - Stop the running CPU's local timer.
+ *
+ * An interrupt the timer already raised may still be delivered.
+ */
+void lapic_timer_stop(void);
+
+/**
+ * lapic_timer_tick_counts() - Local timer counts in one tick.
+ *
+ * Return: Counts at divide 16, or 0 before lapic_timer_calibrate() has
+ * succeeded.
+ */
+uint32_t lapic_timer_tick_counts(void);
+
+/**
+ * lapic_tick_cycles() - Cycle counter increments in one tick.
+ *
+ * Measured by lapic_timer_calibrate() alongside the local timer; the cycle
+ * counter is assumed to run at a constant rate.
+ *
+ * Return: Cycles per tick, or 0 before calibration.
+ */
+uint64_t lapic_tick_cycles(void);
+
+/**
+ * lapic_delay_us() - Busy-wait for at least a number of microseconds.
+ * @us: Microseconds to wait.
+ */
+void lapic_delay_us(uint32_t us);
+
+/**
+ * handle_apic_interrupt() - Dispatch a local APIC system vector.
+ * @frame: Trap frame whose vector is a system vector.
+ */
+void handle_apic_interrupt(struct trap_frame *frame);
+
+#endif
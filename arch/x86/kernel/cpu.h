@@ -44,11 +44,23 @@
  */
 void gdt_init(void);
 
+/**
+ * gdt_init_ap() - Install an application processor's GDT and TSS.
+ * @cpu: Logical number of the running CPU.
+ * @stack_top: Top of the stack the CPU is running on, used as TSS RSP0.
+ */
+void gdt_init_ap(uint32_t cpu, uintptr_t stack_top);
+
 /**
  * idt_init() - Install exception and IRQ gates into the x86 IDT.
  */
 void idt_init(void);
 
+/**
+ * idt_load_ap() - Load the IDT built by idt_init() on the running CPU.
+ */
+void idt_load_ap(void);
+
 /**
  * idt_set_gate() - Install one interrupt gate in the x86 IDT.
  * @vector: IDT vector number.
@@ -71,10 +83,14 @@ void idt_set_gate(uint8_t vector,
 	void entry(void);
 #define DECLARE_IRQ_STUB(vector, entry, irq, gate_type, dpl, ist)              \
 	void entry(void);
+#define DECLARE_SYSTEM_STUB(vector, entry, gate_type, dpl, ist)                \
+	void entry(void);
 
 X86_EXCEPTION_VECTORS(DECLARE_EXCEPTION_STUB)
 X86_IRQ_VECTORS(DECLARE_IRQ_STUB)
+X86_SYSTEM_VECTORS(DECLARE_SYSTEM_STUB)
 
+#undef DECLARE_SYSTEM_STUB
 #undef DECLARE_IRQ_STUB
 #undef DECLARE_EXCEPTION_STUB
 
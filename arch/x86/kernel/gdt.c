@@ -1,5 +1,7 @@
 #include <stdint.h>
 
+#include <tianole/smp.h>
+
 #include "cpu.h"
 
 #define GDT_PRESENT 0x80
@@ -70,9 +72,13 @@ struct gdt_table {
 
 extern char kernel_stack_top[];
 
-static struct tss_entry tss;
-static struct gdt_table gdt;
-static uint8_t double_fault_stack[DOUBLE_FAULT_STACK_SIZE]
+/*
+ * Every CPU needs its own TSS, and a busy TSS descriptor cannot be loaded
+ * twice, so each CPU also gets its own GDT.
+ */
+static struct tss_entry tss[NR_CPUS];
+static struct gdt_table gdt[NR_CPUS];
+static uint8_t double_fault_stack[NR_CPUS][DOUBLE_FAULT_STACK_SIZE]
 	__attribute__((aligned(16)));
 
 static struct gdt_entry make_gdt_entry(uint8_t access, uint8_t flags)
@@ -136,32 +142,54 @@ static void load_tss(void)
 }
 
 /**
- * gdt_init() - Build and install the early x86 GDT/TSS.
- *
- * The boot CPU starts with firmware-provided descriptor tables. This replaces
- * them with Tianole-owned ring-0 code/data descriptors and a TSS whose RSP0
- * points at the boot kernel stack until per-thread or per-CPU stacks exist.
+ * gdt_setup() - Build and install one CPU's GDT/TSS.
+ * @cpu: Logical CPU number indexing the per-CPU tables.
+ * @stack_top: Initial TSS RSP0, the stack the CPU is running on.
  */
-void gdt_init(void)
+static void gdt_setup(uint32_t cpu, uintptr_t stack_top)
 {
+	struct gdt_table *table = &gdt[cpu];
+	struct tss_entry *task = &tss[cpu];
 	struct gdtr gdtr = {
-		.limit = sizeof(gdt) - 1,
-		.base = (uint64_t)(uintptr_t)&gdt,
+		.limit = sizeof(*table) - 1,
+		.base = (uint64_t)(uintptr_t)table,
 	};
 
-	tss.rsp0 = (uint64_t)(uintptr_t)kernel_stack_top;
-	tss.ist[X86_IST_DOUBLE_FAULT - 1] =
-		(uint64_t)(uintptr_t)(double_fault_stack +
+	task->rsp0 = (uint64_t)stack_top;
+	task->ist[X86_IST_DOUBLE_FAULT - 1] =
+		(uint64_t)(uintptr_t)(double_fault_stack[cpu] +
 			DOUBLE_FAULT_STACK_SIZE);
-	tss.io_map_base = sizeof(tss);
+	task->io_map_base = sizeof(*task);
 
-	gdt.null = (struct gdt_entry){0};
-	gdt.kernel_code =
+	table->null = (struct gdt_entry){0};
+	table->kernel_code =
 		make_gdt_entry(GDT_CODE, GDT_LONG_MODE | GDT_GRANULARITY_4K);
-	gdt.kernel_data = make_gdt_entry(GDT_DATA, GDT_GRANULARITY_4K);
-	gdt.tss =
-		make_tss_descriptor((uint64_t)(uintptr_t)&tss, sizeof(tss) - 1);
+	table->kernel_data = make_gdt_entry(GDT_DATA, GDT_GRANULARITY_4K);
+	table->tss = make_tss_descriptor((uint64_t)(uintptr_t)task,
+		sizeof(*task) - 1);
 
 	load_gdt(&gdtr);
 	load_tss();
 }
+
+/**
+ * gdt_init() - Build and install the early x86 GDT/TSS.
+ *
+ * The boot CPU starts with firmware-provided descriptor tables. This replaces
+ * them with Tianole-owned ring-0 code/data descriptors and a TSS whose RSP0
+ * points at the boot kernel stack until per-thread or per-CPU stacks exist.
+ */
+void gdt_init(void)
+{
+	gdt_setup(0, (uintptr_t)kernel_stack_top);
+}
+
+/**
+ * gdt_init_ap() - Install an application processor's GDT/TSS.
+ * @cpu: Logical number of the running CPU.
+ * @stack_top: Top of the boot stack the CPU is running on.
+ */
+void gdt_init_ap(uint32_t cpu, uintptr_t stack_top)
+{
+	gdt_setup(cpu, stack_top);
+}
@@ -26,6 +26,10 @@ struct idtr {
 } __attribute__((packed));
 
 static struct idt_entry idt[256];
+static const struct idtr idt_pointer = {
+	.limit = sizeof(idt) - 1,
+	.base = (uint64_t)(uintptr_t)idt,
+};
 
 /**
  * load_idt() - Load the CPU interrupt descriptor table register.
@@ -72,22 +76,32 @@ void idt_set_gate(uint8_t vector,
  */
 void idt_init(void)
 {
-	struct idtr idtr = {
-		.limit = sizeof(idt) - 1,
-		.base = (uint64_t)(uintptr_t)idt,
-	};
-
 #define INSTALL_EXCEPTION_GATE(                                                \
 	vector, entry, has_error, gate_type, dpl, ist, name, handler)          \
 	idt_set_gate(vector, entry, gate_type, dpl, ist);
 #define INSTALL_IRQ_GATE(vector, entry, irq, gate_type, dpl, ist)              \
 	idt_set_gate(vector, entry, gate_type, dpl, ist);
+#define INSTALL_SYSTEM_GATE(vector, entry, gate_type, dpl, ist)                \
+	idt_set_gate(vector, entry, gate_type, dpl, ist);
 
 	X86_EXCEPTION_VECTORS(INSTALL_EXCEPTION_GATE)
 	X86_IRQ_VECTORS(INSTALL_IRQ_GATE)
+	X86_SYSTEM_VECTORS(INSTALL_SYSTEM_GATE)
 
+#undef INSTALL_SYSTEM_GATE
 #undef INSTALL_IRQ_GATE
 #undef INSTALL_EXCEPTION_GATE
 
-	load_idt(&idtr);
+	load_idt(&idt_pointer);
+}
+
+/**
+ * idt_load_ap() - Load the shared IDT on an application processor.
+ *
+ * The gates are identical on every CPU, so the table idt_init() built on
+ * the boot CPU is reused as is.
+ */
+void idt_load_ap(void)
+{
+	load_idt(&idt_pointer);
 }
@@ -1,6 +1,7 @@
 #include <stdint.h>
 
 #include <arch/io.h>
+#include <arch/smp.h>
 #include <arch/traps.h>
 
 #include <tianole/arch.h>
@@ -8,8 +9,10 @@
 #include <tianole/irq.h>
 #include <tianole/panic.h>
 #include <tianole/printk.h>
+#include <tianole/spinlock.h>
 #include <tianole/timer.h>
 
+#include "apic.h"
 #include "trap_vectors.h"
 
 #define PIC1_COMMAND 0x20
@@ -22,11 +25,24 @@
 #define ICW1_ICW4 0x01
 #define ICW4_8086 0x01
 
+#define PIC_READ_IRR 0x0a
+
 #define PIT_FREQUENCY 1193182u
-#define PIT_TARGET_HZ 100u
+#define PIT_DIVISOR (PIT_FREQUENCY / X86_TICK_HZ)
 #define PIT_COMMAND 0x43
 #define PIT_CHANNEL0 0x40
-#define PIT_MODE_RATE_GENERATOR 0x36
+#define PIT_MODE_ONESHOT 0x30
+#define PIT_MODE_RATE_GENERATOR 0x34
+#define PIT_READ_BACK_CHANNEL0 0xc2
+#define PIT_STATUS_OUT 0x80
+#define PIT_STATUS_NULL_COUNT 0x40
+#define PIT_MAX_COUNT 0xffffu
+
+/*
+ * PIT clocks between latching the counter and a new count taking effect,
+ * at roughly one clock per port access.
+ */
+#define PIT_LOAD_DELAY 6u
 
 #define IRQ_TIMER 0u
 #define IRQ_KEYBOARD 1u
@@ -45,6 +61,57 @@ struct irq_action {
 };
 
 static struct irq_action irq_actions[X86_LEGACY_IRQ_VECTOR_COUNT];
+static struct spinlock irq_actions_lock = SPINLOCK_INITIALIZER;
+
+/**
+ * struct pit_oneshot - Channel 0 state while the periodic tick is stopped.
+ * @armed: Channel 0 runs in one-shot mode.
+ * @drop_irq: Ignore the next IRQ0; a cancelled one-shot already raised it.
+ * @phase: PIT counts between the last counted tick and the count loading.
+ * @count: PIT counts programmed.
+ * @reported: Whole ticks since the last counted tick already reported.
+ * @lag: PIT counts the tick grid has slipped behind real time.
+ *
+ * Every one-shot is programmed to fire exactly on a tick boundary of the
+ * periodic grid. Restarting the periodic tick starts a new grid from the
+ * moment of the restart, which puts the tick count behind by the phase
+ * the old grid had reached; @lag collects that and a tick is added once it
+ * adds up to a whole one, so timer_ticks() does not drift. Only touched
+ * with interrupts disabled.
+ */
+struct pit_oneshot {
+	int armed;
+	int drop_irq;
+	uint32_t phase;
+	uint32_t count;
+	uint64_t reported;
+	uint32_t lag;
+};
+
+static struct pit_oneshot pit_oneshot;
+
+/**
+ * struct lapic_nohz - Boot CPU state while its local timer replaces the tick.
+ * @active: IRQ0 is masked and time is kept by the cycle counter.
+ * @armed: A local timer wakeup is programmed and has not been taken.
+ * @start: Cycle counter value at the last counted tick.
+ * @reported: Whole ticks since @start already reported.
+ *
+ * Used instead of PIT one-shots once the local timer is calibrated. Its
+ * 32-bit count reaches more than a minute ahead where the PIT stops at
+ * 55 ms, and with no timer pending nothing is armed at all, so an idle
+ * machine is woken only by real work. The PIT keeps counting behind the
+ * mask and is reloaded on restart, with the old grid's phase added to
+ * pit_oneshot.lag. Only touched with interrupts disabled.
+ */
+struct lapic_nohz {
+	int active;
+	int armed;
+	uint64_t start;
+	uint64_t reported;
+};
+
+static struct lapic_nohz lapic_nohz;
 
 /**
  * pic_remap() - Move legacy PIC IRQs away from CPU exception vectors.
@@ -88,6 +155,24 @@ static void pic_mask_initial_irqs(void)
 	outb(PIC2_DATA, 0xff);
 }
 
+/**
+ * pic_mask_irq() - Mask or unmask one line on the master PIC.
+ * @irq: IRQ number on the master PIC.
+ * @masked: Non-zero to mask the line.
+ */
+static void pic_mask_irq(uint8_t irq, int masked)
+{
+	uint8_t mask = inb(PIC1_DATA);
+
+	if (masked) {
+		mask |= (uint8_t)(1u << irq);
+	} else {
+		mask &= (uint8_t)~(1u << irq);
+	}
+
+	outb(PIC1_DATA, mask);
+}
+
 /**
  * pic_send_eoi() - Acknowledge a handled legacy PIC interrupt.
  * @irq: IRQ number in the remapped 0-15 PIC range.
@@ -104,19 +189,299 @@ static void pic_send_eoi(uint8_t irq)
 	outb(PIC1_COMMAND, PIC_EOI);
 }
 
+/**
+ * pic_irq_pending() - Check whether an IRQ line is waiting for delivery.
+ * @irq: IRQ number on the master PIC.
+ *
+ * Return: Non-zero if @irq is raised but not yet delivered.
+ */
+static int pic_irq_pending(uint8_t irq)
+{
+	outb(PIC1_COMMAND, PIC_READ_IRR);
+	return (inb(PIC1_COMMAND) & (1u << irq)) != 0;
+}
+
+/**
+ * pit_load() - Program PIT channel 0 with a mode and an initial count.
+ * @mode: PIT_MODE_RATE_GENERATOR or PIT_MODE_ONESHOT.
+ * @count: Initial count in PIT input clocks.
+ */
+static void pit_load(uint8_t mode, uint32_t count)
+{
+	outb(PIT_COMMAND, mode);
+	outb(PIT_CHANNEL0, (uint8_t)(count & 0xff));
+	outb(PIT_CHANNEL0, (uint8_t)(count >> 8));
+}
+
+/**
+ * pit_read_back() - Latch and read channel 0 status and count together.
+ * @count: Current counter value.
+ *
+ * Return: Channel 0 status byte.
+ */
+static uint8_t pit_read_back(uint16_t *count)
+{
+	uint8_t status;
+	uint8_t low;
+
+	outb(PIT_COMMAND, PIT_READ_BACK_CHANNEL0);
+	status = inb(PIT_CHANNEL0);
+	low = inb(PIT_CHANNEL0);
+	*count = (uint16_t)(low | ((uint16_t)inb(PIT_CHANNEL0) << 8));
+	return status;
+}
+
+/**
+ * pit_oneshot_elapsed() - PIT counts since the last counted tick.
+ *
+ * In one-shot mode the counter keeps decrementing past zero and wraps, so
+ * the time since expiry stays readable for another 55 ms.
+ *
+ * Return: Counts since the tick that preceded arming.
+ */
+static uint32_t pit_oneshot_elapsed(void)
+{
+	uint16_t count;
+	uint8_t status = pit_read_back(&count);
+
+	if ((status & PIT_STATUS_NULL_COUNT) != 0) {
+		return pit_oneshot.phase;
+	}
+
+	if ((status & PIT_STATUS_OUT) != 0) {
+		return pit_oneshot.phase + pit_oneshot.count +
+			(uint16_t)(0u - count);
+	}
+
+	return pit_oneshot.phase + pit_oneshot.count - count;
+}
+
 /**
  * pit_init() - Program PIT channel 0 as the initial periodic timer.
  *
  * PIT is only the first x86 timer backend. The generic scheduler sees ticks
- * through `timer_tick()` and should not depend on PIT details.
+ * through `timer_tick()` and should not depend on PIT details. Mode 2 is
+ * used because its counter reads back as the phase within the tick, which
+ * the idle one-shot path needs.
  */
 static void pit_init(void)
 {
-	uint16_t divisor = (uint16_t)(PIT_FREQUENCY / PIT_TARGET_HZ);
+	pit_load(PIT_MODE_RATE_GENERATOR, PIT_DIVISOR);
+}
 
-	outb(PIT_COMMAND, PIT_MODE_RATE_GENERATOR);
-	outb(PIT_CHANNEL0, (uint8_t)(divisor & 0xff));
-	outb(PIT_CHANNEL0, (uint8_t)(divisor >> 8));
+/**
+ * pit_restart_lag() - Account for the phase lost by restarting the grid.
+ * @phase: PIT counts the old grid had run past its last whole tick.
+ *
+ * Return: 1 if the lag adds up to a whole tick that must be counted,
+ * otherwise 0.
+ */
+static uint64_t pit_restart_lag(uint32_t phase)
+{
+	pit_oneshot.lag += phase + PIT_LOAD_DELAY;
+	if (pit_oneshot.lag >= PIT_DIVISOR) {
+		pit_oneshot.lag -= PIT_DIVISOR;
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * lapic_nohz_stop() - Stop the tick using the boot CPU's local timer.
+ * @ticks: Ticks from the last counted tick to the deadline, or UINT64_MAX.
+ *
+ * Also re-arms from a wakeup, in which case the tick it reported becomes
+ * the last counted one.
+ *
+ * Return: Ticks programmed, UINT64_MAX if nothing was armed, or 0.
+ */
+static uint64_t lapic_nohz_stop(uint64_t ticks)
+{
+	uint64_t tick_cycles = lapic_tick_cycles();
+	uint64_t max_ticks = 0xffffffffu / lapic_timer_tick_counts();
+	uint64_t target;
+	uint64_t now;
+	uint64_t wakeup = 1;
+
+	if (lapic_nohz.active) {
+		lapic_nohz.start += lapic_nohz.reported * tick_cycles;
+	} else {
+		uint16_t count;
+
+		/* Masked first: a tick raised after the check would be lost. */
+		pic_mask_irq(IRQ_TIMER, 1);
+		if (pic_irq_pending(IRQ_TIMER)) {
+			pic_mask_irq(IRQ_TIMER, 0);
+			return 0;
+		}
+
+		pit_read_back(&count);
+		lapic_nohz.start = arch_read_cycle_counter() -
+			(uint64_t)(PIT_DIVISOR - count) * tick_cycles /
+				PIT_DIVISOR;
+		lapic_nohz.active = 1;
+	}
+
+	lapic_nohz.reported = 0;
+	if (ticks == UINT64_MAX) {
+		lapic_timer_stop();
+		lapic_nohz.armed = 0;
+		return ticks;
+	}
+
+	if (ticks > max_ticks) {
+		ticks = max_ticks;
+	}
+
+	target = lapic_nohz.start + ticks * tick_cycles;
+	now = arch_read_cycle_counter();
+	if (target > now) {
+		/* Rounded up so the wakeup does not land before the tick. */
+		wakeup = ((target - now) * lapic_timer_tick_counts() +
+				 tick_cycles - 1) /
+			tick_cycles;
+		if (wakeup > 0xffffffffu) {
+			wakeup = 0xffffffffu;
+		}
+	}
+
+	lapic_nohz.armed = 1;
+	lapic_timer_oneshot((uint32_t)wakeup);
+	return ticks;
+}
+
+static uint64_t lapic_nohz_stopped_ticks(void)
+{
+	uint64_t ticks = (arch_read_cycle_counter() - lapic_nohz.start) /
+		lapic_tick_cycles();
+
+	if (ticks > lapic_nohz.reported) {
+		lapic_nohz.reported = ticks;
+	}
+
+	return lapic_nohz.reported;
+}
+
+static uint64_t lapic_nohz_start(void)
+{
+	uint64_t tick_cycles = lapic_tick_cycles();
+	uint64_t elapsed = arch_read_cycle_counter() - lapic_nohz.start;
+	uint64_t ticks;
+
+	lapic_timer_stop();
+	pit_init();
+	lapic_nohz.armed = 0;
+	lapic_nohz.active = 0;
+
+	ticks = elapsed / tick_cycles;
+	if (ticks < lapic_nohz.reported) {
+		ticks = lapic_nohz.reported;
+	}
+
+	ticks += pit_restart_lag((uint32_t)((elapsed % tick_cycles) *
+		PIT_DIVISOR / tick_cycles));
+
+	/* IRQ0 kept latching behind the mask; that request is stale. */
+	pit_oneshot.drop_irq = pic_irq_pending(IRQ_TIMER);
+	pic_mask_irq(IRQ_TIMER, 0);
+	return ticks;
+}
+
+uint64_t arch_timer_stop_tick(uint64_t ticks)
+{
+	uint32_t phase;
+	uint64_t max_ticks;
+
+	if (lapic_timer_tick_counts() != 0) {
+		return lapic_nohz_stop(ticks);
+	}
+
+	if (pit_oneshot.armed) {
+		phase = pit_oneshot_elapsed() -
+			(uint32_t)pit_oneshot.reported * PIT_DIVISOR;
+	} else {
+		uint16_t count;
+
+		/* A tick that is raised but not yet counted would be lost. */
+		if (pic_irq_pending(IRQ_TIMER)) {
+			return 0;
+		}
+
+		pit_read_back(&count);
+		phase = PIT_DIVISOR - count;
+	}
+
+	/* The phase the grid will have reached once the new count loads. */
+	phase += PIT_LOAD_DELAY;
+	if (phase >= PIT_DIVISOR) {
+		return 0;
+	}
+
+	max_ticks = (PIT_MAX_COUNT + phase) / PIT_DIVISOR;
+	if (ticks > max_ticks) {
+		ticks = max_ticks;
+	}
+
+	if (ticks < 2) {
+		return 0;
+	}
+
+	pit_oneshot.armed = 1;
+	pit_oneshot.phase = phase;
+	pit_oneshot.count = (uint32_t)ticks * PIT_DIVISOR - phase;
+	pit_oneshot.reported = 0;
+	pit_load(PIT_MODE_ONESHOT, pit_oneshot.count);
+	return ticks;
+}
+
+uint64_t arch_timer_stopped_ticks(void)
+{
+	uint64_t ticks;
+
+	if (lapic_nohz.active) {
+		return lapic_nohz_stopped_ticks();
+	}
+
+	if (!pit_oneshot.armed) {
+		return 0;
+	}
+
+	ticks = pit_oneshot_elapsed() / PIT_DIVISOR;
+	if (ticks > pit_oneshot.reported) {
+		pit_oneshot.reported = ticks;
+	}
+
+	return pit_oneshot.reported;
+}
+
+uint64_t arch_timer_start_tick(void)
+{
+	uint32_t elapsed;
+	uint64_t ticks;
+
+	if (lapic_nohz.active) {
+		return lapic_nohz_start();
+	}
+
+	if (!pit_oneshot.armed) {
+		return 0;
+	}
+
+	elapsed = pit_oneshot_elapsed();
+	pit_init();
+	pit_oneshot.armed = 0;
+
+	ticks = elapsed / PIT_DIVISOR;
+	if (ticks < pit_oneshot.reported) {
+		ticks = pit_oneshot.reported;
+	}
+
+	ticks += pit_restart_lag(elapsed % PIT_DIVISOR);
+
+	/* The one-shot fired before it was replaced; its IRQ0 is still due. */
+	pit_oneshot.drop_irq = pic_irq_pending(IRQ_TIMER);
+	return ticks;
 }
 
 /**
@@ -143,6 +508,30 @@ void arch_irq_restore(uint64_t flags)
 	}
 }
 
+/**
+ * arch_irq_enable() - Set RFLAGS.IF on the current CPU.
+ */
+void arch_irq_enable(void)
+{
+	__asm__ volatile("sti" : : : "memory");
+}
+
+/**
+ * arch_cpu_relax() - Spin-wait hint that also answers TLB shootdowns.
+ *
+ * A CPU spinning with interrupts off cannot take the flush IPI, and the
+ * CPU waiting for that flush may be the one holding the lock being spun
+ * on, so pending flushes are polled here as well.
+ */
+void arch_cpu_relax(void)
+{
+	uint64_t flags = arch_irq_save();
+
+	tlb_flush_pending();
+	arch_irq_restore(flags);
+	__asm__ volatile("pause" : : : "memory");
+}
+
 /**
  * irq_register() - Register one legacy PIC IRQ handler.
  * @irq: IRQ number in the 0-15 PIC range.
@@ -159,17 +548,17 @@ int irq_register(uint8_t irq, irq_handler_t handler, void *data)
 		return -EINVAL;
 	}
 
-	flags = arch_irq_save();
+	spin_lock_irqsave(&irq_actions_lock, &flags);
 
 	if (irq_actions[irq].handler != 0) {
-		arch_irq_restore(flags);
+		spin_unlock_irqrestore(&irq_actions_lock, flags);
 		return -EBUSY;
 	}
 
 	irq_actions[irq].handler = handler;
 	irq_actions[irq].data = data;
 
-	arch_irq_restore(flags);
+	spin_unlock_irqrestore(&irq_actions_lock, flags);
 	return 0;
 }
 
@@ -178,6 +567,35 @@ static void timer_irq_handler(uint8_t irq, void *data)
 	(void)irq;
 	(void)data;
 
+	if (pit_oneshot.drop_irq) {
+		pit_oneshot.drop_irq = 0;
+		return;
+	}
+
+	/* Raised just as IRQ0 was masked; the tick is counted on restart. */
+	if (lapic_nohz.active) {
+		return;
+	}
+
+	if (pit_oneshot.armed) {
+		uint16_t count;
+
+		/* Raised by a one-shot that has since been reprogrammed. */
+		if ((pit_read_back(&count) & PIT_STATUS_OUT) == 0) {
+			return;
+		}
+	}
+
+	timer_tick();
+}
+
+void handle_tick_wakeup(void)
+{
+	if (!lapic_nohz.armed) {
+		return;
+	}
+
+	lapic_nohz.armed = 0;
 	timer_tick();
 }
 
@@ -210,8 +628,11 @@ void handle_irq(struct trap_frame *frame)
  * arch_timer_init() - Bring up the first x86 periodic timer source.
  *
  * This initializes the legacy PIC/PIT path, registers IRQ0, then enables local
- * interrupts. Later APIC or HPET support should replace this backend without
- * changing scheduler policy.
+ * interrupts. The PIC delivers to the boot CPU only, so the PIT drives the
+ * global tick there; application processors run their local APIC timers
+ * for time slices alone. The boot CPU's local timer is calibrated against
+ * the running tick and then serves as its NO_HZ wakeup; without one, the
+ * stopped tick falls back to PIT one-shots.
  */
 void arch_timer_init(void)
 {
@@ -222,5 +643,9 @@ void arch_timer_init(void)
 	}
 	pit_init();
 	pr_info("timer initialized\n");
-	arch_irq_restore(1ull << 9);
+	arch_irq_enable();
+
+	if (lapic_init() != 0 || lapic_timer_calibrate() != 0) {
+		pr_warn("timer: no local APIC timer, idle tick uses the PIT\n");
+	}
 }
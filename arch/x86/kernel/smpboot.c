@@ -0,0 +1,287 @@
+#include <stdint.h>
+
+#include <arch/msr.h>
+#include <arch/smp.h>
+
+#include <tianole/arch.h>
+#include <tianole/errno.h>
+#include <tianole/memblock.h>
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/printk.h>
+#include <tianole/sched.h>
+#include <tianole/smp.h>
+#include <tianole/timer.h>
+#include <tianole/vmalloc.h>
+
+#include "acpi.h"
+#include "apic.h"
+#include "cpu.h"
+#include "smpboot.h"
+#include "trap_vectors.h"
+
+#define X86_CR4_PCIDE (1ull << 17)
+
+/* Page 0 holds the real-mode interrupt table; SIPI reaches below 1 MiB. */
+#define TRAMPOLINE_FLOOR 0x1000ull
+#define TRAMPOLINE_LIMIT 0x100000ull
+
+#define AP_STACK_SIZE 16384u
+#define AP_INIT_DELAY_US 10000u
+#define AP_STARTUP_DELAY_US 200u
+#define AP_ONLINE_TIMEOUT_TICKS X86_TICK_HZ
+
+struct x86_cpu x86_cpus[NR_CPUS];
+
+/*
+ * Boot CPU state loaded by trampoline.S on the CPU being started. Written
+ * before its INIT IPI; APs start one at a time, so one copy suffices.
+ */
+uint64_t ap_boot_cr0;
+uint64_t ap_boot_cr3;
+uint64_t ap_boot_cr4;
+uint64_t ap_boot_efer;
+uint64_t ap_boot_stack;
+uint32_t ap_boot_cpu;
+
+extern char trampoline_start[];
+extern char trampoline_end[];
+
+static phys_addr_t trampoline_page;
+
+static uint64_t read_cr0(void)
+{
+	uint64_t cr0;
+
+	__asm__ volatile("movq %%cr0, %0" : "=r"(cr0));
+	return cr0;
+}
+
+static uint64_t read_cr4(void)
+{
+	uint64_t cr4;
+
+	__asm__ volatile("movq %%cr4, %0" : "=r"(cr4));
+	return cr4;
+}
+
+uint32_t smp_processor_id(void)
+{
+	uint32_t cpu;
+
+	__asm__ volatile("movl %%gs:0, %0" : "=r"(cpu));
+	return cpu;
+}
+
+static void find_trampoline_page(phys_addr_t start, phys_addr_t end,
+	void *data)
+{
+	phys_addr_t *page = data;
+
+	if (*page != 0) {
+		return;
+	}
+
+	if (start < TRAMPOLINE_FLOOR) {
+		start = TRAMPOLINE_FLOOR;
+	}
+
+	if (start + PAGE_SIZE <= end && start + PAGE_SIZE <= TRAMPOLINE_LIMIT) {
+		*page = start;
+	}
+}
+
+void arch_reserve_low_memory(void)
+{
+	memblock_for_each_free_range(find_trampoline_page, &trampoline_page);
+	if (trampoline_page == 0) {
+		pr_warn("smp: no low page for the AP trampoline\n");
+		return;
+	}
+
+	memblock_reserve(trampoline_page, PAGE_SIZE);
+}
+
+/**
+ * record_cpu() - Assign the next logical number to a MADT processor.
+ * @apic_id: Local APIC ID from the MADT.
+ * @data: Number of CPUs recorded so far.
+ */
+static void record_cpu(uint32_t apic_id, void *data)
+{
+	uint32_t *nr_cpus = data;
+
+	if (apic_id == x86_cpus[0].apic_id) {
+		return;
+	}
+
+	if (*nr_cpus >= NR_CPUS) {
+		pr_warn("smp: ignoring cpu apic=%u beyond NR_CPUS\n", apic_id);
+		return;
+	}
+
+	x86_cpus[*nr_cpus].id = *nr_cpus;
+	x86_cpus[*nr_cpus].apic_id = apic_id;
+	(*nr_cpus)++;
+}
+
+/**
+ * install_trampoline() - Copy the real-mode entry code to its low page.
+ *
+ * Also snapshots the boot CPU's paging state for trampoline.S. CR4.PCIDE
+ * cannot be set outside long mode and EFER.LMA is set by the CPU itself,
+ * so both are left for the AP to reach on its own.
+ */
+static void install_trampoline(void)
+{
+	uint8_t *page = phys_to_virt(trampoline_page);
+	uint64_t length = (uint64_t)(trampoline_end - trampoline_start);
+	uint64_t i;
+
+	if (length > PAGE_SIZE) {
+		panic("AP trampoline larger than a page");
+	}
+
+	for (i = 0; i < length; i++) {
+		page[i] = (uint8_t)trampoline_start[i];
+	}
+
+	ap_boot_cr0 = read_cr0();
+	ap_boot_cr3 = kernel_page_table_root();
+	ap_boot_cr4 = read_cr4() & ~X86_CR4_PCIDE;
+	ap_boot_efer = rdmsr(X86_MSR_EFER) & ~X86_EFER_LMA;
+}
+
+/**
+ * boot_cpu() - Start one application processor and wait for it.
+ * @cpu: Logical number whose x86_cpus entry is filled in.
+ *
+ * Uses the INIT, STARTUP, STARTUP sequence. A CPU that never comes online
+ * keeps its stack and idle thread, since it might still wake up late and
+ * use them.
+ *
+ * Return: 0 once @cpu is online, -ENOMEM, or -ETIMEDOUT.
+ */
+static int boot_cpu(uint32_t cpu)
+{
+	uint32_t apic_id = x86_cpus[cpu].apic_id;
+	uint32_t page = (uint32_t)(trampoline_page >> PAGE_SHIFT);
+	uint8_t *stack;
+	uint64_t start;
+	int ret;
+
+	stack = vmalloc_mapped(AP_STACK_SIZE);
+	if (stack == 0) {
+		return -ENOMEM;
+	}
+
+	ret = sched_idle_create(cpu);
+	if (ret != 0) {
+		vfree(stack);
+		return ret;
+	}
+
+	ap_boot_stack = (uint64_t)(uintptr_t)(stack + AP_STACK_SIZE);
+	ap_boot_cpu = cpu;
+
+	lapic_send_init(apic_id);
+	lapic_delay_us(AP_INIT_DELAY_US);
+	lapic_send_startup(apic_id, page);
+	lapic_delay_us(AP_STARTUP_DELAY_US);
+	lapic_send_startup(apic_id, page);
+
+	start = timer_ticks();
+	while (!cpu_online(cpu)) {
+		if (timer_ticks() - start >= AP_ONLINE_TIMEOUT_TICKS) {
+			return -ETIMEDOUT;
+		}
+
+		arch_cpu_relax();
+	}
+
+	return 0;
+}
+
+/**
+ * arch_smp_boot() - Start the processors listed in the ACPI MADT.
+ *
+ * Each processor is started and waited for in turn, numbered in table
+ * order. The first one that fails to start ends the sequence, because a
+ * late starter would read the boot state meant for the next.
+ */
+void arch_smp_boot(void)
+{
+	uint32_t nr_cpus = 1;
+	uint32_t cpu;
+	int ret;
+
+	if (trampoline_page == 0 || lapic_init() != 0) {
+		pr_info("smp: no usable local APIC\n");
+		return;
+	}
+
+	x86_cpus[0].apic_id = lapic_id();
+	if (acpi_for_each_lapic(record_cpu, &nr_cpus) < 0) {
+		pr_info("smp: no ACPI MADT\n");
+		return;
+	}
+
+	if (nr_cpus == 1) {
+		return;
+	}
+
+	/* Calibrated by arch_timer_init(); APs reuse the boot CPU's rate. */
+	if (lapic_timer_tick_counts() == 0) {
+		pr_err("smp: local APIC timer not calibrated\n");
+		return;
+	}
+
+	install_trampoline();
+	for (cpu = 1; cpu < nr_cpus; cpu++) {
+		ret = boot_cpu(cpu);
+		if (ret != 0) {
+			pr_err("smp: cpu %u apic=%u failed to start: %d\n", cpu,
+				x86_cpus[cpu].apic_id, ret);
+			return;
+		}
+	}
+}
+
+void smp_ap_main(uint32_t cpu, uintptr_t stack_top)
+{
+	wrmsr(X86_MSR_GS_BASE, (uint64_t)(uintptr_t)&x86_cpus[cpu]);
+	gdt_init_ap(cpu, stack_top);
+	idt_load_ap();
+	tlb_init_ap();
+	if (lapic_init() != 0) {
+		panic("application processor lost its local APIC");
+	}
+
+	set_cpu_online(cpu);
+	sched_cpu_start();
+}
+
+void arch_send_reschedule(uint32_t cpu)
+{
+	lapic_send_ipi(x86_cpus[cpu].apic_id, X86_RESCHEDULE_VECTOR);
+}
+
+/* The boot CPU's local timer is its NO_HZ wakeup, not a slice tick. */
+void arch_cpu_tick_start(void)
+{
+	if (smp_processor_id() != 0) {
+		lapic_timer_start();
+	}
+}
+
+void arch_cpu_tick_stop(void)
+{
+	if (smp_processor_id() != 0) {
+		lapic_timer_stop();
+	}
+}
+
+void smp_send_tlb_flush(uint32_t cpu)
+{
+	lapic_send_ipi(x86_cpus[cpu].apic_id, X86_TLB_FLUSH_VECTOR);
+}
@@ -0,0 +1,19 @@
+#ifndef X86_KERNEL_SMPBOOT_H
+#define X86_KERNEL_SMPBOOT_H
+
+#include <stdint.h>
+
+#include <arch/smp.h>
+
+/**
+ * smp_ap_main() - First C code run by an application processor.
+ * @cpu: Logical number assigned by arch_smp_boot().
+ * @stack_top: Top of the boot stack the trampoline switched to.
+ *
+ * Entered from trampoline.S in long mode on the kernel page tables, with
+ * interrupts disabled. Never returns.
+ */
+void smp_ap_main(uint32_t cpu, uintptr_t stack_top)
+	__attribute__((noreturn));
+
+#endif
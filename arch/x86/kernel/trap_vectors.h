@@ -24,6 +24,10 @@
 #define X86_LEGACY_IRQ_VECTOR_COUNT 16u
 #define X86_LEGACY_SYSCALL_VECTOR 0x80u
 #define X86_FIRST_SYSTEM_VECTOR 0xecu
+#define X86_LOCAL_TIMER_VECTOR 0xecu
+#define X86_TLB_FLUSH_VECTOR 0xfcu
+#define X86_RESCHEDULE_VECTOR 0xfdu
+#define X86_SPURIOUS_APIC_VECTOR 0xffu
 
 #ifndef __ASSEMBLER__
 enum x86_vector_class {
@@ -360,4 +364,33 @@ static inline enum x86_vector_class x86_vector_class(uint64_t vector)
 		X86_IDT_DPL0,                                                  \
 		X86_IST_NONE)
 
+/*
+ * X86_SYSTEM_VECTOR(vector, entry, gate_type, dpl, ist)
+ *
+ * Local APIC vectors raised by a CPU's own timer or by other CPUs. They are
+ * not routed through the legacy IRQ table; trap dispatch hands them to the
+ * local APIC code, which acknowledges them.
+ */
+#define X86_SYSTEM_VECTORS(X)                                                  \
+	X(X86_LOCAL_TIMER_VECTOR,                                              \
+		apic_timer_interrupt,                                          \
+		X86_IDT_INTERRUPT_GATE,                                        \
+		X86_IDT_DPL0,                                                  \
+		X86_IST_NONE)                                                  \
+	X(X86_TLB_FLUSH_VECTOR,                                                \
+		tlb_flush_interrupt,                                           \
+		X86_IDT_INTERRUPT_GATE,                                        \
+		X86_IDT_DPL0,                                                  \
+		X86_IST_NONE)                                                  \
+	X(X86_RESCHEDULE_VECTOR,                                               \
+		reschedule_interrupt,                                          \
+		X86_IDT_INTERRUPT_GATE,                                        \
+		X86_IDT_DPL0,                                                  \
+		X86_IST_NONE)                                                  \
+	X(X86_SPURIOUS_APIC_VECTOR,                                            \
+		spurious_apic_interrupt,                                       \
+		X86_IDT_INTERRUPT_GATE,                                        \
+		X86_IDT_DPL0,                                                  \
+		X86_IST_NONE)
+
 #endif
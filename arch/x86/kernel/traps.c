@@ -5,6 +5,7 @@
 #include <tianole/printk.h>
 #include <tianole/sched.h>
 
+#include "apic.h"
 #include "cpu.h"
 #include "trap_policy.h"
 
@@ -53,6 +54,17 @@ static int x86_handle_page_fault(struct trap_frame *frame,
 	enum x86_trap_origin origin,
 	const struct exception_desc *desc);
 
+typedef int (*exception_fixup_t)(struct trap_frame *frame);
+
+/*
+ * Fixups run before any diagnostics and resolve routine exceptions, such as
+ * demand faults, without logging. A zero return falls through to the
+ * reporting path and the vector's handler.
+ */
+static const exception_fixup_t exception_fixups[32] = {
+	[14] = resolve_page_fault,
+};
+
 static const struct exception_desc exception_descs[32] = {
 #define DEFINE_EXCEPTION_DESC(                                                 \
 	vector, entry, has_error, gate_type, dpl, ist, name, handler)          \
@@ -199,6 +211,7 @@ static int x86_handle_invalid_opcode(struct trap_frame *frame,
  * @origin: Interrupted privilege level.
  * @desc: Metadata for vector 14.
  *
+ * Demand faults never get here; resolve_page_fault() backed them already.
  * The MM fault path decodes CR2 and access bits. If it cannot recover, common
  * dispatch applies kernel or future user-mode unhandled policy.
  */
@@ -252,9 +265,10 @@ void arch_traps_init(void)
  * trap_dispatch() - Route x86 exceptions and external IRQs.
  * @frame: Register snapshot from the assembly trap entry.
  *
- * External IRQs are dispatched first and may request a scheduler decision at
- * the common IRQ-exit boundary. CPU exceptions are described by a vector table;
- * each vector can grow its own policy without adding ad hoc checks here.
+ * External IRQs and local APIC interrupts are dispatched first and may
+ * request a scheduler decision at the common IRQ-exit boundary. CPU
+ * exceptions are described by a vector table; each vector can grow its own
+ * policy without adding ad hoc checks here.
  */
 void trap_dispatch(struct trap_frame *frame)
 {
@@ -267,6 +281,11 @@ void trap_dispatch(struct trap_frame *frame)
 		handle_irq(frame);
 		x86_trap_exit(frame, trap_origin(frame), X86_TRAP_EXIT_IRQ);
 		return;
+	case X86_VECTOR_SYSTEM:
+		sched_irq_enter();
+		handle_apic_interrupt(frame);
+		x86_trap_exit(frame, trap_origin(frame), X86_TRAP_EXIT_IRQ);
+		return;
 	case X86_VECTOR_EXCEPTION:
 		break;
 	case X86_VECTOR_SYSCALL:
@@ -275,13 +294,17 @@ void trap_dispatch(struct trap_frame *frame)
 		x86_trap_exit(frame, trap_origin(frame), X86_TRAP_EXIT_SYSCALL);
 		panic("unhandled syscall vector");
 	case X86_VECTOR_EXTERNAL_IRQ:
-	case X86_VECTOR_SYSTEM:
 	case X86_VECTOR_RESERVED:
 		pr_err("unexpected vector=%llu\n",
 			(unsigned long long)frame->vector);
 		panic("unhandled CPU vector");
 	}
 
+	if (frame->vector < 32 && exception_fixups[frame->vector] != 0 &&
+		exception_fixups[frame->vector](frame) != 0) {
+		return;
+	}
+
 	desc = exception_desc(frame->vector);
 	origin = trap_origin(frame);
 	print_exception_frame(frame, desc);
@@ -0,0 +1,20 @@
+#include <stdint.h>
+
+#include <tianole/arch.h>
+
+/**
+ * arch_read_cycle_counter() - Read the x86 time-stamp counter.
+ *
+ * RDTSC is not serializing; callers measure spans long enough that a few
+ * cycles of reordering do not matter.
+ *
+ * Return: Current TSC value.
+ */
+uint64_t arch_read_cycle_counter(void)
+{
+	uint32_t low;
+	uint32_t high;
+
+	__asm__ volatile("rdtsc" : "=a"(low), "=d"(high));
+	return ((uint64_t)high << 32) | low;
+}
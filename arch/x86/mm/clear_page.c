@@ -0,0 +1,74 @@
+#include <stdint.h>
+
+#include <arch/cpuid.h>
+
+#include <tianole/arch.h>
+#include <tianole/mm.h>
+
+/* Tri-state: -1 until CPUID has been checked, then 0 or 1. */
+static int clear_page_erms = -1;
+
+/**
+ * cpu_has_erms() - Report Enhanced REP MOVSB/STOSB support.
+ *
+ * With ERMS, rep stosb is the fastest way to clear a page; without it,
+ * rep stosq avoids the per-byte microcode path of older CPUs.
+ *
+ * Return: Non-zero if CPUID advertises ERMS.
+ */
+static int cpu_has_erms(void)
+{
+	struct cpuid_regs regs;
+
+	if (clear_page_erms >= 0) {
+		return clear_page_erms;
+	}
+
+	clear_page_erms = 0;
+	if (cpuid_max_leaf(0) >= X86_CPUID_EXTENDED_FEATURES) {
+		cpuid(X86_CPUID_EXTENDED_FEATURES, 0, &regs);
+		clear_page_erms = (regs.ebx & X86_CPUID_EBX_ERMS) != 0;
+	}
+
+	return clear_page_erms;
+}
+
+void arch_clear_page(void *page)
+{
+	void *dest = page;
+	uint64_t count;
+
+	if (cpu_has_erms()) {
+		count = PAGE_SIZE;
+		__asm__ volatile("rep stosb"
+			: "+D"(dest), "+c"(count)
+			: "a"(0)
+			: "memory");
+		return;
+	}
+
+	count = PAGE_SIZE / sizeof(uint64_t);
+	__asm__ volatile("rep stosq"
+		: "+D"(dest), "+c"(count)
+		: "a"(0)
+		: "memory");
+}
+
+void arch_clear_page_nocache(void *page)
+{
+	uint64_t *words = page;
+	uint64_t index;
+
+	for (index = 0; index < PAGE_SIZE / sizeof(uint64_t); index += 4) {
+		__asm__ volatile("movnti %1, (%0)\n\t"
+			"movnti %1, 8(%0)\n\t"
+			"movnti %1, 16(%0)\n\t"
+			"movnti %1, 24(%0)"
+			:
+			: "r"(&words[index]), "r"(0ull)
+			: "memory");
+	}
+
+	/* Non-temporal stores are weakly ordered; publish them first. */
+	__asm__ volatile("sfence" : : : "memory");
+}
@@ -1,5 +1,8 @@
+#include <stdint.h>
+
 #include <arch/traps.h>
 
+#include <tianole/mm.h>
 #include <tianole/printk.h>
 
 #define PF_PRESENT (1ull << 0)
@@ -25,8 +28,8 @@ static uint64_t read_cr2(void)
  * log_fault_access() - Decode and print page-fault access bits.
  * @error_code: x86 page-fault error code from the trap frame.
  *
- * This is diagnostic-only today. Demand paging, copy-on-write and user-mode
- * recovery will later replace the unconditional panic path in trap_dispatch().
+ * Only faults that handle_page_fault() cannot resolve are decoded. Copy-on-
+ * write and user-mode recovery will later shrink that set further.
  */
 static void log_fault_access(uint64_t error_code)
 {
@@ -52,12 +55,31 @@ static void log_fault_access(uint64_t error_code)
 	pr_err("\n");
 }
 
+/**
+ * resolve_page_fault() - Back a demand-faulted kernel address.
+ * @frame: Trap frame for vector 14.
+ *
+ * Only not-present kernel accesses are candidates; vm_region_fault() decides
+ * whether the address lies in a region that is populated on first touch.
+ *
+ * Return: Non-zero if a page was mapped and the access may be retried.
+ */
+int resolve_page_fault(struct trap_frame *frame)
+{
+	if ((frame->error_code & (PF_PRESENT | PF_USER | PF_RESERVED)) != 0) {
+		return 0;
+	}
+
+	return vm_region_fault(read_cr2()) == 0;
+}
+
 /**
  * handle_page_fault() - Print x86 page-fault diagnostics.
  * @frame: Trap frame for vector 14.
  *
- * The handler currently records fault address, access type and reason, then
- * returns to trap_dispatch(), which panics because recovery is not implemented.
+ * The handler records fault address, access type and reason for faults that
+ * resolve_page_fault() could not back, then returns to trap_dispatch(),
+ * which panics because no other recovery is implemented.
  */
 void handle_page_fault(struct trap_frame *frame)
 {
@@ -2,6 +2,8 @@
 
 #include <tianole/errno.h>
 #include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/spinlock.h>
 
 #include "page_table.h"
 
@@ -10,24 +12,105 @@ static uint64_t table_index(virt_addr_t virt, unsigned int shift)
 	return (virt >> shift) & 0x1ffu;
 }
 
-static void clear_page(phys_addr_t page)
+static uint64_t *entry_table(uint64_t entry)
 {
-	uint64_t *words = (uint64_t *)(uintptr_t)page;
-	uint64_t index;
+	return phys_to_virt(entry & X86_PAGE_MASK);
+}
+
+static uint64_t make_table_entry(phys_addr_t table)
+{
+	return table | PAGE_PRESENT | PAGE_WRITABLE;
+}
+
+/* Page-table pages currently allocated from the buddy allocator. */
+static uint64_t page_table_pages;
+
+/*
+ * Serializes every walk and update of the kernel page tables. Held across
+ * table allocation and release, so it nests outside the page allocator
+ * locks; the demand-fault path takes it with region_lock held.
+ */
+static struct spinlock page_table_lock = SPINLOCK_INITIALIZER;
+
+phys_addr_t alloc_table_page(void)
+{
+	phys_addr_t page = alloc_zeroed_page();
+	struct page *meta;
 
-	for (index = 0; index < PAGE_SIZE / sizeof(uint64_t); index++) {
-		words[index] = 0;
+	if (page == 0) {
+		return 0;
 	}
+
+	meta = phys_to_page(page);
+	meta->owner = PAGE_OWNER_PAGE_TABLE;
+	meta->inuse = 0;
+	__atomic_add_fetch(&page_table_pages, 1, __ATOMIC_RELAXED);
+	return page;
 }
 
-static uint64_t *entry_table(uint64_t entry)
+void free_table_page(phys_addr_t page)
 {
-	return (uint64_t *)(uintptr_t)(entry & X86_PAGE_MASK);
+	__atomic_sub_fetch(&page_table_pages, 1, __ATOMIC_RELAXED);
+	free_page(page);
 }
 
-static uint64_t make_table_entry(phys_addr_t table)
+uint64_t nr_page_table_pages(void)
 {
-	return table | PAGE_PRESENT | PAGE_WRITABLE;
+	return __atomic_load_n(&page_table_pages, __ATOMIC_RELAXED);
+}
+
+/**
+ * tracked_table() - Find the occupancy count of a table page.
+ * @table: Direct-map address of any entry in a page-table page.
+ *
+ * Tables built by the firmware or from memblock during boot are never
+ * freed, so only pages from alloc_table_page() carry a count.
+ *
+ * Return: The table's page metadata, or NULL if it is not tracked.
+ */
+static struct page *tracked_table(const uint64_t *table)
+{
+	uint64_t pfn = physmap_to_phys(table) >> PAGE_SHIFT;
+	struct page *page;
+
+	if (!pfn_valid(pfn)) {
+		return 0;
+	}
+
+	page = pfn_to_page(pfn);
+	return page->owner == PAGE_OWNER_PAGE_TABLE ? page : 0;
+}
+
+/* Count one more present entry in the table holding @entry. */
+static void table_get(const uint64_t *entry)
+{
+	struct page *page = tracked_table(entry);
+
+	if (page != 0) {
+		page->inuse++;
+	}
+}
+
+/**
+ * table_put() - Count one present entry fewer in the table holding @entry.
+ * @entry: Entry just cleared.
+ *
+ * Return: Non-zero if the table is tracked and now empty.
+ */
+static int table_put(const uint64_t *entry)
+{
+	struct page *page = tracked_table(entry);
+
+	if (page == 0) {
+		return 0;
+	}
+
+	if (page->inuse == 0) {
+		panic("page table occupancy underflow");
+	}
+
+	page->inuse--;
+	return page->inuse == 0;
 }
 
 /**
@@ -47,71 +130,391 @@ static int ensure_next_table(uint64_t *table, uint64_t index, uint64_t **next)
 		return 0;
 	}
 
-	page = alloc_page();
+	page = alloc_table_page();
 	if (page == 0) {
 		return -ENOMEM;
 	}
 
-	clear_page(page);
 	table[index] = make_table_entry(page);
-	*next = (uint64_t *)(uintptr_t)page;
+	table_get(&table[index]);
+	*next = phys_to_virt(page);
+	return 0;
+}
+
+/**
+ * leaf_shift() - Convert a mapping size to the shift of its table level.
+ * @size: Requested leaf size.
+ *
+ * Return: Level shift, or 0 if @size is not a leaf size this CPU supports.
+ */
+static unsigned int leaf_shift(uint64_t size)
+{
+	if (size == PAGE_SIZE) {
+		return X86_PT_SHIFT;
+	}
+
+	if (size == PAGE_SIZE_2M) {
+		return X86_PD_SHIFT;
+	}
+
+	if (size == PAGE_SIZE_1G && cpu_has_1g_pages()) {
+		return X86_PDPT_SHIFT;
+	}
+
 	return 0;
 }
 
+static uint64_t level_size(unsigned int shift)
+{
+	return 1ull << shift;
+}
+
+static int entry_is_leaf(uint64_t entry, unsigned int shift)
+{
+	return shift == X86_PT_SHIFT || (entry & X86_PAGE_SIZE_FLAG) != 0;
+}
+
+static phys_addr_t leaf_phys(uint64_t entry, unsigned int shift)
+{
+	return entry & X86_PAGE_MASK & ~(level_size(shift) - 1);
+}
+
+static uint64_t make_leaf_entry(
+	phys_addr_t phys, uint64_t flags, unsigned int shift)
+{
+	uint64_t entry = phys | flags | PAGE_PRESENT;
+
+	if (shift != X86_PT_SHIFT) {
+		entry |= X86_PAGE_SIZE_FLAG;
+	}
+
+	return entry;
+}
+
+static uint64_t leaf_flags(uint64_t entry)
+{
+	return entry & ~X86_PAGE_MASK & ~X86_PAGE_SIZE_FLAG;
+}
+
+/*
+ * Accessed and dirty bits are set by the CPU, so they never make a leaf's
+ * protection differ from the flags a caller asks for.
+ */
+static int leaf_has_flags(uint64_t entry, uint64_t flags)
+{
+	uint64_t ignored = X86_PAGE_ACCESSED | X86_PAGE_DIRTY;
+
+	return (leaf_flags(entry) & ~ignored) ==
+		((flags | PAGE_PRESENT) & ~ignored);
+}
+
+/*
+ * Kernel-half translations are identical in every address space, so their
+ * leaves are global: they survive CR3 switches, and invlpg drops them from
+ * every PCID at once.
+ */
+static uint64_t global_flag(virt_addr_t virt)
+{
+	return virt >= X86_KERNEL_HALF ? X86_PAGE_GLOBAL : 0;
+}
+
+/**
+ * find_leaf() - Find the leaf entry translating a virtual address.
+ * @virt: Virtual address to look up.
+ * @entry: Receives the leaf entry address.
+ * @shift: Receives the level shift of the leaf, and so its size.
+ *
+ * Return: 0 on success or -ENOENT if @virt is not mapped.
+ */
+static int find_leaf(virt_addr_t virt, uint64_t **entry, unsigned int *shift)
+{
+	uint64_t *table = active_pml4();
+	unsigned int level = X86_PML4_SHIFT;
+
+	for (;;) {
+		uint64_t *slot = &table[table_index(virt, level)];
+
+		if ((*slot & PAGE_PRESENT) == 0) {
+			return -ENOENT;
+		}
+
+		if (level != X86_PML4_SHIFT && entry_is_leaf(*slot, level)) {
+			*entry = slot;
+			*shift = level;
+			return 0;
+		}
+
+		table = entry_table(*slot);
+		level -= X86_LEVEL_BITS;
+	}
+}
+
 /**
- * page_entry() - Resolve the leaf PTE for a virtual address.
- * @virt: Virtual address whose PTE is requested.
+ * table_slot() - Resolve the entry at one level of the page tables.
+ * @virt: Virtual address to resolve.
+ * @shift: Level shift of the entry wanted.
  * @create: Allocate missing intermediate tables when non-zero.
- * @entry: Receives the leaf PTE address.
+ * @entry: Receives the entry address at level @shift.
  *
- * Return: 0 on success, -ENOENT when lookup fails, or -ENOMEM on allocation
- * failure while @create is non-zero.
+ * Return: 0 on success, -EEXIST if a larger leaf already covers @virt,
+ * -ENOENT if an intermediate table is missing and @create is zero, or
+ * -ENOMEM if a table page cannot be allocated.
  */
-static int page_entry(virt_addr_t virt, int create, uint64_t **entry)
+static int table_slot(
+	virt_addr_t virt, unsigned int shift, int create, uint64_t **entry)
 {
-	uint64_t *pml4 = active_pml4();
-	uint64_t *pdpt;
-	uint64_t *pd;
-	uint64_t *pt;
-	uint64_t pml4_index = table_index(virt, 39);
-	uint64_t pdpt_index = table_index(virt, 30);
-	uint64_t pd_index = table_index(virt, 21);
-	uint64_t pt_index = table_index(virt, 12);
+	uint64_t *table = active_pml4();
+	unsigned int level;
 
-	if (create != 0) {
-		int ret = ensure_next_table(pml4, pml4_index, &pdpt);
+	for (level = X86_PML4_SHIFT; level > shift; level -= X86_LEVEL_BITS) {
+		uint64_t index = table_index(virt, level);
+		uint64_t *parent = table;
+		int created;
+		int ret;
 
-		if (ret != 0) {
-			return ret;
+		if ((table[index] & PAGE_PRESENT) == 0 && create == 0) {
+			return -ENOENT;
 		}
 
-		ret = ensure_next_table(pdpt, pdpt_index, &pd);
-		if (ret != 0) {
-			return ret;
+		if (level != X86_PML4_SHIFT &&
+			(table[index] & PAGE_PRESENT) != 0 &&
+			(table[index] & X86_PAGE_SIZE_FLAG) != 0) {
+			return -EEXIST;
 		}
 
-		ret = ensure_next_table(pd, pd_index, &pt);
+		created = (table[index] & PAGE_PRESENT) == 0;
+		ret = ensure_next_table(table, index, &table);
 		if (ret != 0) {
 			return ret;
 		}
+
+		/* Every root must see a new kernel-half top-level entry. */
+		if (created != 0 && level == X86_PML4_SHIFT &&
+			index >= X86_KERNEL_PML4_FIRST) {
+			vm_space_sync_kernel_entry(index, parent[index]);
+		}
+	}
+
+	*entry = &table[table_index(virt, shift)];
+	return 0;
+}
+
+/**
+ * struct tlb_batch - TLB invalidations and frame releases held back by a
+ * range operation.
+ * @leaves: Removed leaves awaiting invalidation, then release.
+ * @count: Valid entries in @leaves.
+ * @flush_all: Set once more leaves were removed than @leaves can hold.
+ * @tables: Detached page-table pages awaiting invalidation, then release.
+ * @table_count: Valid entries in @tables.
+ * @fn: Optional release callback for removed leaves.
+ * @data: Context passed to @fn.
+ *
+ * A removed leaf's frames are handed to @fn only after its stale TLB entry
+ * is gone, so a frame is never reused while still reachable through the
+ * old translation. Detached tables wait the same way, because the CPU
+ * caches upper-level entries as well as leaves.
+ */
+struct tlb_batch {
+	struct {
+		virt_addr_t virt;
+		phys_addr_t phys;
+		uint64_t size;
+	} leaves[X86_TLB_BATCH_SIZE];
+	uint64_t count;
+	int flush_all;
+	phys_addr_t tables[X86_TLB_BATCH_SIZE];
+	uint64_t table_count;
+	unmap_range_fn_t fn;
+	void *data;
+};
+
+static void tlb_batch_init(
+	struct tlb_batch *batch, unmap_range_fn_t fn, void *data)
+{
+	batch->count = 0;
+	batch->flush_all = 0;
+	batch->table_count = 0;
+	batch->fn = fn;
+	batch->data = data;
+}
+
+/**
+ * tlb_batch_flush() - Invalidate every batched leaf and release its frames.
+ * @batch: Batch to drain.
+ *
+ * Up to X86_TLB_FLUSH_ALL_THRESHOLD leaves are invalidated one by one; a
+ * larger batch costs less as a single CR3 reload. Freed tables always take
+ * the full flush: kernel tables are shared, so other PCIDs may still cache
+ * entries pointing at them, and invlpg only reaches the loaded one. Other
+ * CPUs are shot down before anything is released.
+ */
+static void tlb_batch_flush(struct tlb_batch *batch)
+{
+	uint64_t index;
+
+	if (batch->flush_all != 0 || batch->table_count != 0 ||
+		batch->count > X86_TLB_FLUSH_ALL_THRESHOLD) {
+		flush_tlb_all();
 	} else {
-		if ((pml4[pml4_index] & PAGE_PRESENT) == 0) {
-			return -ENOENT;
+		for (index = 0; index < batch->count; index++) {
+			flush_tlb_page(batch->leaves[index].virt);
 		}
-		pdpt = entry_table(pml4[pml4_index]);
+	}
 
-		if ((pdpt[pdpt_index] & PAGE_PRESENT) == 0) {
-			return -ENOENT;
+	if (batch->flush_all != 0 || batch->table_count != 0 ||
+		batch->count != 0) {
+		flush_tlb_others();
+	}
+
+	if (batch->fn != 0) {
+		for (index = 0; index < batch->count; index++) {
+			batch->fn(batch->leaves[index].phys,
+				batch->leaves[index].size,
+				batch->data);
 		}
-		pd = entry_table(pdpt[pdpt_index]);
+	}
 
-		if ((pd[pd_index] & PAGE_PRESENT) == 0) {
-			return -ENOENT;
+	for (index = 0; index < batch->table_count; index++) {
+		free_table_page(batch->tables[index]);
+	}
+
+	batch->count = 0;
+	batch->flush_all = 0;
+	batch->table_count = 0;
+}
+
+/**
+ * release_empty_tables() - Detach the tables emptied by clearing a leaf.
+ * @batch: Batch that frees the detached tables after invalidation.
+ * @virt: Virtual address whose leaf was cleared.
+ * @shift: Level shift of the cleared leaf.
+ *
+ * Walks down again to learn each table's parent, then detaches tables
+ * bottom-up for as long as each parent empties in turn. The root is never
+ * freed; a cleared kernel-half root entry is cleared in every space.
+ */
+static void release_empty_tables(
+	struct tlb_batch *batch, virt_addr_t virt, unsigned int shift)
+{
+	uint64_t *path[4];
+	unsigned int depth = 0;
+	unsigned int level = X86_PML4_SHIFT;
+	uint64_t *table = active_pml4();
+
+	for (;;) {
+		path[depth++] = table;
+		if (level == shift) {
+			break;
+		}
+
+		table = entry_table(table[table_index(virt, level)]);
+		level -= X86_LEVEL_BITS;
+	}
+
+	while (depth > 1) {
+		unsigned int parent_level = level + X86_LEVEL_BITS;
+		uint64_t *parent = path[depth - 2];
+		uint64_t index = table_index(virt, parent_level);
+
+		if (batch->table_count == X86_TLB_BATCH_SIZE) {
+			tlb_batch_flush(batch);
+		}
+
+		parent[index] = 0;
+		batch->tables[batch->table_count++] =
+			physmap_to_phys(path[depth - 1]);
+
+		if (parent_level == X86_PML4_SHIFT) {
+			if (index >= X86_KERNEL_PML4_FIRST) {
+				vm_space_sync_kernel_entry(index, 0);
+			}
+			return;
+		}
+
+		if (table_put(&parent[index]) == 0) {
+			return;
+		}
+
+		depth--;
+		level = parent_level;
+	}
+}
+
+/**
+ * tlb_batch_remove() - Clear a leaf entry and queue its invalidation.
+ * @batch: Batch collecting the current range operation.
+ * @entry: Present leaf entry to clear.
+ * @shift: Level shift of @entry.
+ * @virt: Virtual address translated by @entry.
+ *
+ * Return: Non-zero if the table holding @entry emptied and was detached.
+ */
+static int tlb_batch_remove(struct tlb_batch *batch,
+	uint64_t *entry,
+	unsigned int shift,
+	virt_addr_t virt)
+{
+	phys_addr_t phys = leaf_phys(*entry, shift);
+
+	*entry = 0;
+	if (batch->count == X86_TLB_BATCH_SIZE) {
+		if (batch->fn != 0) {
+			tlb_batch_flush(batch);
+		} else {
+			batch->flush_all = 1;
 		}
-		pt = entry_table(pd[pd_index]);
 	}
 
-	*entry = &pt[pt_index];
+	if (batch->count < X86_TLB_BATCH_SIZE) {
+		batch->leaves[batch->count].virt = virt;
+		batch->leaves[batch->count].phys = phys;
+		batch->leaves[batch->count].size = level_size(shift);
+		batch->count++;
+	}
+
+	if (table_put(entry) == 0) {
+		return 0;
+	}
+
+	release_empty_tables(batch, virt, shift);
+	return 1;
+}
+
+/**
+ * split_leaf() - Replace a large leaf with a table of next-smaller leaves.
+ * @entry: Large leaf entry to split.
+ * @shift: Level shift of @entry.
+ * @virt: Any virtual address inside the leaf, used for TLB invalidation.
+ *
+ * The new table repeats the leaf's flags for every sub-range, so the
+ * translation is unchanged; only its granularity shrinks by one level.
+ *
+ * Return: 0 on success or -ENOMEM if the table page cannot be allocated.
+ */
+static int split_leaf(uint64_t *entry, unsigned int shift, virt_addr_t virt)
+{
+	unsigned int child = shift - X86_LEVEL_BITS;
+	phys_addr_t base = leaf_phys(*entry, shift);
+	uint64_t flags = leaf_flags(*entry);
+	uint64_t *table;
+	phys_addr_t page;
+	uint64_t index;
+
+	page = alloc_table_page();
+	if (page == 0) {
+		return -ENOMEM;
+	}
+
+	table = phys_to_virt(page);
+	for (index = 0; index < X86_PAGE_TABLE_ENTRIES; index++) {
+		table[index] = make_leaf_entry(
+			base + index * level_size(child), flags, child);
+	}
+	phys_to_page(page)->inuse = X86_PAGE_TABLE_ENTRIES;
+
+	*entry = make_table_entry(page);
+	flush_tlb_page(virt);
 	return 0;
 }
 
@@ -126,74 +529,454 @@ static int page_entry(virt_addr_t virt, int create, uint64_t **entry)
  */
 int map_page(virt_addr_t virt, phys_addr_t phys, uint64_t flags)
 {
+	return map_page_size(virt, phys, PAGE_SIZE, flags);
+}
+
+/**
+ * map_page_size() - Map one virtual range with a single leaf entry.
+ * @virt: Virtual address aligned to @size.
+ * @phys: Physical address aligned to @size.
+ * @size: PAGE_SIZE, PAGE_SIZE_2M or PAGE_SIZE_1G.
+ * @flags: Architecture flags supplied by the caller.
+ *
+ * A present entry at the leaf level means the range is already mapped,
+ * either by a leaf of the same size or by a table of smaller ones.
+ *
+ * Return: 0 on success, -EINVAL for unaligned input or unsupported size,
+ * -EEXIST if already mapped, or -ENOMEM on table allocation failure.
+ */
+int map_page_size(
+	virt_addr_t virt, phys_addr_t phys, uint64_t size, uint64_t flags)
+{
+	unsigned int shift = leaf_shift(size);
 	uint64_t *entry;
+	uint64_t irq_flags;
 	int ret;
 
-	if ((virt & (PAGE_SIZE - 1)) != 0 || (phys & (PAGE_SIZE - 1)) != 0) {
+	if (shift == 0 || (virt & (size - 1)) != 0 ||
+		(phys & (size - 1)) != 0) {
 		return -EINVAL;
 	}
 
-	ret = page_entry(virt, 1, &entry);
-	if (ret != 0) {
-		return ret;
+	spin_lock_irqsave(&page_table_lock, &irq_flags);
+	ret = table_slot(virt, shift, 1, &entry);
+	if (ret == 0 && (*entry & PAGE_PRESENT) != 0) {
+		ret = -EEXIST;
 	}
 
-	if ((*entry & PAGE_PRESENT) != 0) {
-		return -EEXIST;
+	if (ret == 0) {
+		*entry = make_leaf_entry(
+			phys & X86_PAGE_MASK, flags | global_flag(virt), shift);
+		table_get(entry);
+		flush_tlb_page(virt);
 	}
-
-	*entry = (phys & X86_PAGE_MASK) | flags | PAGE_PRESENT;
-	flush_tlb_page(virt);
-	return 0;
+	spin_unlock_irqrestore(&page_table_lock, irq_flags);
+	return ret;
 }
 
 /**
  * unmap_page() - Remove one 4 KiB mapping from the active page tables.
  * @virt: Page-aligned virtual address.
  *
- * Return: 0 on success, -EINVAL for unaligned input, or -ENOENT if unmapped.
+ * Return: 0 on success, -EINVAL for unaligned input, -ENOENT if unmapped,
+ * or -ENOMEM if a covering large leaf cannot be split.
  */
 int unmap_page(virt_addr_t virt)
 {
+	return unmap_page_size(virt, PAGE_SIZE);
+}
+
+/**
+ * unmap_leaf_locked() - Remove the leaf of one level mapping @virt.
+ * @virt: Virtual address aligned to the leaf size.
+ * @target: Level shift of the leaf to remove.
+ *
+ * Return: As unmap_page_size(). Called with page_table_lock held.
+ */
+static int unmap_leaf_locked(virt_addr_t virt, unsigned int target)
+{
+	struct tlb_batch batch;
+	unsigned int shift;
 	uint64_t *entry;
 	int ret;
 
-	if ((virt & (PAGE_SIZE - 1)) != 0) {
+	for (;;) {
+		ret = find_leaf(virt, &entry, &shift);
+		if (ret != 0) {
+			return ret;
+		}
+
+		if (shift <= target) {
+			break;
+		}
+
+		ret = split_leaf(entry, shift, virt);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	if (shift != target) {
 		return -EINVAL;
 	}
 
-	ret = page_entry(virt, 0, &entry);
-	if (ret != 0 || (*entry & PAGE_PRESENT) == 0) {
-		return -ENOENT;
+	tlb_batch_init(&batch, 0, 0);
+	tlb_batch_remove(&batch, entry, shift, virt);
+	tlb_batch_flush(&batch);
+	return 0;
+}
+
+/**
+ * unmap_page_size() - Remove one leaf mapping of a given size.
+ * @virt: Virtual address aligned to @size.
+ * @size: PAGE_SIZE, PAGE_SIZE_2M or PAGE_SIZE_1G.
+ *
+ * Tables left empty by the removal are freed after the invalidation.
+ *
+ * Return: 0 on success, -EINVAL for unaligned input or a range mapped with
+ * smaller leaves, -ENOENT if unmapped, or -ENOMEM if a split fails.
+ */
+int unmap_page_size(virt_addr_t virt, uint64_t size)
+{
+	unsigned int target = leaf_shift(size);
+	uint64_t flags;
+	int ret;
+
+	if (target == 0 || (virt & (size - 1)) != 0) {
+		return -EINVAL;
 	}
 
-	*entry = 0;
-	flush_tlb_page(virt);
+	spin_lock_irqsave(&page_table_lock, &flags);
+	ret = unmap_leaf_locked(virt, target);
+	spin_unlock_irqrestore(&page_table_lock, flags);
+	return ret;
+}
+
+/**
+ * protect_range_locked() - Rewrite leaf flags across [@virt, @end).
+ * @virt: Page-aligned start of the range.
+ * @end: Page-aligned end of the range.
+ * @flags: Architecture flags supplied by the caller.
+ * @changed: Set once any leaf was rewritten.
+ *
+ * Return: As protect_range(). Called with page_table_lock held.
+ */
+static int protect_range_locked(virt_addr_t virt, virt_addr_t end,
+	uint64_t flags, int *changed)
+{
+	flags |= global_flag(virt);
+	while (virt < end) {
+		virt_addr_t next;
+		unsigned int shift;
+		uint64_t *entry;
+		uint64_t step;
+		int ret;
+
+		ret = find_leaf(virt, &entry, &shift);
+		if (ret != 0) {
+			return ret;
+		}
+
+		step = level_size(shift);
+		next = (virt | (step - 1)) + 1;
+		if (leaf_has_flags(*entry, flags)) {
+			if (next <= virt) {
+				break;
+			}
+			virt = next;
+			continue;
+		}
+
+		if ((virt & (step - 1)) != 0 || end - virt < step) {
+			ret = split_leaf(entry, shift, virt);
+			if (ret != 0) {
+				return ret;
+			}
+			continue;
+		}
+
+		*entry = make_leaf_entry(
+			leaf_phys(*entry, shift), flags, shift);
+		flush_tlb_page(virt);
+		*changed = 1;
+		if (next <= virt) {
+			break;
+		}
+		virt = next;
+	}
+
+	return 0;
+}
+
+/**
+ * protect_range() - Change the flags of already mapped pages.
+ * @virt: Page-aligned start of the range.
+ * @size: Length in bytes, a multiple of PAGE_SIZE.
+ * @flags: Architecture flags supplied by the caller.
+ *
+ * Each leaf is rewritten in place when it lies wholly inside the range.
+ * A leaf straddling either boundary is split one level at a time until the
+ * boundary falls on a leaf edge, so splitting stays proportional to the
+ * boundaries rather than the range length.
+ *
+ * Return: 0 on success, -EINVAL for unaligned input, -ENOENT if part of the
+ * range is unmapped, or -ENOMEM if a split fails.
+ */
+int protect_range(virt_addr_t virt, uint64_t size, uint64_t flags)
+{
+	virt_addr_t end = virt + size;
+	uint64_t irq_flags;
+	int changed = 0;
+	int ret;
+
+	if ((virt & (PAGE_SIZE - 1)) != 0 || (size & (PAGE_SIZE - 1)) != 0 ||
+		end < virt) {
+		return -EINVAL;
+	}
+
+	spin_lock_irqsave(&page_table_lock, &irq_flags);
+	ret = protect_range_locked(virt, end, flags, &changed);
+	if (changed != 0) {
+		flush_tlb_others();
+	}
+	spin_unlock_irqrestore(&page_table_lock, irq_flags);
+	return ret;
+}
+
+static int unmap_range_locked(virt_addr_t virt, virt_addr_t end,
+	unmap_range_fn_t fn, void *data);
+
+/**
+ * map_range() - Map a physically contiguous range with 4 KiB pages.
+ * @virt: Page-aligned virtual start.
+ * @phys: Page-aligned physical start.
+ * @size: Length in bytes, a multiple of PAGE_SIZE.
+ * @flags: Architecture PTE flags supplied by the caller.
+ *
+ * The walk runs once per page table, after which consecutive PTEs are
+ * filled through a cached table pointer. No TLB flush is needed because
+ * x86 never caches not-present translations. On failure, pages mapped by
+ * this call are removed again.
+ *
+ * Return: 0 on success, -EINVAL for unaligned input, -EEXIST if any page is
+ * already mapped, or -ENOMEM on table allocation failure.
+ */
+int map_range(virt_addr_t virt, phys_addr_t phys, uint64_t size,
+	uint64_t flags)
+{
+	struct page *pt_page = 0;
+	uint64_t *pt = 0;
+	uint64_t irq_flags;
+	uint64_t offset;
+	int ret = 0;
+
+	if ((virt & (PAGE_SIZE - 1)) != 0 || (phys & (PAGE_SIZE - 1)) != 0 ||
+		(size & (PAGE_SIZE - 1)) != 0 || virt + size < virt) {
+		return -EINVAL;
+	}
+
+	flags |= global_flag(virt);
+	spin_lock_irqsave(&page_table_lock, &irq_flags);
+	for (offset = 0; offset < size; offset += PAGE_SIZE) {
+		virt_addr_t current = virt + offset;
+		uint64_t *entry;
+
+		if (pt == 0 || (current & (PAGE_SIZE_2M - 1)) == 0) {
+			ret = table_slot(current & ~(PAGE_SIZE_2M - 1),
+				X86_PT_SHIFT,
+				1,
+				&pt);
+			if (ret != 0) {
+				break;
+			}
+			pt_page = tracked_table(pt);
+		}
+
+		entry = &pt[table_index(current, X86_PT_SHIFT)];
+		if ((*entry & PAGE_PRESENT) != 0) {
+			ret = -EEXIST;
+			break;
+		}
+
+		*entry = make_leaf_entry(phys + offset, flags, X86_PT_SHIFT);
+		if (pt_page != 0) {
+			pt_page->inuse++;
+		}
+	}
+
+	if (ret != 0 && offset != 0) {
+		unmap_range_locked(virt, virt + offset, 0, 0);
+	}
+	spin_unlock_irqrestore(&page_table_lock, irq_flags);
+
+	return ret;
+}
+
+/**
+ * unmap_range_large() - Remove or split a large leaf met by unmap_range().
+ * @batch: Batch collecting the unmap.
+ * @virt: Current virtual address, inside the leaf.
+ * @end: End of the range being unmapped.
+ *
+ * Return: Bytes consumed from @virt, or 0 if the leaf was split and the
+ * caller should walk @virt again. Sets *@ret on failure.
+ */
+static uint64_t unmap_range_large(
+	struct tlb_batch *batch, virt_addr_t virt, virt_addr_t end, int *ret)
+{
+	unsigned int shift;
+	uint64_t *entry;
+	uint64_t step;
+
+	*ret = find_leaf(virt, &entry, &shift);
+	if (*ret != 0) {
+		return 0;
+	}
+
+	step = level_size(shift);
+	if ((virt & (step - 1)) == 0 && end - virt >= step) {
+		(void)tlb_batch_remove(batch, entry, shift, virt);
+		return step;
+	}
+
+	*ret = split_leaf(entry, shift, virt);
 	return 0;
 }
 
+/**
+ * unmap_range_locked() - Remove every mapping in [@virt, @end).
+ * @virt: Page-aligned virtual start.
+ * @end: Page-aligned virtual end.
+ * @fn: Optional callback receiving each removed leaf's frames, or NULL.
+ * @data: Context passed to @fn.
+ *
+ * Return: As unmap_range(). Called with page_table_lock held.
+ */
+static int unmap_range_locked(virt_addr_t virt, virt_addr_t end,
+	unmap_range_fn_t fn, void *data)
+{
+	struct tlb_batch batch;
+	uint64_t *pt = 0;
+	int ret = 0;
+
+	tlb_batch_init(&batch, fn, data);
+	while (virt < end) {
+		virt_addr_t next;
+		uint64_t *entry;
+		int err = 0;
+
+		if (pt == 0 || (virt & (PAGE_SIZE_2M - 1)) == 0) {
+			err = table_slot(virt & ~(PAGE_SIZE_2M - 1),
+				X86_PT_SHIFT,
+				0,
+				&pt);
+		}
+
+		if (err == -EEXIST) {
+			pt = 0;
+			virt += unmap_range_large(&batch, virt, end, &err);
+			if (err != 0) {
+				ret = err;
+				break;
+			}
+			continue;
+		}
+
+		if (err != 0) {
+			ret = -ENOENT;
+			pt = 0;
+			next = (virt | (PAGE_SIZE_2M - 1)) + 1;
+			if (next <= virt) {
+				break;
+			}
+			virt = next;
+			continue;
+		}
+
+		entry = &pt[table_index(virt, X86_PT_SHIFT)];
+		if ((*entry & PAGE_PRESENT) != 0) {
+			/* A detached table must not be used as the cursor. */
+			if (tlb_batch_remove(&batch, entry, X86_PT_SHIFT,
+				virt) != 0) {
+				pt = 0;
+			}
+		} else {
+			ret = -ENOENT;
+		}
+		virt += PAGE_SIZE;
+	}
+
+	tlb_batch_flush(&batch);
+	return ret;
+}
+
+/**
+ * unmap_range() - Remove every mapping in a virtual range.
+ * @virt: Page-aligned virtual start.
+ * @size: Length in bytes, a multiple of PAGE_SIZE.
+ * @fn: Optional callback receiving each removed leaf's frames, or NULL.
+ * @data: Context passed to @fn.
+ *
+ * Like map_range(), PTEs are cleared through a cached table pointer.
+ * Invalidations are batched and issued once at the end, or as one CR3
+ * reload for large ranges; @fn runs only after the matching invalidation.
+ * Large leaves wholly inside the range are removed whole, and only a leaf
+ * straddling a range edge is split. Holes are skipped.
+ *
+ * Return: 0 on success, -EINVAL for unaligned input, -ENOENT if part of the
+ * range was not mapped, or -ENOMEM if a straddling leaf cannot be split.
+ */
+int unmap_range(virt_addr_t virt, uint64_t size, unmap_range_fn_t fn,
+	void *data)
+{
+	virt_addr_t end = virt + size;
+	uint64_t flags;
+	int ret;
+
+	if ((virt & (PAGE_SIZE - 1)) != 0 || (size & (PAGE_SIZE - 1)) != 0 ||
+		end < virt) {
+		return -EINVAL;
+	}
+
+	spin_lock_irqsave(&page_table_lock, &flags);
+	ret = unmap_range_locked(virt, end, fn, data);
+	spin_unlock_irqrestore(&page_table_lock, flags);
+	return ret;
+}
+
 /**
  * virt_to_phys() - Translate a mapped virtual address to physical address.
  * @virt: Virtual address to translate.
  * @phys: Receives the translated physical address including page offset.
  *
+ * Direct-map addresses are translated arithmetically; everything else walks
+ * the active page tables.
+ *
  * Return: 0 on success, -EINVAL for invalid output storage, or -ENOENT if the
  * virtual address is not mapped.
  */
 int virt_to_phys(virt_addr_t virt, phys_addr_t *phys)
 {
+	unsigned int shift;
 	uint64_t *entry;
+	uint64_t flags;
 	int ret;
 
 	if (phys == 0) {
 		return -EINVAL;
 	}
 
-	ret = page_entry(virt, 0, &entry);
-	if (ret != 0 || (*entry & PAGE_PRESENT) == 0) {
-		return -ENOENT;
+	if (physmap_contains((const void *)(uintptr_t)virt)) {
+		*phys = physmap_to_phys((const void *)(uintptr_t)virt);
+		return 0;
 	}
 
-	*phys = (*entry & X86_PAGE_MASK) | (virt & (PAGE_SIZE - 1));
-	return 0;
+	spin_lock_irqsave(&page_table_lock, &flags);
+	ret = find_leaf(virt, &entry, &shift);
+	if (ret == 0) {
+		*phys = leaf_phys(*entry, shift) |
+			(virt & (level_size(shift) - 1));
+	}
+	spin_unlock_irqrestore(&page_table_lock, flags);
+	return ret;
 }
@@ -7,12 +7,47 @@
 
 #define X86_PAGE_TABLE_ENTRIES 512u
 #define X86_PAGE_MASK 0x000ffffffffff000ull
+#define X86_PAGE_ACCESSED (1ull << 5)
+#define X86_PAGE_DIRTY (1ull << 6)
 #define X86_PAGE_SIZE_FLAG (1ull << 7)
+#define X86_PAGE_GLOBAL (1ull << 8)
+
+/* Virtual address shift translated by each page-table level. */
+#define X86_PT_SHIFT 12u
+#define X86_PD_SHIFT 21u
+#define X86_PDPT_SHIFT 30u
+#define X86_PML4_SHIFT 39u
+#define X86_LEVEL_BITS 9u
+
+/*
+ * The upper half of the address space belongs to the kernel. Its top-level
+ * entries are shared by every address space, and its leaves are global.
+ */
+#define X86_KERNEL_HALF 0xffff800000000000ull
+#define X86_KERNEL_PML4_FIRST 256u
+
+/* PCID 0 is the kernel address space; the rest are handed out on demand. */
+#define X86_PCID_COUNT 4096u
+
+/*
+ * Range operations queue up to X86_TLB_BATCH_SIZE removed leaves. Flushing
+ * more than X86_TLB_FLUSH_ALL_THRESHOLD of them at once uses a CR3 reload
+ * instead of one invlpg each.
+ */
+#define X86_TLB_BATCH_SIZE 32u
+#define X86_TLB_FLUSH_ALL_THRESHOLD 16u
+
+/**
+ * read_cr3() - Return the physical address of the loaded top-level table.
+ *
+ * Return: CR3 with control bits masked off.
+ */
+phys_addr_t read_cr3(void);
 
 /**
  * active_pml4() - Return the currently loaded top-level page table.
  *
- * Return: Virtual address of the active PML4, derived from CR3.
+ * Return: Direct-map address of the active PML4, derived from CR3.
  */
 uint64_t *active_pml4(void);
 
@@ -28,6 +63,104 @@ void load_cr3(phys_addr_t root);
  */
 void flush_tlb_page(virt_addr_t virt);
 
+/**
+ * cpu_has_1g_pages() - Report whether the CPU supports 1 GiB leaf entries.
+ *
+ * Return: Non-zero if CPUID advertises gigabyte pages.
+ */
+int cpu_has_1g_pages(void);
+
+/**
+ * flush_tlb_all() - Invalidate every translation in the local TLB.
+ *
+ * Also drops cached upper-level entries, for every PCID.
+ */
+void flush_tlb_all(void);
+
+/**
+ * flush_tlb_others() - Flush the TLB of every other online CPU.
+ *
+ * Waits until all of them have flushed.
+ */
+void flush_tlb_others(void);
+
+/**
+ * tlb_init() - Enable global pages and, when supported, PCIDs.
+ */
+void tlb_init(void);
+
+/**
+ * tlb_pcid_enabled() - Report whether CR4.PCIDE is set.
+ *
+ * Return: Non-zero if CR3 carries an address-space tag.
+ */
+int tlb_pcid_enabled(void);
+
+/**
+ * tlb_invpcid_enabled() - Report whether INVPCID can be used.
+ *
+ * Return: Non-zero if translations of other PCIDs can be invalidated.
+ */
+int tlb_invpcid_enabled(void);
+
+/**
+ * flush_tlb_pcid_page() - Invalidate one page of a PCID that is not loaded.
+ * @pcid: Address-space tag whose translation changed.
+ * @virt: Virtual address whose mapping changed.
+ */
+void flush_tlb_pcid_page(uint16_t pcid, virt_addr_t virt);
+
+/**
+ * load_cr3_pcid() - Load a page-table root tagged with a PCID.
+ * @root: Physical address of the PML4 page.
+ * @pcid: Address-space tag for translations created under @root.
+ * @preserve: Non-zero to keep @pcid's cached translations.
+ */
+void load_cr3_pcid(phys_addr_t root, uint16_t pcid, int preserve);
+
+/**
+ * vm_space_init() - Adopt the kernel page-table root as the first space.
+ *
+ * Also enables global pages and PCIDs through tlb_init().
+ */
+void vm_space_init(void);
+
+/**
+ * vm_space_sync_kernel_entry() - Publish a new kernel top-level entry.
+ * @index: PML4 index in the kernel half.
+ * @entry: Entry just installed in the active root.
+ *
+ * Kernel-half tables below the top level are shared, so only new top-level
+ * entries need copying into the kernel root and every other space.
+ */
+void vm_space_sync_kernel_entry(uint64_t index, uint64_t entry);
+
+/**
+ * vm_space_set_pcid_preserve() - Choose whether switches keep PCID entries.
+ * @enable: Zero to flush the incoming PCID on every switch.
+ *
+ * Exists for the switch-cost benchmark, which compares both behaviours.
+ */
+void vm_space_set_pcid_preserve(int enable);
+
+/**
+ * alloc_table_page() - Allocate a zeroed page-table page.
+ *
+ * The page is tagged PAGE_OWNER_PAGE_TABLE and its struct page inuse field
+ * counts present entries, so the table can be freed once it empties.
+ *
+ * Return: Physical address of the page, or 0 when memory is exhausted.
+ */
+phys_addr_t alloc_table_page(void);
+
+/**
+ * free_table_page() - Free a page from alloc_table_page().
+ * @page: Physical address of the table page.
+ *
+ * The caller must have detached the table and invalidated the TLB.
+ */
+void free_table_page(phys_addr_t page);
+
 /**
  * page_tables_init() - Switch from firmware page tables to the kernel root.
  *
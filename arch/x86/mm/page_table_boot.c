@@ -1,65 +1,57 @@
 #include <stdint.h>
 
+#include <arch/cpuid.h>
+#include <arch/smp.h>
+
 #include <tianole/arch.h>
+#include <tianole/memblock.h>
 #include <tianole/mm.h>
 #include <tianole/panic.h>
 #include <tianole/printk.h>
 
 #include "page_table.h"
 
-#define MAX_RESERVED_TABLE_PAGES 4096
+phys_addr_t physmap_limit;
 
-static phys_addr_t reserved_table_pages[MAX_RESERVED_TABLE_PAGES];
-static uint64_t reserved_table_page_count;
-static int reserved_table_pages_ready;
 static uint64_t kernel_pml4[X86_PAGE_TABLE_ENTRIES]
 	__attribute__((aligned(PAGE_SIZE)));
 static int page_tables_ready;
 
-static uint64_t *entry_table(uint64_t entry)
+/*
+ * Everything in this file runs before the direct map exists, so tables are
+ * reached through the firmware identity mapping of physical memory.
+ */
+static uint64_t *identity_table(phys_addr_t table)
 {
-	return (uint64_t *)(uintptr_t)(entry & X86_PAGE_MASK);
+	return (uint64_t *)(uintptr_t)(table & X86_PAGE_MASK);
 }
 
-/**
- * add_reserved_table_page() - Mark a page table page as allocator-reserved.
- * @page: Physical address of a page currently used as a page-table page.
- *
- * The physical page allocator asks this module whether a firmware page can be
- * reused. Recording active page-table pages prevents reclaiming tables that are
- * still needed to preserve early identity mappings.
- */
-static void add_reserved_table_page(phys_addr_t page)
+static uint64_t *entry_table(uint64_t entry)
 {
-	uint64_t index;
-
-	for (index = 0; index < reserved_table_page_count; index++) {
-		if (reserved_table_pages[index] == page) {
-			return;
-		}
-	}
-
-	if (reserved_table_page_count >= MAX_RESERVED_TABLE_PAGES) {
-		panic("too many active page table pages");
-	}
+	return identity_table(entry);
+}
 
-	reserved_table_pages[reserved_table_page_count++] = page;
+static void reserve_table_page(phys_addr_t page)
+{
+	memblock_reserve(page, PAGE_SIZE);
 }
 
 /**
- * collect_active_page_tables() - Walk current page tables and reserve tables.
+ * arch_reserve_page_tables() - Reserve every active page-table page.
  *
  * The walk records only page-table pages, not the mapped leaf pages. Large
  * pages are treated as leaves and therefore do not add a lower-level table.
+ * Firmware usually allocates tables back to back, so the reservations merge
+ * into a handful of memblock ranges.
  */
-static void collect_active_page_tables(void)
+void arch_reserve_page_tables(void)
 {
 	uint64_t pml4_index;
 	uint64_t pdpt_index;
 	uint64_t pd_index;
-	uint64_t *pml4 = active_pml4();
+	uint64_t *pml4 = identity_table(read_cr3());
 
-	add_reserved_table_page((phys_addr_t)(uintptr_t)pml4);
+	reserve_table_page(read_cr3());
 
 	for (pml4_index = 0; pml4_index < X86_PAGE_TABLE_ENTRIES;
 		pml4_index++) {
@@ -69,7 +61,7 @@ static void collect_active_page_tables(void)
 			continue;
 		}
 
-		add_reserved_table_page(pml4[pml4_index] & X86_PAGE_MASK);
+		reserve_table_page(pml4[pml4_index] & X86_PAGE_MASK);
 
 		pdpt = entry_table(pml4[pml4_index]);
 		for (pdpt_index = 0; pdpt_index < X86_PAGE_TABLE_ENTRIES;
@@ -81,8 +73,7 @@ static void collect_active_page_tables(void)
 				continue;
 			}
 
-			add_reserved_table_page(
-				pdpt[pdpt_index] & X86_PAGE_MASK);
+			reserve_table_page(pdpt[pdpt_index] & X86_PAGE_MASK);
 
 			pd = entry_table(pdpt[pdpt_index]);
 			for (pd_index = 0; pd_index < X86_PAGE_TABLE_ENTRIES;
@@ -93,7 +84,7 @@ static void collect_active_page_tables(void)
 					continue;
 				}
 
-				add_reserved_table_page(
+				reserve_table_page(
 					pd[pd_index] & X86_PAGE_MASK);
 			}
 		}
@@ -101,55 +92,232 @@ static void collect_active_page_tables(void)
 }
 
 /**
- * arch_page_table_uses_page() - Test whether a page backs an active table.
- * @page: Page-aligned physical address to test.
+ * page_tables_init() - Take ownership of the kernel page-table root.
  *
- * Return: Non-zero if @page must stay reserved for page-table ownership.
+ * The initial kernel root is a full copy of the firmware PML4. That keeps UEFI
+ * identity mappings and the GOP framebuffer usable while later page-table
+ * operations mutate only Tianole-owned top-level storage.
  */
-int arch_page_table_uses_page(uint64_t page)
+void page_tables_init(void)
 {
 	uint64_t index;
+	uint64_t *firmware_pml4;
 
-	if ((page & (PAGE_SIZE - 1)) != 0) {
+	if (page_tables_ready != 0) {
+		return;
+	}
+
+	firmware_pml4 = identity_table(read_cr3());
+	for (index = 0; index < X86_PAGE_TABLE_ENTRIES; index++) {
+		kernel_pml4[index] = firmware_pml4[index];
+	}
+
+	load_cr3((phys_addr_t)(uintptr_t)kernel_pml4);
+	page_tables_ready = 1;
+	pr_info("kernel page table root active\n");
+}
+
+uint64_t kernel_page_table_root(void)
+{
+	return (uint64_t)(uintptr_t)kernel_pml4;
+}
+
+int cpu_has_1g_pages(void)
+{
+	struct cpuid_regs regs;
+
+	if (cpuid_max_leaf(X86_CPUID_EXT_MAX) < X86_CPUID_EXT_FEATURES) {
 		return 0;
 	}
 
-	if (reserved_table_pages_ready == 0) {
-		collect_active_page_tables();
-		reserved_table_pages_ready = 1;
+	cpuid(X86_CPUID_EXT_FEATURES, 0, &regs);
+	return (regs.edx & X86_CPUID_EDX_PDPE1GB) != 0;
+}
+
+/**
+ * physmap_ram_type() - Test whether a firmware memory type is RAM.
+ * @type: Firmware memory type of a boot descriptor.
+ *
+ * Everything from loader code through conventional memory is RAM, as are
+ * ACPI reclaim and NVS, whose tables the kernel will parse. MMIO and
+ * reserved ranges stay out of the cacheable direct map.
+ *
+ * Return: Non-zero if the range belongs in the direct map.
+ */
+static int physmap_ram_type(uint32_t type)
+{
+	return (type >= BOOT_MEMORY_TYPE_LOADER_CODE &&
+		       type <= BOOT_MEMORY_TYPE_CONVENTIONAL) ||
+		type == BOOT_MEMORY_TYPE_ACPI_RECLAIM ||
+		type == BOOT_MEMORY_TYPE_ACPI_NVS;
+}
+
+/**
+ * physmap_next_table() - Find or create a direct-map intermediate table.
+ * @table: Current table level, reached through the identity map.
+ * @index: Entry index within @table.
+ *
+ * Table pages come from memblock because the buddy allocator does not
+ * exist yet; they stay reserved for the lifetime of the kernel.
+ *
+ * Return: Next-level table, reached through the identity map.
+ */
+static uint64_t *physmap_next_table(uint64_t *table, uint64_t index)
+{
+	phys_addr_t page;
+	uint64_t *words;
+	uint64_t word;
+
+	if ((table[index] & PAGE_PRESENT) != 0) {
+		return entry_table(table[index]);
 	}
 
-	for (index = 0; index < reserved_table_page_count; index++) {
-		if (reserved_table_pages[index] == page) {
-			return 1;
+	page = memblock_alloc(PAGE_SIZE, PAGE_SIZE);
+	if (page == 0) {
+		panic("direct map table allocation failed");
+	}
+
+	words = identity_table(page);
+	for (word = 0; word < X86_PAGE_TABLE_ENTRIES; word++) {
+		words[word] = 0;
+	}
+
+	table[index] = page | PAGE_PRESENT | PAGE_WRITABLE;
+	return words;
+}
+
+/**
+ * physmap_map_range() - Add one physical range to the direct map.
+ * @start: Page-aligned physical start.
+ * @end: Page-aligned physical end.
+ * @use_1g: Non-zero if the CPU supports 1 GiB leaf entries.
+ *
+ * Fully covered, aligned gigabytes become 1 GiB leaves and fully covered
+ * 2 MiB blocks 2 MiB leaves. The unaligned edges are mapped with 4 KiB
+ * pages, so MMIO or reserved memory sharing an edge block never gets a
+ * cacheable alias. Pages already mapped by an overlapping descriptor are
+ * skipped.
+ */
+static void physmap_map_range(phys_addr_t start, phys_addr_t end, int use_1g)
+{
+	const uint64_t leaf_flags = PAGE_PRESENT | PAGE_WRITABLE |
+		PAGE_NO_EXECUTE | X86_PAGE_SIZE_FLAG | X86_PAGE_GLOBAL;
+	const uint64_t page_flags = PAGE_PRESENT | PAGE_WRITABLE |
+		PAGE_NO_EXECUTE | X86_PAGE_GLOBAL;
+	uint64_t *pml4 = kernel_pml4;
+
+	while (start < end) {
+		virt_addr_t virt = PHYSMAP_BASE + start;
+		uint64_t pdpt_index = (virt >> 30) & 0x1ffu;
+		uint64_t pd_index = (virt >> 21) & 0x1ffu;
+		phys_addr_t block_end;
+		uint64_t *pdpt;
+		uint64_t *pd;
+		uint64_t *pt;
+
+		pdpt = physmap_next_table(pml4, (virt >> 39) & 0x1ffu);
+
+		if ((pdpt[pdpt_index] & X86_PAGE_SIZE_FLAG) != 0) {
+			start = (start | (PAGE_SIZE_1G - 1)) + 1;
+			continue;
+		}
+
+		if (use_1g != 0 && (start & (PAGE_SIZE_1G - 1)) == 0 &&
+			end - start >= PAGE_SIZE_1G &&
+			(pdpt[pdpt_index] & PAGE_PRESENT) == 0) {
+			pdpt[pdpt_index] = start | leaf_flags;
+			start += PAGE_SIZE_1G;
+			continue;
+		}
+
+		pd = physmap_next_table(pdpt, pdpt_index);
+		if ((pd[pd_index] & X86_PAGE_SIZE_FLAG) != 0) {
+			start = (start | (PAGE_SIZE_2M - 1)) + 1;
+			continue;
+		}
+
+		if ((start & (PAGE_SIZE_2M - 1)) == 0 &&
+			end - start >= PAGE_SIZE_2M &&
+			(pd[pd_index] & PAGE_PRESENT) == 0) {
+			pd[pd_index] = start | leaf_flags;
+			start += PAGE_SIZE_2M;
+			continue;
+		}
+
+		block_end = (start | (PAGE_SIZE_2M - 1)) + 1;
+		if (block_end > end) {
+			block_end = end;
+		}
+
+		pt = physmap_next_table(pd, pd_index);
+		for (; start < block_end; start += PAGE_SIZE) {
+			uint64_t pt_index =
+				((PHYSMAP_BASE + start) >> 12) & 0x1ffu;
+
+			if ((pt[pt_index] & PAGE_PRESENT) == 0) {
+				pt[pt_index] = start | page_flags;
+			}
 		}
 	}
 
-	return 0;
+	if (end > physmap_limit) {
+		physmap_limit = end;
+	}
 }
 
 /**
- * page_tables_init() - Take ownership of the kernel page-table root.
+ * arch_physmap_init() - Build the direct map of RAM at PHYSMAP_BASE.
+ * @boot_info: Kernel-owned boot handoff copy with the memory map.
  *
- * The initial kernel root is a full copy of the firmware PML4. That keeps UEFI
- * identity mappings and the GOP framebuffer usable while later page-table
- * operations mutate only Tianole-owned top-level storage.
+ * Takes over the page-table root first so the direct map is installed in
+ * Tianole-owned top-level storage. Runs on firmware identity mappings; from
+ * its return on, physical memory is reached through phys_to_virt().
+ * Adjacent RAM descriptors are mapped as one range, so only the edges of
+ * real holes fall back to 4 KiB pages.
  */
-void page_tables_init(void)
+void arch_physmap_init(const boot_info_t *boot_info)
 {
-	uint64_t index;
-	uint64_t *firmware_pml4;
+	const uint8_t *map = (const uint8_t *)(uintptr_t)boot_info->memory_map;
+	int use_1g = cpu_has_1g_pages();
+	phys_addr_t run_start = 0;
+	phys_addr_t run_end = 0;
+	uint64_t offset;
 
-	if (page_tables_ready != 0) {
-		return;
+	page_tables_init();
+	vm_space_init();
+
+	for (offset = 0; offset + sizeof(boot_memory_descriptor_t) <=
+		boot_info->memory_map_size;
+		offset += boot_info->memory_descriptor_size) {
+		const boot_memory_descriptor_t *descriptor =
+			(const boot_memory_descriptor_t *)(map + offset);
+		phys_addr_t start = descriptor->physical_start;
+		phys_addr_t end =
+			start + descriptor->number_of_pages * PAGE_SIZE;
+
+		if (!physmap_ram_type(descriptor->type)) {
+			continue;
+		}
+
+		if (start == run_end) {
+			run_end = end;
+			continue;
+		}
+
+		if (run_start < run_end) {
+			physmap_map_range(run_start, run_end, use_1g);
+		}
+
+		run_start = start;
+		run_end = end;
 	}
 
-	firmware_pml4 = active_pml4();
-	for (index = 0; index < X86_PAGE_TABLE_ENTRIES; index++) {
-		kernel_pml4[index] = firmware_pml4[index];
+	if (run_start < run_end) {
+		physmap_map_range(run_start, run_end, use_1g);
 	}
 
-	load_cr3((phys_addr_t)(uintptr_t)kernel_pml4);
-	page_tables_ready = 1;
-	pr_info("kernel page table root active\n");
+	pr_info("direct map base=%p limit=%p leaf=%s\n",
+		(void *)(uintptr_t)PHYSMAP_BASE,
+		(void *)(uintptr_t)physmap_limit,
+		use_1g != 0 ? "1G" : "2M");
 }
@@ -1,20 +1,137 @@
 #include <stdint.h>
 
+#include <arch/cpuid.h>
+#include <arch/smp.h>
+
+#include <tianole/arch.h>
+#include <tianole/printk.h>
+#include <tianole/smp.h>
+
 #include "page_table.h"
 
+#define X86_CR3_NOFLUSH (1ull << 63)
+#define X86_CR4_PGE (1ull << 7)
+#define X86_CR4_PCIDE (1ull << 17)
+
+#define X86_INVPCID_ADDRESS 0u
+#define X86_INVPCID_ALL_GLOBAL 2u
+
+static int tlb_pcid;
+static int tlb_invpcid;
+
+/*
+ * Shootdown tickets. A CPU that changed kernel mappings bumps the target's
+ * request count and waits until its done count catches up. Requests from
+ * several initiators collapse into one full flush on the target.
+ */
+static uint64_t tlb_flush_requested[NR_CPUS];
+static uint64_t tlb_flush_done[NR_CPUS];
+
+static uint64_t read_cr4(void)
+{
+	uint64_t cr4;
+
+	__asm__ volatile("movq %%cr4, %0" : "=r"(cr4));
+	return cr4;
+}
+
+static void write_cr4(uint64_t cr4)
+{
+	__asm__ volatile("movq %0, %%cr4" : : "r"(cr4) : "memory");
+}
+
 /**
- * active_pml4() - Return the currently loaded top-level page table.
+ * invpcid() - Execute one INVPCID invalidation.
+ * @type: X86_INVPCID_* invalidation type.
+ * @pcid: Target PCID for address and context invalidations.
+ * @virt: Target address for address invalidations.
+ */
+static void invpcid(uint64_t type, uint64_t pcid, virt_addr_t virt)
+{
+	struct {
+		uint64_t pcid;
+		uint64_t virt;
+	} descriptor = { pcid, virt };
+
+	__asm__ volatile("invpcid %0, %1"
+		:
+		: "m"(descriptor), "r"(type)
+		: "memory");
+}
+
+/**
+ * tlb_init() - Enable global pages and, when present, PCIDs.
  *
- * Return: Virtual address of the active PML4, derived from CR3. Early boot
- * still relies on identity mappings established by firmware and then copied
- * into the Tianole-owned root.
+ * Global pages keep shared kernel translations across CR3 switches. PCIDs
+ * additionally tag every other translation with its address space, so a
+ * switch need not drop them. Must run with PCID 0 loaded in CR3.
  */
-uint64_t *active_pml4(void)
+void tlb_init(void)
+{
+	struct cpuid_regs regs;
+	uint64_t cr4 = read_cr4() | X86_CR4_PGE;
+
+	cpuid(X86_CPUID_FEATURES, 0, &regs);
+	tlb_pcid = (regs.ecx & X86_CPUID_ECX_PCID) != 0;
+	if (tlb_pcid != 0 &&
+		cpuid_max_leaf(0) >= X86_CPUID_EXTENDED_FEATURES) {
+		cpuid(X86_CPUID_EXTENDED_FEATURES, 0, &regs);
+		tlb_invpcid = (regs.ebx & X86_CPUID_EBX_INVPCID) != 0;
+	}
+
+	if (tlb_pcid != 0) {
+		cr4 |= X86_CR4_PCIDE;
+	}
+
+	write_cr4(cr4);
+	pr_info("tlb global pages on pcid=%s invpcid=%s\n",
+		tlb_pcid != 0 ? "on" : "off",
+		tlb_invpcid != 0 ? "on" : "off");
+}
+
+void tlb_init_ap(void)
+{
+	uint64_t cr4 = read_cr4() | X86_CR4_PGE;
+
+	if (tlb_pcid != 0) {
+		cr4 |= X86_CR4_PCIDE;
+	}
+
+	write_cr4(cr4);
+}
+
+int tlb_pcid_enabled(void)
+{
+	return tlb_pcid;
+}
+
+int tlb_invpcid_enabled(void)
+{
+	return tlb_invpcid;
+}
+
+/**
+ * read_cr3() - Return the physical address of the loaded top-level table.
+ *
+ * Return: CR3 with control bits masked off.
+ */
+phys_addr_t read_cr3(void)
 {
 	uint64_t cr3;
 
 	__asm__ volatile("movq %%cr3, %0" : "=r"(cr3));
-	return (uint64_t *)(uintptr_t)(cr3 & X86_PAGE_MASK);
+	return cr3 & X86_PAGE_MASK;
+}
+
+/**
+ * active_pml4() - Return the currently loaded top-level page table.
+ *
+ * Return: Direct-map address of the active PML4, derived from CR3. Only
+ * valid once arch_physmap_init() has built the direct map.
+ */
+uint64_t *active_pml4(void)
+{
+	return phys_to_virt(read_cr3());
 }
 
 /**
@@ -26,6 +143,103 @@ void flush_tlb_page(virt_addr_t virt)
 	__asm__ volatile("invlpg (%0)" : : "r"((uintptr_t)virt) : "memory");
 }
 
+/**
+ * flush_tlb_all() - Invalidate every translation in the local TLB.
+ *
+ * Kernel mappings are global, so a CR3 reload is not enough. INVPCID drops
+ * global and tagged entries of every PCID in one instruction; without it,
+ * toggling CR4.PGE has the same effect.
+ */
+void flush_tlb_all(void)
+{
+	uint64_t cr4;
+	uint64_t cr3;
+
+	if (tlb_invpcid != 0) {
+		invpcid(X86_INVPCID_ALL_GLOBAL, 0, 0);
+		return;
+	}
+
+	cr4 = read_cr4();
+	if ((cr4 & X86_CR4_PGE) != 0) {
+		write_cr4(cr4 & ~X86_CR4_PGE);
+		write_cr4(cr4);
+		return;
+	}
+
+	__asm__ volatile("movq %%cr3, %0\n\tmovq %0, %%cr3"
+		: "=r"(cr3)
+		:
+		: "memory");
+}
+
+void tlb_flush_pending(void)
+{
+	uint32_t cpu = smp_processor_id();
+	uint64_t requested =
+		__atomic_load_n(&tlb_flush_requested[cpu], __ATOMIC_ACQUIRE);
+
+	if (requested == tlb_flush_done[cpu]) {
+		return;
+	}
+
+	flush_tlb_all();
+	__atomic_store_n(&tlb_flush_done[cpu], requested, __ATOMIC_RELEASE);
+}
+
+/**
+ * flush_tlb_others() - Flush the TLB of every other online CPU.
+ *
+ * Called after kernel mappings were removed or narrowed and the local TLB
+ * was flushed. Returns once every other CPU has flushed; a CPU spinning
+ * with interrupts off answers from arch_cpu_relax(). A no-op until the
+ * application processors are up.
+ */
+void flush_tlb_others(void)
+{
+	uint64_t wanted[NR_CPUS];
+	uint64_t flags;
+	uint32_t self;
+	uint32_t cpu;
+
+	if (num_online_cpus() == 1) {
+		return;
+	}
+
+	flags = arch_irq_save();
+	self = smp_processor_id();
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		wanted[cpu] = 0;
+		if (cpu == self || !cpu_online(cpu)) {
+			continue;
+		}
+
+		wanted[cpu] = __atomic_add_fetch(
+			&tlb_flush_requested[cpu], 1, __ATOMIC_SEQ_CST);
+		smp_send_tlb_flush(cpu);
+	}
+
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		while (__atomic_load_n(&tlb_flush_done[cpu], __ATOMIC_ACQUIRE) <
+			wanted[cpu]) {
+			arch_cpu_relax();
+		}
+	}
+	arch_irq_restore(flags);
+}
+
+/**
+ * flush_tlb_pcid_page() - Invalidate one page of a PCID that is not loaded.
+ * @pcid: Address-space tag whose translation changed.
+ * @virt: Virtual address whose mapping changed.
+ *
+ * Only valid when tlb_invpcid_enabled() reports INVPCID support.
+ */
+void flush_tlb_pcid_page(uint16_t pcid, virt_addr_t virt)
+{
+	invpcid(X86_INVPCID_ADDRESS, pcid, virt);
+}
+
 /**
  * load_cr3() - Load a new top-level x86 page table.
  * @root: Physical address of the PML4 page to load into CR3.
@@ -37,3 +251,23 @@ void load_cr3(phys_addr_t root)
 {
 	__asm__ volatile("movq %0, %%cr3" : : "r"(root) : "memory");
 }
+
+/**
+ * load_cr3_pcid() - Load a page-table root tagged with a PCID.
+ * @root: Physical address of the PML4 page.
+ * @pcid: Address-space tag for translations created under @root.
+ * @preserve: Non-zero to keep @pcid's cached translations.
+ *
+ * With @preserve set the no-flush bit is written, so switching back to a
+ * recently used address space finds its translations still cached.
+ */
+void load_cr3_pcid(phys_addr_t root, uint16_t pcid, int preserve)
+{
+	uint64_t cr3 = root | pcid;
+
+	if (preserve != 0) {
+		cr3 |= X86_CR3_NOFLUSH;
+	}
+
+	load_cr3(cr3);
+}
@@ -0,0 +1,345 @@
+#include <stdint.h>
+
+#include <arch/smp.h>
+
+#include <tianole/arch.h>
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/smp.h>
+#include <tianole/spinlock.h>
+
+#include "page_table.h"
+
+#define PCID_MAP_WORDS (X86_PCID_COUNT / 64u)
+
+/**
+ * struct vm_space - One x86 address space.
+ * @pml4: Physical address of the space's top-level table.
+ * @pcid: Tag of the space's TLB entries; valid in @pcid_generation only.
+ * @pcid_generation: PCID generation @pcid was assigned in, 0 for none.
+ * @stale: Set when a translation changed while the space was not loaded and
+ *         could not be invalidated directly; the next switch flushes.
+ * @next: Next space on the list kept in sync with kernel top-level entries.
+ *
+ * The kernel half of every root points at the same lower-level tables, so
+ * kernel mappings are shared. Lower-half entries copied from the kernel root
+ * at creation are shared as well; other lower-half slots are private.
+ */
+struct vm_space {
+	phys_addr_t pml4;
+	uint16_t pcid;
+	uint64_t pcid_generation;
+	int stale;
+	struct vm_space *next;
+};
+
+static struct vm_space kernel_vm_space;
+static struct vm_space *space_list;
+static struct spinlock vm_space_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * PCIDs are recycled by generation. A space keeps its PCID until every tag
+ * has been handed out; then the generation advances, every CPU's TLB is
+ * flushed once, and each space draws a fresh tag on its next switch.
+ */
+static uint64_t pcid_map[PCID_MAP_WORDS];
+static uint64_t pcid_generation = 1;
+static uint32_t pcid_next = 1;
+static int pcid_preserve = 1;
+
+static uint64_t *root_table(const struct vm_space *space)
+{
+	return phys_to_virt(space->pml4);
+}
+
+/* Callers keep interrupts disabled so they cannot change CPUs. */
+static struct x86_cpu *this_cpu(void)
+{
+	return &x86_cpus[smp_processor_id()];
+}
+
+static int pcid_test_and_set(uint32_t pcid)
+{
+	uint64_t bit = 1ull << (pcid % 64u);
+
+	if ((pcid_map[pcid / 64u] & bit) != 0) {
+		return 1;
+	}
+
+	pcid_map[pcid / 64u] |= bit;
+	return 0;
+}
+
+static void pcid_release(struct vm_space *space)
+{
+	if (space->pcid_generation == pcid_generation) {
+		pcid_map[space->pcid / 64u] &= ~(1ull << (space->pcid % 64u));
+	}
+
+	space->pcid_generation = 0;
+}
+
+/**
+ * pcid_assign() - Give a space a PCID valid in the current generation.
+ * @space: Space about to be loaded.
+ *
+ * The caller must load the space without the no-flush bit, because the
+ * tag may still have translations cached from its previous owner.
+ *
+ * Starting a new generation hands out tags that other CPUs may still hold
+ * translations for, so every CPU flushes before any tag is reused.
+ */
+static void pcid_assign(struct vm_space *space)
+{
+	uint32_t tries;
+	uint64_t index;
+
+	for (tries = 1; tries < X86_PCID_COUNT; tries++) {
+		uint32_t pcid = pcid_next;
+
+		pcid_next = pcid_next + 1 == X86_PCID_COUNT ? 1 : pcid_next + 1;
+		if (pcid_test_and_set(pcid) == 0) {
+			space->pcid = (uint16_t)pcid;
+			space->pcid_generation = pcid_generation;
+			return;
+		}
+	}
+
+	pcid_generation++;
+	for (index = 0; index < PCID_MAP_WORDS; index++) {
+		pcid_map[index] = 0;
+	}
+	pcid_map[0] = 1;
+	flush_tlb_all();
+	flush_tlb_others();
+
+	pcid_test_and_set(1);
+	pcid_next = 2;
+	space->pcid = 1;
+	space->pcid_generation = pcid_generation;
+}
+
+void vm_space_init(void)
+{
+	uint32_t cpu;
+
+	tlb_init();
+
+	kernel_vm_space.pml4 = read_cr3();
+	kernel_vm_space.pcid = 0;
+	kernel_vm_space.pcid_generation = 0;
+	kernel_vm_space.next = 0;
+	pcid_map[0] = 1;
+
+	/* Application processors start on the kernel root with PCID 0. */
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		x86_cpus[cpu].current_space = &kernel_vm_space;
+		x86_cpus[cpu].pcid_generation = 0;
+	}
+}
+
+void vm_space_sync_kernel_entry(uint64_t index, uint64_t entry)
+{
+	struct vm_space *space;
+	uint64_t flags;
+
+	spin_lock_irqsave(&vm_space_lock, &flags);
+	root_table(&kernel_vm_space)[index] = entry;
+	for (space = space_list; space != 0; space = space->next) {
+		root_table(space)[index] = entry;
+	}
+	spin_unlock_irqrestore(&vm_space_lock, flags);
+}
+
+void vm_space_set_pcid_preserve(int enable)
+{
+	pcid_preserve = enable;
+}
+
+struct vm_space *vm_space_kernel(void)
+{
+	return &kernel_vm_space;
+}
+
+struct vm_space *vm_space_current(void)
+{
+	struct vm_space *space;
+	uint64_t flags;
+
+	flags = arch_irq_save();
+	space = this_cpu()->current_space;
+	arch_irq_restore(flags);
+	return space;
+}
+
+struct vm_space *vm_space_create(void)
+{
+	struct vm_space *space = kmalloc(sizeof(*space));
+	const uint64_t *kernel_root = root_table(&kernel_vm_space);
+	uint64_t *root;
+	uint64_t index;
+	uint64_t flags;
+
+	if (space == 0) {
+		return 0;
+	}
+
+	space->pml4 = alloc_table_page();
+	if (space->pml4 == 0) {
+		kfree(space);
+		return 0;
+	}
+
+	space->pcid = 0;
+	space->pcid_generation = 0;
+	space->stale = 0;
+
+	root = root_table(space);
+	spin_lock_irqsave(&vm_space_lock, &flags);
+	for (index = 0; index < X86_PAGE_TABLE_ENTRIES; index++) {
+		root[index] = kernel_root[index];
+	}
+	space->next = space_list;
+	space_list = space;
+	spin_unlock_irqrestore(&vm_space_lock, flags);
+
+	return space;
+}
+
+/**
+ * free_table_tree() - Free a private page-table page and the tables below.
+ * @table: Physical address of the table page.
+ * @shift: Level shift of the entries in @table.
+ *
+ * Leaf frames are left alone; their owner must have unmapped them.
+ */
+static void free_table_tree(phys_addr_t table, unsigned int shift)
+{
+	const uint64_t *entries = phys_to_virt(table);
+	uint64_t index;
+
+	if (shift > X86_PT_SHIFT) {
+		for (index = 0; index < X86_PAGE_TABLE_ENTRIES; index++) {
+			if ((entries[index] & PAGE_PRESENT) == 0 ||
+				(entries[index] & X86_PAGE_SIZE_FLAG) != 0) {
+				continue;
+			}
+
+			free_table_tree(entries[index] & X86_PAGE_MASK,
+				shift - X86_LEVEL_BITS);
+		}
+	}
+
+	free_table_page(table);
+}
+
+void vm_space_destroy(struct vm_space *space)
+{
+	const uint64_t *kernel_root = root_table(&kernel_vm_space);
+	struct vm_space **link;
+	uint64_t *root;
+	uint64_t index;
+	uint64_t flags;
+
+	if (space == 0) {
+		return;
+	}
+
+	if (space == &kernel_vm_space) {
+		panic("vm_space_destroy of an active address space");
+	}
+
+	spin_lock_irqsave(&vm_space_lock, &flags);
+	for (index = 0; index < NR_CPUS; index++) {
+		if (x86_cpus[index].current_space == space) {
+			panic("vm_space_destroy of an active address space");
+		}
+	}
+
+	link = &space_list;
+	while (*link != space) {
+		link = &(*link)->next;
+	}
+	*link = space->next;
+	pcid_release(space);
+	spin_unlock_irqrestore(&vm_space_lock, flags);
+
+	root = root_table(space);
+	for (index = 0; index < X86_KERNEL_PML4_FIRST; index++) {
+		if ((root[index] & PAGE_PRESENT) != 0 &&
+			root[index] != kernel_root[index]) {
+			free_table_tree(root[index] & X86_PAGE_MASK,
+				X86_PDPT_SHIFT);
+		}
+	}
+
+	free_table_page(space->pml4);
+	kfree(space);
+}
+
+void vm_space_switch(struct vm_space *space)
+{
+	struct x86_cpu *cpu;
+	uint64_t flags;
+	int preserve;
+
+	spin_lock_irqsave(&vm_space_lock, &flags);
+	cpu = this_cpu();
+	if (space == cpu->current_space) {
+		spin_unlock_irqrestore(&vm_space_lock, flags);
+		return;
+	}
+
+	if (tlb_pcid_enabled() == 0) {
+		load_cr3(space->pml4);
+		cpu->current_space = space;
+		spin_unlock_irqrestore(&vm_space_lock, flags);
+		return;
+	}
+
+	/*
+	 * A tag from before the last generation change kept caching
+	 * translations here after the shootdown; drop them before the tag
+	 * can be handed to another space.
+	 */
+	if (cpu->pcid_generation != 0 &&
+		cpu->pcid_generation != pcid_generation) {
+		flush_tlb_all();
+	}
+
+	preserve = pcid_preserve != 0 && space->stale == 0;
+	if (space != &kernel_vm_space &&
+		space->pcid_generation != pcid_generation) {
+		pcid_assign(space);
+		preserve = 0;
+	}
+
+	space->stale = 0;
+	load_cr3_pcid(space->pml4, space->pcid, preserve);
+	cpu->current_space = space;
+	cpu->pcid_generation = space->pcid_generation;
+	spin_unlock_irqrestore(&vm_space_lock, flags);
+}
+
+void vm_space_flush_page(struct vm_space *space, virt_addr_t virt)
+{
+	if (space == vm_space_current()) {
+		flush_tlb_page(virt);
+		return;
+	}
+
+	if (tlb_pcid_enabled() == 0) {
+		return;
+	}
+
+	if (space != &kernel_vm_space &&
+		space->pcid_generation != pcid_generation) {
+		return;
+	}
+
+	if (tlb_invpcid_enabled() != 0) {
+		flush_tlb_pcid_page(space->pcid, virt);
+	} else {
+		space->stale = 1;
+	}
+}
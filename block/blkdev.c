@@ -0,0 +1,118 @@
+#include <stdint.h>
+
+#include <tianole/blkdev.h>
+#include <tianole/errno.h>
+#include <tianole/spinlock.h>
+
+static struct block_device *block_devices;
+static struct spinlock block_devices_lock = SPINLOCK_INITIALIZER;
+
+static int block_name_equal(const char *left, const char *right)
+{
+	while (*left != '\0' && *left == *right) {
+		left++;
+		right++;
+	}
+
+	return *left == *right;
+}
+
+static struct block_device *find_locked(const char *name)
+{
+	struct block_device *dev;
+
+	for (dev = block_devices; dev != 0; dev = dev->next) {
+		if (block_name_equal(dev->name, name)) {
+			return dev;
+		}
+	}
+
+	return 0;
+}
+
+int block_device_register(struct block_device *dev)
+{
+	uint64_t flags;
+
+	if (dev == 0 || dev->name == 0 || dev->ops == 0 ||
+		dev->block_size == 0 || dev->ops->read == 0 ||
+		dev->ops->write == 0) {
+		return -EINVAL;
+	}
+
+	spin_lock_irqsave(&block_devices_lock, &flags);
+	if (find_locked(dev->name) != 0) {
+		spin_unlock_irqrestore(&block_devices_lock, flags);
+		return -EEXIST;
+	}
+
+	dev->next = block_devices;
+	block_devices = dev;
+	spin_unlock_irqrestore(&block_devices_lock, flags);
+	return 0;
+}
+
+void block_device_unregister(struct block_device *dev)
+{
+	struct block_device **link;
+	uint64_t flags;
+
+	spin_lock_irqsave(&block_devices_lock, &flags);
+	link = &block_devices;
+	while (*link != 0 && *link != dev) {
+		link = &(*link)->next;
+	}
+
+	if (*link != 0) {
+		*link = dev->next;
+	}
+	spin_unlock_irqrestore(&block_devices_lock, flags);
+}
+
+struct block_device *block_device_find(const char *name)
+{
+	struct block_device *dev;
+	uint64_t flags;
+
+	if (name == 0) {
+		return 0;
+	}
+
+	spin_lock_irqsave(&block_devices_lock, &flags);
+	dev = find_locked(name);
+	spin_unlock_irqrestore(&block_devices_lock, flags);
+	return dev;
+}
+
+int block_read(struct block_device *dev, uint64_t block, void *buffer)
+{
+	if (dev == 0 || buffer == 0 || block >= dev->nr_blocks) {
+		return -EINVAL;
+	}
+
+	return dev->ops->read(dev, block, buffer);
+}
+
+int block_write(struct block_device *dev, uint64_t block,
+	const void *buffer)
+{
+	if (dev == 0 || buffer == 0 || block >= dev->nr_blocks) {
+		return -EINVAL;
+	}
+
+	return dev->ops->write(dev, block, buffer);
+}
+
+int block_discard(struct block_device *dev, uint64_t block, uint64_t count)
+{
+	if (dev == 0 || block >= dev->nr_blocks ||
+		count > dev->nr_blocks - block) {
+		return -EINVAL;
+	}
+
+	if (count == 0 || dev->ops->discard == 0) {
+		return 0;
+	}
+
+	return dev->ops->discard(dev, block, count);
+}
@@ -0,0 +1,576 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tianole/blkdev.h>
+#include <tianole/errno.h>
+#include <tianole/lz4.h>
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/printk.h>
+#include <tianole/slab.h>
+#include <tianole/spinlock.h>
+#include <tianole/zram.h>
+
+/*
+ * Compressed pages go to slab caches in ZRAM_CLASS_STEP increments, which
+ * bounds rounding waste below one step. Anything that does not compress
+ * into the largest class is stored as a raw page instead.
+ */
+#define ZRAM_CLASS_STEP 256u
+#define ZRAM_CLASS_COUNT 12u
+#define ZRAM_MAX_COMPRESSED (ZRAM_CLASS_STEP * ZRAM_CLASS_COUNT)
+#define ZRAM0_PAGES 8192u
+
+/**
+ * enum zram_slot_flags - How a slot's data is stored.
+ * @ZRAM_SAME: Page is one repeated word, kept in zram_slot::fill.
+ * @ZRAM_HUGE: Page is stored uncompressed in a whole page.
+ */
+enum zram_slot_flags {
+	ZRAM_SAME = 1u << 0,
+	ZRAM_HUGE = 1u << 1,
+};
+
+/**
+ * struct zram_slot - Storage of one device page.
+ * @handle: Compressed object or raw page; NULL for empty and same slots.
+ * @fill: Repeated word of a ZRAM_SAME page.
+ * @size: Compressed bytes in @handle.
+ * @flags: Bitmask of enum zram_slot_flags.
+ *
+ * A slot with no flags and no handle has never been written, or was
+ * discarded, and reads as zero.
+ */
+struct zram_slot {
+	union {
+		void *handle;
+		uint64_t fill;
+	};
+	uint16_t size;
+	uint8_t flags;
+};
+
+/**
+ * struct zram_stream - Scratch memory of one request in flight.
+ * @buffer: Compressed data, ZRAM_MAX_COMPRESSED bytes.
+ * @wrkmem: LZ4 match finder scratch.
+ * @next: Next idle stream of the device.
+ */
+struct zram_stream {
+	uint8_t *buffer;
+	void *wrkmem;
+	struct zram_stream *next;
+};
+
+/**
+ * struct zram - One compressed RAM device.
+ * @dev: Registered block device.
+ * @table: One slot per page.
+ * @lock: Protects @table, @streams and @stats. Never held across LZ4.
+ * @streams: Idle streams. A request takes one for its whole duration, so
+ *           concurrent requests compress in parallel.
+ * @stats: Counters returned by zram_get_stats().
+ */
+struct zram {
+	struct block_device dev;
+	struct zram_slot *table;
+	struct spinlock lock;
+	struct zram_stream *streams;
+	struct zram_stats stats;
+};
+
+static const char *const zram_class_names[ZRAM_CLASS_COUNT] = {
+	"zram-256", "zram-512", "zram-768", "zram-1024",
+	"zram-1280", "zram-1536", "zram-1792", "zram-2048",
+	"zram-2304", "zram-2560", "zram-2816", "zram-3072",
+};
+
+static struct kmem_cache *zram_classes[ZRAM_CLASS_COUNT];
+static const struct block_device_ops zram_ops;
+
+static struct zram *to_zram(struct block_device *dev)
+{
+	return dev->private_data;
+}
+
+static int zram_classes_init(void)
+{
+	unsigned int index;
+
+	for (index = 0; index < ZRAM_CLASS_COUNT; index++) {
+		if (zram_classes[index] != 0) {
+			continue;
+		}
+
+		zram_classes[index] = kmem_cache_create(zram_class_names[index],
+			ZRAM_CLASS_STEP * (index + 1),
+			0,
+			0);
+		if (zram_classes[index] == 0) {
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static unsigned int zram_class_for(uint32_t size)
+{
+	return (size + ZRAM_CLASS_STEP - 1) / ZRAM_CLASS_STEP - 1;
+}
+
+/**
+ * page_same_fill() - Test whether a page is one repeated 64-bit word.
+ * @page: PAGE_SIZE bytes.
+ * @fill: Receives the word.
+ *
+ * Return: Non-zero if every word equals the first.
+ */
+static int page_same_fill(const void *page, uint64_t *fill)
+{
+	const uint64_t *words = page;
+	uint64_t index;
+
+	for (index = 1; index < PAGE_SIZE / sizeof(uint64_t); index++) {
+		if (words[index] != words[0]) {
+			return 0;
+		}
+	}
+
+	*fill = words[0];
+	return 1;
+}
+
+static void copy_bytes(void *dst, const void *src, uint64_t size)
+{
+	const uint8_t *from = src;
+	uint8_t *to = dst;
+	uint64_t index;
+
+	for (index = 0; index < size; index++) {
+		to[index] = from[index];
+	}
+}
+
+static void stream_free(struct zram_stream *stream)
+{
+	kfree(stream->wrkmem);
+	kfree(stream->buffer);
+	kfree(stream);
+}
+
+static struct zram_stream *stream_alloc(void)
+{
+	struct zram_stream *stream = kmalloc(sizeof(*stream));
+
+	if (stream == 0) {
+		return 0;
+	}
+
+	stream->buffer = kmalloc(ZRAM_MAX_COMPRESSED);
+	stream->wrkmem = kmalloc(LZ4_MEM_COMPRESS);
+	stream->next = 0;
+	if (stream->buffer == 0 || stream->wrkmem == 0) {
+		stream_free(stream);
+		return 0;
+	}
+
+	return stream;
+}
+
+/**
+ * stream_get() - Take an idle stream, or make one if all are busy.
+ * @zram: Device, lock not held.
+ *
+ * A device ends up with as many streams as it ever had requests in flight
+ * at once.
+ *
+ * Return: Stream owned by the caller, or NULL when memory is exhausted.
+ */
+static struct zram_stream *stream_get(struct zram *zram)
+{
+	struct zram_stream *stream;
+	uint64_t flags;
+
+	spin_lock_irqsave(&zram->lock, &flags);
+	stream = zram->streams;
+	if (stream != 0) {
+		zram->streams = stream->next;
+	}
+	spin_unlock_irqrestore(&zram->lock, flags);
+
+	return stream != 0 ? stream : stream_alloc();
+}
+
+static void stream_put_locked(struct zram *zram, struct zram_stream *stream)
+{
+	stream->next = zram->streams;
+	zram->streams = stream;
+}
+
+/**
+ * slot_unaccount() - Drop a slot's storage from the device counters.
+ * @zram: Device, lock held.
+ * @slot: Slot whose storage is going away.
+ */
+static void slot_unaccount(struct zram *zram, const struct zram_slot *slot)
+{
+	struct zram_stats *stats = &zram->stats;
+
+	if ((slot->flags & ZRAM_SAME) != 0) {
+		stats->same_pages--;
+		stats->stored_pages--;
+	} else if ((slot->flags & ZRAM_HUGE) != 0) {
+		stats->huge_pages--;
+		stats->stored_pages--;
+		stats->mem_used_bytes -= PAGE_SIZE;
+	} else if (slot->handle != 0) {
+		stats->stored_pages--;
+		stats->compr_bytes -= slot->size;
+		stats->mem_used_bytes -= ZRAM_CLASS_STEP *
+			(zram_class_for(slot->size) + 1);
+	}
+}
+
+/**
+ * slot_release() - Free a slot's storage.
+ * @slot: Slot no longer reachable from the table, or one whose device
+ *        lock is held.
+ */
+static void slot_release(struct zram_slot *slot)
+{
+	if ((slot->flags & ZRAM_HUGE) != 0) {
+		free_page(physmap_to_phys(slot->handle));
+	} else if ((slot->flags & ZRAM_SAME) == 0 && slot->handle != 0) {
+		kmem_cache_free(zram_classes[zram_class_for(slot->size)],
+			slot->handle);
+	}
+
+	slot->handle = 0;
+	slot->size = 0;
+	slot->flags = 0;
+}
+
+/**
+ * slot_store() - Build the storage for one page.
+ * @stream: Scratch memory owned by the caller.
+ * @buffer: Page contents.
+ * @slot: Receives the new storage; not yet accounted.
+ *
+ * Runs without the device lock; the new storage is private until the
+ * caller swaps it into the table.
+ *
+ * Return: 0 or -ENOMEM.
+ */
+static int slot_store(struct zram_stream *stream, const void *buffer,
+	struct zram_slot *slot)
+{
+	phys_addr_t page;
+	int size;
+
+	slot->size = 0;
+	if (page_same_fill(buffer, &slot->fill)) {
+		slot->flags = ZRAM_SAME;
+		return 0;
+	}
+
+	size = lz4_compress(buffer, PAGE_SIZE, stream->buffer,
+		ZRAM_MAX_COMPRESSED, stream->wrkmem);
+	if (size > 0) {
+		slot->handle = kmem_cache_alloc(
+			zram_classes[zram_class_for((uint32_t)size)]);
+		if (slot->handle == 0) {
+			return -ENOMEM;
+		}
+
+		copy_bytes(slot->handle, stream->buffer, (uint64_t)size);
+		slot->size = (uint16_t)size;
+		slot->flags = 0;
+		return 0;
+	}
+
+	page = alloc_page();
+	if (page == 0) {
+		return -ENOMEM;
+	}
+
+	slot->handle = phys_to_virt(page);
+	copy_bytes(slot->handle, buffer, PAGE_SIZE);
+	slot->flags = ZRAM_HUGE;
+	return 0;
+}
+
+static void slot_account(struct zram *zram, const struct zram_slot *slot)
+{
+	struct zram_stats *stats = &zram->stats;
+
+	stats->stored_pages++;
+	if ((slot->flags & ZRAM_SAME) != 0) {
+		stats->same_pages++;
+	} else if ((slot->flags & ZRAM_HUGE) != 0) {
+		stats->huge_pages++;
+		stats->mem_used_bytes += PAGE_SIZE;
+	} else {
+		stats->compr_bytes += slot->size;
+		stats->mem_used_bytes += ZRAM_CLASS_STEP *
+			(zram_class_for(slot->size) + 1);
+	}
+}
+
+/**
+ * zram_read() - Read one page back.
+ * @dev: zram device.
+ * @block: Page index.
+ * @buffer: Receives the page.
+ *
+ * Compressed bytes are copied out under the lock, so a concurrent write
+ * cannot free them mid-read, and decompressed after it is dropped.
+ *
+ * Return: 0, -ENOMEM, or -EIO for corrupt compressed data.
+ */
+static int zram_read(struct block_device *dev, uint64_t block, void *buffer)
+{
+	struct zram *zram = to_zram(dev);
+	struct zram_stream *stream = stream_get(zram);
+	struct zram_slot slot;
+	uint64_t *words = buffer;
+	uint64_t flags;
+	uint64_t index;
+	int ret = 0;
+
+	if (stream == 0) {
+		return -ENOMEM;
+	}
+
+	spin_lock_irqsave(&zram->lock, &flags);
+	slot = zram->table[block];
+	if ((slot.flags & ZRAM_HUGE) != 0) {
+		copy_bytes(buffer, slot.handle, PAGE_SIZE);
+	} else if ((slot.flags & ZRAM_SAME) == 0 && slot.handle != 0) {
+		copy_bytes(stream->buffer, slot.handle, slot.size);
+	}
+	spin_unlock_irqrestore(&zram->lock, flags);
+
+	if ((slot.flags & ZRAM_SAME) != 0 || slot.handle == 0) {
+		uint64_t fill = (slot.flags & ZRAM_SAME) != 0 ? slot.fill : 0;
+
+		for (index = 0; index < PAGE_SIZE / sizeof(uint64_t); index++) {
+			words[index] = fill;
+		}
+	} else if ((slot.flags & ZRAM_HUGE) == 0 &&
+		lz4_decompress(stream->buffer, slot.size, buffer,
+			PAGE_SIZE) != (int)PAGE_SIZE) {
+		ret = -EIO;
+	}
+
+	spin_lock_irqsave(&zram->lock, &flags);
+	stream_put_locked(zram, stream);
+	if (ret == 0) {
+		zram->stats.reads++;
+	}
+	spin_unlock_irqrestore(&zram->lock, flags);
+
+	return ret;
+}
+
+/**
+ * zram_write() - Store one page, replacing what the slot held.
+ * @dev: zram device.
+ * @block: Page index.
+ * @buffer: Page contents.
+ *
+ * The page is compressed and its storage allocated without the lock, which
+ * is then taken only to swap the slot. The old storage is only released
+ * once the new one exists, so a failed write leaves the previous contents
+ * readable.
+ *
+ * Return: 0 or -ENOMEM.
+ */
+static int zram_write(struct block_device *dev, uint64_t block,
+	const void *buffer)
+{
+	struct zram *zram = to_zram(dev);
+	struct zram_stream *stream = stream_get(zram);
+	struct zram_slot slot;
+	struct zram_slot old;
+	uint64_t flags;
+	int ret;
+
+	if (stream == 0) {
+		return -ENOMEM;
+	}
+
+	ret = slot_store(stream, buffer, &slot);
+
+	spin_lock_irqsave(&zram->lock, &flags);
+	stream_put_locked(zram, stream);
+	if (ret == 0) {
+		old = zram->table[block];
+		zram->table[block] = slot;
+		slot_unaccount(zram, &old);
+		slot_account(zram, &slot);
+		zram->stats.writes++;
+	}
+	spin_unlock_irqrestore(&zram->lock, flags);
+
+	if (ret == 0) {
+		slot_release(&old);
+	}
+
+	return ret;
+}
+
+static int zram_discard(struct block_device *dev, uint64_t block,
+	uint64_t count)
+{
+	struct zram *zram = to_zram(dev);
+	uint64_t flags;
+	uint64_t index;
+
+	spin_lock_irqsave(&zram->lock, &flags);
+	for (index = block; index < block + count; index++) {
+		if (zram->table[index].flags != 0 ||
+			zram->table[index].handle != 0) {
+			slot_unaccount(zram, &zram->table[index]);
+			slot_release(&zram->table[index]);
+			zram->stats.discards++;
+		}
+	}
+	spin_unlock_irqrestore(&zram->lock, flags);
+
+	return 0;
+}
+
+static const struct block_device_ops zram_ops = {
+	.read = zram_read,
+	.write = zram_write,
+	.discard = zram_discard,
+};
+
+static void zram_free(struct zram *zram)
+{
+	while (zram->streams != 0) {
+		struct zram_stream *stream = zram->streams;
+
+		zram->streams = stream->next;
+		stream_free(stream);
+	}
+
+	kfree(zram->table);
+	kfree(zram);
+}
+
+struct block_device *zram_create(const char *name, uint64_t nr_pages)
+{
+	struct zram *zram;
+	uint64_t index;
+
+	if (name == 0 || nr_pages == 0 ||
+		nr_pages > UINT64_MAX / sizeof(struct zram_slot) ||
+		zram_classes_init() != 0) {
+		return 0;
+	}
+
+	zram = kmalloc(sizeof(*zram));
+	if (zram == 0) {
+		return 0;
+	}
+
+	zram->table = kmalloc(nr_pages * sizeof(*zram->table));
+	/* Made up front, so running out of memory fails creation instead. */
+	zram->streams = stream_alloc();
+	if (zram->table == 0 || zram->streams == 0) {
+		zram_free(zram);
+		return 0;
+	}
+
+	for (index = 0; index < nr_pages; index++) {
+		zram->table[index].handle = 0;
+		zram->table[index].size = 0;
+		zram->table[index].flags = 0;
+	}
+
+	zram->lock = (struct spinlock)SPINLOCK_INITIALIZER;
+	zram->stats = (struct zram_stats){ .nr_pages = nr_pages };
+	zram->dev.name = name;
+	zram->dev.block_size = PAGE_SIZE;
+	zram->dev.nr_blocks = nr_pages;
+	zram->dev.ops = &zram_ops;
+	zram->dev.private_data = zram;
+	if (block_device_register(&zram->dev) != 0) {
+		zram_free(zram);
+		return 0;
+	}
+
+	return &zram->dev;
+}
+
+void zram_destroy(struct block_device *dev)
+{
+	struct zram *zram;
+
+	if (dev == 0 || dev->ops != &zram_ops) {
+		return;
+	}
+
+	zram = to_zram(dev);
+	block_device_unregister(dev);
+	(void)zram_discard(dev, 0, dev->nr_blocks);
+	zram_free(zram);
+}
+
+int zram_get_stats(struct block_device *dev, struct zram_stats *stats)
+{
+	struct zram *zram;
+	uint64_t flags;
+
+	if (dev == 0 || stats == 0 || dev->ops != &zram_ops) {
+		return -EINVAL;
+	}
+
+	zram = to_zram(dev);
+	spin_lock_irqsave(&zram->lock, &flags);
+	*stats = zram->stats;
+	spin_unlock_irqrestore(&zram->lock, flags);
+	return 0;
+}
+
+void zram_report(struct block_device *dev)
+{
+	struct zram_stats stats;
+	uint64_t ratio = 0;
+
+	if (zram_get_stats(dev, &stats) != 0) {
+		return;
+	}
+
+	/* Hundredths of stored bytes per byte of memory used. */
+	if (stats.mem_used_bytes != 0) {
+		ratio = stats.stored_pages * PAGE_SIZE * 100 /
+			stats.mem_used_bytes;
+	}
+
+	pr_info("%s pages=%llu stored=%llu same=%llu huge=%llu compr=%llu "
+		"used=%llu ratio=%llu.%02llu\n",
+		dev->name,
+		(unsigned long long)stats.nr_pages,
+		(unsigned long long)stats.stored_pages,
+		(unsigned long long)stats.same_pages,
+		(unsigned long long)stats.huge_pages,
+		(unsigned long long)stats.compr_bytes,
+		(unsigned long long)stats.mem_used_bytes,
+		(unsigned long long)(ratio / 100),
+		(unsigned long long)(ratio % 100));
+}
+
+void zram_init(void)
+{
+	struct block_device *dev = zram_create("zram0", ZRAM0_PAGES);
+
+	if (dev == 0) {
+		panic("zram0 creation failed");
+	}
+
+	pr_info("zram0 initialized pages=%llu\n",
+		(unsigned long long)dev->nr_blocks);
+}
@@ -4,6 +4,7 @@
 #include <tianole/input.h>
 #include <tianole/irq.h>
 #include <tianole/keyboard.h>
+#include <tianole/mempool.h>
 #include <tianole/panic.h>
 #include <tianole/printk.h>
 #include <tianole/spinlock.h>
@@ -14,12 +15,28 @@
 #define PS2_STATUS_OUTPUT_FULL 0x01
 #define PS2_KEYBOARD_IRQ 1u
 #define PS2_RAW_QUEUE_CAPACITY 32u
+#define PS2_SPILL_BYTES 56u
+#define PS2_SPILL_RESERVE 4u
 #define PS2_SCANCODE_RELEASE 0x80u
 #define PS2_SCANCODE_EXTENDED 0xe0u
 #define PS2_SCANCODE_PAUSE 0xe1u
 #define PS2_SCANCODE_MASK 0x7fu
 #define PS2_SET1_KEYMAP_SIZE 128u
 
+/**
+ * struct ps2_spill - Overflow chunk for scancodes that missed the ring.
+ * @next: Next chunk in arrival order.
+ * @head: Next byte to decode.
+ * @count: Bytes stored in @bytes.
+ * @bytes: Raw scancodes.
+ */
+struct ps2_spill {
+	struct ps2_spill *next;
+	uint32_t head;
+	uint32_t count;
+	uint8_t bytes[PS2_SPILL_BYTES];
+};
+
 /**
  * struct ps2_keyboard - Minimal PS/2 set-1 keyboard state.
  * @lock: Protects raw scancode queue from IRQ and worker context.
@@ -28,7 +45,10 @@
  * @head: Next raw scancode to decode.
  * @tail: Next raw slot to write.
  * @count: Number of queued raw scancodes.
- * @dropped: Raw scancodes dropped because the ring was full.
+ * @spill_pool: Reserve of overflow chunks the IRQ may take without blocking.
+ * @spill_head: Oldest overflow chunk; newer than everything in @raw.
+ * @spill_tail: Overflow chunk new bytes are appended to.
+ * @dropped: Raw scancodes dropped because no overflow chunk was left.
  * @modifiers: Current modifier state snapshot.
  * @extended_pending: Non-zero after an 0xe0 scancode prefix.
  * @pause_bytes: Number of remaining Pause/Break sequence bytes to ignore.
@@ -44,6 +64,9 @@ struct ps2_keyboard {
 	uint32_t head;
 	uint32_t tail;
 	uint32_t count;
+	struct mempool *spill_pool;
+	struct ps2_spill *spill_head;
+	struct ps2_spill *spill_tail;
 	uint64_t dropped;
 	uint32_t modifiers;
 	int extended_pending;
@@ -204,21 +227,55 @@ static void ps2_update_modifier(enum input_key_code key, int pressed)
 	}
 }
 
+/**
+ * ps2_spill_pop() - Take the oldest overflow byte.
+ * @scancode: Storage for the byte.
+ * @done: Set to a chunk that was emptied and must be freed, else NULL.
+ *
+ * Called with the keyboard lock held and the ring empty.
+ *
+ * Return: Non-zero if a byte was returned.
+ */
+static int ps2_spill_pop(uint8_t *scancode, struct ps2_spill **done)
+{
+	struct ps2_spill *spill = ps2_keyboard.spill_head;
+
+	*done = 0;
+	if (spill == 0) {
+		return 0;
+	}
+
+	*scancode = spill->bytes[spill->head++];
+	if (spill->head == spill->count) {
+		ps2_keyboard.spill_head = spill->next;
+		if (ps2_keyboard.spill_tail == spill) {
+			ps2_keyboard.spill_tail = 0;
+		}
+		*done = spill;
+	}
+
+	return 1;
+}
+
 static int ps2_raw_pop(uint8_t *scancode)
 {
+	struct ps2_spill *done = 0;
 	uint64_t flags;
+	int ret = 1;
 
 	spin_lock_irqsave(&ps2_keyboard.lock, &flags);
-	if (ps2_keyboard.count == 0) {
-		spin_unlock_irqrestore(&ps2_keyboard.lock, flags);
-		return 0;
+	if (ps2_keyboard.count != 0) {
+		*scancode = ps2_keyboard.raw[ps2_keyboard.head];
+		ps2_keyboard.head = (ps2_keyboard.head + 1) %
+			PS2_RAW_QUEUE_CAPACITY;
+		ps2_keyboard.count--;
+	} else {
+		ret = ps2_spill_pop(scancode, &done);
 	}
-
-	*scancode = ps2_keyboard.raw[ps2_keyboard.head];
-	ps2_keyboard.head = (ps2_keyboard.head + 1) % PS2_RAW_QUEUE_CAPACITY;
-	ps2_keyboard.count--;
 	spin_unlock_irqrestore(&ps2_keyboard.lock, flags);
-	return 1;
+
+	mempool_free(ps2_keyboard.spill_pool, done);
+	return ret;
 }
 
 static void ps2_keyboard_work(struct work_struct *work)
@@ -267,6 +324,41 @@ static void ps2_keyboard_work(struct work_struct *work)
 	}
 }
 
+/**
+ * ps2_spill_push() - Queue a byte behind a full ring.
+ * @scancode: Byte read from the controller.
+ *
+ * Called from IRQ context with the keyboard lock held. New chunks come from
+ * the spill pool's reserve, which never maps or blocks; the workqueue tops
+ * the reserve up again afterwards.
+ *
+ * Return: 0 on success or -ENOMEM when the reserve is exhausted.
+ */
+static int ps2_spill_push(uint8_t scancode)
+{
+	struct ps2_spill *spill = ps2_keyboard.spill_tail;
+
+	if (spill == 0 || spill->count == PS2_SPILL_BYTES) {
+		spill = mempool_alloc(ps2_keyboard.spill_pool, GFP_ATOMIC);
+		if (spill == 0) {
+			return -ENOMEM;
+		}
+
+		spill->next = 0;
+		spill->head = 0;
+		spill->count = 0;
+		if (ps2_keyboard.spill_tail != 0) {
+			ps2_keyboard.spill_tail->next = spill;
+		} else {
+			ps2_keyboard.spill_head = spill;
+		}
+		ps2_keyboard.spill_tail = spill;
+	}
+
+	spill->bytes[spill->count++] = scancode;
+	return 0;
+}
+
 static void ps2_keyboard_irq(uint8_t irq, void *data)
 {
 	uint8_t status;
@@ -283,15 +375,19 @@ static void ps2_keyboard_irq(uint8_t irq, void *data)
 
 	scancode = inb(PS2_DATA_PORT);
 	spin_lock_irqsave(&ps2_keyboard.lock, &flags);
-	if (ps2_keyboard.count == PS2_RAW_QUEUE_CAPACITY) {
-		ps2_keyboard.dropped++;
-		spin_unlock_irqrestore(&ps2_keyboard.lock, flags);
-		return;
+	if (ps2_keyboard.count == PS2_RAW_QUEUE_CAPACITY ||
+		ps2_keyboard.spill_head != 0) {
+		if (ps2_spill_push(scancode) != 0) {
+			ps2_keyboard.dropped++;
+			spin_unlock_irqrestore(&ps2_keyboard.lock, flags);
+			return;
+		}
+	} else {
+		ps2_keyboard.raw[ps2_keyboard.tail] = scancode;
+		ps2_keyboard.tail = (ps2_keyboard.tail + 1) %
+			PS2_RAW_QUEUE_CAPACITY;
+		ps2_keyboard.count++;
 	}
-
-	ps2_keyboard.raw[ps2_keyboard.tail] = scancode;
-	ps2_keyboard.tail = (ps2_keyboard.tail + 1) % PS2_RAW_QUEUE_CAPACITY;
-	ps2_keyboard.count++;
 	spin_unlock_irqrestore(&ps2_keyboard.lock, flags);
 
 	(void)queue_work(&ps2_keyboard.work);
@@ -307,11 +403,19 @@ void ps2_keyboard_init(void)
 	ps2_keyboard.head = 0;
 	ps2_keyboard.tail = 0;
 	ps2_keyboard.count = 0;
+	ps2_keyboard.spill_head = 0;
+	ps2_keyboard.spill_tail = 0;
 	ps2_keyboard.dropped = 0;
 	ps2_keyboard.extended_pending = 0;
 	ps2_keyboard.pause_bytes = 0;
 	ps2_keyboard.modifiers = 0;
 	work_init(&ps2_keyboard.work, ps2_keyboard_work, 0);
+	ps2_keyboard.spill_pool = mempool_create("ps2_spill",
+		sizeof(struct ps2_spill),
+		PS2_SPILL_RESERVE);
+	if (ps2_keyboard.spill_pool == 0) {
+		panic("keyboard spill pool allocation failed");
+	}
 	if (input_register_device(&ps2_input_dev) != 0) {
 		panic("keyboard input device registration failed");
 	}
@@ -44,12 +44,77 @@ uint64_t arch_irq_save(void);
 void arch_irq_restore(uint64_t flags);
 
 /**
- * arch_page_table_uses_page() - Check whether a page backs page tables.
- * @page: Physical page base address.
+ * arch_irq_enable() - Enable maskable interrupts on the current CPU.
  *
- * Return: Non-zero if the architecture page-table layer owns the page.
+ * Used where a new context starts with interrupts off and no saved state
+ * to restore, such as the first run of a kernel thread.
  */
-int arch_page_table_uses_page(uint64_t page);
+void arch_irq_enable(void);
+
+/**
+ * arch_cpu_relax() - Pause inside a busy-wait loop.
+ *
+ * Besides the spin-wait hint, services cross-CPU requests that cannot wait
+ * for interrupts to be enabled again, so a CPU spinning with interrupts off
+ * never stalls another CPU waiting on it.
+ */
+void arch_cpu_relax(void);
+
+/**
+ * arch_read_cycle_counter() - Read a free-running CPU cycle counter.
+ *
+ * Only differences between two reads are meaningful. Used for benchmarks,
+ * latency diagnostics and scheduler runtime accounting, never for
+ * timekeeping.
+ *
+ * Return: Current counter value.
+ */
+uint64_t arch_read_cycle_counter(void);
+
+/**
+ * arch_clear_page() - Zero one page, leaving it in the cache.
+ * @page: Page-aligned kernel address of a PAGE_SIZE page.
+ *
+ * Uses the fastest string store the CPU offers. Suited to pages the caller
+ * is about to use.
+ */
+void arch_clear_page(void *page);
+
+/**
+ * arch_clear_page_nocache() - Zero one page while bypassing the cache.
+ * @page: Page-aligned kernel address of a PAGE_SIZE page.
+ *
+ * Suited to background zeroing of pages that will not be used soon, so the
+ * zeroes do not evict data that is in use.
+ */
+void arch_clear_page_nocache(void *page);
+
+/**
+ * arch_physmap_init() - Build the kernel direct map of physical RAM.
+ * @boot_info: Boot handoff whose memory map names the RAM ranges.
+ *
+ * Called by mm_init() once memblock can hand out page-table pages. After it
+ * returns, phys_to_virt() is valid for every RAM address below
+ * physmap_limit.
+ */
+void arch_physmap_init(const boot_info_t *boot_info);
+
+/**
+ * arch_reserve_page_tables() - Reserve pages backing active page tables.
+ *
+ * Walks the live page-table hierarchy once and passes each table page to
+ * memblock_reserve() so the page allocator never reuses it.
+ */
+void arch_reserve_page_tables(void);
+
+/**
+ * arch_reserve_low_memory() - Reserve low RAM the architecture needs later.
+ *
+ * Called after arch_reserve_page_tables() while memblock still owns RAM.
+ * x86 keeps one page below 1 MiB for the application processor startup
+ * trampoline, which must run in real mode.
+ */
+void arch_reserve_low_memory(void);
 
 /**
  * arch_traps_init() - Initialize architecture trap and IRQ entry tables.
@@ -86,6 +151,44 @@ void arch_test_general_protection(void);
  */
 void arch_test_user_invalid_opcode(void);
 
+/**
+ * arch_smp_boot() - Start every application processor firmware describes.
+ *
+ * Called once by smp_init() on the boot CPU with interrupts enabled. Each
+ * processor that starts is marked online and enters the scheduler before
+ * this returns.
+ */
+void arch_smp_boot(void);
+
+/**
+ * arch_send_reschedule() - Interrupt another CPU so it reschedules.
+ * @cpu: Online CPU other than the caller.
+ *
+ * The interrupt does nothing by itself; the target reschedules on the way
+ * out of it if its need-resched flag is set.
+ */
+void arch_send_reschedule(uint32_t cpu);
+
+/**
+ * arch_cpu_tick_start() - Start the running CPU's local time-slice tick.
+ *
+ * Called by the scheduler with interrupts disabled when the CPU leaves its
+ * idle thread for real work. Does nothing on the CPU that owns the timer
+ * tick.
+ */
+void arch_cpu_tick_start(void);
+
+/**
+ * arch_cpu_tick_stop() - Stop the running CPU's local time-slice tick.
+ *
+ * Called by the scheduler with interrupts disabled when the CPU switches
+ * to its idle thread, which has no slice to end; the reschedule interrupt
+ * that brings new work is the only wakeup an idle CPU needs. A tick
+ * already raised may still arrive. Does nothing on the CPU that owns the
+ * timer tick.
+ */
+void arch_cpu_tick_stop(void);
+
 /**
  * arch_timer_init() - Initialize the architecture timer backend.
  *
@@ -93,4 +196,40 @@ void arch_test_user_invalid_opcode(void);
  */
 void arch_timer_init(void);
 
+/**
+ * arch_timer_stop_tick() - Replace the periodic tick with one wakeup.
+ * @ticks: Ticks from the last counted tick to the next deadline, or
+ *         UINT64_MAX if no timer is pending.
+ *
+ * Called from the timer tick with interrupts disabled. The timer then
+ * raises one interrupt on the tick boundary @ticks after the last counted
+ * tick, clamped to what the hardware can program. Calling it again after
+ * that interrupt arms the next one. Hardware that can keep time without a
+ * wakeup arms nothing for UINT64_MAX, and the tick stays stopped until
+ * some other interrupt arrives.
+ *
+ * Return: Ticks programmed, UINT64_MAX if no wakeup was armed, or 0 if the
+ * periodic tick keeps running.
+ */
+uint64_t arch_timer_stop_tick(uint64_t ticks);
+
+/**
+ * arch_timer_stopped_ticks() - Read how far a stopped tick has come.
+ *
+ * Return: Whole ticks since arch_timer_stop_tick() armed the current
+ * wakeup, or 0 while the periodic tick runs.
+ */
+uint64_t arch_timer_stopped_ticks(void);
+
+/**
+ * arch_timer_start_tick() - Restart the periodic tick after a stop.
+ *
+ * Safe from any interrupt or thread context with interrupts disabled. The
+ * periodic tick resumes in phase with the ticks counted before the stop.
+ *
+ * Return: Whole ticks since arch_timer_stop_tick() armed the current
+ * wakeup, or 0 if the tick was not stopped.
+ */
+uint64_t arch_timer_start_tick(void);
+
 #endif
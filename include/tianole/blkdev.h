@@ -0,0 +1,97 @@
+#ifndef TIANOLE_BLKDEV_H
+#define TIANOLE_BLKDEV_H
+
+#include <stdint.h>
+
+struct block_device;
+
+/**
+ * struct block_device_ops - Driver callbacks for one block device.
+ * @read: Copy block @block into @buffer.
+ * @write: Store @buffer as block @block.
+ * @discard: Drop @count blocks starting at @block; they read back as zero.
+ *
+ * The block layer checks ranges before calling a driver, so drivers only
+ * see in-range requests. Each callback returns 0 or a negative errno.
+ */
+struct block_device_ops {
+	int (*read)(struct block_device *dev, uint64_t block, void *buffer);
+	int (*write)(struct block_device *dev, uint64_t block,
+		const void *buffer);
+	int (*discard)(struct block_device *dev, uint64_t block,
+		uint64_t count);
+};
+
+/**
+ * struct block_device - Registered block device descriptor.
+ * @name: Unique device name such as "zram0".
+ * @block_size: Bytes per block.
+ * @nr_blocks: Device size in blocks.
+ * @ops: Driver callbacks.
+ * @private_data: Driver-owned device state.
+ * @next: Registry link owned by the block layer.
+ */
+struct block_device {
+	const char *name;
+	uint32_t block_size;
+	uint64_t nr_blocks;
+	const struct block_device_ops *ops;
+	void *private_data;
+	struct block_device *next;
+};
+
+/**
+ * block_device_register() - Make a device visible by name.
+ * @dev: Driver-owned descriptor with every field but @next filled in.
+ *
+ * Return: 0 on success, -EINVAL for a malformed descriptor, or -EEXIST if
+ * the name is taken.
+ */
+int block_device_register(struct block_device *dev);
+
+/**
+ * block_device_unregister() - Remove a device from the registry.
+ * @dev: Device passed to block_device_register().
+ */
+void block_device_unregister(struct block_device *dev);
+
+/**
+ * block_device_find() - Look a device up by name.
+ * @name: Device name.
+ *
+ * Return: Device, or NULL if none is registered under @name.
+ */
+struct block_device *block_device_find(const char *name);
+
+/**
+ * block_read() - Read one block.
+ * @dev: Device.
+ * @block: Block index.
+ * @buffer: @dev->block_size bytes of output.
+ *
+ * Return: 0, -EINVAL for an out-of-range block, or a driver error.
+ */
+int block_read(struct block_device *dev, uint64_t block, void *buffer);
+
+/**
+ * block_write() - Write one block.
+ * @dev: Device.
+ * @block: Block index.
+ * @buffer: @dev->block_size bytes of input.
+ *
+ * Return: 0, -EINVAL for an out-of-range block, or a driver error.
+ */
+int block_write(struct block_device *dev, uint64_t block,
+	const void *buffer);
+
+/**
+ * block_discard() - Tell the device a range no longer holds data.
+ * @dev: Device.
+ * @block: First block.
+ * @count: Number of blocks.
+ *
+ * Return: 0, -EINVAL for an out-of-range range, or a driver error.
+ */
+int block_discard(struct block_device *dev, uint64_t block, uint64_t count);
+
+#endif
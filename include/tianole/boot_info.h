@@ -3,6 +3,32 @@
 
 #include <stdint.h>
 
+/**
+ * BOOT_MEMORY_TYPE_LOADER_CODE - Firmware memory type for bootloader code.
+ */
+#define BOOT_MEMORY_TYPE_LOADER_CODE 1u
+
+/**
+ * BOOT_MEMORY_TYPE_LOADER_DATA - Firmware memory type for bootloader data.
+ *
+ * Covers the loaded kernel segments as well as loader pool buffers, so only
+ * ranges the kernel no longer references may be reused.
+ */
+#define BOOT_MEMORY_TYPE_LOADER_DATA 2u
+
+/**
+ * BOOT_MEMORY_TYPE_BOOT_SERVICES_CODE - Firmware boot-services code.
+ */
+#define BOOT_MEMORY_TYPE_BOOT_SERVICES_CODE 3u
+
+/**
+ * BOOT_MEMORY_TYPE_BOOT_SERVICES_DATA - Firmware boot-services data.
+ *
+ * Usable after ExitBootServices() except for structures the kernel still
+ * uses, such as the inherited page tables.
+ */
+#define BOOT_MEMORY_TYPE_BOOT_SERVICES_DATA 4u
+
 /**
  * BOOT_MEMORY_TYPE_CONVENTIONAL - Firmware memory type for usable RAM.
  *
@@ -11,6 +37,16 @@
  */
 #define BOOT_MEMORY_TYPE_CONVENTIONAL 7u
 
+/**
+ * BOOT_MEMORY_TYPE_ACPI_RECLAIM - RAM holding ACPI tables.
+ */
+#define BOOT_MEMORY_TYPE_ACPI_RECLAIM 9u
+
+/**
+ * BOOT_MEMORY_TYPE_ACPI_NVS - RAM reserved for firmware ACPI NVS storage.
+ */
+#define BOOT_MEMORY_TYPE_ACPI_NVS 10u
+
 /**
  * typedef boot_memory_descriptor_t - Boot memory map descriptor.
  * @type: Firmware memory type.
@@ -48,6 +84,7 @@ typedef struct {
  * @framebuffer_height: Visible framebuffer height in pixels.
  * @framebuffer_pixels_per_scan_line: Physical pixels per scan line.
  * @framebuffer_pixel_format: Bootloader-provided pixel format identifier.
+ * @acpi_rsdp: Physical address of the ACPI RSDP, or 0 if firmware has none.
  *
  * Boot-time handoff data owned by Tianole rather than by a specific firmware
  * or architecture API. Fields can grow while the kernel entry stays stable.
@@ -67,12 +104,13 @@ typedef struct {
 	uint32_t framebuffer_height;
 	uint32_t framebuffer_pixels_per_scan_line;
 	uint32_t framebuffer_pixel_format;
+	uint64_t acpi_rsdp;
 } boot_info_t;
 
 /**
  * BOOT_INFO_VERSION - Current boot_info_t layout version.
  */
-#define BOOT_INFO_VERSION 2u
+#define BOOT_INFO_VERSION 3u
 
 /**
  * BOOT_FLAG_SERVICES_ACTIVE - Firmware boot services were active at handoff.
@@ -0,0 +1,71 @@
+#ifndef TIANOLE_DMA_H
+#define TIANOLE_DMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tianole/mm.h>
+#include <tianole/scatterlist.h>
+
+/**
+ * DMA_BIT_MASK() - Mask of the bus addresses an n-bit DMA engine reaches.
+ * @n: Address bits, 1 to 64.
+ */
+#define DMA_BIT_MASK(n) ((n) >= 64 ? ~0ull : (1ull << (n)) - 1)
+
+/**
+ * dma_alloc_coherent() - Allocate a zeroed buffer shared with a device.
+ * @size: Bytes, rounded up to whole pages.
+ * @dma_handle: Receives the bus address to program into the device.
+ * @dma_mask: Highest bus address the device can reach.
+ *
+ * The buffer is physically contiguous and may exceed the largest buddy
+ * block, which suits descriptor rings. Masks below 4 GiB take memory from
+ * ZONE_DMA32. x86 DMA snoops the cache, so the write-back direct map is
+ * coherent without extra flushing.
+ *
+ * Return: Direct-map address of the buffer, or NULL when no run below
+ * @dma_mask is free.
+ */
+void *dma_alloc_coherent(size_t size, dma_addr_t *dma_handle,
+	uint64_t dma_mask);
+
+/**
+ * dma_free_coherent() - Free a buffer from dma_alloc_coherent().
+ * @size: Size passed to dma_alloc_coherent().
+ * @vaddr: Address returned by dma_alloc_coherent().
+ * @dma_handle: Bus address returned with @vaddr.
+ *
+ * The device must have stopped using the buffer.
+ */
+void dma_free_coherent(size_t size, void *vaddr, dma_addr_t dma_handle);
+
+/**
+ * dma_map_sg() - Give a device access to a scatterlist.
+ * @sgl: Entries filled by sg_set_phys() or sg_init_buffer().
+ * @nents: Number of entries.
+ * @dma_mask: Highest bus address the device can reach.
+ *
+ * Fills the DMA fields, merging entries whose bus ranges are adjacent so
+ * the device sees as few segments as possible. Memory above @dma_mask is
+ * refused rather than bounced through a copy.
+ *
+ * Return: Number of DMA segments at the front of @sgl, -EINVAL for bad
+ * arguments, or -EIO if an entry is beyond @dma_mask.
+ */
+int dma_map_sg(struct scatterlist *sgl, unsigned int nents,
+	uint64_t dma_mask);
+
+/**
+ * dma_unmap_sg() - End device access to a mapped scatterlist.
+ * @sgl: List passed to dma_map_sg().
+ * @nents: Entry count passed to dma_map_sg(), not its return value.
+ */
+void dma_unmap_sg(struct scatterlist *sgl, unsigned int nents);
+
+/**
+ * dma_selftest() - Check coherent allocation and scatterlist mapping.
+ */
+void dma_selftest(void);
+
+#endif
@@ -16,6 +16,16 @@
  */
 #define ENOMEM 12
 
+/**
+ * EFAULT - Bad address.
+ */
+#define EFAULT 14
+
+/**
+ * EIO - Stored data could not be read back.
+ */
+#define EIO 5
+
 /**
  * EBUSY - Resource is already busy.
  */
@@ -56,4 +66,9 @@
  */
 #define ETIMEDOUT 110
 
+/**
+ * ENODEV - Required hardware is absent or unusable.
+ */
+#define ENODEV 19
+
 #endif
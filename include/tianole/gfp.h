@@ -0,0 +1,29 @@
+#ifndef TIANOLE_GFP_H
+#define TIANOLE_GFP_H
+
+#include <stdint.h>
+
+/**
+ * typedef gfp_t - Allocation context flags.
+ *
+ * Tells an allocator what the caller's context allows it to do while
+ * looking for memory.
+ */
+typedef uint32_t gfp_t;
+
+/**
+ * GFP_KERNEL - Thread context: the allocator may map pages and take faults.
+ */
+#define GFP_KERNEL 0u
+
+/**
+ * GFP_ATOMIC - Never map, never sleep.
+ *
+ * Safe from IRQ handlers and with spinlocks held. Only memory reserved in
+ * advance, such as mempool reserve elements, can satisfy the request; the
+ * allocator does not fall back to its slab cache or the page allocator and
+ * fails instead.
+ */
+#define GFP_ATOMIC (1u << 0)
+
+#endif
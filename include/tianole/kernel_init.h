@@ -7,7 +7,9 @@
  * kernel_report_boot_state() - Log the boot handoff state.
  * @boot_info: Firmware-independent boot data passed to the kernel.
  *
- * Prints early diagnostics used to verify the bootloader-to-kernel contract.
+ * Prints early diagnostics used to verify the bootloader-to-kernel contract,
+ * including how many loader and boot-services pages mm_init() reclaimed. Pass
+ * mm_boot_info(); the bootloader's own copy is gone by then.
  */
 void kernel_report_boot_state(const boot_info_t *boot_info);
 
@@ -0,0 +1,69 @@
+#ifndef TIANOLE_LZ4_H
+#define TIANOLE_LZ4_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * LZ4_MAX_INPUT_SIZE - Largest input lz4_compress() accepts.
+ *
+ * Keeps every position within the 64 KiB LZ4 match window, so the match
+ * finder's hash table can hold 16-bit positions.
+ */
+#define LZ4_MAX_INPUT_SIZE 0x10000u
+
+/**
+ * LZ4_HASH_LOG - log2 of the match finder's hash table entries.
+ */
+#define LZ4_HASH_LOG 12u
+
+/**
+ * LZ4_MEM_COMPRESS - Bytes of scratch memory lz4_compress() needs.
+ */
+#define LZ4_MEM_COMPRESS ((1u << LZ4_HASH_LOG) * sizeof(uint16_t))
+
+/**
+ * lz4_compress_bound() - Worst-case compressed size.
+ * @size: Input bytes.
+ *
+ * Return: Output capacity that can hold any @size-byte input.
+ */
+static inline size_t lz4_compress_bound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+/**
+ * lz4_compress() - Compress a buffer into an LZ4 block.
+ * @src: Input.
+ * @src_len: Input bytes, at most LZ4_MAX_INPUT_SIZE.
+ * @dst: Output.
+ * @dst_cap: Output capacity.
+ * @wrkmem: LZ4_MEM_COMPRESS bytes of scratch memory.
+ *
+ * Produces the standard LZ4 block format with a greedy single-probe match
+ * finder. A @dst_cap below the input size is how callers ask for "only if
+ * it actually shrinks".
+ *
+ * Return: Compressed bytes, -EINVAL for bad arguments, or -ENOSPC if the
+ * output does not fit in @dst_cap.
+ */
+int lz4_compress(const void *src, size_t src_len, void *dst, size_t dst_cap,
+	void *wrkmem);
+
+/**
+ * lz4_decompress() - Expand an LZ4 block with full bounds checking.
+ * @src: Compressed block.
+ * @src_len: Exact compressed size.
+ * @dst: Output.
+ * @dst_cap: Output capacity.
+ *
+ * Malformed input can never read outside @src or write outside @dst.
+ *
+ * Return: Decompressed bytes, or -EINVAL for malformed input or too
+ * small an output buffer.
+ */
+int lz4_decompress(const void *src, size_t src_len, void *dst,
+	size_t dst_cap);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef TIANOLE_MEMBLOCK_H
+#define TIANOLE_MEMBLOCK_H
+
+#include <stdint.h>
+
+#include <tianole/mm.h>
+
+/**
+ * MEMBLOCK_MAX_REGIONS - Capacity of each boot range table.
+ *
+ * Ranges are merged on insertion, so this bounds distinct discontiguous
+ * ranges rather than pages.
+ */
+#define MEMBLOCK_MAX_REGIONS 256u
+
+/**
+ * struct memblock_region - One half-open physical range [base, base + size).
+ * @base: Page-aligned physical start.
+ * @size: Length in bytes, a multiple of PAGE_SIZE.
+ */
+struct memblock_region {
+	phys_addr_t base;
+	uint64_t size;
+};
+
+/**
+ * typedef memblock_range_fn_t - Callback for memblock range iteration.
+ * @start: Page-aligned physical start of the range.
+ * @end: Page-aligned physical end of the range.
+ * @data: Caller context passed through unchanged.
+ */
+typedef void (*memblock_range_fn_t)(phys_addr_t start,
+	phys_addr_t end,
+	void *data);
+
+/**
+ * memblock_reset() - Drop every memory and reserved range.
+ *
+ * Called once by mm_init() before the boot memory map is registered.
+ */
+void memblock_reset(void);
+
+/**
+ * memblock_add() - Register usable RAM.
+ * @base: Physical start; rounded up to a page boundary.
+ * @size: Length in bytes; the end is rounded down to a page boundary.
+ *
+ * Overlapping and adjacent ranges are merged so the table stays sorted.
+ */
+void memblock_add(phys_addr_t base, uint64_t size);
+
+/**
+ * memblock_reserve() - Mark a physical range as not allocatable.
+ * @base: Physical start; rounded down to a page boundary.
+ * @size: Length in bytes; the end is rounded up to a page boundary.
+ *
+ * Reservations need not lie inside registered RAM. Overlapping and adjacent
+ * reservations are merged.
+ */
+void memblock_reserve(phys_addr_t base, uint64_t size);
+
+/**
+ * memblock_alloc() - Carve a free range out of boot memory.
+ * @size: Length in bytes; rounded up to a page multiple.
+ * @align: Power-of-two alignment, at least PAGE_SIZE.
+ *
+ * The range is reserved before returning, so later free-range iteration
+ * never hands it to the page allocator.
+ *
+ * Return: Physical base address, or 0 if no free range is large enough.
+ */
+phys_addr_t memblock_alloc(uint64_t size, uint64_t align);
+
+/**
+ * memblock_for_each_free_range() - Visit RAM not covered by reservations.
+ * @fn: Callback invoked once per maximal free range, in address order.
+ * @data: Context passed to @fn.
+ *
+ * Reservations are subtracted with one merge pass over both sorted tables,
+ * so the cost scales with the number of ranges rather than pages.
+ */
+void memblock_for_each_free_range(memblock_range_fn_t fn, void *data);
+
+/**
+ * memblock_region_count() - Report how many ranges a table holds.
+ * @reserved: Non-zero for the reserved table, zero for the memory table.
+ *
+ * Return: Number of merged ranges currently stored.
+ */
+uint64_t memblock_region_count(int reserved);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef TIANOLE_MEMPOOL_H
+#define TIANOLE_MEMPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tianole/gfp.h>
+
+struct mempool;
+
+/**
+ * mempool_create() - Create a pool with a reserve of pre-allocated elements.
+ * @name: Diagnostic name, also used for the backing slab cache.
+ * @size: Element size in bytes.
+ * @min_nr: Elements kept in reserve for allocations that must not fail.
+ *
+ * Elements come from a dedicated slab cache in the direct map. Free
+ * elements are linked through their own first word, so @size is rounded up
+ * to a pointer. Must be called from thread context.
+ *
+ * Return: New pool with a full reserve, or NULL when memory is exhausted.
+ */
+struct mempool *mempool_create(const char *name, size_t size,
+	uint32_t min_nr);
+
+/**
+ * mempool_destroy() - Free a pool, its reserve and its slab cache.
+ * @pool: Pool from mempool_create(), or NULL.
+ *
+ * Every element must have been freed. A refill still queued is cancelled,
+ * and one already running is waited for, so this must be called from
+ * thread context.
+ */
+void mempool_destroy(struct mempool *pool);
+
+/**
+ * mempool_alloc() - Allocate one element.
+ * @pool: Pool to allocate from.
+ * @gfp: GFP_ATOMIC from IRQ context, otherwise GFP_KERNEL.
+ *
+ * GFP_ATOMIC only pops the reserve, so it costs a bounded list pop and
+ * never grows the slab cache from IRQ context. GFP_KERNEL tries the
+ * slab cache first and dips into the reserve only when that fails. Whenever
+ * the reserve drops below its minimum, a refill is queued on the system
+ * workqueue.
+ *
+ * Return: Element, or NULL if no element is available for @gfp.
+ */
+void *mempool_alloc(struct mempool *pool, gfp_t gfp);
+
+/**
+ * mempool_free() - Return an element to its pool.
+ * @pool: Pool the element came from.
+ * @element: Element from mempool_alloc(), or NULL.
+ *
+ * Always pushes onto the reserve, so it is safe from IRQ context. Elements
+ * beyond the minimum are handed back to the cache by the queued refill.
+ */
+void mempool_free(struct mempool *pool, void *element);
+
+/**
+ * mempool_refill() - Bring the reserve back to exactly its minimum.
+ * @pool: Pool to rebalance.
+ *
+ * Allocates missing elements from the cache and returns surplus ones. Runs
+ * from the pool's workqueue item; callable directly in thread context.
+ *
+ * Return: Elements in reserve afterwards.
+ */
+uint32_t mempool_refill(struct mempool *pool);
+
+/**
+ * mempool_selftest() - Check reserve use, fallback and refill.
+ */
+void mempool_selftest(void);
+
+#endif
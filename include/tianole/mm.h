@@ -11,6 +11,36 @@
  */
 #define PAGE_SIZE 4096u
 
+/**
+ * PAGE_SHIFT - log2(PAGE_SIZE), converts physical addresses to frame numbers.
+ */
+#define PAGE_SHIFT 12u
+
+/**
+ * PAGE_SIZE_2M - Size of a second-level large page mapping.
+ */
+#define PAGE_SIZE_2M (1ull << 21)
+
+/**
+ * PAGE_SIZE_1G - Size of a third-level large page mapping.
+ *
+ * Only usable where the CPU supports gigabyte pages.
+ */
+#define PAGE_SIZE_1G (1ull << 30)
+
+/**
+ * PAGE_ORDER_2M - Buddy order of a physically contiguous 2 MiB block.
+ */
+#define PAGE_ORDER_2M 9u
+
+/**
+ * PAGE_MAX_ORDER - Largest buddy order served by alloc_pages().
+ *
+ * An order-N block is 2^N physically contiguous, naturally aligned base
+ * pages; the maximum order is a 4 MiB run.
+ */
+#define PAGE_MAX_ORDER 10u
+
 /**
  * typedef phys_addr_t - Physical address value.
  *
@@ -25,6 +55,212 @@ typedef uint64_t phys_addr_t;
  */
 typedef uint64_t virt_addr_t;
 
+/**
+ * typedef dma_addr_t - Bus address a device uses to reach memory.
+ *
+ * Equal to the physical address while there is no IOMMU, but kept
+ * distinct so drivers never program a physical address directly.
+ */
+typedef uint64_t dma_addr_t;
+
+/**
+ * enum page_flags - Allocator state bits stored in struct page::flags.
+ * @PG_RESERVED: Frame is not managed by the page allocator, for example a
+ *               memory hole, firmware data or the kernel image.
+ * @PG_BUDDY: Frame heads a free buddy block of struct page::order.
+ * @PG_SLAB: Frame belongs to a kmem_cache slab; struct page::slab_cache is
+ *           valid on every frame of the slab.
+ * @PG_KMALLOC: Frame heads a page-backed kmalloc() block of struct
+ *              page::order.
+ */
+enum page_flags {
+	PG_RESERVED = 1u << 0,
+	PG_BUDDY = 1u << 1,
+	PG_SLAB = 1u << 2,
+	PG_KMALLOC = 1u << 3,
+};
+
+/**
+ * enum page_owner - Subsystem that currently owns an allocated frame.
+ * @PAGE_OWNER_RESERVED: Frame was never handed to the allocator.
+ * @PAGE_OWNER_FREE: Frame sits in a buddy free block.
+ * @PAGE_OWNER_KERNEL: Generic alloc_pages() user without a finer tag.
+ * @PAGE_OWNER_PAGE_TABLE: Frame backs an architecture page-table level.
+ * @PAGE_OWNER_HEAP: Frame backs the heap arena or a page-backed kmalloc()
+ *                   block.
+ * @PAGE_OWNER_SLAB: Frame backs a kmem_cache slab.
+ * @PAGE_OWNER_VMALLOC: Frame backs a vmalloc() area.
+ * @PAGE_OWNER_DMA: Frame backs a dma_alloc_coherent() buffer.
+ *
+ * Owners are diagnostic and for reclaim decisions; they never change how the
+ * buddy allocator treats a frame.
+ */
+enum page_owner {
+	PAGE_OWNER_RESERVED,
+	PAGE_OWNER_FREE,
+	PAGE_OWNER_KERNEL,
+	PAGE_OWNER_PAGE_TABLE,
+	PAGE_OWNER_HEAP,
+	PAGE_OWNER_SLAB,
+	PAGE_OWNER_VMALLOC,
+	PAGE_OWNER_DMA,
+};
+
+struct kmem_cache;
+
+/**
+ * struct page - Per-frame metadata indexed by PFN.
+ * @flags: Bitmask of enum page_flags.
+ * @order: Buddy order of a free block head or of an allocation head.
+ * @owner: enum page_owner value for allocated frames.
+ * @inuse: Allocated objects on a slab head page.
+ * @refcount: Reference count; 1 after alloc_pages(), 0 while free.
+ * @private: Owner-defined word, such as a usage counter.
+ * @next: List link owned by the current owner, buddy lists while free.
+ * @prev: List link paired with @next.
+ * @slab_cache: Cache owning the slab when PG_SLAB is set.
+ * @freelist: First free object of a slab head page.
+ *
+ * Only the head page of a block carries meaningful @order, @owner and
+ * @refcount values.
+ */
+struct page {
+	uint32_t flags;
+	uint8_t order;
+	uint8_t owner;
+	uint16_t inuse;
+	uint32_t refcount;
+	uint32_t private;
+	struct page *next;
+	struct page *prev;
+	struct kmem_cache *slab_cache;
+	void *freelist;
+};
+
+/*
+ * Flat page array covering [mem_map_base_pfn, mem_map_end_pfn). Built by
+ * mm_init() from the boot memory map and never resized afterwards.
+ */
+extern struct page *mem_map;
+extern uint64_t mem_map_base_pfn;
+extern uint64_t mem_map_end_pfn;
+
+/**
+ * pfn_valid() - Check whether a frame number has a struct page.
+ * @pfn: Physical frame number.
+ *
+ * Return: Non-zero if @pfn lies inside the page array.
+ */
+static inline int pfn_valid(uint64_t pfn)
+{
+	return pfn >= mem_map_base_pfn && pfn < mem_map_end_pfn;
+}
+
+/**
+ * pfn_to_page() - Look up the metadata of a frame.
+ * @pfn: Physical frame number accepted by pfn_valid().
+ *
+ * Return: Struct page for @pfn.
+ */
+static inline struct page *pfn_to_page(uint64_t pfn)
+{
+	return &mem_map[pfn - mem_map_base_pfn];
+}
+
+/**
+ * page_to_pfn() - Convert page metadata back to its frame number.
+ * @page: Entry inside the page array.
+ *
+ * Return: Physical frame number described by @page.
+ */
+static inline uint64_t page_to_pfn(const struct page *page)
+{
+	return mem_map_base_pfn + (uint64_t)(page - mem_map);
+}
+
+/**
+ * phys_to_page() - Look up the metadata of the frame holding an address.
+ * @phys: Physical address inside a frame accepted by pfn_valid().
+ *
+ * Return: Struct page for the frame containing @phys.
+ */
+static inline struct page *phys_to_page(phys_addr_t phys)
+{
+	return pfn_to_page(phys >> PAGE_SHIFT);
+}
+
+/**
+ * page_to_phys() - Return the physical base address of a frame.
+ * @page: Entry inside the page array.
+ *
+ * Return: Page-aligned physical address described by @page.
+ */
+static inline phys_addr_t page_to_phys(const struct page *page)
+{
+	return page_to_pfn(page) << PAGE_SHIFT;
+}
+
+/**
+ * PHYSMAP_BASE - Kernel virtual address of the direct map of physical RAM.
+ *
+ * Physical address P is mapped at PHYSMAP_BASE + P with large pages, so
+ * translation in both directions is pure arithmetic.
+ */
+#define PHYSMAP_BASE 0xffff800000000000ull
+
+/*
+ * End of the highest physical range covered by the direct map. Set by
+ * arch_physmap_init(); holes below it stay unmapped.
+ */
+extern phys_addr_t physmap_limit;
+
+/**
+ * phys_to_virt() - Return the direct-map address of a physical address.
+ * @phys: Physical address of RAM below physmap_limit.
+ *
+ * Return: Kernel virtual pointer to @phys.
+ */
+static inline void *phys_to_virt(phys_addr_t phys)
+{
+	return (void *)(uintptr_t)(phys + PHYSMAP_BASE);
+}
+
+/**
+ * physmap_contains() - Check whether a pointer lies in the direct map.
+ * @virt: Kernel virtual address.
+ *
+ * Return: Non-zero if @virt is a direct-map address.
+ */
+static inline int physmap_contains(const void *virt)
+{
+	virt_addr_t address = (virt_addr_t)(uintptr_t)virt;
+
+	return address >= PHYSMAP_BASE &&
+		address - PHYSMAP_BASE < physmap_limit;
+}
+
+/**
+ * physmap_to_phys() - Convert a direct-map address back to physical.
+ * @virt: Address accepted by physmap_contains().
+ *
+ * Return: Physical address mapped at @virt.
+ */
+static inline phys_addr_t physmap_to_phys(const void *virt)
+{
+	return (phys_addr_t)(uintptr_t)virt - PHYSMAP_BASE;
+}
+
+/**
+ * virt_to_page() - Look up the frame metadata behind a direct-map address.
+ * @virt: Address accepted by physmap_contains() whose frame has a struct page.
+ *
+ * Return: Struct page of the frame containing @virt.
+ */
+static inline struct page *virt_to_page(const void *virt)
+{
+	return phys_to_page(physmap_to_phys(virt));
+}
+
 /**
  * PAGE_PRESENT - Mapping flag that marks a page table entry present.
  */
@@ -48,6 +284,96 @@ typedef uint64_t virt_addr_t;
  */
 void mm_init(const boot_info_t *boot_info);
 
+/**
+ * mm_boot_info() - Return the kernel-owned copy of the boot handoff.
+ *
+ * mm_init() reclaims the memory holding the bootloader's handoff and memory
+ * map, so later readers must use this copy instead of the entry argument.
+ *
+ * Return: Boot handoff whose memory_map points at kernel-owned storage.
+ */
+const boot_info_t *mm_boot_info(void);
+
+/**
+ * nr_boot_reclaimed_pages() - Count pages reclaimed from firmware and loader.
+ *
+ * Return: Loader and boot-services pages handed to the page allocator.
+ */
+uint64_t nr_boot_reclaimed_pages(void);
+
+/**
+ * ZONE_DMA32_LIMIT - First physical address above the DMA32 zone.
+ */
+#define ZONE_DMA32_LIMIT (1ull << 32)
+
+/**
+ * enum zone_type - Physical address ranges with separate free lists.
+ * @ZONE_DMA32: RAM below ZONE_DMA32_LIMIT, reachable by 32-bit DMA engines.
+ * @ZONE_NORMAL: All RAM above ZONE_DMA32_LIMIT.
+ * @NR_ZONES: Number of zones.
+ *
+ * Allocations name the highest zone they accept and fall back to lower
+ * ones, so general allocations leave DMA32 memory alone while they can.
+ */
+enum zone_type {
+	ZONE_DMA32,
+	ZONE_NORMAL,
+	NR_ZONES,
+};
+
+/**
+ * alloc_pages() - Allocate physically contiguous pages.
+ * @order: Buddy order; the allocation spans 2^@order base pages.
+ *
+ * The returned block is aligned to its own size. Same as
+ * alloc_pages_zone(@order, ZONE_NORMAL).
+ *
+ * Return: Physical base address, or 0 when no block of @order is available.
+ */
+phys_addr_t alloc_pages(unsigned int order);
+
+/**
+ * alloc_pages_zone() - Allocate physically contiguous pages below a limit.
+ * @order: Buddy order; the allocation spans 2^@order base pages.
+ * @zone: Highest zone the block may come from.
+ *
+ * The block is freed with free_pages() like any other.
+ *
+ * Return: Physical base address, or 0 when no block of @order is available
+ * in @zone or below.
+ */
+phys_addr_t alloc_pages_zone(unsigned int order, enum zone_type zone);
+
+/**
+ * alloc_contig_pages() - Allocate a contiguous run of any page count.
+ * @nr_pages: Number of base pages.
+ * @zone: Highest zone the run may come from.
+ *
+ * Unlike alloc_pages() the run may exceed PAGE_MAX_ORDER and is not
+ * rounded up to a power of two. It is only aligned to PAGE_SIZE, or to
+ * the largest buddy block when longer than one.
+ *
+ * Return: Physical base address, or 0 when no long enough run is free.
+ */
+phys_addr_t alloc_contig_pages(uint64_t nr_pages, enum zone_type zone);
+
+/**
+ * free_contig_pages() - Return a run from alloc_contig_pages().
+ * @base: Physical base address of the run.
+ * @nr_pages: Page count passed to alloc_contig_pages().
+ */
+void free_contig_pages(phys_addr_t base, uint64_t nr_pages);
+
+/**
+ * free_pages() - Return a contiguous block to the page allocator.
+ * @page: Physical base address previously returned by alloc_pages().
+ * @order: The same order passed to alloc_pages().
+ *
+ * The block is coalesced with free buddies. It must not still be mapped or
+ * owned by another subsystem.
+ */
+void free_pages(phys_addr_t page, unsigned int order);
+
 /**
  * alloc_page() - Allocate one physical page.
  *
@@ -64,9 +390,112 @@ phys_addr_t alloc_page(void);
 void free_page(phys_addr_t page);
 
 /**
- * kmalloc() - Allocate small kernel heap memory.
+ * nr_free_pages() - Count free base pages in the page allocator.
+ *
+ * Return: Number of free 4 KiB pages across all buddy orders.
+ */
+uint64_t nr_free_pages(void);
+
+/**
+ * nr_zone_free_pages() - Count free base pages in one zone.
+ * @zone: Zone to query.
+ *
+ * Return: Free 4 KiB pages in @zone, or 0 for an invalid zone.
+ */
+uint64_t nr_zone_free_pages(enum zone_type zone);
+
+/**
+ * nr_zone_managed_pages() - Count pages the allocator manages in one zone.
+ * @zone: Zone to query.
+ *
+ * Return: Pages handed to the allocator at boot in @zone, or 0 for an
+ * invalid zone.
+ */
+uint64_t nr_zone_managed_pages(enum zone_type zone);
+
+/**
+ * enum page_watermark - Free-page levels that drive background reclaim.
+ * @WMARK_LOW: Dropping below this wakes the reclaim thread.
+ * @WMARK_HIGH: Reclaim stops once free memory is back above this.
+ * @NR_WMARK: Number of watermarks.
+ */
+enum page_watermark {
+	WMARK_LOW,
+	WMARK_HIGH,
+	NR_WMARK,
+};
+
+/**
+ * page_watermark() - Read a free-page watermark.
+ * @mark: Watermark to read.
+ *
+ * Watermarks scale with the memory handed to the buddy allocator at boot.
+ *
+ * Return: Watermark in 4 KiB pages, or 0 for an invalid @mark.
+ */
+uint64_t page_watermark(enum page_watermark mark);
+
+/**
+ * nr_free_blocks() - Count free blocks of one buddy order.
+ * @order: Buddy order to query.
+ *
+ * Used to judge fragmentation before sizing large contiguous allocations.
+ *
+ * Return: Number of free order-@order blocks, or 0 for an invalid order.
+ */
+uint64_t nr_free_blocks(unsigned int order);
+
+/**
+ * alloc_zeroed_page() - Allocate one zero-filled page.
+ *
+ * Pops a page zeroed ahead of time by the idle thread when one is pooled,
+ * and otherwise allocates and zeroes a page synchronously.
+ *
+ * Return: Physical address of the page, or 0 when memory is exhausted.
+ */
+phys_addr_t alloc_zeroed_page(void);
+
+/**
+ * zero_pool_refill() - Zero free pages into the pre-zeroed pool.
+ * @budget: Maximum number of pages to add.
+ *
+ * Called by the idle thread. Pages are zeroed with non-temporal stores so
+ * the pool does not evict cache lines that running code still uses. Nothing
+ * is added while free memory is at or below the high watermark, so the pool
+ * never refills what reclaim just drained.
+ *
+ * Return: Number of pages added; 0 once the pool is full or memory is low.
+ */
+uint32_t zero_pool_refill(uint32_t budget);
+
+/**
+ * nr_zero_pool_pages() - Count pages waiting in the pre-zeroed pool.
+ *
+ * Return: Pooled pages.
+ */
+uint64_t nr_zero_pool_pages(void);
+
+/**
+ * zero_pool_init() - Register the pre-zeroed pool with reclaim.
+ */
+void zero_pool_init(void);
+
+/**
+ * zero_pool_selftest() - Check the pre-zeroed pool and time page clearing.
+ *
+ * Logs cycles per page for a scalar loop, the cached string store and the
+ * non-temporal store, plus pooled versus synchronous alloc_zeroed_page().
+ */
+void zero_pool_selftest(void);
+
+/**
+ * kmalloc() - Allocate kernel heap memory.
  * @size: Number of bytes requested.
  *
+ * Small requests are served from power-of-two-ish slab size classes in
+ * bounded time; large requests take whole pages from the heap arena. The
+ * result is aligned to at least 16 bytes.
+ *
  * Return: Kernel virtual pointer, or NULL when allocation fails.
  */
 void *kmalloc(size_t size);
@@ -75,7 +504,7 @@ void *kmalloc(size_t size);
  * kfree() - Free memory allocated by kmalloc().
  * @ptr: Pointer returned by kmalloc(), or NULL.
  *
- * Releases the allocation back to the kernel heap.
+ * Releases the allocation back to its size class or the heap arena.
  */
 void kfree(void *ptr);
 
@@ -89,14 +518,103 @@ void kfree(void *ptr);
  */
 int map_page(virt_addr_t virt, phys_addr_t phys, uint64_t flags);
 
+/**
+ * map_page_size() - Map one virtual range with a single leaf entry.
+ * @virt: Virtual address aligned to @size.
+ * @phys: Physical address aligned to @size.
+ * @size: PAGE_SIZE, PAGE_SIZE_2M or PAGE_SIZE_1G.
+ * @flags: Generic page flags such as PAGE_WRITABLE.
+ *
+ * Large leaves cover their range with one entry, so they need no lower table
+ * pages and one TLB entry serves the whole range.
+ *
+ * Return: 0 on success, -EINVAL for unaligned input or a size the CPU cannot
+ * map, -EEXIST if any part of the range is already mapped, or -ENOMEM.
+ */
+int map_page_size(
+	virt_addr_t virt, phys_addr_t phys, uint64_t size, uint64_t flags);
+
 /**
  * unmap_page() - Remove one virtual page mapping.
  * @virt: Virtual page address to unmap.
  *
- * Return: 0 on success, -EINVAL or -ENOENT on failure.
+ * A large leaf covering @virt is split first so its other pages stay mapped.
+ *
+ * Return: 0 on success, -EINVAL or -ENOENT on failure, or -ENOMEM if a
+ * covering large leaf cannot be split.
  */
 int unmap_page(virt_addr_t virt);
 
+/**
+ * unmap_page_size() - Remove one leaf mapping of a given size.
+ * @virt: Virtual address aligned to @size.
+ * @size: PAGE_SIZE, PAGE_SIZE_2M or PAGE_SIZE_1G.
+ *
+ * Larger covering leaves are split down to @size first.
+ *
+ * Return: 0 on success, -EINVAL for unaligned input or when the range is
+ * mapped with smaller pages, -ENOENT if unmapped, or -ENOMEM.
+ */
+int unmap_page_size(virt_addr_t virt, uint64_t size);
+
+/**
+ * typedef unmap_range_fn_t - Receives frames released by unmap_range().
+ * @phys: Physical base of the removed leaf.
+ * @size: Size of the removed leaf in bytes.
+ * @data: Caller context passed through unchanged.
+ *
+ * Called only after the leaf's stale TLB entries have been invalidated, so
+ * the frames may be freed immediately.
+ */
+typedef void (*unmap_range_fn_t)(phys_addr_t phys, uint64_t size,
+	void *data);
+
+/**
+ * map_range() - Map a physically contiguous range with 4 KiB pages.
+ * @virt: Page-aligned virtual start.
+ * @phys: Page-aligned physical start.
+ * @size: Length in bytes, a multiple of PAGE_SIZE.
+ * @flags: Generic page flags such as PAGE_WRITABLE.
+ *
+ * Walks the page tables once per 512 pages instead of once per page. A
+ * failure leaves nothing from this call mapped.
+ *
+ * Return: 0 on success, -EINVAL, -EEXIST or -ENOMEM on failure.
+ */
+int map_range(virt_addr_t virt, phys_addr_t phys, uint64_t size,
+	uint64_t flags);
+
+/**
+ * unmap_range() - Remove every mapping in a virtual range.
+ * @virt: Page-aligned virtual start.
+ * @size: Length in bytes, a multiple of PAGE_SIZE.
+ * @fn: Optional callback receiving each removed leaf, or NULL.
+ * @data: Context passed to @fn.
+ *
+ * TLB invalidation is deferred to the end of the batch. Holes are skipped
+ * but reported.
+ *
+ * Return: 0 on success, -EINVAL for unaligned input, -ENOENT if part of the
+ * range was unmapped, or -ENOMEM if a large leaf cannot be split.
+ */
+int unmap_range(virt_addr_t virt, uint64_t size, unmap_range_fn_t fn,
+	void *data);
+
+/**
+ * protect_range() - Change the flags of already mapped pages.
+ * @virt: Page-aligned start of the range.
+ * @size: Length in bytes, a multiple of PAGE_SIZE.
+ * @flags: New generic page flags such as PAGE_WRITABLE.
+ *
+ * Large leaves keep their size when they lie wholly inside the range or
+ * already carry @flags; only a leaf straddling a range boundary is split.
+ * On failure, pages before the failing address keep their new flags.
+ *
+ * Return: 0 on success, -EINVAL for unaligned input, -ENOENT if part of the
+ * range is unmapped, or -ENOMEM if a large leaf cannot be split.
+ */
+int protect_range(virt_addr_t virt, uint64_t size, uint64_t flags);
+
 /**
  * virt_to_phys() - Resolve a virtual address to a physical address.
  * @virt: Virtual address to query.
@@ -106,6 +624,155 @@ int unmap_page(virt_addr_t virt);
  */
 int virt_to_phys(virt_addr_t virt, phys_addr_t *phys);
 
+/**
+ * nr_page_table_pages() - Count page-table pages taken from the allocator.
+ *
+ * Tables freed when their last entry is unmapped are no longer counted.
+ * Boot-time tables from the firmware or memblock are not included.
+ *
+ * Return: Live page-table pages.
+ */
+uint64_t nr_page_table_pages(void);
+
+struct vm_space;
+
+/**
+ * vm_space_create() - Create an address space sharing the kernel half.
+ *
+ * The new root starts as a copy of the kernel root, so kernel mappings and
+ * the boot identity map are shared. Mappings made while the space is loaded
+ * in other lower-half slots are private to it.
+ *
+ * Return: New address space, or NULL when memory is exhausted.
+ */
+struct vm_space *vm_space_create(void);
+
+/**
+ * vm_space_destroy() - Free an address space and its private tables.
+ * @space: Space returned by vm_space_create(), or NULL.
+ *
+ * The space must not be loaded on any CPU, and its private mappings must
+ * already be unmapped; only page-table pages are freed here.
+ */
+void vm_space_destroy(struct vm_space *space);
+
+/**
+ * vm_space_switch() - Load an address space on this CPU.
+ * @space: Space to load.
+ *
+ * When the CPU supports PCIDs each space carries its own tag and the switch
+ * keeps cached translations; otherwise it flushes all non-global entries.
+ */
+void vm_space_switch(struct vm_space *space);
+
+/**
+ * vm_space_kernel() - Return the kernel's own address space.
+ *
+ * Return: Space built at boot around the kernel page-table root.
+ */
+struct vm_space *vm_space_kernel(void);
+
+/**
+ * vm_space_current() - Return the address space loaded on this CPU.
+ *
+ * Return: Current address space.
+ */
+struct vm_space *vm_space_current(void);
+
+/**
+ * vm_space_flush_page() - Invalidate one page of a possibly idle space.
+ * @space: Space whose mapping at @virt changed.
+ * @virt: Virtual address of the changed mapping.
+ *
+ * Uses invlpg for the loaded space and INVPCID for others. Without INVPCID
+ * the space is marked so its next switch drops its cached translations.
+ */
+void vm_space_flush_page(struct vm_space *space, virt_addr_t virt);
+
+/**
+ * vm_space_selftest() - Check address-space isolation and switch cost.
+ */
+void vm_space_selftest(void);
+
+/**
+ * VM_REGION_LARGE - Back 2 MiB aligned spans of a region with one leaf.
+ *
+ * A fault inside a span wholly covered by the region maps the span with a
+ * single 2 MiB page when an order-9 block is free and no 4 KiB page of it
+ * is mapped yet; otherwise the fault maps one 4 KiB page.
+ */
+#define VM_REGION_LARGE (1u << 0)
+
+/**
+ * struct vm_region - Kernel virtual range backed on first touch.
+ * @start: Page-aligned first address.
+ * @end: Page-aligned end address; see vm_region_resize().
+ * @page_flags: Page flags such as PAGE_WRITABLE for faulted-in pages.
+ * @owner: enum page_owner recorded in faulted-in frames.
+ * @flags: Bitmask of VM_REGION_* behaviour flags.
+ * @name: Diagnostic name.
+ * @pages: 4 KiB pages faulted in so far; never decremented.
+ * @next: Registry link, sorted by @start.
+ *
+ * Registering a region reserves address space only. A not-present kernel
+ * fault inside [@start, @end) allocates a frame, maps it with @page_flags
+ * and resumes the faulting instruction. The owner unmaps the range and
+ * frees the frames when it is done with them.
+ */
+struct vm_region {
+	virt_addr_t start;
+	virt_addr_t end;
+	uint64_t page_flags;
+	uint8_t owner;
+	uint32_t flags;
+	const char *name;
+	uint64_t pages;
+	struct vm_region *next;
+};
+
+/**
+ * vm_region_register() - Make a range fault in pages on demand.
+ * @region: Caller-owned region with @start, @end, @page_flags, @owner,
+ *          @flags and @name filled in.
+ *
+ * An empty region (@start == @end) is allowed and can grow later.
+ *
+ * Return: 0 on success, -EINVAL for unaligned bounds, or -EEXIST if the
+ * range overlaps a registered region.
+ */
+int vm_region_register(struct vm_region *region);
+
+/**
+ * vm_region_unregister() - Stop faulting in pages for a region.
+ * @region: Region passed to vm_region_register().
+ *
+ * Pages already mapped stay mapped; the owner unmaps them.
+ */
+void vm_region_unregister(struct vm_region *region);
+
+/**
+ * vm_region_resize() - Move the end of a registered region.
+ * @region: Registered region.
+ * @end: New page-aligned end, at least @region->start.
+ *
+ * Shrinking does not unmap pages that were faulted in above @end.
+ *
+ * Return: 0 on success, -EINVAL for a bad @end, or -EEXIST if growing
+ * would overlap the next region.
+ */
+int vm_region_resize(struct vm_region *region, virt_addr_t end);
+
+/**
+ * vm_region_fault() - Back a faulting address inside a region.
+ * @addr: Faulting virtual address.
+ *
+ * Called by the architecture fault handler for not-present kernel faults.
+ *
+ * Return: 0 if the faulting access can be retried, -EFAULT if @addr is in
+ * no region, or -ENOMEM if no frame or page table could be allocated.
+ */
+int vm_region_fault(virt_addr_t addr);
+
 /**
  * heap_init() - Initialize the kernel heap.
  *
@@ -113,6 +780,17 @@ int virt_to_phys(virt_addr_t virt, phys_addr_t *phys);
  */
 void heap_init(void);
 
+/**
+ * heap_report() - Log kmalloc() usage and heap arena fragmentation.
+ *
+ * Prints slab usage per size class, live page-backed kmalloc() memory, the
+ * arena's used and free bytes, largest free block and free-block size
+ * histogram and, in KERNEL_HEAP_PROFILE builds, the call sites holding the
+ * most live kmalloc() memory. Each line is one printk() call, so output
+ * from other CPUs cannot land in the middle of it.
+ */
+void heap_report(void);
+
 /**
  * page_table_selftest() - Run boot-time page table checks.
  *
@@ -0,0 +1,131 @@
+#ifndef TIANOLE_RBTREE_H
+#define TIANOLE_RBTREE_H
+
+#include <stddef.h>
+
+/**
+ * struct rb_node - Node of an intrusive red-black tree.
+ * @parent: Parent node, or NULL for the root.
+ * @left: Subtree of smaller keys.
+ * @right: Subtree of equal or larger keys.
+ * @red: Non-zero for a red node.
+ *
+ * The tree never looks at keys. Callers walk down from the root with their
+ * own comparison, link the new node with rb_link_node() and then rebalance
+ * with rb_insert_color(), so one implementation serves every key type.
+ */
+struct rb_node {
+	struct rb_node *parent;
+	struct rb_node *left;
+	struct rb_node *right;
+	int red;
+};
+
+/**
+ * struct rb_root - Red-black tree.
+ * @node: Root node, or NULL for an empty tree.
+ */
+struct rb_root {
+	struct rb_node *node;
+};
+
+/**
+ * struct rb_root_cached - Red-black tree that remembers its first node.
+ * @root: The tree.
+ * @leftmost: Smallest node, or NULL for an empty tree.
+ *
+ * Suits trees used as priority queues, where the minimum is read far more
+ * often than the tree changes.
+ */
+struct rb_root_cached {
+	struct rb_root root;
+	struct rb_node *leftmost;
+};
+
+/**
+ * rb_entry() - Get the structure containing a tree node.
+ * @ptr: Pointer to the embedded struct rb_node.
+ * @type: Type of the containing structure.
+ * @member: Name of the struct rb_node member within @type.
+ */
+#define rb_entry(ptr, type, member)                                            \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+/**
+ * rb_link_node() - Attach a new node where a search ended.
+ * @node: Node to insert.
+ * @parent: Last node visited by the search, or NULL for an empty tree.
+ * @link: Child pointer of @parent, or the root pointer, that was NULL.
+ *
+ * Must be followed by rb_insert_color().
+ */
+static inline void rb_link_node(struct rb_node *node, struct rb_node *parent,
+	struct rb_node **link)
+{
+	node->parent = parent;
+	node->left = 0;
+	node->right = 0;
+	node->red = 1;
+	*link = node;
+}
+
+/**
+ * rb_insert_color() - Rebalance after rb_link_node().
+ * @node: Node just linked.
+ * @root: Tree containing @node.
+ */
+void rb_insert_color(struct rb_node *node, struct rb_root *root);
+
+/**
+ * rb_erase() - Remove a node from its tree.
+ * @node: Node in @root.
+ * @root: Tree containing @node.
+ */
+void rb_erase(struct rb_node *node, struct rb_root *root);
+
+/**
+ * rb_first() - Find the smallest node.
+ * @root: Tree to search.
+ *
+ * Return: Leftmost node, or NULL for an empty tree.
+ */
+struct rb_node *rb_first(const struct rb_root *root);
+
+/**
+ * rb_next() - Find the in-order successor.
+ * @node: Node in a tree.
+ *
+ * Return: Next larger node, or NULL if @node is the last one.
+ */
+struct rb_node *rb_next(const struct rb_node *node);
+
+/**
+ * rb_insert_color_cached() - Rebalance a cached tree after rb_link_node().
+ * @node: Node just linked.
+ * @root: Tree containing @node.
+ * @leftmost: Non-zero if the search never went right, so @node is now the
+ *            smallest node.
+ */
+void rb_insert_color_cached(struct rb_node *node,
+	struct rb_root_cached *root, int leftmost);
+
+/**
+ * rb_erase_cached() - Remove a node from a cached tree.
+ * @node: Node in @root.
+ * @root: Tree containing @node.
+ */
+void rb_erase_cached(struct rb_node *node, struct rb_root_cached *root);
+
+/**
+ * rb_first_cached() - Read the smallest node of a cached tree.
+ * @root: Tree to read.
+ *
+ * Return: Leftmost node, or NULL for an empty tree.
+ */
+static inline struct rb_node *rb_first_cached(
+	const struct rb_root_cached *root)
+{
+	return root->leftmost;
+}
+
+#endif
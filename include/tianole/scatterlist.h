@@ -0,0 +1,67 @@
+#ifndef TIANOLE_SCATTERLIST_H
+#define TIANOLE_SCATTERLIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tianole/mm.h>
+
+/**
+ * struct scatterlist - One physically contiguous piece of an I/O buffer.
+ * @phys: Physical start of the piece.
+ * @length: Bytes in the piece.
+ * @dma_length: Bytes at @dma_address, set by dma_map_sg().
+ * @dma_address: Bus address set by dma_map_sg().
+ *
+ * Lists are plain arrays with an explicit entry count. dma_map_sg() may
+ * merge adjacent pieces, so the DMA fields of entry N need not describe
+ * the same bytes as its @phys and @length.
+ */
+struct scatterlist {
+	phys_addr_t phys;
+	uint32_t length;
+	uint32_t dma_length;
+	dma_addr_t dma_address;
+};
+
+/**
+ * sg_set_phys() - Point one entry at a physical range.
+ * @sg: Entry to fill.
+ * @phys: Physical start.
+ * @length: Bytes.
+ */
+static inline void sg_set_phys(struct scatterlist *sg, phys_addr_t phys,
+	uint32_t length)
+{
+	sg->phys = phys;
+	sg->length = length;
+	sg->dma_address = 0;
+	sg->dma_length = 0;
+}
+
+/**
+ * sg_init_table() - Clear a scatterlist array.
+ * @sgl: First entry.
+ * @nents: Number of entries.
+ */
+void sg_init_table(struct scatterlist *sgl, unsigned int nents);
+
+/**
+ * sg_init_buffer() - Describe a mapped kernel buffer without copying it.
+ * @sgl: Output entries.
+ * @nents: Capacity of @sgl.
+ * @buf: Kernel virtual address, in the direct map or any mapped area.
+ * @length: Bytes, at least one.
+ *
+ * Each entry covers the longest physically contiguous stretch of the
+ * buffer, so a direct-map buffer needs one entry and a vmalloc_mapped()
+ * buffer at most one per page. Demand-faulted pages must already be
+ * touched; this never faults them in.
+ *
+ * Return: Entries used, -EINVAL for bad arguments, -ENOENT if part of the
+ * buffer is unmapped, or -ENOSPC if @nents entries are not enough.
+ */
+int sg_init_buffer(struct scatterlist *sgl, unsigned int nents,
+	const void *buf, size_t length);
+
+#endif
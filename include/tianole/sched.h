@@ -4,7 +4,9 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <tianole/rbtree.h>
 #include <tianole/spinlock.h>
+#include <tianole/timer.h>
 
 /**
  * typedef kernel_thread_entry_t - Kernel thread entry function.
@@ -25,10 +27,60 @@ typedef int (*wait_condition_t)(void *arg);
 
 struct trap_frame;
 
+/**
+ * SCHED_NR_PRIO - Number of scheduling priorities.
+ *
+ * Priority 0 is the most urgent. A thread only yields the CPU to threads
+ * of equal or more urgent priority. Every level except SCHED_PRIO_DEFAULT
+ * is round robin with a fixed time slice.
+ */
+#define SCHED_NR_PRIO 32u
+
+/**
+ * SCHED_PRIO_DEFAULT - Priority of newly created threads.
+ *
+ * Threads at this level form the fair class: instead of taking turns they
+ * are ordered by weighted virtual runtime, so each gets a CPU share in
+ * proportion to its weight and a thread that mostly blocks runs promptly
+ * when it wakes.
+ */
+#define SCHED_PRIO_DEFAULT 16u
+
+/**
+ * SCHED_PRIO_IDLE - Priority of the idle thread, below every other thread.
+ */
+#define SCHED_PRIO_IDLE (SCHED_NR_PRIO - 1u)
+
+/**
+ * SCHED_NICE_MIN - Nice value with the largest fair-class share.
+ */
+#define SCHED_NICE_MIN (-20)
+
+/**
+ * SCHED_NICE_MAX - Nice value with the smallest fair-class share.
+ *
+ * Each step of nice changes a thread's weight by about 25%, so two CPU-bound
+ * threads one nice level apart split the CPU roughly 55:45.
+ */
+#define SCHED_NICE_MAX 19
+
+/**
+ * SCHED_LATENCY_TICKS_DEFAULT - Default fair-class scheduling period.
+ *
+ * Every READY fair thread runs once per period, for a slice proportional
+ * to its weight and never shorter than one tick.
+ */
+#define SCHED_LATENCY_TICKS_DEFAULT 4u
+
+/**
+ * SCHED_RR_TICKS_DEFAULT - Default time slice of round-robin priorities.
+ */
+#define SCHED_RR_TICKS_DEFAULT 10u
+
 /**
  * enum thread_state - Scheduler-visible thread lifecycle state.
  * @THREAD_READY: Thread is runnable and may be selected by the scheduler.
- * @THREAD_RUNNING: Thread is currently executing on the CPU.
+ * @THREAD_RUNNING: Thread is currently executing on a CPU.
  * @THREAD_SLEEPING: Thread is blocked until a timer deadline.
  * @THREAD_WAITING: Thread is blocked on a wait queue.
  * @THREAD_ZOMBIE: Thread exited; resources are kept until safe reclamation.
@@ -63,6 +115,8 @@ struct wait_queue {
  * struct thread - Kernel scheduler thread object.
  * @id: Scheduler-assigned thread identifier.
  * @state: Current scheduler state.
+ * @priority: Run queue priority, 0 to SCHED_NR_PRIO - 1.
+ * @cpu: CPU the thread runs on, or last ran on.
  * @stack_pointer: Saved context stack pointer for context switching.
  * @entry: Thread entry function.
  * @arg: Entry function argument.
@@ -70,7 +124,16 @@ struct wait_queue {
  * @stack_top: Aligned initial stack top.
  * @stack_size: Kernel stack size in bytes.
  * @wake_tick: Timer tick deadline for sleeping threads.
- * @next: Run queue link owned by the scheduler.
+ * @nice: Fair-class nice value, SCHED_NICE_MIN to SCHED_NICE_MAX.
+ * @weight: Fair-class load weight derived from @nice.
+ * @vruntime: Runtime scaled by 1024 / @weight, in cycle counter units.
+ *            Orders the thread in the fair class.
+ * @sum_exec_runtime: Total runtime in cycle counter units.
+ * @exec_start: Cycle counter when runtime was last charged.
+ * @slice_start: Tick at which the current time slice began.
+ * @next: Run queue link while READY, zombie list link once exited.
+ * @run_node: Fair run queue node while READY at SCHED_PRIO_DEFAULT.
+ * @sleep_timer: Wheel timer that wakes the thread at @wake_tick.
  * @wait_next: Wait queue link owned by wait queue code.
  * @wait_queue: Wait queue currently owning @wait_next, or NULL.
  * @name: Diagnostic thread name.
@@ -81,6 +144,8 @@ struct wait_queue {
 struct thread {
 	uint64_t id;
 	enum thread_state state;
+	uint32_t priority;
+	uint32_t cpu;
 	uintptr_t stack_pointer;
 	kernel_thread_entry_t entry;
 	void *arg;
@@ -88,7 +153,15 @@ struct thread {
 	uintptr_t stack_top;
 	size_t stack_size;
 	uint64_t wake_tick;
+	int32_t nice;
+	uint32_t weight;
+	uint64_t vruntime;
+	uint64_t sum_exec_runtime;
+	uint64_t exec_start;
+	uint64_t slice_start;
 	struct thread *next;
+	struct rb_node run_node;
+	struct timer_list sleep_timer;
 	struct thread *wait_next;
 	struct wait_queue *wait_queue;
 	char name[32];
@@ -113,6 +186,42 @@ void sched_init(void);
 struct thread *kernel_thread_create(
 	const char *name, kernel_thread_entry_t entry, void *arg);
 
+/**
+ * sched_set_priority() - Change a thread's scheduling priority.
+ * @thread: Thread to change.
+ * @priority: New priority, 0 to SCHED_NR_PRIO - 1.
+ *
+ * A READY thread moves to the tail of its new priority's queue. A running
+ * thread keeps the CPU until it next yields. A thread entering the fair
+ * class starts level with the threads already in it.
+ *
+ * Return: 0 on success, or -EINVAL for a NULL thread or bad priority.
+ */
+int sched_set_priority(struct thread *thread, uint32_t priority);
+
+/**
+ * sched_set_nice() - Change a thread's fair-class share.
+ * @thread: Thread to change.
+ * @nice: New nice value, SCHED_NICE_MIN to SCHED_NICE_MAX.
+ *
+ * Runtime already charged is kept; only time run from now on is weighted
+ * by the new value. Has no effect outside the fair class.
+ *
+ * Return: 0 on success, or -EINVAL for a NULL thread or bad nice value.
+ */
+int sched_set_nice(struct thread *thread, int32_t nice);
+
+/**
+ * sched_set_timeslice() - Configure scheduler time slices.
+ * @latency_ticks: Fair-class period shared out among READY fair threads.
+ * @rr_ticks: Slice of a thread at a round-robin priority.
+ *
+ * Slices already running finish under the old values.
+ *
+ * Return: 0 on success, or -EINVAL if either value is zero.
+ */
+int sched_set_timeslice(uint32_t latency_ticks, uint32_t rr_ticks);
+
 /**
  * kernel_thread_exit() - Terminate the current kernel thread.
  *
@@ -122,21 +231,65 @@ struct thread *kernel_thread_create(
  */
 void kernel_thread_exit(void) __attribute__((noreturn));
 
+/**
+ * sched_idle_create() - Create the idle thread of a CPU.
+ * @cpu: CPU that will run the thread.
+ *
+ * The idle thread is never queued; its CPU runs it whenever no thread is
+ * READY. Must be called before @cpu first schedules.
+ *
+ * Return: 0 on success, -EINVAL for a bad or already set up CPU, or
+ * -ENOMEM.
+ */
+int sched_idle_create(uint32_t cpu);
+
 /**
  * sched_start() - Start scheduler demo threads and enter scheduling.
  *
- * Creates the idle thread and current boot-stage scheduler demonstration.
+ * Creates the boot CPU's idle thread and current boot-stage scheduler
+ * demonstration.
  */
 void sched_start(void) __attribute__((noreturn));
 
+/**
+ * sched_cpu_start() - Enter the scheduler on an application processor.
+ *
+ * Called once by a freshly started CPU, after sched_idle_create() for it
+ * and with interrupts disabled. Switches away from the boot context for
+ * good.
+ */
+void sched_cpu_start(void) __attribute__((noreturn));
+
 /**
  * sched_tick() - Notify the scheduler about a timer tick.
  * @tick: Current generic timer tick.
  *
- * Wakes sleeping threads whose deadlines expired and requests rescheduling.
+ * Charges the running thread and requests rescheduling once its time slice
+ * is used up. Sleeping threads are woken earlier in the same tick by their
+ * own wheel timers, and a woken thread that should run first asks for the
+ * reschedule itself. Called on the CPU that owns the timer tick.
  */
 void sched_tick(uint64_t tick);
 
+/**
+ * sched_cpu_tick() - Notify the scheduler about a local CPU timer tick.
+ *
+ * CPUs that do not own the timer tick call this from their own timer
+ * interrupt, which only ends the running thread's time slice when due.
+ * That timer runs only while the CPU has work other than its idle thread.
+ */
+void sched_cpu_tick(void);
+
+/**
+ * sched_idle_cpu() - Check whether the machine has nothing but idle to run.
+ *
+ * Read without scheduler_lock; call with interrupts disabled.
+ *
+ * Return: Non-zero if the calling CPU and every other online CPU run their
+ * idle thread and no thread is READY.
+ */
+int sched_idle_cpu(void);
+
 /**
  * sched_irq_enter() - Mark entry into external IRQ dispatch.
  *
@@ -159,8 +312,11 @@ void sched_irq_exit(struct trap_frame *frame);
 /**
  * sched_yield() - Yield the CPU to another runnable kernel thread.
  *
- * Performs cooperative scheduling and context switching when another runnable
- * thread is available.
+ * Switches to the most urgent READY thread: the oldest one of a
+ * round-robin priority, or the one with the least virtual runtime in the
+ * fair class. A running caller keeps the CPU if every READY thread is less
+ * urgent. Otherwise a round-robin caller goes to the back of its queue,
+ * and a fair caller only gives way to a thread that has run less.
  */
 void sched_yield(void);
 
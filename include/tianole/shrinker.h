@@ -0,0 +1,108 @@
+#ifndef TIANOLE_SHRINKER_H
+#define TIANOLE_SHRINKER_H
+
+#include <stdint.h>
+
+struct shrinker;
+
+/**
+ * typedef shrinker_count_t - Report how much a cache could give back.
+ * @shrinker: Shrinker being queried.
+ *
+ * Return: Pages the cache could free right now; an estimate is fine.
+ */
+typedef uint64_t (*shrinker_count_t)(struct shrinker *shrinker);
+
+/**
+ * typedef shrinker_scan_t - Release cached memory.
+ * @shrinker: Shrinker being asked to free memory.
+ * @nr_to_scan: Pages wanted; freeing fewer or somewhat more is allowed.
+ *
+ * Return: Pages actually returned to the page allocator.
+ */
+typedef uint64_t (*shrinker_scan_t)(struct shrinker *shrinker,
+	uint64_t nr_to_scan);
+
+/**
+ * struct shrinker - Cache that can hand memory back under pressure.
+ * @name: Diagnostic name.
+ * @count: Reports reclaimable pages.
+ * @scan: Frees pages.
+ * @freed: Pages freed by @scan so far; maintained by the registry.
+ * @active: shrink_caches() passes holding the shrinker; owned by the
+ *          registry.
+ * @next: Registry link owned by the registry.
+ *
+ * Both callbacks run in thread context without the registry lock, so they
+ * may take their own locks, unmap memory and wait for TLB shootdowns. They
+ * must not unregister their own shrinker, or allocate memory they do not
+ * give back before returning.
+ */
+struct shrinker {
+	const char *name;
+	shrinker_count_t count;
+	shrinker_scan_t scan;
+	uint64_t freed;
+	uint32_t active;
+	struct shrinker *next;
+};
+
+/**
+ * register_shrinker() - Let reclaim trim a cache.
+ * @shrinker: Caller-owned shrinker with @name, @count and @scan set.
+ *
+ * Shrinkers are asked in registration order, so caches that are cheap to
+ * rebuild should register first.
+ *
+ * Return: 0 on success, -EINVAL for a missing callback, or -EEXIST if
+ * @shrinker is already registered.
+ */
+int register_shrinker(struct shrinker *shrinker);
+
+/**
+ * unregister_shrinker() - Remove a shrinker from the registry.
+ * @shrinker: Shrinker passed to register_shrinker().
+ *
+ * Waits for callbacks already running on other threads, so the caller may
+ * free @shrinker's cache once this returns. Must be called from thread
+ * context.
+ */
+void unregister_shrinker(struct shrinker *shrinker);
+
+/**
+ * shrink_caches() - Ask registered caches to free memory.
+ * @nr_pages: Pages wanted.
+ *
+ * Shrinkers registered or removed during the pass may be skipped or asked
+ * twice; reclaim only needs a best effort.
+ *
+ * Return: Pages freed, which may fall short of @nr_pages.
+ */
+uint64_t shrink_caches(uint64_t nr_pages);
+
+/**
+ * reclaim_wake() - Kick the reclaim thread.
+ *
+ * Called by the page allocator when free memory drops below the low
+ * watermark or an allocation fails. Safe from IRQ context and before the
+ * reclaim thread exists, in which case it only records the request.
+ */
+void reclaim_wake(void);
+
+/**
+ * reclaim_start() - Start the reclaim kernel thread.
+ *
+ * The thread sleeps until reclaim_wake() and then shrinks caches until
+ * free memory is back above the high watermark or nothing more can be
+ * freed.
+ *
+ * Return: 0 on success or -ENOMEM.
+ */
+int reclaim_start(void);
+
+/**
+ * shrinker_selftest() - Check watermarks and shrinker dispatch.
+ */
+void shrinker_selftest(void);
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef TIANOLE_SLAB_H
+#define TIANOLE_SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * SLAB_NAME_LENGTH - Maximum cache name length including the terminator.
+ */
+#define SLAB_NAME_LENGTH 24u
+
+/**
+ * typedef kmem_ctor_t - Object constructor run when a slab is populated.
+ * @object: Newly carved object.
+ *
+ * Constructors run once per object when its slab is created, not on every
+ * allocation. Users must return objects to the cache in constructed state.
+ */
+typedef void (*kmem_ctor_t)(void *object);
+
+/**
+ * struct kmem_cache_stats - Snapshot of one cache's usage.
+ * @name: Cache name given to kmem_cache_create().
+ * @object_size: Requested object size in bytes.
+ * @stride: Bytes each object occupies inside a slab, including alignment.
+ * @objects_per_slab: Objects carved from one slab.
+ * @slab_bytes: Size of one slab in bytes.
+ * @slabs: Slabs currently owned by the cache.
+ * @objects_inuse: Objects currently allocated.
+ * @waste_bytes: Slab bytes not holding a live object's requested bytes.
+ */
+struct kmem_cache_stats {
+	const char *name;
+	size_t object_size;
+	size_t stride;
+	uint32_t objects_per_slab;
+	uint64_t slab_bytes;
+	uint64_t slabs;
+	uint64_t objects_inuse;
+	uint64_t waste_bytes;
+};
+
+struct kmem_cache;
+
+/**
+ * kmem_cache_create() - Create a cache of fixed-size objects.
+ * @name: Diagnostic name, copied into the cache.
+ * @size: Object size in bytes.
+ * @align: Power-of-two object alignment, or 0 for pointer alignment.
+ * @ctor: Optional constructor, or NULL.
+ *
+ * Slabs are whole buddy blocks sized so each holds several objects. Free
+ * objects are chained through their first word, so allocation and free are
+ * a few pointer operations once a slab exists.
+ *
+ * Return: New cache, or NULL for invalid arguments or exhausted memory.
+ */
+struct kmem_cache *kmem_cache_create(
+	const char *name, size_t size, size_t align, kmem_ctor_t ctor);
+
+/**
+ * kmem_cache_destroy() - Release a cache and all of its slabs.
+ * @cache: Cache returned by kmem_cache_create().
+ *
+ * Every object must already have been freed; live objects are a bug.
+ */
+void kmem_cache_destroy(struct kmem_cache *cache);
+
+/**
+ * kmem_cache_alloc() - Allocate one object from a cache.
+ * @cache: Cache to allocate from.
+ *
+ * Safe in IRQ and thread context.
+ *
+ * Return: Object pointer, or NULL when no slab can be allocated.
+ */
+void *kmem_cache_alloc(struct kmem_cache *cache);
+
+/**
+ * kmem_cache_free() - Return an object to its cache.
+ * @cache: Cache the object was allocated from.
+ * @object: Object returned by kmem_cache_alloc(), or NULL.
+ *
+ * Freeing into the wrong cache panics instead of corrupting slab state.
+ */
+void kmem_cache_free(struct kmem_cache *cache, void *object);
+
+/**
+ * kmem_cache_get_stats() - Snapshot one cache's usage counters.
+ * @cache: Cache to query.
+ * @stats: Output storage.
+ */
+void kmem_cache_get_stats(
+	struct kmem_cache *cache, struct kmem_cache_stats *stats);
+
+/**
+ * kmem_cache_dump() - Log usage statistics for every cache.
+ *
+ * Prints one line per cache with objects in use, slab count and waste.
+ */
+void kmem_cache_dump(void);
+
+/**
+ * slab_selftest() - Run boot-time slab allocator checks.
+ *
+ * Verifies constructors, object reuse, slab growth and release.
+ */
+void slab_selftest(void);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef TIANOLE_SMP_H
+#define TIANOLE_SMP_H
+
+#include <stdint.h>
+
+/**
+ * NR_CPUS - Most CPUs the kernel brings online.
+ *
+ * Sizes every per-CPU array. Firmware may describe more processors; the
+ * extra ones are left halted.
+ */
+#define NR_CPUS 16u
+
+/**
+ * smp_processor_id() - Return the logical number of the running CPU.
+ *
+ * The boot CPU is 0 and application processors are numbered in the order
+ * they were started. The result is only stable while the caller cannot
+ * move to another CPU, i.e. with interrupts disabled or from IRQ context.
+ *
+ * Return: CPU number below NR_CPUS.
+ */
+uint32_t smp_processor_id(void);
+
+/**
+ * num_online_cpus() - Count the CPUs that have come online.
+ *
+ * Return: Number of online CPUs, at least 1.
+ */
+uint32_t num_online_cpus(void);
+
+/**
+ * cpu_online() - Check whether a CPU has come online.
+ * @cpu: Logical CPU number.
+ *
+ * Return: Non-zero if @cpu is online.
+ */
+int cpu_online(uint32_t cpu);
+
+/**
+ * set_cpu_online() - Mark the running CPU online.
+ * @cpu: Logical number of the running CPU.
+ *
+ * Called once by each application processor when it can take TLB
+ * shootdowns and reschedule requests. CPUs never go offline again.
+ */
+void set_cpu_online(uint32_t cpu);
+
+/**
+ * smp_init() - Start the application processors.
+ *
+ * Called by kernel_main() on the boot CPU once the scheduler and timer
+ * are running. Each started CPU enters the scheduler on its own idle
+ * thread. Firmware without usable processor tables leaves the kernel on
+ * the boot CPU.
+ */
+void smp_init(void);
+
+#endif
@@ -4,11 +4,12 @@
 #include <stdint.h>
 
 /**
- * struct spinlock - Early interrupt-safe lock.
- * @locked: Non-zero while the lock is held.
+ * struct spinlock - Interrupt-safe SMP lock.
+ * @locked: Owning CPU number plus one, or zero while the lock is free.
  *
- * Current implementation is single-CPU and panics on contention. The API is
- * shaped so it can later grow toward a real SMP spinlock.
+ * Other CPUs spin until the owner releases the lock. Recording the owner
+ * lets a CPU that tries to take a lock it already holds panic instead of
+ * deadlocking on itself.
  */
 struct spinlock {
 	int locked;
@@ -23,12 +24,13 @@ struct spinlock {
 	}
 
 /**
- * spin_lock_irqsave() - Acquire a single-CPU interrupt-safe spinlock.
+ * spin_lock_irqsave() - Acquire an interrupt-safe spinlock.
  * @lock: Lock to acquire.
  * @flags: Storage for the previous interrupt state.
  *
- * Disables interrupts before taking the lock so IRQ and thread context can
- * share early kernel data structures.
+ * Disables local interrupts before taking the lock so IRQ and thread
+ * context can share kernel data structures, then spins while another CPU
+ * holds it. Taking a lock the current CPU already holds panics.
  */
 void spin_lock_irqsave(struct spinlock *lock, uint64_t *flags);
 
@@ -44,9 +46,9 @@ void spin_unlock_irqrestore(struct spinlock *lock, uint64_t flags);
 /**
  * spinlock_held_count() - Return the current CPU spinlock nesting count.
  *
- * This is an early single-CPU scheduling guard, similar in spirit to the
- * lock/preempt state Linux uses before allowing a blocking operation. Code
- * that can sleep or context switch must only run when this count is zero.
+ * This is a per-CPU scheduling guard, similar in spirit to the lock/preempt
+ * state Linux uses before allowing a blocking operation. Code that can sleep
+ * or context switch must only run when this count is zero.
  *
  * Return: Number of interrupt-safe spinlocks held by the current CPU.
  */
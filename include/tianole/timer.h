@@ -3,10 +3,44 @@
 
 #include <stdint.h>
 
+struct timer_list;
+struct timer_base;
+
+/**
+ * typedef timer_func_t - Kernel timer callback.
+ * @timer: Timer that expired; @timer->data carries the caller's context.
+ */
+typedef void (*timer_func_t)(struct timer_list *timer);
+
+/**
+ * struct timer_list - One-shot kernel timer on the timer wheel.
+ * @expires: Tick at which @func runs.
+ * @func: Callback run from the timer IRQ once @expires has passed.
+ * @data: Opaque caller data consumed by @func.
+ * @next: Wheel slot link owned by the timer core.
+ * @pprev: Link that points at this timer, or NULL while not pending.
+ * @base: Wheel the timer was last queued on.
+ *
+ * A timer is caller-owned storage. Callbacks run in IRQ context with
+ * interrupts disabled, so they must not sleep; a callback may re-arm its
+ * own timer with mod_timer().
+ */
+struct timer_list {
+	uint64_t expires;
+	timer_func_t func;
+	void *data;
+	struct timer_list *next;
+	struct timer_list **pprev;
+	struct timer_base *base;
+};
+
 /**
  * timer_tick() - Advance generic timer state by one hardware tick.
  *
- * Called by the architecture timer IRQ handler before scheduler tick handling.
+ * Called by the architecture timer IRQ handler. Runs every timer that
+ * expired on this tick, then the scheduler tick. When only the idle
+ * thread is runnable, it stops the periodic tick until the next pending
+ * timer; the IRQ that ends the stop also arrives here.
  */
 void timer_tick(void);
 
@@ -17,4 +51,78 @@ void timer_tick(void);
  */
 uint64_t timer_ticks(void);
 
+/**
+ * timer_init() - Initialize a caller-owned timer.
+ * @timer: Timer storage.
+ * @func: Callback to run on expiry.
+ * @data: Opaque callback data.
+ */
+void timer_init(struct timer_list *timer, timer_func_t func, void *data);
+
+/**
+ * add_timer() - Start a timer that is not pending.
+ * @timer: Initialized timer with @timer->expires set.
+ *
+ * An @expires that already passed fires on the next tick. Adding a
+ * pending timer panics; use mod_timer() to move one.
+ */
+void add_timer(struct timer_list *timer);
+
+/**
+ * mod_timer() - Set a timer's expiry, starting it if needed.
+ * @timer: Initialized timer.
+ * @expires: New expiry tick.
+ *
+ * Return: 1 if the timer was pending, 0 if it was idle.
+ */
+int mod_timer(struct timer_list *timer, uint64_t expires);
+
+/**
+ * del_timer() - Stop a timer.
+ * @timer: Initialized timer.
+ *
+ * Return: 1 if a pending timer was stopped, 0 if it was idle.
+ */
+int del_timer(struct timer_list *timer);
+
+/**
+ * timer_pending() - Check whether a timer is queued.
+ * @timer: Initialized timer.
+ *
+ * Return: Non-zero while the timer waits on the wheel.
+ */
+static inline int timer_pending(const struct timer_list *timer)
+{
+	return timer->pprev != 0;
+}
+
+/**
+ * timer_next_expiry() - Find the earliest pending kernel timer.
+ *
+ * Return: Expiry tick of the earliest pending timer, or UINT64_MAX.
+ */
+uint64_t timer_next_expiry(void);
+
+/**
+ * tick_nohz_irq_enter() - Bring timer_ticks() up to date on IRQ entry.
+ *
+ * Called on the outermost IRQ entry. While the idle CPU runs with the
+ * periodic tick stopped, this counts the ticks that passed so handlers see
+ * an accurate tick count.
+ */
+void tick_nohz_irq_enter(void);
+
+/**
+ * tick_nohz_irq_exit() - Restart a stopped tick if the CPU is busy again.
+ *
+ * Called on the outermost IRQ exit, before any reschedule. A handler that
+ * made a thread READY needs the periodic tick back before it runs.
+ */
+void tick_nohz_irq_exit(void);
+
+/**
+ * timer_selftest() - Check timer wheel insert, cascade and expiry.
+ */
+void timer_selftest(void);
+
 #endif
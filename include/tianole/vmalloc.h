@@ -0,0 +1,60 @@
+#ifndef TIANOLE_VMALLOC_H
+#define TIANOLE_VMALLOC_H
+
+#include <stddef.h>
+
+/**
+ * vmalloc() - Reserve virtually contiguous kernel memory.
+ * @size: Bytes requested, rounded up to whole pages.
+ *
+ * Only address space is reserved; each page is allocated and mapped by the
+ * page-fault handler on first touch, so untouched pages cost no memory.
+ * An unmapped guard page follows every area, and since areas are packed
+ * upwards, the previous area's guard page precedes it.
+ *
+ * Must not be touched for the first time from code that holds the page
+ * allocator or vm_region locks.
+ *
+ * Return: Page-aligned pointer, or NULL when @size is 0 or the vmalloc
+ * window or the area descriptor cannot be allocated.
+ */
+void *vmalloc(size_t size);
+
+/**
+ * vmalloc_mapped() - Reserve kernel memory and map all of it now.
+ * @size: Bytes requested, rounded up to whole pages.
+ *
+ * Same layout and guard pages as vmalloc(), for memory that must never
+ * take a demand fault, such as kernel stacks: the fault itself would need
+ * the stack. Frames come in as few buddy blocks as memory allows.
+ *
+ * Return: Page-aligned pointer, or NULL on failure.
+ */
+void *vmalloc_mapped(size_t size);
+
+/**
+ * vfree() - Release a vmalloc() area and the pages mapped in it.
+ * @ptr: Pointer returned by vmalloc() or vmalloc_mapped(), or NULL.
+ *
+ * Freeing an address that is not the start of a live area panics.
+ */
+void vfree(void *ptr);
+
+/**
+ * vmalloc_contains() - Check whether a pointer lies in the vmalloc window.
+ * @ptr: Kernel virtual address.
+ *
+ * Return: Non-zero if @ptr is inside the window, whether or not an area
+ * currently covers it.
+ */
+int vmalloc_contains(const void *ptr);
+
+/**
+ * vmalloc_selftest() - Check demand-faulted vmalloc() areas.
+ *
+ * Verifies that a reservation allocates nothing until touched, that the
+ * touched pages are faulted in, and that vfree() returns them.
+ */
+void vmalloc_selftest(void);
+
+#endif
@@ -57,4 +57,16 @@ int workqueue_start(void);
  */
 int queue_work(struct work_struct *work);
 
+/**
+ * cancel_work_sync() - Dequeue work and wait for a running callback.
+ * @work: Initialized work item.
+ *
+ * Once this returns, @work is neither queued nor running, so its storage
+ * may be freed unless someone queues it again. Must be called from thread
+ * context and never from @work's own callback.
+ *
+ * Return: 1 if @work was queued and has been removed, otherwise 0.
+ */
+int cancel_work_sync(struct work_struct *work);
+
 #endif
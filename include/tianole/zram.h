@@ -0,0 +1,79 @@
+#ifndef TIANOLE_ZRAM_H
+#define TIANOLE_ZRAM_H
+
+#include <stdint.h>
+
+#include <tianole/blkdev.h>
+
+/**
+ * struct zram_stats - Usage counters of one compressed RAM device.
+ * @nr_pages: Device size in pages.
+ * @stored_pages: Pages holding data, same-filled ones included.
+ * @same_pages: Pages stored as a single repeated word, without storage.
+ * @huge_pages: Incompressible pages stored uncompressed in a whole page.
+ * @compr_bytes: LZ4 output bytes of the compressed pages.
+ * @mem_used_bytes: Storage actually allocated, size-class rounding and
+ *                  huge pages included.
+ * @reads: Completed reads.
+ * @writes: Completed writes.
+ * @discards: Stored pages dropped by discard.
+ */
+struct zram_stats {
+	uint64_t nr_pages;
+	uint64_t stored_pages;
+	uint64_t same_pages;
+	uint64_t huge_pages;
+	uint64_t compr_bytes;
+	uint64_t mem_used_bytes;
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t discards;
+};
+
+/**
+ * zram_create() - Create and register a compressed RAM block device.
+ * @name: Device name; the string must outlive the device.
+ * @nr_pages: Device size in PAGE_SIZE blocks.
+ *
+ * Written pages are LZ4-compressed into slab size classes. Pages filled
+ * with one repeated 64-bit word, zero pages included, only record that
+ * word; pages that do not compress below three quarters of a page are
+ * kept uncompressed. Unwritten pages read as zero. Memory is allocated on
+ * write, so the device can be much larger than the RAM it uses.
+ *
+ * Return: Registered device, or NULL on failure.
+ */
+struct block_device *zram_create(const char *name, uint64_t nr_pages);
+
+/**
+ * zram_destroy() - Unregister a zram device and free everything it holds.
+ * @dev: Device from zram_create().
+ */
+void zram_destroy(struct block_device *dev);
+
+/**
+ * zram_get_stats() - Snapshot a zram device's counters.
+ * @dev: Device from zram_create().
+ * @stats: Output.
+ *
+ * Return: 0, or -EINVAL if @dev is not a zram device.
+ */
+int zram_get_stats(struct block_device *dev, struct zram_stats *stats);
+
+/**
+ * zram_report() - Log a zram device's counters and compression ratio.
+ * @dev: Device from zram_create().
+ */
+void zram_report(struct block_device *dev);
+
+/**
+ * zram_init() - Create the boot-time "zram0" device.
+ */
+void zram_init(void);
+
+/**
+ * zram_selftest() - Check LZ4 round trips and zram storage classes.
+ */
+void zram_selftest(void);
+
+#endif
@@ -2,6 +2,7 @@
 
 #include <tianole/boot_info.h>
 #include <tianole/kernel_init.h>
+#include <tianole/mm.h>
 #include <tianole/printk.h>
 
 static void log_memory_map_summary(const boot_info_t *boot_info)
@@ -20,9 +21,8 @@ static void log_memory_map_summary(const boot_info_t *boot_info)
 		boot_info->memory_map_size;
 		offset += boot_info->memory_descriptor_size) {
 		const boot_memory_descriptor_t *descriptor =
-			(const boot_memory_descriptor_t
-					*)(uintptr_t)(boot_info->memory_map +
-				offset);
+			(const boot_memory_descriptor_t *)((const uint8_t *)
+				phys_to_virt(boot_info->memory_map) + offset);
 
 		descriptors++;
 		if (descriptor->type == BOOT_MEMORY_TYPE_CONVENTIONAL) {
@@ -52,4 +52,6 @@ void kernel_report_boot_state(const boot_info_t *boot_info)
 	}
 
 	log_memory_map_summary(boot_info);
+	pr_info("boot memory reclaimed pages=%llu\n",
+		(unsigned long long)nr_boot_reclaimed_pages());
 }
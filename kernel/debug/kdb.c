@@ -2,9 +2,11 @@
 
 #include <tianole/input.h>
 #include <tianole/kdb.h>
+#include <tianole/mm.h>
 #include <tianole/panic.h>
 #include <tianole/printk.h>
 #include <tianole/sched.h>
+#include <tianole/slab.h>
 #include <tianole/timer.h>
 #include <tianole/tty.h>
 
@@ -53,6 +55,8 @@ static void kdb_print_help(void)
 	tty_write_string("  ticks       show timer ticks\n");
 	tty_write_string("  drops       show input and line drops\n");
 	tty_write_string("  keys        show the most recent input event\n");
+	tty_write_string("  slab        log slab cache statistics\n");
+	tty_write_string("  heap        log heap usage and fragmentation\n");
 	tty_write_string("  echo TEXT   print TEXT\n");
 }
 
@@ -181,6 +185,16 @@ static void kdb_run_command(const char *line)
 		return;
 	}
 
+	if (kdb_streq(command, "slab")) {
+		kmem_cache_dump();
+		return;
+	}
+
+	if (kdb_streq(command, "heap")) {
+		heap_report();
+		return;
+	}
+
 	if (kdb_starts_with(command, "echo")) {
 		const char *text = command + 4;
 
@@ -0,0 +1,122 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tianole/arch.h>
+#include <tianole/dma.h>
+#include <tianole/errno.h>
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/scatterlist.h>
+
+static uint64_t dma_pages(size_t size)
+{
+	return ((uint64_t)size + PAGE_SIZE - 1) / PAGE_SIZE;
+}
+
+void *dma_alloc_coherent(size_t size, dma_addr_t *dma_handle,
+	uint64_t dma_mask)
+{
+	uint64_t nr_pages = dma_pages(size);
+	enum zone_type zone = ZONE_NORMAL;
+	phys_addr_t phys;
+	uint64_t index;
+
+	if (size == 0 || dma_handle == 0) {
+		return 0;
+	}
+
+	if (dma_mask < ZONE_DMA32_LIMIT) {
+		zone = ZONE_DMA32;
+	}
+
+	phys = alloc_contig_pages(nr_pages, zone);
+	if (phys == 0) {
+		return 0;
+	}
+
+	/* DMA32 is the narrowest zone; narrower masks may still miss. */
+	if (phys + nr_pages * PAGE_SIZE - 1 > dma_mask) {
+		free_contig_pages(phys, nr_pages);
+		return 0;
+	}
+
+	phys_to_page(phys)->owner = PAGE_OWNER_DMA;
+	for (index = 0; index < nr_pages; index++) {
+		arch_clear_page(phys_to_virt(phys + index * PAGE_SIZE));
+	}
+
+	*dma_handle = phys;
+	return phys_to_virt(phys);
+}
+
+void dma_free_coherent(size_t size, void *vaddr, dma_addr_t dma_handle)
+{
+	if (vaddr == 0) {
+		return;
+	}
+
+	if (size == 0 || vaddr != phys_to_virt(dma_handle)) {
+		panic("invalid coherent DMA free");
+	}
+
+	free_contig_pages(dma_handle, dma_pages(size));
+}
+
+int dma_map_sg(struct scatterlist *sgl, unsigned int nents,
+	uint64_t dma_mask)
+{
+	unsigned int mapped = 0;
+	unsigned int index;
+
+	if (sgl == 0 || nents == 0) {
+		return -EINVAL;
+	}
+
+	for (index = 0; index < nents; index++) {
+		if (sgl[index].length == 0) {
+			return -EINVAL;
+		}
+
+		if (sgl[index].phys + sgl[index].length - 1 > dma_mask) {
+			return -EIO;
+		}
+	}
+
+	/*
+	 * Segment N is written no later than entry N is read, and only the
+	 * DMA fields are written, so merging in place is safe.
+	 */
+	for (index = 0; index < nents; index++) {
+		const struct scatterlist *sg = &sgl[index];
+		struct scatterlist *last = mapped != 0 ? &sgl[mapped - 1] : 0;
+
+		if (last != 0 &&
+			last->dma_address + last->dma_length == sg->phys &&
+			last->dma_length <= UINT32_MAX - sg->length) {
+			last->dma_length += sg->length;
+			continue;
+		}
+
+		sgl[mapped].dma_address = sg->phys;
+		sgl[mapped].dma_length = sg->length;
+		mapped++;
+	}
+
+	for (index = mapped; index < nents; index++) {
+		sgl[index].dma_address = 0;
+		sgl[index].dma_length = 0;
+	}
+
+	return (int)mapped;
+}
+
+void dma_unmap_sg(struct scatterlist *sgl, unsigned int nents)
+{
+	unsigned int index;
+
+	/* Bus addresses are physical, so there is no translation to undo. */
+	for (index = 0; sgl != 0 && index < nents; index++) {
+		sgl[index].dma_address = 0;
+		sgl[index].dma_length = 0;
+	}
+}
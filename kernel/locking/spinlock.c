@@ -2,51 +2,76 @@
 
 #include <tianole/arch.h>
 #include <tianole/panic.h>
+#include <tianole/smp.h>
 #include <tianole/spinlock.h>
 
-static int spinlock_depth;
+static int spinlock_depth[NR_CPUS];
 
 /**
  * spinlock_held_count() - Return current CPU spinlock nesting depth.
  *
- * The early kernel is single-CPU, so a global counter is enough to catch
+ * Each CPU counts only the locks it holds itself, which is what catches
  * accidental calls into blocking scheduler paths while an irq-safe spinlock
- * is held. SMP support will need to move this state to per-CPU storage.
+ * is held. Interrupts are held off for the read so the task cannot migrate
+ * between picking the CPU and reading its counter.
  */
 int spinlock_held_count(void)
 {
-	return spinlock_depth;
+	uint64_t flags = arch_irq_save();
+	int depth = spinlock_depth[smp_processor_id()];
+
+	arch_irq_restore(flags);
+	return depth;
 }
 
 void spin_lock_irqsave(struct spinlock *lock, uint64_t *flags)
 {
 	uint64_t saved_flags;
+	int owner;
+	int unlocked;
 
 	if (lock == 0 || flags == 0) {
 		panic("invalid spinlock acquire");
 	}
 
 	saved_flags = arch_irq_save();
-	if (lock->locked != 0) {
-		panic("spinlock recursion or contention");
+	owner = (int)smp_processor_id() + 1;
+	if (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED) == owner) {
+		panic("spinlock recursion");
+	}
+
+	for (;;) {
+		unlocked = 0;
+		if (__atomic_compare_exchange_n(&lock->locked, &unlocked, owner,
+			    0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			break;
+		}
+
+		/* Wait on plain loads so the cache line stays shared. */
+		while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED) != 0) {
+			arch_cpu_relax();
+		}
 	}
 
-	lock->locked = 1;
-	spinlock_depth++;
+	spinlock_depth[owner - 1]++;
 	*flags = saved_flags;
 }
 
 void spin_unlock_irqrestore(struct spinlock *lock, uint64_t flags)
 {
-	if (lock == 0 || lock->locked == 0) {
+	uint32_t cpu = smp_processor_id();
+
+	if (lock == 0 ||
+		__atomic_load_n(&lock->locked, __ATOMIC_RELAXED) !=
+			(int)cpu + 1) {
 		panic("invalid spinlock release");
 	}
 
-	if (spinlock_depth <= 0) {
+	if (spinlock_depth[cpu] <= 0) {
 		panic("spinlock depth underflow");
 	}
 
-	spinlock_depth--;
-	lock->locked = 0;
+	spinlock_depth[cpu]--;
+	__atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
 	arch_irq_restore(flags);
 }
@@ -2,6 +2,7 @@
 
 #include <tianole/arch.h>
 #include <tianole/console.h>
+#include <tianole/dma.h>
 #include <tianole/early_log.h>
 #include <tianole/fs.h>
 #include <tianole/input.h>
@@ -12,7 +13,11 @@
 #include <tianole/panic.h>
 #include <tianole/printk.h>
 #include <tianole/sched.h>
+#include <tianole/shrinker.h>
+#include <tianole/smp.h>
+#include <tianole/timer.h>
 #include <tianole/workqueue.h>
+#include <tianole/zram.h>
 
 void kernel_main(const boot_info_t *boot_info)
 {
@@ -20,8 +25,9 @@ void kernel_main(const boot_info_t *boot_info)
 	printk_init();
 	pr_info("kernel_main entered\n");
 	arch_traps_init();
-	kernel_report_boot_state(boot_info);
 	mm_init(boot_info);
+	kernel_report_boot_state(mm_boot_info());
+	dma_selftest();
 	sched_init();
 	workqueue_init();
 	input_init();
@@ -29,6 +35,9 @@ void kernel_main(const boot_info_t *boot_info)
 	vfs_init();
 	ramfs_init();
 	vfs_selftest();
+	zram_init();
+	zram_selftest();
+	timer_selftest();
 	ps2_keyboard_init();
 	arch_timer_init();
 
@@ -55,8 +64,12 @@ void kernel_main(const boot_info_t *boot_info)
 	if (workqueue_start() != 0) {
 		panic("workqueue start failed");
 	}
+	if (reclaim_start() != 0) {
+		panic("reclaim thread start failed");
+	}
 	input_console_init();
 	kdb_init();
+	smp_init();
 
 	sched_start();
 }
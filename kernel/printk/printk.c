@@ -2,8 +2,10 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <tianole/arch.h>
 #include <tianole/console.h>
 #include <tianole/printk.h>
+#include <tianole/smp.h>
 
 #define PRINTK_RING_SIZE 4096u
 
@@ -28,6 +30,51 @@ struct printk_ring {
 static struct printk_ring printk_ring;
 static int printk_ready;
 
+/*
+ * CPU number plus one of the CPU emitting a record, or zero. Not a struct
+ * spinlock: a CPU that faults or panics half way through a record must be
+ * able to print again instead of deadlocking on itself.
+ */
+static int printk_owner;
+
+/**
+ * printk_lock() - Serialize records between CPUs.
+ * @flags: Storage for the previous interrupt state.
+ *
+ * Return: Non-zero if the current CPU already owned the lock, in which case
+ * printk_unlock() leaves it held.
+ */
+static int printk_lock(uint64_t *flags)
+{
+	int owner;
+	int unlocked;
+
+	*flags = arch_irq_save();
+	owner = (int)smp_processor_id() + 1;
+	if (__atomic_load_n(&printk_owner, __ATOMIC_RELAXED) == owner) {
+		return 1;
+	}
+
+	for (;;) {
+		unlocked = 0;
+		if (__atomic_compare_exchange_n(&printk_owner, &unlocked, owner,
+			    0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			return 0;
+		}
+
+		arch_cpu_relax();
+	}
+}
+
+static void printk_unlock(int nested, uint64_t flags)
+{
+	if (!nested) {
+		__atomic_store_n(&printk_owner, 0, __ATOMIC_RELEASE);
+	}
+
+	arch_irq_restore(flags);
+}
+
 static void printk_ring_putc(char ch)
 {
 	printk_ring.buffer[printk_ring.head] = ch;
@@ -257,11 +304,15 @@ void printk_init(void)
 int printk(const char *fmt, ...)
 {
 	va_list args;
+	uint64_t flags;
+	int nested;
 	int ret;
 
+	nested = printk_lock(&flags);
 	va_start(args, fmt);
 	ret = vprintk_format(fmt, args);
 	va_end(args);
+	printk_unlock(nested, flags);
 	return ret;
 }
 
@@ -270,10 +321,15 @@ int printk_level(enum printk_loglevel level, const char *fmt, ...)
 	va_list args;
 	int ret;
 
+	uint64_t flags;
+	int nested;
+
 	(void)level;
 
+	nested = printk_lock(&flags);
 	va_start(args, fmt);
 	ret = vprintk_format(fmt, args);
 	va_end(args);
+	printk_unlock(nested, flags);
 	return ret;
 }
@@ -2,121 +2,724 @@
 
 #include <arch/switch.h>
 
+#include <tianole/arch.h>
+#include <tianole/errno.h>
 #include <tianole/printk.h>
 #include <tianole/sched.h>
+#include <tianole/smp.h>
 #include <tianole/timer.h>
 
 #include "sched.h"
 
-struct thread *run_queue_head;
-struct thread *run_queue_tail;
-struct thread *current_thread;
-uintptr_t boot_stack_pointer;
+/* Wakeups preempt a fair thread only if it is this far ahead. */
+#define WAKEUP_GRANULARITY_TICKS 1u
+
+struct run_queue run_queue;
+struct sched_cpu sched_cpus[NR_CPUS];
+struct thread *zombie_list;
 uint64_t next_thread_id = 1;
 int scheduler_ready;
-int schedule_locked;
-int need_resched;
-int irq_depth;
-struct thread *idle_thread;
 struct spinlock scheduler_lock = SPINLOCK_INITIALIZER;
 
-void enqueue_thread(struct thread *thread)
+static uint32_t sched_latency_ticks = SCHED_LATENCY_TICKS_DEFAULT;
+static uint32_t sched_rr_ticks = SCHED_RR_TICKS_DEFAULT;
+
+/*
+ * Weight of each nice value, SCHED_NICE_MIN first. Adjacent entries differ
+ * by about 1.25x, so one nice level moves about 10% of the CPU between two
+ * competing threads whatever their absolute nice values.
+ */
+static const uint32_t nice_to_weight[SCHED_NICE_MAX - SCHED_NICE_MIN + 1] = {
+	88761, 71755, 56483, 46273, 36291,
+	29154, 23254, 18705, 14949, 11916,
+	9548, 7620, 6100, 4904, 3906,
+	3121, 2501, 1991, 1586, 1277,
+	1024, 820, 655, 526, 423,
+	335, 272, 215, 172, 137,
+	110, 87, 70, 56, 45,
+	36, 29, 23, 18, 15,
+};
+
+uint32_t sched_nice_to_weight(int32_t nice)
 {
-	thread->next = 0;
+	return nice_to_weight[nice - SCHED_NICE_MIN];
+}
+
+struct thread *sched_current(void)
+{
+	uint64_t flags = arch_irq_save();
+	struct thread *thread = this_sched_cpu()->curr;
+
+	arch_irq_restore(flags);
+	return thread;
+}
 
-	if (run_queue_tail != 0) {
-		run_queue_tail->next = thread;
+static void set_need_resched(struct sched_cpu *cpu)
+{
+	__atomic_store_n(&cpu->need_resched, 1, __ATOMIC_RELAXED);
+}
+
+/* Compare vruntimes so that the counter may wrap. */
+static int vruntime_before(uint64_t left, uint64_t right)
+{
+	return (int64_t)(left - right) < 0;
+}
+
+/**
+ * ticks_to_runtime() - Convert a tick count into cycle counter units.
+ * @ticks: Tick count.
+ *
+ * Return: Runtime worth @ticks, or 0 before the tick length is measured.
+ */
+static uint64_t ticks_to_runtime(uint64_t ticks)
+{
+	return ticks * run_queue.tick_cycles;
+}
+
+static struct thread *fair_first(void)
+{
+	struct rb_node *node = rb_first_cached(&run_queue.fair);
+
+	return node != 0 ? rb_entry(node, struct thread, run_node) : 0;
+}
+
+/**
+ * update_min_vruntime() - Advance the fair class's vruntime floor.
+ * @curr: Thread that owns the CPU, which is not in the tree.
+ *
+ * The floor follows the smallest vruntime of the running fair thread and
+ * the READY ones, but never moves back.
+ */
+static void update_min_vruntime(const struct thread *curr)
+{
+	struct thread *first = fair_first();
+	uint64_t vruntime;
+
+	if (thread_is_running(curr) && thread_is_fair(curr)) {
+		vruntime = curr->vruntime;
+		if (first != 0 && vruntime_before(first->vruntime, vruntime)) {
+			vruntime = first->vruntime;
+		}
+	} else if (first != 0) {
+		vruntime = first->vruntime;
 	} else {
-		run_queue_head = thread;
+		return;
 	}
 
-	run_queue_tail = thread;
+	if (vruntime_before(run_queue.min_vruntime, vruntime)) {
+		run_queue.min_vruntime = vruntime;
+	}
 }
 
-static struct thread *next_runnable_thread(void)
+/**
+ * update_curr() - Charge the current thread for the time since last charged.
+ * @curr: Thread that owns the CPU and is not in the fair tree.
+ *
+ * Caller holds scheduler_lock.
+ */
+static void update_curr(struct thread *curr)
 {
-	struct thread *start;
-	struct thread *thread;
+	uint64_t now = arch_read_cycle_counter();
+	uint64_t delta = now - curr->exec_start;
 
-	if (current_thread == 0 || current_thread->next == 0) {
-		start = run_queue_head;
-	} else {
-		start = current_thread->next;
+	curr->exec_start = now;
+	if ((int64_t)delta <= 0) {
+		return;
+	}
+
+	curr->sum_exec_runtime += delta;
+	if (!thread_is_fair(curr)) {
+		return;
 	}
 
-	thread = start;
-	while (thread != 0) {
-		if (thread_is_ready(thread) && thread != idle_thread) {
-			return thread;
+	if (curr->weight != NICE_0_WEIGHT) {
+		delta = delta * NICE_0_WEIGHT / curr->weight;
+	}
+
+	curr->vruntime += delta;
+	update_min_vruntime(curr);
+}
+
+/**
+ * enqueue_fair() - Insert a READY thread into the fair tree.
+ * @thread: Thread to insert; its vruntime is the key.
+ *
+ * Equal keys go to the right, so threads that have run equally long take
+ * turns in the order they became READY.
+ */
+static void enqueue_fair(struct thread *thread)
+{
+	struct rb_node **link = &run_queue.fair.root.node;
+	struct rb_node *parent = 0;
+	int leftmost = 1;
+
+	while (*link != 0) {
+		struct thread *entry;
+
+		parent = *link;
+		entry = rb_entry(parent, struct thread, run_node);
+		if (vruntime_before(thread->vruntime, entry->vruntime)) {
+			link = &parent->left;
+		} else {
+			link = &parent->right;
+			leftmost = 0;
 		}
-		thread = thread->next;
 	}
 
-	for (thread = run_queue_head; thread != start; thread = thread->next) {
-		if (thread_is_ready(thread) && thread != idle_thread) {
-			return thread;
+	rb_link_node(&thread->run_node, parent, link);
+	rb_insert_color_cached(&thread->run_node, &run_queue.fair, leftmost);
+	run_queue.fair_weight += thread->weight;
+	run_queue.bitmap |= 1u << SCHED_PRIO_DEFAULT;
+}
+
+static void dequeue_fair(struct thread *thread)
+{
+	rb_erase_cached(&thread->run_node, &run_queue.fair);
+	run_queue.fair_weight -= thread->weight;
+	if (rb_first_cached(&run_queue.fair) == 0) {
+		run_queue.bitmap &= ~(1u << SCHED_PRIO_DEFAULT);
+	}
+}
+
+/**
+ * place_thread() - Position a waking fair thread against the others.
+ * @thread: Thread waking from SLEEPING or WAITING.
+ *
+ * A sleeper keeps the credit of the time it did not use, so it runs ahead
+ * of CPU-bound threads when it wakes, but only up to half a scheduling
+ * period: a thread that slept for a long time must not then monopolize the
+ * CPU until its vruntime catches up.
+ */
+static void place_thread(struct thread *thread)
+{
+	uint64_t floor = run_queue.min_vruntime -
+		ticks_to_runtime(sched_latency_ticks) / 2u;
+
+	if (vruntime_before(thread->vruntime, floor)) {
+		thread->vruntime = floor;
+	}
+}
+
+/**
+ * enqueue_thread() - Put a thread that just became READY on the run queue.
+ * @thread: Thread that just became READY.
+ * @flags: ENQUEUE_WAKEUP if it is waking up, 0 if it was preempted, is new
+ *         or is changing priority.
+ *
+ * Round-robin threads go to the tail of their priority's queue and fair
+ * threads into the fair tree. Caller holds scheduler_lock.
+ */
+void enqueue_thread(struct thread *thread, uint32_t flags)
+{
+	struct thread *curr = this_sched_cpu()->curr;
+	uint32_t priority = thread->priority;
+
+	/*
+	 * Charge the CPU owner first so the floor a waking thread is placed
+	 * against is current. The owner may itself be the thread going back
+	 * on the queue, but is never already in the tree.
+	 */
+	if (curr != 0 && (curr == thread || !thread_is_ready(curr))) {
+		update_curr(curr);
+	}
+
+	run_queue.nr_ready++;
+	if (thread_is_fair(thread)) {
+		if ((flags & ENQUEUE_WAKEUP) != 0) {
+			place_thread(thread);
 		}
+
+		enqueue_fair(thread);
+		return;
 	}
 
-	if (thread_is_ready(idle_thread)) {
-		return idle_thread;
+	thread->next = 0;
+	if (run_queue.tail[priority] != 0) {
+		run_queue.tail[priority]->next = thread;
+	} else {
+		run_queue.head[priority] = thread;
 	}
 
-	return 0;
+	run_queue.tail[priority] = thread;
+	run_queue.bitmap |= 1u << priority;
 }
 
-static void wake_sleeping_threads(uint64_t tick)
+/**
+ * dequeue_thread() - Unlink a READY thread from anywhere in its queue.
+ * @thread: Queued thread.
+ *
+ * Only priority and nice changes remove a thread from the middle of a
+ * queue, so a walk of one round-robin level is acceptable here. Caller
+ * holds scheduler_lock.
+ */
+void dequeue_thread(struct thread *thread)
 {
+	uint32_t priority = thread->priority;
+	struct thread **link = &run_queue.head[priority];
+	struct thread *prev = 0;
+
+	run_queue.nr_ready--;
+	if (thread_is_fair(thread)) {
+		dequeue_fair(thread);
+		return;
+	}
+
+	while (*link != 0 && *link != thread) {
+		prev = *link;
+		link = &prev->next;
+	}
+
+	if (*link == 0) {
+		panic("run queue membership is inconsistent");
+	}
+
+	*link = thread->next;
+	if (run_queue.tail[priority] == thread) {
+		run_queue.tail[priority] = prev;
+	}
+
+	if (run_queue.head[priority] == 0) {
+		run_queue.bitmap &= ~(1u << priority);
+	}
+
+	thread->next = 0;
+}
+
+/**
+ * pick_next_thread() - Remove the thread that should run next.
+ *
+ * Takes the most urgent priority with a READY thread: its oldest thread,
+ * or for the fair class the one with the least vruntime. Caller holds
+ * scheduler_lock.
+ *
+ * Return: Dequeued thread, or NULL if nothing is READY.
+ */
+static struct thread *pick_next_thread(void)
+{
+	uint32_t priority;
 	struct thread *thread;
 
-	for (thread = run_queue_head; thread != 0; thread = thread->next) {
-		if (thread_is_sleeping(thread) && thread->wake_tick <= tick) {
-			thread_set_ready(thread);
+	if (run_queue.bitmap == 0) {
+		return 0;
+	}
+
+	priority = (uint32_t)__builtin_ctz(run_queue.bitmap);
+	if (priority == SCHED_PRIO_DEFAULT) {
+		thread = fair_first();
+		dequeue_fair(thread);
+		run_queue.nr_ready--;
+		return thread;
+	}
+
+	thread = run_queue.head[priority];
+	run_queue.head[priority] = thread->next;
+	if (run_queue.head[priority] == 0) {
+		run_queue.tail[priority] = 0;
+		run_queue.bitmap &= ~(1u << priority);
+	}
+
+	thread->next = 0;
+	run_queue.nr_ready--;
+	return thread;
+}
+
+/**
+ * thread_timeslice() - Length of a thread's time slice.
+ * @thread: Running thread.
+ *
+ * A fair thread gets its weight's share of the scheduling period among
+ * itself and the READY fair threads, but at least one tick.
+ *
+ * Return: Slice in ticks.
+ */
+static uint64_t thread_timeslice(const struct thread *thread)
+{
+	uint64_t slice;
+
+	if (!thread_is_fair(thread)) {
+		return sched_rr_ticks;
+	}
+
+	slice = (uint64_t)sched_latency_ticks * thread->weight /
+		(run_queue.fair_weight + thread->weight);
+	return slice != 0 ? slice : 1u;
+}
+
+/**
+ * should_preempt() - Decide whether a running thread gives up the CPU.
+ * @curr: Running thread, charged up to now.
+ *
+ * Caller holds scheduler_lock.
+ *
+ * Return: Non-zero if a READY thread should run instead.
+ */
+static int should_preempt(const struct thread *curr)
+{
+	struct thread *first;
+
+	/* A running thread only gives way to equal or more urgent work. */
+	if ((run_queue.bitmap & ((2u << curr->priority) - 1u)) == 0) {
+		return 0;
+	}
+
+	if ((run_queue.bitmap & ((1u << curr->priority) - 1u)) != 0 ||
+		!thread_is_fair(curr)) {
+		return 1;
+	}
+
+	first = fair_first();
+	return vruntime_before(first->vruntime, curr->vruntime);
+}
+
+/**
+ * resched_idle_cpu() - Get an idle CPU to pick up newly queued work.
+ *
+ * Tries the calling CPU first, so work woken from an interrupt that hit an
+ * idle CPU stays there. A remote CPU is interrupted; the calling one
+ * reschedules at its next IRQ exit. A CPU already asked to reschedule will
+ * take only one thread, so it is passed over. Caller holds scheduler_lock.
+ *
+ * Return: Non-zero if a CPU was asked to reschedule.
+ */
+int resched_idle_cpu(void)
+{
+	uint32_t self = smp_processor_id();
+	uint32_t index;
+
+	for (index = 0; index < NR_CPUS; index++) {
+		uint32_t target = (self + index) % NR_CPUS;
+		struct sched_cpu *cpu = &sched_cpus[target];
+
+		if (!cpu_online(target) || cpu->idle == 0 ||
+			cpu->curr != cpu->idle ||
+			__atomic_load_n(&cpu->need_resched, __ATOMIC_RELAXED)) {
+			continue;
 		}
+
+		set_need_resched(cpu);
+		if (target != self) {
+			arch_send_reschedule(target);
+		}
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * check_preempt_wakeup() - Ask for a reschedule if a woken thread should run.
+ * @thread: Thread just made READY by a wakeup.
+ *
+ * An idle CPU takes the woken thread if there is one. Otherwise it
+ * preempts the waking CPU's thread if that is less urgent, or a fair one
+ * that has run at least a tick's worth of vruntime longer. The margin
+ * keeps two threads waking each other from switching on every wakeup.
+ * Caller holds scheduler_lock.
+ */
+void check_preempt_wakeup(struct thread *thread)
+{
+	struct sched_cpu *cpu = this_sched_cpu();
+	struct thread *curr = cpu->curr;
+
+	if (resched_idle_cpu()) {
+		return;
+	}
+
+	if (!thread_is_running(curr) || thread->priority > curr->priority) {
+		return;
+	}
+
+	if (thread->priority < curr->priority) {
+		set_need_resched(cpu);
+		return;
+	}
+
+	if (!thread_is_fair(curr)) {
+		return;
+	}
+
+	update_curr(curr);
+	if (vruntime_before(thread->vruntime +
+			ticks_to_runtime(WAKEUP_GRANULARITY_TICKS),
+		    curr->vruntime)) {
+		set_need_resched(cpu);
+	}
+}
+
+/**
+ * thread_sleep_timeout() - Wheel callback ending a timed sleep.
+ * @timer: struct thread::sleep_timer of the sleeping thread.
+ *
+ * Runs from the timer tick with the wheel lock dropped. A thread that was
+ * woken and went back to sleep before this ran has re-armed its timer and
+ * is left alone.
+ */
+void thread_sleep_timeout(struct timer_list *timer)
+{
+	struct thread *thread = timer->data;
+	uint64_t flags;
+
+	spin_lock_irqsave(&scheduler_lock, &flags);
+	if (thread_is_sleeping(thread) && !timer_pending(timer)) {
+		thread_set_ready_locked(thread);
+	}
+	spin_unlock_irqrestore(&scheduler_lock, flags);
+}
+
+int sched_set_priority(struct thread *thread, uint32_t priority)
+{
+	uint64_t flags;
+	int queued;
+
+	if (thread == 0 || priority >= SCHED_NR_PRIO) {
+		return -EINVAL;
+	}
+
+	spin_lock_irqsave(&scheduler_lock, &flags);
+	queued = thread_on_run_queue(thread);
+	if (queued) {
+		dequeue_thread(thread);
+	} else if (thread_is_current(thread)) {
+		update_curr(thread);
+	}
+
+	/* vruntime earned in another class means nothing against this one. */
+	if (priority == SCHED_PRIO_DEFAULT && !thread_is_fair(thread)) {
+		thread->vruntime = run_queue.min_vruntime;
+	}
+
+	thread->priority = priority;
+	if (queued) {
+		enqueue_thread(thread, 0);
+	}
+	spin_unlock_irqrestore(&scheduler_lock, flags);
+
+	return 0;
+}
+
+int sched_set_nice(struct thread *thread, int32_t nice)
+{
+	uint64_t flags;
+	int queued;
+
+	if (thread == 0 || nice < SCHED_NICE_MIN || nice > SCHED_NICE_MAX) {
+		return -EINVAL;
+	}
+
+	spin_lock_irqsave(&scheduler_lock, &flags);
+	queued = thread_on_run_queue(thread);
+	if (queued) {
+		dequeue_thread(thread);
+	} else if (thread_is_current(thread)) {
+		update_curr(thread);
+	}
+
+	thread->nice = nice;
+	thread->weight = sched_nice_to_weight(nice);
+	if (queued) {
+		enqueue_thread(thread, 0);
+	}
+	spin_unlock_irqrestore(&scheduler_lock, flags);
+
+	return 0;
+}
+
+int sched_set_timeslice(uint32_t latency_ticks, uint32_t rr_ticks)
+{
+	uint64_t flags;
+
+	if (latency_ticks == 0 || rr_ticks == 0) {
+		return -EINVAL;
 	}
+
+	spin_lock_irqsave(&scheduler_lock, &flags);
+	sched_latency_ticks = latency_ticks;
+	sched_rr_ticks = rr_ticks;
+	spin_unlock_irqrestore(&scheduler_lock, flags);
+
+	return 0;
 }
 
 void sched_yield(void)
 {
+	struct sched_cpu *cpu;
 	struct thread *prev;
 	struct thread *next;
+	uint64_t flags;
 
 	sched_assert_can_switch();
 
 	sched_reap_dead_threads();
 
-	prev = current_thread;
-	next = next_runnable_thread();
+	spin_lock_irqsave(&scheduler_lock, &flags);
+	cpu = this_sched_cpu();
+	prev = cpu->curr;
+
+	/* prev was woken before it got here; it still owns the CPU. */
+	if (thread_is_ready(prev)) {
+		thread_set_running(prev);
+	}
+
+	if (prev != 0) {
+		update_curr(prev);
+	}
 
-	if (next == 0 || next == prev) {
+	if (thread_is_running(prev) && !should_preempt(prev)) {
+		prev->slice_start = run_queue.tick;
+		spin_unlock_irqrestore(&scheduler_lock, flags);
 		return;
 	}
 
-	schedule_locked = 1;
+	next = pick_next_thread();
+	if (next == 0) {
+		next = cpu->idle;
+	}
+
+	if (next == 0) {
+		spin_unlock_irqrestore(&scheduler_lock, flags);
+		return;
+	}
+
+	cpu->schedule_locked = 1;
 
 	if (thread_is_running(prev)) {
-		thread_set_ready(prev);
+		thread_set_ready_locked(prev);
+	}
+
+	/* Only real work needs a local tick to end its slice. */
+	if (next == cpu->idle && prev != 0 && prev != cpu->idle) {
+		arch_cpu_tick_stop();
+	} else if (next != cpu->idle && (prev == 0 || prev == cpu->idle)) {
+		arch_cpu_tick_start();
 	}
 
 	thread_set_running(next);
-	current_thread = next;
-	schedule_locked = 0;
+	next->cpu = smp_processor_id();
+	next->exec_start = arch_read_cycle_counter();
+	next->slice_start = run_queue.tick;
+	cpu->curr = next;
+	cpu->schedule_locked = 0;
+
+	/*
+	 * scheduler_lock stays held across the switch, so no other CPU can
+	 * pick prev off the run queue while it is still on its stack. The
+	 * thread switched to drops the lock: here if it is resuming, or in
+	 * sched_switch_finish_new() if it is new.
+	 */
+	arch_context_switch(
+		prev != 0 ? &prev->stack_pointer : &cpu->boot_stack_pointer,
+		next->stack_pointer);
+	spin_unlock_irqrestore(&scheduler_lock, flags);
+}
 
-	if (prev == 0) {
-		arch_context_switch(&boot_stack_pointer, next->stack_pointer);
+/**
+ * sched_switch_finish_new() - Finish the first switch to a new thread.
+ *
+ * Drops the scheduler_lock sched_yield() held across the switch and turns
+ * on interrupts, which are off across every switch.
+ */
+void sched_switch_finish_new(void)
+{
+	spin_unlock_irqrestore(&scheduler_lock, arch_irq_save());
+	arch_irq_enable();
+}
+
+/**
+ * sched_clock_tick() - Record a tick and refine the measured tick length.
+ * @tick: Current tick.
+ * @now: Cycle counter at @tick.
+ *
+ * Only back-to-back ticks are measured, so a tick that was stopped during
+ * idle does not skew the average.
+ */
+static void sched_clock_tick(uint64_t tick, uint64_t now)
+{
+	if (run_queue.tick != 0 && tick == run_queue.tick + 1u) {
+		uint64_t sample = now - run_queue.tick_stamp;
+
+		if (run_queue.tick_cycles == 0) {
+			run_queue.tick_cycles = sample;
+		} else {
+			run_queue.tick_cycles -= run_queue.tick_cycles / 8u;
+			run_queue.tick_cycles += sample / 8u;
+		}
+	}
+
+	run_queue.tick = tick;
+	run_queue.tick_stamp = now;
+}
+
+/**
+ * sched_check_slice() - Charge a CPU's thread and end a used-up slice.
+ * @cpu: Calling CPU.
+ *
+ * Caller holds scheduler_lock.
+ */
+static void sched_check_slice(struct sched_cpu *cpu)
+{
+	struct thread *curr = cpu->curr;
+
+	if (!thread_is_running(curr)) {
 		return;
 	}
 
-	arch_context_switch(&prev->stack_pointer, next->stack_pointer);
+	update_curr(curr);
+	if (run_queue.tick - curr->slice_start >= thread_timeslice(curr) ||
+		(run_queue.bitmap & ((1u << curr->priority) - 1u)) != 0) {
+		set_need_resched(cpu);
+	}
 }
 
 void sched_tick(uint64_t tick)
 {
-	wake_sleeping_threads(tick);
+	uint64_t flags;
+
+	spin_lock_irqsave(&scheduler_lock, &flags);
+	sched_clock_tick(tick, arch_read_cycle_counter());
+	sched_check_slice(this_sched_cpu());
+	spin_unlock_irqrestore(&scheduler_lock, flags);
+}
+
+void sched_cpu_tick(void)
+{
+	struct sched_cpu *cpu = this_sched_cpu();
+	uint64_t flags;
+
+	/* Raised just before the switch to idle stopped the local tick. */
+	if (cpu->curr == cpu->idle) {
+		return;
+	}
+
+	spin_lock_irqsave(&scheduler_lock, &flags);
+	sched_check_slice(cpu);
+	spin_unlock_irqrestore(&scheduler_lock, flags);
+}
+
+int sched_idle_cpu(void)
+{
+	uint32_t self = smp_processor_id();
+	uint32_t index;
 
-	if (thread_is_running(current_thread)) {
-		need_resched = 1;
+	if (__atomic_load_n(&run_queue.nr_ready, __ATOMIC_RELAXED) != 0) {
+		return 0;
 	}
+
+	for (index = 0; index < NR_CPUS; index++) {
+		struct sched_cpu *cpu = &sched_cpus[index];
+		struct thread *curr;
+
+		if (index != self && !cpu_online(index)) {
+			continue;
+		}
+
+		curr = __atomic_load_n(&cpu->curr, __ATOMIC_RELAXED);
+		if (curr == 0 || curr != cpu->idle) {
+			return 0;
+		}
+	}
+
+	return 1;
 }
 
 /**
@@ -124,41 +727,54 @@ void sched_tick(uint64_t tick)
  *
  * This is the scheduler side of the trap boundary. Handlers may request a
  * reschedule, but normal blocking paths remain forbidden until the matching
- * outermost sched_irq_exit() has left IRQ context.
+ * outermost sched_irq_exit() has left IRQ context. The outermost entry also
+ * catches up a stopped idle tick before any handler reads the tick count.
  */
 void sched_irq_enter(void)
 {
-	irq_depth++;
+	struct sched_cpu *cpu = this_sched_cpu();
+
+	cpu->irq_depth++;
+	if (cpu->irq_depth == 1) {
+		tick_nohz_irq_enter();
+	}
 }
 
 /**
  * sched_irq_exit() - Leave external IRQ context and run pending reschedule.
  * @frame: Trap frame for the interrupted context, or NULL in selftests.
  *
- * Only the outermost IRQ exit may consume need_resched. The IRQ nesting count
- * is dropped before switching so the next thread runs in normal thread
- * context, while direct scheduling from inside an IRQ handler still trips the
- * scheduler context assertion. The frame is currently a reserved boundary for
- * future syscall/user-mode return handling.
+ * Only the outermost IRQ exit may consume this CPU's need_resched. The IRQ
+ * nesting count is dropped before switching so the next thread runs in normal
+ * thread context, while direct scheduling from inside an IRQ handler still
+ * trips the scheduler context assertion. The frame is currently a reserved
+ * boundary for future syscall/user-mode return handling.
  */
 void sched_irq_exit(struct trap_frame *frame)
 {
+	struct sched_cpu *cpu = this_sched_cpu();
+
 	(void)frame;
 
-	if (irq_depth <= 0) {
+	if (cpu->irq_depth <= 0) {
 		panic("scheduler irq exit without irq entry");
 	}
 
-	irq_depth--;
-	if (irq_depth != 0) {
+	if (cpu->irq_depth == 1) {
+		tick_nohz_irq_exit();
+	}
+
+	cpu->irq_depth--;
+	if (cpu->irq_depth != 0) {
 		return;
 	}
 
-	if (need_resched == 0 || current_thread == 0 || schedule_locked != 0) {
+	if (__atomic_load_n(&cpu->need_resched, __ATOMIC_RELAXED) == 0 ||
+		cpu->curr == 0 || cpu->schedule_locked != 0) {
 		return;
 	}
 
-	need_resched = 0;
+	__atomic_store_n(&cpu->need_resched, 0, __ATOMIC_RELAXED);
 	sched_yield();
 }
 
@@ -183,9 +799,9 @@ void sched_init(void)
 		return;
 	}
 
-	run_queue_head = 0;
-	run_queue_tail = 0;
-	idle_thread = 0;
+	run_queue = (struct run_queue){ 0 };
+	zombie_list = 0;
+	thread_cache_init();
 	scheduler_ready = 1;
 
 	pr_info("scheduler initialized\n");
@@ -194,9 +810,15 @@ void sched_init(void)
 
 void sched_start(void)
 {
-	if (sched_idle_create() != 0) {
+	if (sched_idle_create(smp_processor_id()) != 0) {
 		panic("idle thread creation failed");
 	}
 
 	sched_demo_start();
 }
+
+void sched_cpu_start(void)
+{
+	sched_yield();
+	panic("scheduler returned to CPU boot context");
+}
@@ -1,21 +1,46 @@
+#include <stdint.h>
+
 #include <tianole/errno.h>
+#include <tianole/mm.h>
 #include <tianole/sched.h>
+#include <tianole/smp.h>
 
 #include "sched.h"
 
+/* Pages zeroed per pass, so a wakeup never waits behind a long batch. */
+#define IDLE_ZERO_BATCH 4u
+
+/**
+ * idle_thread_entry() - Run only when no other thread is ready.
+ * @arg: Unused.
+ *
+ * Idle time first refills the pre-zeroed page pool; the thread halts once
+ * the pool is full. Interrupts stay enabled throughout, so a timer tick
+ * still preempts the refill when real work becomes ready. Each CPU has
+ * its own idle thread and is pulled out of the halt by a reschedule
+ * interrupt when another CPU queues work for it. Other CPUs stop their
+ * local tick while idle, and while every CPU idles the periodic tick is
+ * stopped too, so the boot CPU's halt lasts until the next pending timer
+ * or device IRQ rather than the next tick.
+ */
 static void idle_thread_entry(void *arg)
 {
 	(void)arg;
 
 	for (;;) {
-		__asm__ volatile("hlt");
+		if (zero_pool_refill(IDLE_ZERO_BATCH) == 0) {
+			__asm__ volatile("hlt");
+		}
 	}
 }
 
-int sched_idle_create(void)
+int sched_idle_create(uint32_t cpu)
 {
-	idle_thread = kernel_thread_create("idle", idle_thread_entry, 0);
-	if (idle_thread == 0) {
+	if (cpu >= NR_CPUS || sched_cpus[cpu].idle != 0) {
+		return -EINVAL;
+	}
+
+	if (idle_thread_create(cpu, idle_thread_entry) == 0) {
 		return -ENOMEM;
 	}
 
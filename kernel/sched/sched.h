@@ -3,24 +3,107 @@
 
 #include <stdint.h>
 
+#include <tianole/arch.h>
 #include <tianole/panic.h>
 #include <tianole/sched.h>
+#include <tianole/smp.h>
 #include <tianole/spinlock.h>
+#include <tianole/timer.h>
 
-extern struct thread *run_queue_head;
-extern struct thread *run_queue_tail;
-extern struct thread *current_thread;
-extern uintptr_t boot_stack_pointer;
+/**
+ * struct run_queue - READY threads, one queue per priority.
+ * @bitmap: Bit N is set while priority N has a READY thread.
+ * @nr_ready: Threads on all queues.
+ * @head: Oldest READY thread of each round-robin priority, linked through
+ *        struct thread::next.
+ * @tail: Newest READY thread of each round-robin priority.
+ * @fair: READY threads at SCHED_PRIO_DEFAULT, keyed by vruntime, linked
+ *        through struct thread::run_node. @head and @tail of that level
+ *        stay empty.
+ * @fair_weight: Sum of the weights of the threads in @fair.
+ * @min_vruntime: Never-decreasing floor of the fair class's vruntimes.
+ *                Threads joining or waking into the class are placed
+ *                relative to it.
+ * @tick: Last tick passed to sched_tick().
+ * @tick_stamp: Cycle counter at @tick.
+ * @tick_cycles: Smoothed cycle counter units per tick, or 0 until
+ *               measured. Converts tick-based tunables into runtime.
+ *
+ * A thread is on the run queue exactly while it is READY, so picking the
+ * next thread is one bit scan plus one unlink, or one cached tree minimum
+ * for the fair class, no matter how many threads are blocked. There is one
+ * queue for the whole machine, so load balancing is just every CPU picking
+ * from it. Protected by scheduler_lock.
+ */
+struct run_queue {
+	uint32_t bitmap;
+	uint32_t nr_ready;
+	struct thread *head[SCHED_NR_PRIO];
+	struct thread *tail[SCHED_NR_PRIO];
+	struct rb_root_cached fair;
+	uint64_t fair_weight;
+	uint64_t min_vruntime;
+	uint64_t tick;
+	uint64_t tick_stamp;
+	uint64_t tick_cycles;
+};
+
+/**
+ * struct sched_cpu - Scheduler state of one CPU.
+ * @curr: Thread running on the CPU, or NULL while it is still in boot
+ *        context.
+ * @idle: Idle thread of the CPU, or NULL until sched_idle_create().
+ * @boot_stack_pointer: Saved boot context stack pointer after the first
+ *                      switch away from it.
+ * @need_resched: Reschedule at the next outermost IRQ exit. Set by other
+ *                CPUs too, so accessed atomically.
+ * @irq_depth: External IRQ nesting depth.
+ * @schedule_locked: Non-zero while sched_yield() is choosing a thread.
+ *
+ * @curr and @idle change under scheduler_lock; the rest belongs to the CPU
+ * itself and is only touched by it with interrupts disabled.
+ */
+struct sched_cpu {
+	struct thread *curr;
+	struct thread *idle;
+	uintptr_t boot_stack_pointer;
+	int need_resched;
+	int irq_depth;
+	int schedule_locked;
+};
+
+/* Weight of a nice 0 thread; its vruntime advances at wall-clock rate. */
+#define NICE_0_WEIGHT 1024u
+
+/* enqueue_thread() flag: the thread is waking from SLEEPING or WAITING. */
+#define ENQUEUE_WAKEUP 1u
+
+extern struct run_queue run_queue;
+extern struct sched_cpu sched_cpus[NR_CPUS];
+extern struct thread *zombie_list;
 extern uint64_t next_thread_id;
 extern int scheduler_ready;
-extern int schedule_locked;
-extern int need_resched;
-extern int irq_depth;
-extern struct thread *idle_thread;
 extern struct spinlock scheduler_lock;
 
+/* Call with interrupts disabled, so the caller cannot change CPU. */
+static inline struct sched_cpu *this_sched_cpu(void)
+{
+	return &sched_cpus[smp_processor_id()];
+}
+
+struct thread *sched_current(void);
+
+/* Thread running on the calling CPU, or NULL in boot context. */
+#define current_thread sched_current()
+
 static inline void sched_assert_can_switch(void)
 {
+	uint64_t flags = arch_irq_save();
+	struct sched_cpu *cpu = this_sched_cpu();
+	int schedule_locked = cpu->schedule_locked;
+	int irq_depth = cpu->irq_depth;
+
+	arch_irq_restore(flags);
 	if (schedule_locked != 0) {
 		panic("scheduler reentry while switch locked");
 	}
@@ -34,6 +117,11 @@ static inline void sched_assert_can_switch(void)
 	}
 }
 
+static inline int thread_is_fair(const struct thread *thread)
+{
+	return thread->priority == SCHED_PRIO_DEFAULT;
+}
+
 static inline int thread_is_ready(const struct thread *thread)
 {
 	return thread != 0 && thread->state == THREAD_READY;
@@ -64,6 +152,28 @@ static inline int thread_is_dead(const struct thread *thread)
 	return thread != 0 && thread->state == THREAD_DEAD;
 }
 
+static inline int thread_is_idle(const struct thread *thread)
+{
+	return thread != 0 && sched_cpus[thread->cpu].idle == thread;
+}
+
+/* A thread is only ever current on the CPU it last ran on. */
+static inline int thread_is_current(const struct thread *thread)
+{
+	return thread != 0 && sched_cpus[thread->cpu].curr == thread;
+}
+
+/*
+ * READY threads are queued, except idle threads, which are never queued,
+ * and a thread woken on its way into sched_yield(), which takes the CPU
+ * back there. Caller holds scheduler_lock.
+ */
+static inline int thread_on_run_queue(const struct thread *thread)
+{
+	return thread_is_ready(thread) && !thread_is_idle(thread) &&
+		!thread_is_current(thread);
+}
+
 static inline int thread_state_transition_is_valid(
 	enum thread_state from, enum thread_state to)
 {
@@ -114,10 +224,52 @@ static inline void thread_init_ready(struct thread *thread)
 	thread->state = THREAD_READY;
 }
 
-static inline void thread_set_ready(struct thread *thread)
+void enqueue_thread(struct thread *thread, uint32_t flags);
+void dequeue_thread(struct thread *thread);
+int resched_idle_cpu(void);
+void check_preempt_wakeup(struct thread *thread);
+void thread_sleep_timeout(struct timer_list *timer);
+uint32_t sched_nice_to_weight(int32_t nice);
+
+/*
+ * The helpers below that move a thread on or off the run queue expect
+ * scheduler_lock to be held; thread_set_ready() and thread_set_sleeping()
+ * take it themselves for callers outside the scheduler core. The sleep
+ * timer is always armed and cancelled under scheduler_lock, so the lock
+ * order is scheduler_lock before the timer wheel lock.
+ *
+ * A thread that blocks stays current until it gets into sched_yield(). If
+ * it is woken before that, possibly by another CPU, it is only marked
+ * READY and sched_yield() lets it keep the CPU.
+ */
+static inline void thread_set_ready_locked(struct thread *thread)
 {
+	enum thread_state from = thread->state;
+
 	thread_set_state(thread, THREAD_READY);
+	if (from == THREAD_SLEEPING) {
+		del_timer(&thread->sleep_timer);
+	}
+
 	thread->wake_tick = 0;
+	if (from == THREAD_RUNNING) {
+		if (!thread_is_idle(thread)) {
+			enqueue_thread(thread, 0);
+			resched_idle_cpu();
+		}
+	} else if (from != THREAD_READY && !thread_is_current(thread)) {
+		enqueue_thread(thread, ENQUEUE_WAKEUP);
+		check_preempt_wakeup(thread);
+	}
+}
+
+static inline void thread_set_ready(struct thread *thread)
+{
+	uint64_t flags;
+
+	spin_lock_irqsave(&scheduler_lock, &flags);
+	thread_set_ready_locked(thread);
+	spin_unlock_irqrestore(&scheduler_lock, flags);
 }
 
 static inline void thread_set_running(struct thread *thread)
@@ -128,9 +280,14 @@ static inline void thread_set_running(struct thread *thread)
 static inline void thread_set_sleeping(
 	struct thread *thread, uint64_t wake_tick)
 {
+	uint64_t flags;
+
 	thread_validate_state_transition(thread, THREAD_SLEEPING);
+	spin_lock_irqsave(&scheduler_lock, &flags);
 	thread->wake_tick = wake_tick;
 	thread->state = THREAD_SLEEPING;
+	mod_timer(&thread->sleep_timer, wake_tick);
+	spin_unlock_irqrestore(&scheduler_lock, flags);
 }
 
 static inline void thread_set_waiting(struct thread *thread)
@@ -141,7 +298,13 @@ static inline void thread_set_waiting(struct thread *thread)
 
 static inline void thread_set_zombie(struct thread *thread)
 {
+	enum thread_state from = thread->state;
+
 	thread_set_state(thread, THREAD_ZOMBIE);
+	if (from == THREAD_SLEEPING) {
+		del_timer(&thread->sleep_timer);
+	}
+
 	thread->wake_tick = 0;
 }
 
@@ -151,11 +314,12 @@ static inline void thread_set_dead(struct thread *thread)
 	thread->wake_tick = 0;
 }
 
-void enqueue_thread(struct thread *thread);
+void thread_cache_init(void);
+struct thread *idle_thread_create(uint32_t cpu, kernel_thread_entry_t entry);
 void sched_reap_dead_threads(void);
 void sched_thread_exit(void) __attribute__((noreturn));
+void sched_switch_finish_new(void);
 void sched_selftest(void);
-int sched_idle_create(void);
 void sched_demo_start(void) __attribute__((noreturn));
 
 #endif
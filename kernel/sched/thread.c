@@ -1,19 +1,194 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <tianole/arch.h>
 #include <tianole/mm.h>
 #include <tianole/panic.h>
 #include <tianole/printk.h>
 #include <tianole/sched.h>
+#include <tianole/shrinker.h>
+#include <tianole/slab.h>
+#include <tianole/smp.h>
 #include <tianole/spinlock.h>
+#include <tianole/vmalloc.h>
 
 #include "sched.h"
 
 #define KERNEL_STACK_SIZE (PAGE_SIZE * 4u)
 #define STACK_ALIGNMENT 16u
+#define STACK_CACHE_SIZE 4u
+
+/**
+ * struct stack_cache - Recently freed kernel stacks of one CPU.
+ * @lock: Protects @stacks and @count.
+ * @stacks: Stacks still mapped and ready for reuse.
+ * @count: Valid entries in @stacks.
+ *
+ * A spawn that follows an exit reuses a cached stack without touching the
+ * page tables or vmalloc. Threads take from and give back to their own
+ * CPU's cache, so @lock is only ever contended when the shrinker drains a
+ * cache from another CPU.
+ */
+struct stack_cache {
+	struct spinlock lock;
+	void *stacks[STACK_CACHE_SIZE];
+	uint32_t count;
+};
+
+static struct kmem_cache *thread_cache;
+static struct stack_cache stack_caches[NR_CPUS];
+
+/*
+ * Only a locality hint: a thread that moves to another CPU right after
+ * the lookup still uses a properly locked cache.
+ */
+static struct stack_cache *this_cpu_stack_cache(void)
+{
+	return &stack_caches[smp_processor_id()];
+}
+
+/**
+ * stack_cache_pop() - Take a stack from a cache.
+ * @cache: Cache to take from.
+ *
+ * Return: Cached stack, or NULL if @cache is empty.
+ */
+static void *stack_cache_pop(struct stack_cache *cache)
+{
+	void *stack = 0;
+	uint64_t flags;
+
+	spin_lock_irqsave(&cache->lock, &flags);
+	if (cache->count != 0) {
+		stack = cache->stacks[--cache->count];
+	}
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	return stack;
+}
+
+/**
+ * alloc_thread_stack() - Get a kernel stack, preferably a cached one.
+ *
+ * New stacks are vmalloc_mapped() areas: fully mapped, because a demand
+ * fault on the stack could not be handled, and bordered below by an
+ * unmapped page, so an overflow faults instead of corrupting memory.
+ *
+ * Return: Base of a KERNEL_STACK_SIZE stack, or NULL.
+ */
+static void *alloc_thread_stack(void)
+{
+	void *stack = stack_cache_pop(this_cpu_stack_cache());
+
+	if (stack != 0) {
+		return stack;
+	}
+
+	return vmalloc_mapped(KERNEL_STACK_SIZE);
+}
+
+/**
+ * free_thread_stack() - Cache a dead thread's stack or release it.
+ * @stack: Stack from alloc_thread_stack().
+ */
+static void free_thread_stack(void *stack)
+{
+	struct stack_cache *cache = this_cpu_stack_cache();
+	uint64_t flags;
+
+	spin_lock_irqsave(&cache->lock, &flags);
+	if (cache->count < STACK_CACHE_SIZE) {
+		cache->stacks[cache->count++] = stack;
+		stack = 0;
+	}
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	vfree(stack);
+}
+
+static uint64_t stack_cache_count(struct shrinker *shrinker)
+{
+	uint64_t count = 0;
+	uint32_t cpu;
+
+	(void)shrinker;
+
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		count += __atomic_load_n(&stack_caches[cpu].count,
+			__ATOMIC_RELAXED);
+	}
+
+	return count * (KERNEL_STACK_SIZE / PAGE_SIZE);
+}
+
+/**
+ * stack_cache_scan() - Release cached stacks back to vmalloc.
+ * @shrinker: Stack cache shrinker.
+ * @nr_to_scan: Pages wanted; whole stacks are freed.
+ *
+ * Drains every CPU's cache, the calling CPU's last.
+ *
+ * Return: Pages freed.
+ */
+static uint64_t stack_cache_scan(struct shrinker *shrinker,
+	uint64_t nr_to_scan)
+{
+	uint32_t self = smp_processor_id();
+	uint64_t freed = 0;
+	uint32_t index;
+
+	(void)shrinker;
+
+	for (index = 1; index <= NR_CPUS && freed < nr_to_scan; index++) {
+		struct stack_cache *cache = &stack_caches[(self + index) %
+			NR_CPUS];
+
+		while (freed < nr_to_scan) {
+			void *stack = stack_cache_pop(cache);
+
+			if (stack == 0) {
+				break;
+			}
+
+			vfree(stack);
+			freed += KERNEL_STACK_SIZE / PAGE_SIZE;
+		}
+	}
+
+	return freed;
+}
+
+static struct shrinker stack_cache_shrinker = {
+	.name = "stack_cache",
+	.count = stack_cache_count,
+	.scan = stack_cache_scan,
+};
 
 static void thread_trampoline(void) __attribute__((noreturn));
 
+/**
+ * thread_cache_init() - Create the slab cache backing struct thread.
+ *
+ * Thread objects are fixed-size and created and reaped at runtime, so they
+ * come from a dedicated cache instead of the general-purpose heap. The
+ * stack cache is registered with reclaim at the same time.
+ */
+void thread_cache_init(void)
+{
+	if (thread_cache != 0) {
+		return;
+	}
+
+	thread_cache = kmem_cache_create("thread", sizeof(struct thread), 0, 0);
+	if (thread_cache == 0) {
+		panic("thread cache creation failed");
+	}
+
+	if (register_shrinker(&stack_cache_shrinker) != 0) {
+		panic("stack cache shrinker registration failed");
+	}
+}
+
 /**
  * align_down_uintptr() - Round a pointer value down to an alignment.
  * @value: Pointer-sized value to align.
@@ -80,45 +255,119 @@ static uintptr_t prepare_initial_stack(uintptr_t stack_top)
 	return (uintptr_t)stack;
 }
 
-struct thread *kernel_thread_create(
+/**
+ * thread_alloc() - Allocate and set up a thread that is not yet scheduled.
+ * @name: Diagnostic name.
+ * @entry: Thread entry point.
+ * @arg: Argument passed to @entry.
+ *
+ * Everything but the ID and the run queue placement, which need
+ * scheduler_lock, is filled in here.
+ *
+ * Return: New READY thread, or NULL when allocation fails.
+ */
+static struct thread *thread_alloc(
 	const char *name, kernel_thread_entry_t entry, void *arg)
 {
 	struct thread *thread;
 	uintptr_t stack_top;
-	uint64_t flags;
-
-	if (entry == 0) {
-		return 0;
-	}
 
-	thread = kmalloc(sizeof(*thread));
+	thread = kmem_cache_alloc(thread_cache);
 	if (thread == 0) {
 		return 0;
 	}
 
-	thread->stack_base = kmalloc(KERNEL_STACK_SIZE);
+	thread->stack_base = alloc_thread_stack();
 	if (thread->stack_base == 0) {
-		kfree(thread);
+		kmem_cache_free(thread_cache, thread);
 		return 0;
 	}
 
 	stack_top = (uintptr_t)thread->stack_base + KERNEL_STACK_SIZE;
 
 	thread_init_ready(thread);
+	thread->priority = SCHED_PRIO_DEFAULT;
+	thread->cpu = 0;
 	thread->entry = entry;
 	thread->arg = arg;
 	thread->stack_top = align_down_uintptr(stack_top, STACK_ALIGNMENT);
 	thread->stack_pointer = prepare_initial_stack(thread->stack_top);
 	thread->stack_size = KERNEL_STACK_SIZE;
 	thread->wake_tick = 0;
+	thread->nice = 0;
+	thread->weight = sched_nice_to_weight(0);
+	thread->sum_exec_runtime = 0;
+	thread->exec_start = 0;
+	thread->slice_start = 0;
 	thread->next = 0;
+	timer_init(&thread->sleep_timer, thread_sleep_timeout, thread);
 	thread->wait_next = 0;
 	thread->wait_queue = 0;
 	copy_thread_name(thread->name, sizeof(thread->name), name);
 
+	return thread;
+}
+
+struct thread *kernel_thread_create(
+	const char *name, kernel_thread_entry_t entry, void *arg)
+{
+	struct thread *thread;
+	uint64_t flags;
+
+	if (entry == 0) {
+		return 0;
+	}
+
+	thread = thread_alloc(name, entry, arg);
+	if (thread == 0) {
+		return 0;
+	}
+
 	spin_lock_irqsave(&scheduler_lock, &flags);
 	thread->id = next_thread_id++;
-	enqueue_thread(thread);
+	thread->vruntime = run_queue.min_vruntime;
+	enqueue_thread(thread, 0);
+	resched_idle_cpu();
+	spin_unlock_irqrestore(&scheduler_lock, flags);
+
+	return thread;
+}
+
+/**
+ * idle_thread_create() - Create and install the idle thread of a CPU.
+ * @cpu: CPU whose idle thread this is.
+ * @entry: Idle loop.
+ *
+ * The thread is never queued. It runs at the lowest priority, only on
+ * @cpu, whenever sched_yield() finds nothing READY there.
+ *
+ * Return: The idle thread, or NULL when allocation fails or @cpu already
+ * has one.
+ */
+struct thread *idle_thread_create(uint32_t cpu, kernel_thread_entry_t entry)
+{
+	struct thread *thread;
+	uint64_t flags;
+
+	thread = thread_alloc("idle", entry, 0);
+	if (thread == 0) {
+		return 0;
+	}
+
+	thread->priority = SCHED_PRIO_IDLE;
+	thread->cpu = cpu;
+
+	spin_lock_irqsave(&scheduler_lock, &flags);
+	if (sched_cpus[cpu].idle != 0) {
+		spin_unlock_irqrestore(&scheduler_lock, flags);
+		free_thread_stack(thread->stack_base);
+		kmem_cache_free(thread_cache, thread);
+		return 0;
+	}
+
+	thread->id = next_thread_id++;
+	thread->vruntime = run_queue.min_vruntime;
+	sched_cpus[cpu].idle = thread;
 	spin_unlock_irqrestore(&scheduler_lock, flags);
 
 	return thread;
@@ -134,7 +383,7 @@ struct thread *kernel_thread_create(
  */
 static void release_thread(struct thread *thread)
 {
-	if (thread == 0 || thread == current_thread) {
+	if (thread == 0 || thread_is_current(thread)) {
 		panic("invalid thread release target");
 	}
 
@@ -146,7 +395,7 @@ static void release_thread(struct thread *thread)
 		panic("reaping thread still on wait queue");
 	}
 
-	if (thread->wake_tick != 0) {
+	if (thread->wake_tick != 0 || timer_pending(&thread->sleep_timer)) {
 		panic("reaping thread still has wake deadline");
 	}
 
@@ -155,48 +404,39 @@ static void release_thread(struct thread *thread)
 	}
 
 	pr_info("thread reaped %s\n", thread->name);
-	kfree(thread->stack_base);
-	kfree(thread);
+	free_thread_stack(thread->stack_base);
+	kmem_cache_free(thread_cache, thread);
 }
 
 /**
  * sched_reap_dead_threads() - Reclaim exited threads at a safe boundary.
  *
- * Walks the run queue under the scheduler lock, detaches non-current zombie
- * threads, transitions them to DEAD, then frees memory after dropping the
- * lock. This keeps queue mutation serialized while avoiding allocator work
+ * Detaches non-current threads from the zombie list under the scheduler
+ * lock and transitions them to DEAD, then frees memory after dropping the
+ * lock. This keeps list mutation serialized while avoiding allocator work
  * inside the scheduler critical section.
  */
 void sched_reap_dead_threads(void)
 {
-	struct thread *prev = 0;
-	struct thread *thread = run_queue_head;
+	struct thread **link;
 	struct thread *reap_list = 0;
 	uint64_t flags;
 
 	spin_lock_irqsave(&scheduler_lock, &flags);
-	while (thread != 0) {
-		struct thread *next = thread->next;
-
-		if (thread_is_zombie(thread) && thread != current_thread) {
-			thread_set_dead(thread);
-			if (prev != 0) {
-				prev->next = next;
-			} else {
-				run_queue_head = next;
-			}
-
-			if (run_queue_tail == thread) {
-				run_queue_tail = prev;
-			}
-
-			thread->next = reap_list;
-			reap_list = thread;
-		} else {
-			prev = thread;
+	link = &zombie_list;
+	while (*link != 0) {
+		struct thread *thread = *link;
+
+		/* Still on its stack until its CPU has switched away. */
+		if (thread_is_current(thread)) {
+			link = &thread->next;
+			continue;
 		}
 
-		thread = next;
+		*link = thread->next;
+		thread_set_dead(thread);
+		thread->next = reap_list;
+		reap_list = thread;
 	}
 	spin_unlock_irqrestore(&scheduler_lock, flags);
 
@@ -212,11 +452,14 @@ void sched_reap_dead_threads(void)
 /**
  * sched_thread_exit() - Terminate the current thread without freeing its stack.
  *
- * The current thread becomes ZOMBIE and yields forever. A later scheduler pass
- * observes that it is no longer current, turns it DEAD, and releases storage.
+ * The current thread becomes ZOMBIE, joins the zombie list and yields
+ * forever. A later scheduler pass observes that it is no longer current,
+ * turns it DEAD, and releases storage.
  */
 void sched_thread_exit(void)
 {
+	uint64_t flags;
+
 	if (current_thread == 0) {
 		panic("thread exit without current thread");
 	}
@@ -226,7 +469,11 @@ void sched_thread_exit(void)
 		panic("thread exit entered twice");
 	}
 
+	spin_lock_irqsave(&scheduler_lock, &flags);
 	thread_set_zombie(current_thread);
+	current_thread->next = zombie_list;
+	zombie_list = current_thread;
+	spin_unlock_irqrestore(&scheduler_lock, flags);
 
 	for (;;) {
 		sched_yield();
@@ -241,13 +488,17 @@ void kernel_thread_exit(void)
 /**
  * thread_trampoline() - Enter a kernel thread and normalize return-to-exit.
  *
- * New contexts start here after the first architecture switch. If the entry
- * function returns, the trampoline routes it through kernel_thread_exit() so
- * both explicit and implicit exits use the same lifecycle.
+ * New contexts start here after the first architecture switch, still
+ * holding the scheduler lock of that switch. If the entry function returns,
+ * the trampoline routes it through kernel_thread_exit() so both explicit
+ * and implicit exits use the same lifecycle.
  */
 static void thread_trampoline(void)
 {
-	struct thread *thread = current_thread;
+	struct thread *thread;
+
+	sched_switch_finish_new();
+	thread = current_thread;
 
 	if (thread == 0 || thread->entry == 0) {
 		panic("kernel thread entered without entry");
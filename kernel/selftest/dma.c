@@ -0,0 +1,115 @@
+#include <stdint.h>
+
+#include <tianole/dma.h>
+#include <tianole/errno.h>
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/printk.h>
+#include <tianole/scatterlist.h>
+#include <tianole/vmalloc.h>
+
+/* Longer than the largest buddy block, and not a multiple of it. */
+#define TEST_RING_BYTES (((1ull << PAGE_MAX_ORDER) + 3) * PAGE_SIZE)
+#define TEST_SMALL_BYTES (3 * PAGE_SIZE + 100)
+#define TEST_SG_ENTRIES 4u
+
+static void coherent_selftest(void)
+{
+	uint64_t free_before = nr_free_pages();
+	dma_addr_t small_handle;
+	dma_addr_t ring_handle;
+	uint64_t *small;
+	uint8_t *ring;
+	uint64_t index;
+
+	small = dma_alloc_coherent(TEST_SMALL_BYTES, &small_handle,
+		DMA_BIT_MASK(32));
+	if (small == 0 || small != phys_to_virt(small_handle) ||
+		small_handle + TEST_SMALL_BYTES > ZONE_DMA32_LIMIT ||
+		phys_to_page(small_handle)->owner != PAGE_OWNER_DMA) {
+		panic("dma selftest coherent allocation failed");
+	}
+
+	for (index = 0; index < 4 * PAGE_SIZE / sizeof(uint64_t); index++) {
+		if (small[index] != 0) {
+			panic("dma selftest coherent buffer not zeroed");
+		}
+	}
+
+	ring = dma_alloc_coherent(TEST_RING_BYTES, &ring_handle,
+		DMA_BIT_MASK(64));
+	if (ring == 0 || (ring_handle & (PAGE_SIZE - 1)) != 0) {
+		panic("dma selftest contiguous allocation failed");
+	}
+
+	ring[0] = 1;
+	ring[TEST_RING_BYTES - 1] = 1;
+	if (nr_free_pages() + 4 + TEST_RING_BYTES / PAGE_SIZE != free_before) {
+		panic("dma selftest allocation size mismatch");
+	}
+
+	dma_free_coherent(TEST_RING_BYTES, ring, ring_handle);
+	dma_free_coherent(TEST_SMALL_BYTES, small, small_handle);
+	if (nr_free_pages() != free_before) {
+		panic("dma selftest free mismatch");
+	}
+}
+
+static void sg_selftest(void)
+{
+	struct scatterlist sgl[TEST_SG_ENTRIES];
+	phys_addr_t pages = alloc_pages(1);
+	uint8_t *area = vmalloc_mapped(3 * PAGE_SIZE);
+	uint64_t total = 0;
+	int count;
+	int index;
+
+	if (pages == 0 || area == 0) {
+		panic("dma selftest sg allocation failed");
+	}
+
+	/* A direct-map buffer is one contiguous piece. */
+	sg_init_table(sgl, TEST_SG_ENTRIES);
+	if (sg_init_buffer(sgl, TEST_SG_ENTRIES,
+		(uint8_t *)phys_to_virt(pages) + 8, PAGE_SIZE) != 1 ||
+		sgl[0].phys != pages + 8 || sgl[0].length != PAGE_SIZE) {
+		panic("dma selftest direct-map sg failed");
+	}
+
+	/* vmalloc pages may or may not be physically adjacent. */
+	count = sg_init_buffer(sgl, TEST_SG_ENTRIES, area + 100,
+		2 * PAGE_SIZE);
+	if (count < 1 || count > 3) {
+		panic("dma selftest vmalloc sg failed");
+	}
+
+	for (index = 0; index < count; index++) {
+		total += sgl[index].length;
+	}
+
+	if (total != 2 * PAGE_SIZE || (count > 1 &&
+		sg_init_buffer(sgl, 1, area + 100, 2 * PAGE_SIZE) != -ENOSPC)) {
+		panic("dma selftest vmalloc sg length failed");
+	}
+
+	sg_set_phys(&sgl[0], pages, PAGE_SIZE);
+	sg_set_phys(&sgl[1], pages + PAGE_SIZE, PAGE_SIZE);
+	if (dma_map_sg(sgl, 2, DMA_BIT_MASK(64)) != 1 ||
+		sgl[0].dma_address != pages ||
+		sgl[0].dma_length != 2 * PAGE_SIZE ||
+		sgl[1].dma_length != 0 ||
+		dma_map_sg(sgl, 2, DMA_BIT_MASK(12)) != -EIO) {
+		panic("dma selftest dma_map_sg failed");
+	}
+
+	dma_unmap_sg(sgl, 2);
+	vfree(area);
+	free_pages(pages, 1);
+}
+
+void dma_selftest(void)
+{
+	coherent_selftest();
+	sg_selftest();
+	pr_info("dma selftest ok\n");
+}
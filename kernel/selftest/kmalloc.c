@@ -0,0 +1,143 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tianole/arch.h>
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/printk.h>
+#include <tianole/vmalloc.h>
+
+#include "mm/heap.h"
+
+#define KMALLOC_BENCH_LIVE 512u
+#define KMALLOC_BENCH_ROUNDS 256u
+#define KMALLOC_BENCH_SIZE 128u
+
+typedef void *(*bench_alloc_fn)(size_t size);
+typedef void (*bench_free_fn)(void *ptr);
+
+/**
+ * struct kmalloc_bench_result - Cycle counts for one allocator under test.
+ * @total: Sum of alloc+free cycles over all rounds.
+ * @max: Slowest single alloc+free round.
+ */
+struct kmalloc_bench_result {
+	uint64_t total;
+	uint64_t max;
+};
+
+static void *bench_live[KMALLOC_BENCH_LIVE];
+
+/**
+ * kmalloc_bench_run() - Time alloc/free pairs against a fragmented heap.
+ * @alloc: Allocation function under test.
+ * @release: Matching free function.
+ * @result: Output cycle counts.
+ *
+ * Every other block of a population of small live objects is freed first,
+ * leaving holes too small for the timed request. A first-fit allocator has
+ * to walk past all of them; a size-class allocator does not look at them.
+ */
+static void kmalloc_bench_run(bench_alloc_fn alloc,
+	bench_free_fn release,
+	struct kmalloc_bench_result *result)
+{
+	uint32_t index;
+
+	for (index = 0; index < KMALLOC_BENCH_LIVE; index++) {
+		bench_live[index] = alloc(32 + (index % 4) * 16);
+		if (bench_live[index] == 0) {
+			panic("kmalloc benchmark allocation failed");
+		}
+	}
+
+	for (index = 0; index < KMALLOC_BENCH_LIVE; index += 2) {
+		release(bench_live[index]);
+		bench_live[index] = 0;
+	}
+
+	result->total = 0;
+	result->max = 0;
+	for (index = 0; index < KMALLOC_BENCH_ROUNDS; index++) {
+		uint64_t start = arch_read_cycle_counter();
+		void *ptr = alloc(KMALLOC_BENCH_SIZE);
+		uint64_t cycles;
+
+		if (ptr == 0) {
+			panic("kmalloc benchmark allocation failed");
+		}
+
+		release(ptr);
+		cycles = arch_read_cycle_counter() - start;
+		result->total += cycles;
+		if (cycles > result->max) {
+			result->max = cycles;
+		}
+	}
+
+	for (index = 1; index < KMALLOC_BENCH_LIVE; index += 2) {
+		release(bench_live[index]);
+		bench_live[index] = 0;
+	}
+}
+
+static void kmalloc_dispatch_selftest(void)
+{
+	uint8_t *small = kmalloc(100);
+	uint8_t *largest_class = kmalloc(KMALLOC_MAX_CACHE_SIZE);
+	uint8_t *large = kmalloc(KMALLOC_MAX_CACHE_SIZE + 1);
+	uint8_t *huge = kmalloc((PAGE_SIZE << PAGE_MAX_ORDER) + 1);
+	uint64_t small_pfn;
+	uint64_t large_pfn;
+
+	if (small == 0 || largest_class == 0 || large == 0 || huge == 0) {
+		panic("kmalloc selftest allocation failed");
+	}
+
+	if (((uintptr_t)small & (HEAP_ALIGNMENT - 1)) != 0 ||
+		((uintptr_t)large & (HEAP_ALIGNMENT - 1)) != 0) {
+		panic("kmalloc selftest alignment failed");
+	}
+
+	small_pfn = physmap_to_phys(small) >> PAGE_SHIFT;
+	if (!physmap_contains(small) || !pfn_valid(small_pfn) ||
+		(pfn_to_page(small_pfn)->flags & PG_SLAB) == 0) {
+		panic("kmalloc selftest size class dispatch failed");
+	}
+
+	large_pfn = physmap_to_phys(large) >> PAGE_SHIFT;
+	if (!physmap_contains(large) || !pfn_valid(large_pfn) ||
+		(pfn_to_page(large_pfn)->flags & PG_KMALLOC) == 0 ||
+		!vmalloc_contains(huge)) {
+		panic("kmalloc selftest large dispatch failed");
+	}
+
+	small[99] = 0x5a;
+	largest_class[KMALLOC_MAX_CACHE_SIZE - 1] = 0x5b;
+	large[KMALLOC_MAX_CACHE_SIZE] = 0x5c;
+	huge[PAGE_SIZE << PAGE_MAX_ORDER] = 0x5d;
+
+	kfree(huge);
+	kfree(large);
+	kfree(largest_class);
+	kfree(small);
+}
+
+void kmalloc_selftest(void)
+{
+	struct kmalloc_bench_result size_class;
+	struct kmalloc_bench_result first_fit;
+
+	kmalloc_dispatch_selftest();
+
+	kmalloc_bench_run(kmalloc, kfree, &size_class);
+	kmalloc_bench_run(heap_arena_alloc, heap_arena_free, &first_fit);
+
+	pr_info("kmalloc bench cycles size-class avg=%llu max=%llu "
+		"first-fit avg=%llu max=%llu\n",
+		(unsigned long long)(size_class.total / KMALLOC_BENCH_ROUNDS),
+		(unsigned long long)size_class.max,
+		(unsigned long long)(first_fit.total / KMALLOC_BENCH_ROUNDS),
+		(unsigned long long)first_fit.max);
+	pr_info("kmalloc selftest ok\n");
+}
@@ -0,0 +1,69 @@
+#include <stdint.h>
+
+#include <tianole/gfp.h>
+#include <tianole/mempool.h>
+#include <tianole/panic.h>
+#include <tianole/printk.h>
+
+#define TEST_ELEMENT_SIZE 48u
+#define TEST_RESERVE 8u
+
+void mempool_selftest(void)
+{
+	struct mempool *pool = mempool_create("mempool_test",
+		TEST_ELEMENT_SIZE,
+		TEST_RESERVE);
+	void *elements[TEST_RESERVE];
+	void *fallback;
+	uint32_t index;
+
+	if (pool == 0) {
+		panic("mempool selftest create failed");
+	}
+
+	for (index = 0; index < TEST_RESERVE; index++) {
+		void *element = mempool_alloc(pool, GFP_ATOMIC);
+
+		if (element == 0 ||
+			(index != 0 && element == elements[index - 1])) {
+			panic("mempool selftest reserve allocation failed");
+		}
+
+		elements[index] = element;
+	}
+
+	/* An atomic caller never falls through to the slab cache. */
+	if (mempool_alloc(pool, GFP_ATOMIC) != 0) {
+		panic("mempool selftest atomic overdraw");
+	}
+
+	fallback = mempool_alloc(pool, GFP_KERNEL);
+	if (fallback == 0) {
+		panic("mempool selftest kernel allocation failed");
+	}
+
+	mempool_free(pool, fallback);
+	for (index = 0; index < TEST_RESERVE; index++) {
+		mempool_free(pool, elements[index]);
+	}
+
+	if (mempool_refill(pool) != TEST_RESERVE) {
+		panic("mempool selftest surplus not trimmed");
+	}
+
+	for (index = 0; index < TEST_RESERVE / 2; index++) {
+		elements[index] = mempool_alloc(pool, GFP_ATOMIC);
+	}
+
+	if (mempool_refill(pool) != TEST_RESERVE) {
+		panic("mempool selftest refill failed");
+	}
+
+	for (index = 0; index < TEST_RESERVE / 2; index++) {
+		mempool_free(pool, elements[index]);
+	}
+
+	/* The frees above queued a trim that destroy has to cancel. */
+	mempool_destroy(pool);
+	pr_info("mempool selftest ok\n");
+}
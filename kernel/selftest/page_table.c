@@ -1,5 +1,6 @@
 #include <stdint.h>
 
+#include <tianole/arch.h>
 #include <tianole/errno.h>
 #include <tianole/mm.h>
 #include <tianole/panic.h>
@@ -8,11 +9,236 @@
 #include "arch/x86/mm/page_table.h"
 
 #define TEST_VIRTUAL_PAGE 0xffffff0000000000ull
+#define TEST_LARGE_PAGE (TEST_VIRTUAL_PAGE + PAGE_SIZE_2M)
+#define TEST_HUGE_PAGE (TEST_VIRTUAL_PAGE + PAGE_SIZE_1G)
+#define TEST_RANGE_BASE (TEST_VIRTUAL_PAGE + 4 * PAGE_SIZE_2M)
+#define TEST_RANGE_ORDER PAGE_MAX_ORDER
+#define TEST_RANGE_BYTES ((uint64_t)PAGE_SIZE << TEST_RANGE_ORDER)
+
+static void count_released_frames(phys_addr_t phys, uint64_t size, void *data)
+{
+	uint64_t *pages = data;
+
+	(void)phys;
+	*pages += size / PAGE_SIZE;
+}
+
+/**
+ * range_map_selftest() - Check map_range()/unmap_range() and time them.
+ *
+ * The same 4 MiB block is mapped page by page through map_page() and in
+ * one batch through map_range(). Each pass allocates the page tables on
+ * its first map and frees them on its last unmap, so the timings compare.
+ */
+static void range_map_selftest(void)
+{
+	const uint64_t flags = PAGE_WRITABLE | PAGE_NO_EXECUTE;
+	phys_addr_t block = alloc_pages(TEST_RANGE_ORDER);
+	uint64_t single_map;
+	uint64_t single_unmap;
+	uint64_t range_map;
+	uint64_t range_unmap;
+	uint64_t released = 0;
+	phys_addr_t resolved;
+	uint64_t offset;
+	uint64_t start;
+
+	if (block == 0) {
+		panic("page table selftest range allocation failed");
+	}
+
+	start = arch_read_cycle_counter();
+	for (offset = 0; offset < TEST_RANGE_BYTES; offset += PAGE_SIZE) {
+		int ret = map_page(TEST_RANGE_BASE + offset, block + offset,
+			flags);
+
+		if (ret != 0) {
+			panic("page table selftest single map failed");
+		}
+	}
+	single_map = arch_read_cycle_counter() - start;
+
+	start = arch_read_cycle_counter();
+	for (offset = 0; offset < TEST_RANGE_BYTES; offset += PAGE_SIZE) {
+		if (unmap_page(TEST_RANGE_BASE + offset) != 0) {
+			panic("page table selftest single unmap failed");
+		}
+	}
+	single_unmap = arch_read_cycle_counter() - start;
+
+	start = arch_read_cycle_counter();
+	if (map_range(TEST_RANGE_BASE, block, TEST_RANGE_BYTES, flags) != 0) {
+		panic("page table selftest range map failed");
+	}
+	range_map = arch_read_cycle_counter() - start;
+
+	for (offset = 0; offset < TEST_RANGE_BYTES; offset += 64 * PAGE_SIZE) {
+		if (virt_to_phys(TEST_RANGE_BASE + offset, &resolved) != 0 ||
+			resolved != block + offset) {
+			panic("page table selftest range resolve failed");
+		}
+	}
+
+	if (map_range(TEST_RANGE_BASE + TEST_RANGE_BYTES - PAGE_SIZE, block,
+			2 * PAGE_SIZE, flags) != -EEXIST ||
+		virt_to_phys(TEST_RANGE_BASE + TEST_RANGE_BYTES, &resolved) !=
+			-ENOENT) {
+		panic("page table selftest range overlap failed");
+	}
+
+	start = arch_read_cycle_counter();
+	if (unmap_range(TEST_RANGE_BASE, TEST_RANGE_BYTES,
+			count_released_frames, &released) != 0) {
+		panic("page table selftest range unmap failed");
+	}
+	range_unmap = arch_read_cycle_counter() - start;
+
+	if (released != TEST_RANGE_BYTES / PAGE_SIZE ||
+		virt_to_phys(TEST_RANGE_BASE, &resolved) != -ENOENT ||
+		unmap_range(TEST_RANGE_BASE, PAGE_SIZE, 0, 0) != -ENOENT) {
+		panic("page table selftest range release failed");
+	}
+
+	free_pages(block, TEST_RANGE_ORDER);
+	pr_info("page table bench cycles pages=%llu map_page=%llu "
+		"map_range=%llu unmap_page=%llu unmap_range=%llu\n",
+		(unsigned long long)(TEST_RANGE_BYTES / PAGE_SIZE),
+		(unsigned long long)single_map,
+		(unsigned long long)range_map,
+		(unsigned long long)single_unmap,
+		(unsigned long long)range_unmap);
+}
+
+/**
+ * gigabyte_page_selftest() - Check 1 GiB leaf mapping and translation.
+ *
+ * The leaf is only translated, never dereferenced, so mapping the first
+ * gigabyte of physical memory is harmless.
+ */
+static void gigabyte_page_selftest(void)
+{
+	phys_addr_t resolved;
+	int ret;
+
+	ret = map_page_size(TEST_HUGE_PAGE, 0, PAGE_SIZE_1G, PAGE_NO_EXECUTE);
+	if (!cpu_has_1g_pages()) {
+		if (ret != -EINVAL) {
+			panic("page table selftest 1G support errno failed");
+		}
+		return;
+	}
+
+	if (ret != 0) {
+		panic("page table selftest 1G map failed");
+	}
+
+	ret = virt_to_phys(TEST_HUGE_PAGE + PAGE_SIZE_2M + 0x10, &resolved);
+	if (ret != 0 || resolved != PAGE_SIZE_2M + 0x10) {
+		panic("page table selftest 1G resolve failed");
+	}
+
+	if (unmap_page_size(TEST_HUGE_PAGE, PAGE_SIZE_1G) != 0) {
+		panic("page table selftest 1G unmap failed");
+	}
+}
+
+/**
+ * large_page_selftest() - Check 2 MiB leaves and split-on-protect.
+ *
+ * Protecting a whole leaf must rewrite it in place, while protecting one
+ * 4 KiB page inside it must split it into exactly one new table page that
+ * keeps every other page's translation.
+ */
+static void large_page_selftest(void)
+{
+	phys_addr_t block = alloc_pages(PAGE_ORDER_2M);
+	volatile uint64_t *last = (volatile uint64_t *)(uintptr_t)(
+		TEST_LARGE_PAGE + PAGE_SIZE_2M - sizeof(uint64_t));
+	const uint64_t flags = PAGE_WRITABLE | PAGE_NO_EXECUTE;
+	phys_addr_t resolved;
+	virt_addr_t virt;
+	uint64_t free_before;
+
+	if (block == 0) {
+		panic("page table selftest large allocation failed");
+	}
+
+	if (map_page_size(TEST_LARGE_PAGE + PAGE_SIZE, block, PAGE_SIZE_2M,
+			flags) != -EINVAL) {
+		panic("page table selftest large unaligned errno failed");
+	}
+
+	if (map_page_size(TEST_LARGE_PAGE, block, PAGE_SIZE_2M, flags) != 0) {
+		panic("page table selftest large map failed");
+	}
+
+	if (map_page(TEST_LARGE_PAGE + PAGE_SIZE, block, flags) != -EEXIST) {
+		panic("page table selftest large overlap errno failed");
+	}
+
+	if (virt_to_phys(TEST_LARGE_PAGE + 0x12345, &resolved) != 0 ||
+		resolved != block + 0x12345) {
+		panic("page table selftest large resolve failed");
+	}
+
+	*last = 0x4c41524745ull;
+	if (*(volatile uint64_t *)((uint8_t *)phys_to_virt(block) +
+			PAGE_SIZE_2M - sizeof(uint64_t)) != 0x4c41524745ull) {
+		panic("page table selftest large access failed");
+	}
+
+	free_before = nr_free_pages();
+	if (protect_range(TEST_LARGE_PAGE, PAGE_SIZE_2M,
+			PAGE_NO_EXECUTE) != 0 ||
+		protect_range(TEST_LARGE_PAGE, PAGE_SIZE_2M, flags) != 0 ||
+		nr_free_pages() != free_before) {
+		panic("page table selftest whole-leaf protect split");
+	}
+
+	if (protect_range(TEST_LARGE_PAGE + PAGE_SIZE, PAGE_SIZE,
+			PAGE_NO_EXECUTE) != 0 ||
+		nr_free_pages() != free_before - 1) {
+		panic("page table selftest split protect failed");
+	}
+
+	for (virt = TEST_LARGE_PAGE; virt < TEST_LARGE_PAGE + PAGE_SIZE_2M;
+		virt += PAGE_SIZE) {
+		if (virt_to_phys(virt, &resolved) != 0 ||
+			resolved != block + (virt - TEST_LARGE_PAGE)) {
+			panic("page table selftest split resolve failed");
+		}
+	}
+
+	*last = 0x53504c4954ull;
+	if (unmap_page_size(TEST_LARGE_PAGE, PAGE_SIZE_2M) != -EINVAL) {
+		panic("page table selftest split unmap errno failed");
+	}
+
+	for (virt = TEST_LARGE_PAGE; virt < TEST_LARGE_PAGE + PAGE_SIZE_2M;
+		virt += PAGE_SIZE) {
+		if (unmap_page(virt) != 0) {
+			panic("page table selftest split unmap failed");
+		}
+	}
+
+	if (map_page_size(TEST_LARGE_PAGE + PAGE_SIZE_2M, block, PAGE_SIZE_2M,
+			flags) != 0 ||
+		unmap_page_size(TEST_LARGE_PAGE + PAGE_SIZE_2M,
+			PAGE_SIZE_2M) != 0 ||
+		virt_to_phys(TEST_LARGE_PAGE + PAGE_SIZE_2M, &resolved) !=
+			-ENOENT) {
+		panic("page table selftest large unmap failed");
+	}
+
+	free_pages(block, PAGE_ORDER_2M);
+	gigabyte_page_selftest();
+}
 
 void page_table_selftest(void)
 {
 	phys_addr_t page = alloc_page();
 	phys_addr_t resolved;
+	uint64_t tables;
 	volatile uint64_t *mapped =
 		(volatile uint64_t *)(uintptr_t)TEST_VIRTUAL_PAGE;
 
@@ -21,6 +247,7 @@ void page_table_selftest(void)
 	}
 
 	page_tables_init();
+	tables = nr_page_table_pages();
 
 	if (map_page(TEST_VIRTUAL_PAGE + 1, page, PAGE_WRITABLE) != -EINVAL) {
 		panic("page table selftest unaligned map errno failed");
@@ -60,6 +287,18 @@ void page_table_selftest(void)
 		panic("page table selftest missing unmap errno failed");
 	}
 
+	if (nr_page_table_pages() != tables) {
+		panic("page table selftest empty tables not freed");
+	}
+
 	free_page(page);
+	large_page_selftest();
+	range_map_selftest();
+	if (nr_page_table_pages() != tables) {
+		panic("page table selftest leaked table pages");
+	}
+
+	pr_info("page table pages live=%llu\n",
+		(unsigned long long)nr_page_table_pages());
 	pr_info("page table selftest ok\n");
 }
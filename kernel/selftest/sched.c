@@ -4,12 +4,19 @@
 #include <tianole/panic.h>
 #include <tianole/printk.h>
 #include <tianole/sched.h>
+#include <tianole/smp.h>
 #include <tianole/spinlock.h>
+#include <tianole/timer.h>
 
 #include "sched/sched.h"
 
 #define STACK_ALIGNMENT 16u
 
+/* Ticks the CPU-bound pair of the fair share test competes for. */
+#define FAIR_SHARE_TICKS 40u
+/* One-tick sleeps of the I/O-bound thread, all inside that window. */
+#define FAIR_IO_LOOPS 20u
+
 static void thread_selftest_entry(void *arg)
 {
 	(void)arg;
@@ -21,6 +28,67 @@ static int selftest_condition_false(void *arg)
 	return 0;
 }
 
+static struct thread *fair_first_thread(void)
+{
+	struct rb_node *node = rb_first_cached(&run_queue.fair);
+
+	return node != 0 ? rb_entry(node, struct thread, run_node) : 0;
+}
+
+/**
+ * sched_fair_selftest() - Check fair-class ordering, weights and placement.
+ * @first: READY fair thread queued before @second.
+ * @second: READY fair thread with the same vruntime as @first.
+ *
+ * Requeues the threads by hand, so it runs before anything is scheduled.
+ */
+static void sched_fair_selftest(struct thread *first, struct thread *second)
+{
+	uint64_t vruntime = second->vruntime;
+	uint64_t flags;
+
+	if (sched_set_nice(second, 5) != 0 || second->weight != 335u ||
+		run_queue.fair_weight != NICE_0_WEIGHT + 335u ||
+		sched_set_nice(second, SCHED_NICE_MAX + 1) != -EINVAL ||
+		sched_set_nice(second, SCHED_NICE_MIN - 1) != -EINVAL ||
+		sched_set_nice(second, 0) != 0 ||
+		run_queue.fair_weight != 2u * NICE_0_WEIGHT ||
+		sched_set_timeslice(0, SCHED_RR_TICKS_DEFAULT) != -EINVAL ||
+		sched_set_timeslice(SCHED_LATENCY_TICKS_DEFAULT, 0) !=
+			-EINVAL) {
+		panic("fair scheduling selftest tunables failed");
+	}
+
+	spin_lock_irqsave(&scheduler_lock, &flags);
+
+	/* Less vruntime runs first, whatever the queueing order. */
+	dequeue_thread(second);
+	second->vruntime = vruntime - 1u;
+	enqueue_thread(second, 0);
+	if (fair_first_thread() != second || run_queue.nr_ready != 2u) {
+		panic("fair scheduling selftest ordering failed");
+	}
+
+	/* A long sleeper wakes no further back than the class floor allows. */
+	dequeue_thread(second);
+	second->vruntime = run_queue.min_vruntime - (1ull << 40);
+	enqueue_thread(second, ENQUEUE_WAKEUP);
+	if ((int64_t)(run_queue.min_vruntime - second->vruntime) < 0 ||
+		run_queue.min_vruntime - second->vruntime >=
+			1ull << 40) {
+		panic("fair scheduling selftest wakeup placement failed");
+	}
+
+	dequeue_thread(second);
+	second->vruntime = vruntime;
+	enqueue_thread(second, 0);
+	spin_unlock_irqrestore(&scheduler_lock, flags);
+
+	if (fair_first_thread() != first) {
+		panic("fair scheduling selftest requeue failed");
+	}
+}
+
 static void assert_thread_transition(
 	enum thread_state from, enum thread_state to, int expected)
 {
@@ -88,11 +156,29 @@ void sched_selftest(void)
 		panic("kernel thread selftest stack alignment failed");
 	}
 
-	if (run_queue_head != first || first->next != second ||
-		run_queue_tail != second) {
+	if (fair_first_thread() != first ||
+		run_queue.fair_weight != 2u * NICE_0_WEIGHT ||
+		run_queue.head[SCHED_PRIO_DEFAULT] != 0 ||
+		(run_queue.bitmap & (1u << SCHED_PRIO_DEFAULT)) == 0) {
 		panic("kernel thread selftest run queue failed");
 	}
 
+	/* A priority change requeues a READY thread at the new level. */
+	if (sched_set_priority(second, SCHED_PRIO_DEFAULT - 1) != 0 ||
+		run_queue.head[SCHED_PRIO_DEFAULT - 1] != second ||
+		run_queue.fair_weight != NICE_0_WEIGHT ||
+		__builtin_ctz(run_queue.bitmap) != SCHED_PRIO_DEFAULT - 1 ||
+		sched_set_priority(second, SCHED_NR_PRIO) != -EINVAL ||
+		sched_set_priority(second, SCHED_PRIO_DEFAULT) != 0 ||
+		run_queue.head[SCHED_PRIO_DEFAULT - 1] != 0 ||
+		(run_queue.bitmap & (1u << (SCHED_PRIO_DEFAULT - 1))) != 0 ||
+		fair_first_thread() != first ||
+		run_queue.fair_weight != 2u * NICE_0_WEIGHT) {
+		panic("kernel thread selftest priority failed");
+	}
+
+	sched_fair_selftest(first, second);
+
 	if (spinlock_held_count() != 0) {
 		panic("spinlock depth selftest initial state failed");
 	}
@@ -107,17 +193,17 @@ void sched_selftest(void)
 		panic("spinlock depth selftest release failed");
 	}
 
-	if (irq_depth != 0) {
+	if (this_sched_cpu()->irq_depth != 0) {
 		panic("irq depth selftest initial state failed");
 	}
 
 	sched_irq_enter();
-	if (irq_depth != 1) {
+	if (this_sched_cpu()->irq_depth != 1) {
 		panic("irq depth selftest enter failed");
 	}
 	sched_irq_exit(0);
 
-	if (irq_depth != 0) {
+	if (this_sched_cpu()->irq_depth != 0) {
 		panic("irq depth selftest exit failed");
 	}
 
@@ -226,6 +312,107 @@ static void timeout_wait_demo_waiter(void *arg)
 	pr_info("timeout waiter timed out\n");
 }
 
+static volatile int fair_share_stop;
+static volatile int fair_io_done;
+static uint64_t fair_io_late_max;
+
+static void fair_cpu_bound_thread(void *arg)
+{
+	(void)arg;
+
+	while (fair_share_stop == 0) {
+	}
+}
+
+static void fair_io_bound_thread(void *arg)
+{
+	uint32_t loop;
+
+	(void)arg;
+
+	for (loop = 0; loop < FAIR_IO_LOOPS; loop++) {
+		uint64_t deadline = timer_ticks() + 1u;
+		uint64_t late;
+
+		sched_sleep(1);
+		late = timer_ticks() - deadline;
+		if (late > fair_io_late_max) {
+			fair_io_late_max = late;
+		}
+	}
+
+	fair_io_done = 1;
+}
+
+/**
+ * fair_share_demo_thread() - Check CPU shares under the fair class.
+ * @arg: Unused.
+ *
+ * CPU-bound threads at nice 0 and nice 5 (weights 1024 and 335), one of
+ * each per online CPU so every CPU is contended, spin against each other
+ * and against an I/O-bound thread that sleeps a tick at a time. The two
+ * groups must split their runtime about 3:1, and the I/O-bound thread must
+ * be back on a CPU within a tick of every wakeup instead of waiting out the
+ * spinners' slices.
+ */
+static void fair_share_demo_thread(void *arg)
+{
+	struct thread *heavy[NR_CPUS];
+	struct thread *light[NR_CPUS];
+	struct thread *io;
+	uint64_t heavy_runtime = 0;
+	uint64_t light_runtime = 0;
+	uint32_t nr_pairs = num_online_cpus();
+	uint32_t index;
+	uint64_t flags;
+
+	(void)arg;
+
+	for (index = 0; index < nr_pairs; index++) {
+		heavy[index] = kernel_thread_create(
+			"fair-nice0", fair_cpu_bound_thread, 0);
+		light[index] = kernel_thread_create(
+			"fair-nice5", fair_cpu_bound_thread, 0);
+		if (heavy[index] == 0 || light[index] == 0 ||
+			sched_set_nice(light[index], 5) != 0) {
+			panic("fair share selftest setup failed");
+		}
+	}
+
+	io = kernel_thread_create("fair-io", fair_io_bound_thread, 0);
+	if (io == 0) {
+		panic("fair share selftest setup failed");
+	}
+
+	sched_sleep(FAIR_SHARE_TICKS);
+
+	/*
+	 * Spinners still running elsewhere are charged up to their last tick;
+	 * a tick's worth of error is well inside the accepted range.
+	 */
+	spin_lock_irqsave(&scheduler_lock, &flags);
+	for (index = 0; index < nr_pairs; index++) {
+		heavy_runtime += heavy[index]->sum_exec_runtime;
+		light_runtime += light[index]->sum_exec_runtime;
+	}
+	spin_unlock_irqrestore(&scheduler_lock, flags);
+	fair_share_stop = 1;
+
+	if (light_runtime == 0 || heavy_runtime < 2u * light_runtime ||
+		heavy_runtime > 5u * light_runtime) {
+		panic("fair share selftest CPU split failed");
+	}
+
+	if (fair_io_done == 0 || fair_io_late_max > 1u) {
+		panic("fair share selftest I/O latency failed");
+	}
+
+	pr_info("fair share selftest ok nice0=%llu%% io_late=%llu\n",
+		(unsigned long long)(heavy_runtime * 100u /
+			(heavy_runtime + light_runtime)),
+		(unsigned long long)fair_io_late_max);
+}
+
 static void return_exit_demo_thread(void *arg)
 {
 	(void)arg;
@@ -250,6 +437,7 @@ void sched_demo_start(void)
 	struct thread *condition_waiter;
 	struct thread *condition_waker;
 	struct thread *timeout_waiter;
+	struct thread *fair_share;
 	struct thread *return_exit;
 	struct thread *explicit_exit;
 
@@ -257,6 +445,9 @@ void sched_demo_start(void)
 	wait_queue_init(&condition_wait_queue);
 	wait_queue_init(&timeout_wait_queue);
 	condition_ready = 0;
+	fair_share_stop = 0;
+	fair_io_done = 0;
+	fair_io_late_max = 0;
 
 	first = kernel_thread_create(
 		"round-robin-a", scheduler_demo_entry, (void *)(uintptr_t)1);
@@ -270,6 +461,8 @@ void sched_demo_start(void)
 		"condition-waker", condition_wait_demo_waker, 0);
 	timeout_waiter = kernel_thread_create(
 		"timeout-waiter", timeout_wait_demo_waiter, 0);
+	fair_share =
+		kernel_thread_create("fair-share", fair_share_demo_thread, 0);
 	return_exit =
 		kernel_thread_create("return-exit", return_exit_demo_thread, 0);
 	explicit_exit = kernel_thread_create(
@@ -277,7 +470,8 @@ void sched_demo_start(void)
 
 	if (first == 0 || second == 0 || waiter == 0 || waker == 0 ||
 		condition_waiter == 0 || condition_waker == 0 ||
-		timeout_waiter == 0 || return_exit == 0 || explicit_exit == 0) {
+		timeout_waiter == 0 || fair_share == 0 || return_exit == 0 ||
+		explicit_exit == 0) {
 		panic("scheduler demo thread creation failed");
 	}
 
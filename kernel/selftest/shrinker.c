@@ -0,0 +1,92 @@
+#include <stdint.h>
+
+#include <tianole/errno.h>
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/printk.h>
+#include <tianole/shrinker.h>
+
+#define TEST_PAGES 16u
+
+static phys_addr_t test_pages[TEST_PAGES];
+static uint32_t test_count;
+
+static uint64_t test_count_pages(struct shrinker *shrinker)
+{
+	(void)shrinker;
+
+	return test_count;
+}
+
+static uint64_t test_scan(struct shrinker *shrinker, uint64_t nr_to_scan)
+{
+	uint64_t freed = 0;
+
+	(void)shrinker;
+
+	while (freed < nr_to_scan && test_count != 0) {
+		free_page(test_pages[--test_count]);
+		freed++;
+	}
+
+	return freed;
+}
+
+static struct shrinker test_shrinker = {
+	.name = "selftest",
+	.count = test_count_pages,
+	.scan = test_scan,
+};
+
+void shrinker_selftest(void)
+{
+	struct shrinker broken = { .name = "broken" };
+	uint64_t before;
+	uint64_t freed;
+
+	if (page_watermark(WMARK_LOW) == 0 ||
+		page_watermark(WMARK_HIGH) <= page_watermark(WMARK_LOW) ||
+		page_watermark(NR_WMARK) != 0) {
+		panic("shrinker selftest watermarks invalid");
+	}
+
+	for (test_count = 0; test_count < TEST_PAGES; test_count++) {
+		test_pages[test_count] = alloc_page();
+		if (test_pages[test_count] == 0) {
+			panic("shrinker selftest allocation failed");
+		}
+	}
+
+	if (register_shrinker(&broken) != -EINVAL ||
+		register_shrinker(&test_shrinker) != 0 ||
+		register_shrinker(&test_shrinker) != -EEXIST) {
+		panic("shrinker selftest registration failed");
+	}
+
+	/* Ask for everything so the scan reaches the last shrinker. */
+	before = nr_free_pages();
+	freed = shrink_caches(UINT64_MAX);
+	unregister_shrinker(&test_shrinker);
+
+	if (test_count != 0 || test_shrinker.freed != TEST_PAGES ||
+		freed < TEST_PAGES || nr_free_pages() - before < TEST_PAGES) {
+		panic("shrinker selftest scan failed");
+	}
+
+	test_pages[0] = alloc_page();
+	if (test_pages[0] == 0) {
+		panic("shrinker selftest allocation failed");
+	}
+
+	test_count = 1;
+	(void)shrink_caches(UINT64_MAX);
+	if (test_count != 1) {
+		panic("shrinker selftest unregister failed");
+	}
+
+	free_page(test_pages[0]);
+	test_count = 0;
+
+	pr_info("shrinker selftest ok freed=%llu\n",
+		(unsigned long long)freed);
+}
@@ -0,0 +1,98 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/printk.h>
+#include <tianole/slab.h>
+
+#define SLAB_TEST_MAGIC 0x534c4142u
+#define SLAB_TEST_MAX_OBJECTS 256u
+
+struct slab_test_object {
+	uint32_t magic;
+	uint32_t value;
+	uint64_t payload[4];
+};
+
+static void slab_test_ctor(void *object)
+{
+	struct slab_test_object *test = object;
+
+	test->magic = SLAB_TEST_MAGIC;
+	test->value = 0;
+}
+
+static void expect_slabs(struct kmem_cache *cache, uint64_t slabs,
+	uint64_t inuse, const char *message)
+{
+	struct kmem_cache_stats stats;
+
+	kmem_cache_get_stats(cache, &stats);
+	if (stats.slabs != slabs || stats.objects_inuse != inuse) {
+		panic(message);
+	}
+}
+
+void slab_selftest(void)
+{
+	struct slab_test_object *objects[SLAB_TEST_MAX_OBJECTS];
+	struct kmem_cache_stats stats;
+	struct kmem_cache *cache;
+	struct slab_test_object *reused;
+	uint32_t count;
+	uint32_t index;
+
+	cache = kmem_cache_create("selftest",
+		sizeof(struct slab_test_object),
+		0,
+		slab_test_ctor);
+	if (cache == 0) {
+		panic("slab selftest cache creation failed");
+	}
+
+	kmem_cache_get_stats(cache, &stats);
+	count = stats.objects_per_slab + 1;
+	if (count > SLAB_TEST_MAX_OBJECTS ||
+		stats.stride < sizeof(struct slab_test_object)) {
+		panic("slab selftest layout failed");
+	}
+
+	for (index = 0; index < count; index++) {
+		objects[index] = kmem_cache_alloc(cache);
+		if (objects[index] == 0 ||
+			objects[index]->magic != SLAB_TEST_MAGIC) {
+			panic("slab selftest constructor failed");
+		}
+
+		if (index != 0 && objects[index] == objects[index - 1]) {
+			panic("slab selftest duplicate object");
+		}
+
+		objects[index]->value = index;
+	}
+
+	expect_slabs(cache, 2, count, "slab selftest growth failed");
+
+	for (index = 0; index < count; index++) {
+		if (objects[index]->value != index) {
+			panic("slab selftest object corrupted");
+		}
+	}
+
+	for (index = 0; index < count; index++) {
+		kmem_cache_free(cache, objects[index]);
+	}
+
+	expect_slabs(cache, 1, 0, "slab selftest empty slab release failed");
+
+	reused = kmem_cache_alloc(cache);
+	if (reused == 0 || reused->magic != SLAB_TEST_MAGIC) {
+		panic("slab selftest reuse failed");
+	}
+
+	kmem_cache_free(cache, reused);
+	kmem_cache_destroy(cache);
+
+	pr_info("slab selftest ok\n");
+}
@@ -0,0 +1,180 @@
+#include <stdint.h>
+
+#include <tianole/panic.h>
+#include <tianole/printk.h>
+#include <tianole/timer.h>
+
+#include "time/timer_wheel.h"
+
+/* Start just short of the tick where every outer level cascades at once. */
+#define TEST_START ((1ull << (TVR_BITS + 3 * TVN_BITS)) - 5u)
+#define TEST_REARMS 3u
+
+struct test_timer {
+	struct timer_list timer;
+	uint64_t fired_at;
+	uint32_t fired;
+};
+
+static struct timer_base test_base;
+
+static const uint64_t test_delays[] = {
+	0,
+	1,
+	4,
+	5,
+	255,
+	256,
+	300,
+	TVR_SIZE << TVN_BITS,
+	20000,
+	(1ull << (TVR_BITS + 2 * TVN_BITS)) + 1000,
+};
+
+#define TEST_TIMERS (sizeof(test_delays) / sizeof(test_delays[0]))
+
+static struct test_timer test_timers[TEST_TIMERS];
+static struct test_timer test_deleted;
+static struct test_timer test_moved;
+static struct test_timer test_rearmed;
+static struct test_timer test_global;
+
+static void test_timer_fn(struct timer_list *timer)
+{
+	struct test_timer *test = timer->data;
+
+	test->fired_at = test_base.clk - 1;
+	test->fired++;
+}
+
+static void test_rearm_fn(struct timer_list *timer)
+{
+	struct test_timer *test = timer->data;
+
+	test->fired_at = test_base.clk - 1;
+	test->fired++;
+	if (test->fired < TEST_REARMS) {
+		timer_base_mod(&test_base, timer, timer->expires + 100);
+	}
+}
+
+static void test_timer_setup(struct test_timer *test, timer_func_t func)
+{
+	timer_init(&test->timer, func, test);
+	test->fired_at = 0;
+	test->fired = 0;
+}
+
+static void test_expect_fired(const struct test_timer *test,
+	uint64_t expires, uint32_t count)
+{
+	if (test->fired != count) {
+		panic("timer selftest fire count mismatch");
+	}
+
+	if (count != 0 && test->fired_at != expires) {
+		panic("timer selftest fired at wrong tick");
+	}
+}
+
+static void test_wheel(void)
+{
+	uint64_t last = TEST_START;
+	uint32_t index;
+
+	timer_base_init(&test_base, TEST_START);
+
+	for (index = 0; index < TEST_TIMERS; index++) {
+		test_timer_setup(&test_timers[index], test_timer_fn);
+		timer_base_mod(&test_base, &test_timers[index].timer,
+			TEST_START + test_delays[index]);
+		if (TEST_START + test_delays[index] > last) {
+			last = TEST_START + test_delays[index];
+		}
+	}
+
+	test_timer_setup(&test_deleted, test_timer_fn);
+	timer_base_mod(&test_base, &test_deleted.timer, TEST_START + 256);
+	test_timer_setup(&test_moved, test_timer_fn);
+	timer_base_mod(&test_base, &test_moved.timer, TEST_START + 10);
+	test_timer_setup(&test_rearmed, test_rearm_fn);
+	timer_base_mod(&test_base, &test_rearmed.timer, TEST_START + 50);
+
+	if (timer_base_next_expiry(&test_base) != TEST_START) {
+		panic("timer selftest next expiry mismatch");
+	}
+
+	if (del_timer(&test_deleted.timer) != 1 ||
+		del_timer(&test_deleted.timer) != 0 ||
+		timer_pending(&test_deleted.timer)) {
+		panic("timer selftest delete failed");
+	}
+
+	if (timer_base_mod(&test_base, &test_moved.timer,
+		    TEST_START + 5000) != 1) {
+		panic("timer selftest modify failed");
+	}
+
+	/* Run past the boundary in two steps to check partial progress. */
+	timer_base_run(&test_base, TEST_START + 255);
+	test_expect_fired(&test_timers[4], TEST_START + 255, 1);
+	test_expect_fired(&test_timers[5], 0, 0);
+	if (!timer_pending(&test_timers[5].timer)) {
+		panic("timer selftest fired early");
+	}
+
+	/* Cascaded into the first level by now, so the lookup is exact. */
+	if (timer_base_next_expiry(&test_base) != TEST_START + 256) {
+		panic("timer selftest next expiry after cascade mismatch");
+	}
+
+	timer_base_run(&test_base, last);
+	if (timer_base_next_expiry(&test_base) != UINT64_MAX) {
+		panic("timer selftest wheel not empty");
+	}
+
+	for (index = 0; index < TEST_TIMERS; index++) {
+		test_expect_fired(&test_timers[index],
+			TEST_START + test_delays[index], 1);
+	}
+
+	test_expect_fired(&test_deleted, 0, 0);
+	test_expect_fired(&test_moved, TEST_START + 5000, 1);
+	test_expect_fired(&test_rearmed,
+		TEST_START + 50 + (TEST_REARMS - 1) * 100, TEST_REARMS);
+
+	/* A timer that already expired fires on the next processed tick. */
+	test_timer_setup(&test_deleted, test_timer_fn);
+	timer_base_mod(&test_base, &test_deleted.timer, TEST_START);
+	timer_base_run(&test_base, last + 1);
+	test_expect_fired(&test_deleted, last + 1, 1);
+}
+
+static void test_global_wheel(void)
+{
+	test_timer_setup(&test_global, test_timer_fn);
+	test_global.timer.expires = timer_ticks() + 1000;
+	add_timer(&test_global.timer);
+
+	if (!timer_pending(&test_global.timer) ||
+		mod_timer(&test_global.timer, timer_ticks() + 2000) != 1 ||
+		del_timer(&test_global.timer) != 1 ||
+		del_timer(&test_global.timer) != 0) {
+		panic("timer selftest global wheel failed");
+	}
+}
+
+/**
+ * timer_selftest() - Check timer wheel expiry, cascading and cancellation.
+ *
+ * Runs a private wheel across outer-level wraps and checks every timer
+ * fires exactly once on its own tick, then exercises the global wheel API
+ * without letting anything expire.
+ */
+void timer_selftest(void)
+{
+	test_wheel();
+	test_global_wheel();
+
+	pr_info("timer selftest ok\n");
+}
@@ -0,0 +1,157 @@
+#include <stdint.h>
+
+#include <tianole/arch.h>
+#include <tianole/errno.h>
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/printk.h>
+
+#include "arch/x86/mm/page_table.h"
+
+/* Lower-half slot untouched by the boot identity map: private per space. */
+#define TEST_PRIVATE_BASE 0x00007f0000000000ull
+#define TEST_SHARED_PAGE 0xfffffe8000000000ull
+#define TEST_PRIVATE_ORDER 5u
+#define TEST_PRIVATE_PAGES (1u << TEST_PRIVATE_ORDER)
+#define TEST_PRIVATE_BYTES ((uint64_t)PAGE_SIZE * TEST_PRIVATE_PAGES)
+#define TEST_SWITCH_ROUNDS 64u
+
+static void release_private_frame(phys_addr_t phys, uint64_t size, void *data)
+{
+	(void)size;
+	(void)data;
+	free_page(phys);
+}
+
+/**
+ * map_private_range() - Back the private test range of the loaded space.
+ * @tag: Value written to the first word of the range.
+ */
+static void map_private_range(uint64_t tag)
+{
+	phys_addr_t block = alloc_pages(TEST_PRIVATE_ORDER);
+
+	if (block == 0) {
+		panic("vm_space selftest private allocation failed");
+	}
+
+	if (map_range(TEST_PRIVATE_BASE, block, TEST_PRIVATE_BYTES,
+			PAGE_WRITABLE | PAGE_NO_EXECUTE) != 0) {
+		panic("vm_space selftest private map failed");
+	}
+
+	*(volatile uint64_t *)(uintptr_t)TEST_PRIVATE_BASE = tag;
+}
+
+static uint64_t read_private_tag(void)
+{
+	return *(volatile uint64_t *)(uintptr_t)TEST_PRIVATE_BASE;
+}
+
+static void touch_private_range(void)
+{
+	uint64_t page;
+
+	for (page = 0; page < TEST_PRIVATE_PAGES; page++) {
+		(void)*(volatile uint64_t *)(uintptr_t)(
+			TEST_PRIVATE_BASE + page * PAGE_SIZE);
+	}
+}
+
+/**
+ * switch_bench() - Time round trips between two spaces touching their data.
+ * @a: First space.
+ * @b: Second space.
+ *
+ * Return: Cycles spent on TEST_SWITCH_ROUNDS round trips.
+ */
+static uint64_t switch_bench(struct vm_space *a, struct vm_space *b)
+{
+	uint64_t start = arch_read_cycle_counter();
+	uint32_t round;
+
+	for (round = 0; round < TEST_SWITCH_ROUNDS; round++) {
+		vm_space_switch(a);
+		touch_private_range();
+		vm_space_switch(b);
+		touch_private_range();
+	}
+
+	return arch_read_cycle_counter() - start;
+}
+
+void vm_space_selftest(void)
+{
+	struct vm_space *a = vm_space_create();
+	struct vm_space *b = vm_space_create();
+	phys_addr_t shared = alloc_page();
+	phys_addr_t resolved;
+	uint64_t preserved;
+	uint64_t flushed;
+
+	if (a == 0 || b == 0 || shared == 0) {
+		panic("vm_space selftest allocation failed");
+	}
+
+	vm_space_switch(a);
+	map_private_range(0xa);
+
+	vm_space_switch(b);
+	if (virt_to_phys(TEST_PRIVATE_BASE, &resolved) != -ENOENT) {
+		panic("vm_space selftest private mapping leaked");
+	}
+	map_private_range(0xb);
+
+	if (map_page(TEST_SHARED_PAGE, shared,
+			PAGE_WRITABLE | PAGE_NO_EXECUTE) != 0) {
+		panic("vm_space selftest shared map failed");
+	}
+
+	vm_space_switch(a);
+	if (read_private_tag() != 0xa ||
+		virt_to_phys(TEST_SHARED_PAGE, &resolved) != 0 ||
+		resolved != shared) {
+		panic("vm_space selftest isolation failed");
+	}
+
+	vm_space_switch(b);
+	if (read_private_tag() != 0xb) {
+		panic("vm_space selftest isolation failed");
+	}
+
+	vm_space_flush_page(a, TEST_PRIVATE_BASE);
+	preserved = switch_bench(a, b);
+	vm_space_set_pcid_preserve(0);
+	flushed = switch_bench(a, b);
+	vm_space_set_pcid_preserve(1);
+
+	if (unmap_range(TEST_PRIVATE_BASE, TEST_PRIVATE_BYTES,
+			release_private_frame, 0) != 0) {
+		panic("vm_space selftest private unmap failed");
+	}
+
+	vm_space_switch(a);
+	if (read_private_tag() != 0xa ||
+		unmap_range(TEST_PRIVATE_BASE, TEST_PRIVATE_BYTES,
+			release_private_frame, 0) != 0) {
+		panic("vm_space selftest private unmap failed");
+	}
+
+	vm_space_switch(vm_space_kernel());
+	if (unmap_page(TEST_SHARED_PAGE) != 0) {
+		panic("vm_space selftest shared unmap failed");
+	}
+
+	free_page(shared);
+	vm_space_destroy(a);
+	vm_space_destroy(b);
+
+	pr_info("vm_space switch bench cycles pcid=%s rounds=%u pages=%u "
+		"preserve=%llu flush=%llu\n",
+		tlb_pcid_enabled() != 0 ? "on" : "off",
+		TEST_SWITCH_ROUNDS,
+		TEST_PRIVATE_PAGES,
+		(unsigned long long)preserved,
+		(unsigned long long)flushed);
+	pr_info("vm_space selftest ok\n");
+}
@@ -0,0 +1,62 @@
+#include <stdint.h>
+
+#include <tianole/arch.h>
+#include <tianole/errno.h>
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/printk.h>
+#include <tianole/vmalloc.h>
+
+#define TEST_AREA_BYTES (64ull << 20)
+#define TEST_TOUCH_PAGES 8u
+#define TEST_TOUCH_STRIDE (TEST_AREA_BYTES / TEST_TOUCH_PAGES)
+
+void vmalloc_selftest(void)
+{
+	uint8_t *area = vmalloc(TEST_AREA_BYTES);
+	uint8_t *small = vmalloc(1);
+	phys_addr_t resolved;
+	uint64_t free_before;
+	uint64_t cycles;
+	uint32_t index;
+
+	if (area == 0 || small == 0) {
+		panic("vmalloc selftest allocation failed");
+	}
+
+	if (small < area + TEST_AREA_BYTES + PAGE_SIZE ||
+		virt_to_phys((virt_addr_t)(uintptr_t)area, &resolved) !=
+			-ENOENT) {
+		panic("vmalloc selftest reservation was backed");
+	}
+
+	free_before = nr_free_pages();
+	cycles = arch_read_cycle_counter();
+	for (index = 0; index < TEST_TOUCH_PAGES; index++) {
+		area[index * TEST_TOUCH_STRIDE] = (uint8_t)(index + 1);
+	}
+	cycles = arch_read_cycle_counter() - cycles;
+
+	for (index = 0; index < TEST_TOUCH_PAGES; index++) {
+		if (area[index * TEST_TOUCH_STRIDE] != (uint8_t)(index + 1)) {
+			panic("vmalloc selftest faulted page corrupted");
+		}
+	}
+
+	if (free_before - nr_free_pages() < TEST_TOUCH_PAGES ||
+		virt_to_phys((virt_addr_t)(uintptr_t)(area + PAGE_SIZE),
+			&resolved) != -ENOENT) {
+		panic("vmalloc selftest demand fault failed");
+	}
+
+	vfree(small);
+	vfree(area);
+	if (nr_free_pages() < free_before) {
+		panic("vmalloc selftest leaked pages");
+	}
+
+	pr_info("vmalloc fault cycles pages=%u total=%llu\n",
+		TEST_TOUCH_PAGES,
+		(unsigned long long)cycles);
+	pr_info("vmalloc selftest ok\n");
+}
@@ -0,0 +1,136 @@
+#include <stdint.h>
+
+#include <tianole/arch.h>
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/printk.h>
+
+#define TEST_CLEAR_ROUNDS 64u
+#define TEST_ALLOC_PAGES 16u
+
+static void clear_page_scalar(void *page)
+{
+	volatile uint64_t *words = page;
+	uint64_t index;
+
+	for (index = 0; index < PAGE_SIZE / sizeof(uint64_t); index++) {
+		words[index] = 0;
+	}
+}
+
+/**
+ * time_clear() - Average the cost of one page-clearing routine.
+ * @clear: Routine under test.
+ * @page: Scratch page.
+ *
+ * Return: Cycles per page over TEST_CLEAR_ROUNDS runs.
+ */
+static uint64_t time_clear(void (*clear)(void *page), void *page)
+{
+	uint64_t start = arch_read_cycle_counter();
+	uint32_t round;
+
+	for (round = 0; round < TEST_CLEAR_ROUNDS; round++) {
+		clear(page);
+	}
+
+	return (arch_read_cycle_counter() - start) / TEST_CLEAR_ROUNDS;
+}
+
+static int page_is_zero(phys_addr_t page)
+{
+	const uint64_t *words = phys_to_virt(page);
+	uint64_t index;
+
+	for (index = 0; index < PAGE_SIZE / sizeof(uint64_t); index++) {
+		if (words[index] != 0) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * time_alloc() - Average the cost of one zeroed-page allocation.
+ * @pooled: Non-zero to pop pre-zeroed pages, zero to clear inline.
+ *
+ * Every page obtained is checked for zeroes and freed afterwards.
+ *
+ * Return: Cycles per page over TEST_ALLOC_PAGES allocations.
+ */
+static uint64_t time_alloc(int pooled)
+{
+	phys_addr_t pages[TEST_ALLOC_PAGES];
+	uint64_t start = arch_read_cycle_counter();
+	uint64_t cycles;
+	uint32_t index;
+
+	for (index = 0; index < TEST_ALLOC_PAGES; index++) {
+		if (pooled != 0) {
+			pages[index] = alloc_zeroed_page();
+		} else {
+			pages[index] = alloc_page();
+			if (pages[index] != 0) {
+				arch_clear_page(phys_to_virt(pages[index]));
+			}
+		}
+	}
+	cycles = arch_read_cycle_counter() - start;
+
+	for (index = 0; index < TEST_ALLOC_PAGES; index++) {
+		if (pages[index] == 0 || !page_is_zero(pages[index])) {
+			panic("zero page selftest page not zeroed");
+		}
+		free_page(pages[index]);
+	}
+
+	return cycles / TEST_ALLOC_PAGES;
+}
+
+void zero_pool_selftest(void)
+{
+	phys_addr_t scratch = alloc_page();
+	uint64_t *words;
+	uint64_t scalar;
+	uint64_t cached;
+	uint64_t nocache;
+	uint64_t pooled;
+	uint64_t inline_clear;
+	uint64_t index;
+
+	if (scratch == 0) {
+		panic("zero page selftest allocation failed");
+	}
+
+	words = phys_to_virt(scratch);
+	for (index = 0; index < PAGE_SIZE / sizeof(uint64_t); index++) {
+		words[index] = 0xa5a5a5a5a5a5a5a5ull;
+	}
+
+	scalar = time_clear(clear_page_scalar, words);
+	cached = time_clear(arch_clear_page, words);
+	nocache = time_clear(arch_clear_page_nocache, words);
+
+	/* Dirty the page again so the pool has to zero it. */
+	words[0] = 1;
+	words[PAGE_SIZE / sizeof(uint64_t) - 1] = 1;
+	free_page(scratch);
+
+	if (zero_pool_refill(TEST_ALLOC_PAGES) == 0 ||
+		nr_zero_pool_pages() < TEST_ALLOC_PAGES) {
+		panic("zero page selftest pool refill failed");
+	}
+
+	pooled = time_alloc(1);
+	inline_clear = time_alloc(0);
+
+	pr_info("zero page cycles per page scalar=%llu string=%llu nt=%llu "
+		"pooled=%llu inline=%llu\n",
+		(unsigned long long)scalar,
+		(unsigned long long)cached,
+		(unsigned long long)nocache,
+		(unsigned long long)pooled,
+		(unsigned long long)inline_clear);
+	pr_info("zero page selftest ok\n");
+}
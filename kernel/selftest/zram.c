@@ -0,0 +1,176 @@
+#include <stdint.h>
+
+#include <tianole/blkdev.h>
+#include <tianole/errno.h>
+#include <tianole/lz4.h>
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/printk.h>
+#include <tianole/zram.h>
+
+#define TEST_PAGES 64u
+#define TEST_RECORD_PAGES 32u
+
+static uint64_t test_random_state = 0x2545f4914f6cdd1dull;
+
+static uint64_t test_random(void)
+{
+	test_random_state ^= test_random_state << 13;
+	test_random_state ^= test_random_state >> 7;
+	test_random_state ^= test_random_state << 17;
+	return test_random_state;
+}
+
+static void *test_page(void)
+{
+	phys_addr_t page = alloc_page();
+
+	if (page == 0) {
+		panic("zram selftest page allocation failed");
+	}
+
+	return phys_to_virt(page);
+}
+
+static int bytes_equal(const uint8_t *left, const uint8_t *right,
+	uint64_t size)
+{
+	uint64_t index;
+
+	for (index = 0; index < size; index++) {
+		if (left[index] != right[index]) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * fill_records() - Fill a page like a table of small kernel records.
+ * @page: Page to fill.
+ * @seed: Varies the record contents between pages.
+ *
+ * Each 32-byte record repeats its layout and differs in a counter and a
+ * few random bytes, which is roughly what slab-sized kernel data looks
+ * like to a compressor.
+ */
+static void fill_records(uint8_t *page, uint64_t seed)
+{
+	uint64_t offset;
+
+	for (offset = 0; offset < PAGE_SIZE; offset += 32) {
+		uint64_t *record = (uint64_t *)(page + offset);
+
+		record[0] = 0x0000746e756f6300ull;
+		record[1] = seed * 4096 + offset;
+		record[2] = test_random() & 0xffu;
+		record[3] = 0;
+	}
+}
+
+static void lz4_selftest(uint8_t *input, uint8_t *output, uint8_t *scratch)
+{
+	static uint8_t wrkmem[LZ4_MEM_COMPRESS];
+	static const size_t lengths[] = { 0, 5, 13, 300, PAGE_SIZE };
+	unsigned int index;
+
+	for (index = 0; index < sizeof(lengths) / sizeof(lengths[0]); index++) {
+		int size;
+
+		fill_records(input, index);
+		size = lz4_compress(input, lengths[index], scratch,
+			lz4_compress_bound(lengths[index]), wrkmem);
+		if (size <= 0 || lz4_decompress(scratch, (size_t)size, output,
+			PAGE_SIZE) != (int)lengths[index] ||
+			!bytes_equal(input, output, lengths[index])) {
+			panic("lz4 selftest round trip failed");
+		}
+	}
+
+	/* A match reaching back before the start of the output. */
+	scratch[0] = 0x10;
+	scratch[1] = 'a';
+	scratch[2] = 0x08;
+	scratch[3] = 0x00;
+	scratch[4] = 0x00;
+	if (lz4_decompress(scratch, 5, output, PAGE_SIZE) != -EINVAL ||
+		lz4_compress(input, PAGE_SIZE, scratch, 16, wrkmem) !=
+			-ENOSPC) {
+		panic("lz4 selftest bounds check failed");
+	}
+}
+
+void zram_selftest(void)
+{
+	struct block_device *dev = zram_create("zram-test", TEST_PAGES);
+	uint8_t *input = test_page();
+	uint8_t *output = test_page();
+	uint8_t *scratch = test_page();
+	struct zram_stats stats;
+	uint64_t index;
+
+	if (dev == 0 || block_device_find("zram-test") != dev) {
+		panic("zram selftest create failed");
+	}
+
+	lz4_selftest(input, output, scratch);
+
+	for (index = 0; index < PAGE_SIZE; index++) {
+		input[index] = 0x5a;
+	}
+
+	if (block_write(dev, 0, input) != 0 ||
+		block_read(dev, 0, output) != 0 ||
+		!bytes_equal(input, output, PAGE_SIZE) ||
+		block_read(dev, 1, output) != 0 || output[0] != 0 ||
+		output[PAGE_SIZE - 1] != 0 ||
+		block_read(dev, TEST_PAGES, output) != -EINVAL) {
+		panic("zram selftest same-filled page failed");
+	}
+
+	for (index = 0; index < PAGE_SIZE / sizeof(uint64_t); index++) {
+		((uint64_t *)input)[index] = test_random();
+	}
+
+	if (block_write(dev, 1, input) != 0 ||
+		block_read(dev, 1, output) != 0 ||
+		!bytes_equal(input, output, PAGE_SIZE)) {
+		panic("zram selftest incompressible page failed");
+	}
+
+	for (index = 0; index < TEST_RECORD_PAGES; index++) {
+		fill_records(input, index);
+		if (block_write(dev, 2 + index, input) != 0 ||
+			block_read(dev, 2 + index, output) != 0 ||
+			!bytes_equal(input, output, PAGE_SIZE)) {
+			panic("zram selftest compressed page failed");
+		}
+	}
+
+	if (zram_get_stats(dev, &stats) != 0 || stats.same_pages != 1 ||
+		stats.huge_pages != 1 ||
+		stats.stored_pages != TEST_RECORD_PAGES + 2 ||
+		stats.mem_used_bytes >= stats.stored_pages * PAGE_SIZE / 2) {
+		panic("zram selftest statistics failed");
+	}
+
+	zram_report(dev);
+
+	if (block_discard(dev, 0, 2) != 0 || block_read(dev, 1, output) != 0 ||
+		output[0] != 0 || zram_get_stats(dev, &stats) != 0 ||
+		stats.same_pages != 0 || stats.huge_pages != 0 ||
+		stats.discards != 2) {
+		panic("zram selftest discard failed");
+	}
+
+	zram_destroy(dev);
+	if (block_device_find("zram-test") != 0) {
+		panic("zram selftest destroy failed");
+	}
+
+	free_page(physmap_to_phys(scratch));
+	free_page(physmap_to_phys(output));
+	free_page(physmap_to_phys(input));
+	pr_info("zram selftest ok\n");
+}
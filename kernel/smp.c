@@ -0,0 +1,40 @@
+#include <stdint.h>
+
+#include <tianole/arch.h>
+#include <tianole/panic.h>
+#include <tianole/printk.h>
+#include <tianole/smp.h>
+
+/* Bit n set once CPU n is online. The boot CPU is online from the start. */
+static uint32_t cpu_online_mask = 1u;
+
+uint32_t num_online_cpus(void)
+{
+	return (uint32_t)__builtin_popcount(
+		__atomic_load_n(&cpu_online_mask, __ATOMIC_ACQUIRE));
+}
+
+int cpu_online(uint32_t cpu)
+{
+	if (cpu >= NR_CPUS) {
+		return 0;
+	}
+
+	return (__atomic_load_n(&cpu_online_mask, __ATOMIC_ACQUIRE) &
+		       (1u << cpu)) != 0;
+}
+
+void set_cpu_online(uint32_t cpu)
+{
+	if (cpu >= NR_CPUS) {
+		panic("cpu number out of range");
+	}
+
+	__atomic_or_fetch(&cpu_online_mask, 1u << cpu, __ATOMIC_RELEASE);
+}
+
+void smp_init(void)
+{
+	arch_smp_boot();
+	pr_info("smp: %u CPUs online\n", num_online_cpus());
+}
@@ -0,0 +1,119 @@
+#include <stdint.h>
+
+#include <tianole/arch.h>
+#include <tianole/printk.h>
+#include <tianole/sched.h>
+#include <tianole/smp.h>
+#include <tianole/timer.h>
+
+#include "time/timer_wheel.h"
+
+/*
+ * NO_HZ idle: while every CPU runs its idle thread, the periodic tick is
+ * replaced by one architecture wakeup at the next pending timer. The tick
+ * count is caught up from the hardware whenever an IRQ arrives, so
+ * timer_ticks() stays exact for handlers and for every thread that runs
+ * afterwards. The tick and all state here belong to the boot CPU and are
+ * touched with interrupts disabled. Work can only appear on an all-idle
+ * machine through an interrupt of the boot CPU, which restarts the tick
+ * on its way out; other CPUs' interrupts leave this state alone.
+ */
+#define TICK_CPU 0u
+
+static int tick_stopped;
+static uint64_t tick_stop_base;
+static uint64_t tick_nohz_stops;
+
+static void tick_nohz_catch_up(uint64_t since_stop)
+{
+	uint64_t now = tick_stop_base + since_stop;
+
+	if (now > timer_ticks()) {
+		timer_advance(now - timer_ticks());
+	}
+}
+
+/**
+ * tick_nohz_stop() - Stop the periodic tick until the next timer.
+ *
+ * Called on a tick boundary. A timer due on the next tick keeps the
+ * periodic tick running; the hardware may also cap how far ahead the
+ * wakeup can be programmed, in which case it is re-armed when it fires.
+ * With no timer pending no wakeup is asked for at all.
+ *
+ * Return: 1 if the tick is now stopped, 0 otherwise.
+ */
+static int tick_nohz_stop(void)
+{
+	uint64_t now = timer_ticks();
+	uint64_t next = timer_next_expiry();
+	uint64_t ticks;
+
+	if (next <= now + 1) {
+		return 0;
+	}
+
+	ticks = arch_timer_stop_tick(next == UINT64_MAX ? next : next - now);
+	if (ticks == 0) {
+		return 0;
+	}
+
+	tick_stopped = 1;
+	tick_stop_base = now;
+	if (tick_nohz_stops++ == 0) {
+		pr_info("nohz idle tick stopped ticks=%llu\n",
+			(unsigned long long)ticks);
+	}
+
+	return 1;
+}
+
+static void tick_nohz_start(void)
+{
+	uint64_t since_stop;
+
+	if (!tick_stopped) {
+		return;
+	}
+
+	since_stop = arch_timer_start_tick();
+	tick_stopped = 0;
+	tick_nohz_catch_up(since_stop);
+}
+
+void timer_tick(void)
+{
+	if (tick_stopped) {
+		tick_nohz_catch_up(arch_timer_stopped_ticks());
+	} else {
+		timer_advance(1);
+	}
+
+	if (sched_idle_cpu() && tick_nohz_stop()) {
+		return;
+	}
+
+	tick_nohz_start();
+}
+
+void tick_nohz_irq_enter(void)
+{
+	if (smp_processor_id() != TICK_CPU) {
+		return;
+	}
+
+	if (tick_stopped) {
+		tick_nohz_catch_up(arch_timer_stopped_ticks());
+	}
+}
+
+void tick_nohz_irq_exit(void)
+{
+	if (smp_processor_id() != TICK_CPU) {
+		return;
+	}
+
+	if (tick_stopped && !sched_idle_cpu()) {
+		tick_nohz_start();
+	}
+}
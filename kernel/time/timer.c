@@ -1,19 +1,411 @@
 #include <stdint.h>
 
+#include <tianole/panic.h>
 #include <tianole/printk.h>
 #include <tianole/sched.h>
+#include <tianole/spinlock.h>
 #include <tianole/timer.h>
 
+#include "time/timer_wheel.h"
+
 static uint64_t tick_count;
+static struct timer_base timer_wheel = {
+	.lock = SPINLOCK_INITIALIZER,
+};
+
+static void timer_detach(struct timer_list *timer)
+{
+	*timer->pprev = timer->next;
+	if (timer->next != 0) {
+		timer->next->pprev = timer->pprev;
+	}
+
+	timer->next = 0;
+	timer->pprev = 0;
+}
+
+/**
+ * timer_slot_mark() - Set the occupancy bit of a slot.
+ * @base: Wheel, lock held.
+ * @slot: Slot head inside @base.
+ */
+static void timer_slot_mark(struct timer_base *base, struct timer_list **slot)
+{
+	unsigned int index;
+	unsigned int level;
+
+	if (slot >= &base->tv1[0] && slot < &base->tv1[TVR_SIZE]) {
+		index = (unsigned int)(slot - &base->tv1[0]);
+		base->tv1_map[index / 64u] |= 1ull << (index % 64u);
+		return;
+	}
+
+	index = (unsigned int)(slot - &base->tvn[0][0]);
+	level = index / TVN_SIZE;
+	base->tvn_map[level] |= 1ull << (index % TVN_SIZE);
+}
+
+static void timer_slot_add(struct timer_list **slot, struct timer_list *timer)
+{
+	timer->next = *slot;
+	if (*slot != 0) {
+		(*slot)->pprev = &timer->next;
+	}
+
+	*slot = timer;
+	timer->pprev = slot;
+}
+
+/**
+ * timer_slot() - Pick the wheel slot for an expiry tick.
+ * @base: Wheel, lock held.
+ * @expires: Expiry tick.
+ *
+ * Expiries in the past land in the slot processed next. Ones beyond the
+ * outermost level are parked at its far end and re-sorted each time that
+ * slot cascades.
+ *
+ * Return: Slot head to link the timer into.
+ */
+static struct timer_list **timer_slot(struct timer_base *base,
+	uint64_t expires)
+{
+	uint64_t delta;
+	unsigned int level;
+
+	if (expires < base->clk) {
+		return &base->tv1[base->clk & TVR_MASK];
+	}
+
+	delta = expires - base->clk;
+	if (delta < TVR_SIZE) {
+		return &base->tv1[expires & TVR_MASK];
+	}
+
+	if (delta > UINT32_MAX) {
+		expires = base->clk + UINT32_MAX;
+	}
+
+	for (level = 0; level < TVN_LEVELS - 1; level++) {
+		if (delta < 1ull << (TVR_BITS + (level + 1) * TVN_BITS)) {
+			break;
+		}
+	}
+
+	return &base->tvn[level][(expires >> (TVR_BITS + level * TVN_BITS)) &
+		TVN_MASK];
+}
+
+/**
+ * cascade() - Redistribute one outer slot into finer slots.
+ * @base: Wheel, lock held.
+ * @level: Outer level index.
+ * @index: Slot that just became due.
+ */
+static void cascade(struct timer_base *base, unsigned int level,
+	unsigned int index)
+{
+	struct timer_list *list = base->tvn[level][index];
+
+	base->tvn[level][index] = 0;
+	base->tvn_map[level] &= ~(1ull << index);
+	while (list != 0) {
+		struct timer_list *timer = list;
+		struct timer_list **slot = timer_slot(base, timer->expires);
+
+		list = timer->next;
+		timer->next = 0;
+		timer->pprev = 0;
+		timer_slot_add(slot, timer);
+		timer_slot_mark(base, slot);
+	}
+}
+
+void timer_base_init(struct timer_base *base, uint64_t clk)
+{
+	unsigned int level;
+	unsigned int index;
+
+	base->lock = (struct spinlock)SPINLOCK_INITIALIZER;
+	base->clk = clk;
+	for (index = 0; index < TVR_SIZE; index++) {
+		base->tv1[index] = 0;
+	}
+
+	for (index = 0; index < TV1_MAP_WORDS; index++) {
+		base->tv1_map[index] = 0;
+	}
+
+	for (level = 0; level < TVN_LEVELS; level++) {
+		for (index = 0; index < TVN_SIZE; index++) {
+			base->tvn[level][index] = 0;
+		}
+
+		base->tvn_map[level] = 0;
+	}
+}
+
+int timer_base_mod(struct timer_base *base, struct timer_list *timer,
+	uint64_t expires)
+{
+	struct timer_list **slot;
+	uint64_t flags;
+	int pending;
+
+	if (timer == 0 || timer->func == 0) {
+		panic("timer queued without callback");
+	}
+
+	spin_lock_irqsave(&base->lock, &flags);
+	pending = timer_pending(timer);
+	if (pending) {
+		if (timer->base != base) {
+			panic("timer moved between wheels while pending");
+		}
+
+		timer_detach(timer);
+	}
+
+	timer->expires = expires;
+	timer->base = base;
+	slot = timer_slot(base, expires);
+	timer_slot_add(slot, timer);
+	timer_slot_mark(base, slot);
+	spin_unlock_irqrestore(&base->lock, flags);
+
+	return pending;
+}
+
+void timer_base_run(struct timer_base *base, uint64_t now)
+{
+	uint64_t flags;
+
+	spin_lock_irqsave(&base->lock, &flags);
+	while (base->clk <= now) {
+		unsigned int index = base->clk & TVR_MASK;
+		struct timer_list *expired;
+		unsigned int level;
+
+		/* The first level wrapped: pull the next coarser slot down. */
+		if (index == 0) {
+			for (level = 0; level < TVN_LEVELS; level++) {
+				unsigned int shift =
+					TVR_BITS + level * TVN_BITS;
+				unsigned int slot =
+					(base->clk >> shift) & TVN_MASK;
+
+				cascade(base, level, slot);
+				if (slot != 0) {
+					break;
+				}
+			}
+		}
+
+		base->clk++;
+
+		/*
+		 * Move the due slot to a local head. Its timers stay linked, so
+		 * a callback can still delete or re-arm any of them.
+		 */
+		expired = base->tv1[index];
+		base->tv1[index] = 0;
+		base->tv1_map[index / 64u] &= ~(1ull << (index % 64u));
+		if (expired != 0) {
+			expired->pprev = &expired;
+		}
 
-void timer_tick(void)
+		while (expired != 0) {
+			struct timer_list *timer = expired;
+
+			timer_detach(timer);
+			spin_unlock_irqrestore(&base->lock, flags);
+			timer->func(timer);
+			spin_lock_irqsave(&base->lock, &flags);
+		}
+	}
+	spin_unlock_irqrestore(&base->lock, flags);
+}
+
+/**
+ * tv1_next_slot() - Distance to the next first-level slot marked occupied.
+ * @base: Wheel, lock held.
+ * @start: Slot to start from, included.
+ *
+ * Return: Slots from @start, or TVR_SIZE if no bit is set.
+ */
+static unsigned int tv1_next_slot(struct timer_base *base, unsigned int start)
+{
+	unsigned int distance = 0;
+
+	while (distance < TVR_SIZE) {
+		unsigned int index = (start + distance) & TVR_MASK;
+		uint64_t word = base->tv1_map[index / 64u] >> (index % 64u);
+
+		if (word != 0) {
+			distance += (unsigned int)__builtin_ctzll(word);
+			return distance < TVR_SIZE ? distance : TVR_SIZE;
+		}
+
+		distance += 64u - index % 64u;
+	}
+
+	return TVR_SIZE;
+}
+
+/**
+ * tv1_next_expiry() - Earliest expiry on the first level.
+ * @base: Wheel, lock held.
+ *
+ * Slot i holds the timers due at the next tick whose low bits are i; the
+ * slot processed next also holds any that are already overdue.
+ *
+ * Return: Expiry tick, or UINT64_MAX if the level is empty.
+ */
+static uint64_t tv1_next_expiry(struct timer_base *base)
+{
+	unsigned int start = base->clk & TVR_MASK;
+	unsigned int distance;
+
+	while ((distance = tv1_next_slot(base, start)) < TVR_SIZE) {
+		unsigned int index = (start + distance) & TVR_MASK;
+
+		if (base->tv1[index] != 0) {
+			return base->clk + distance;
+		}
+
+		base->tv1_map[index / 64u] &= ~(1ull << (index % 64u));
+	}
+
+	return UINT64_MAX;
+}
+
+/**
+ * tvn_next_expiry() - Start of the first occupied slot of an outer level.
+ * @base: Wheel, lock held.
+ * @level: Outer level index.
+ *
+ * The slot @base->clk falls in is cascaded when the clock reaches its
+ * start. Until then it holds timers due within it; afterwards only timers
+ * a whole turn of the level ahead can land there.
+ *
+ * Return: Lower bound for the level's expiries, or UINT64_MAX if empty.
+ */
+static uint64_t tvn_next_expiry(struct timer_base *base, unsigned int level)
+{
+	unsigned int shift = TVR_BITS + level * TVN_BITS;
+	unsigned int start = (base->clk >> shift) & TVN_MASK;
+	int due = (base->clk & ((1ull << shift) - 1u)) == 0;
+	uint64_t map;
+
+	while ((map = base->tvn_map[level]) != 0) {
+		unsigned int distance;
+		unsigned int index;
+
+		/* Rotate so bit n stands for the slot n after @start. */
+		if (start != 0) {
+			map = (map >> start) | (map << (TVN_SIZE - start));
+		}
+
+		if (!due) {
+			map &= ~1ull;
+		}
+
+		distance = map != 0 ? (unsigned int)__builtin_ctzll(map) :
+				      TVN_SIZE;
+		index = (start + distance) & TVN_MASK;
+		if (base->tvn[level][index] != 0) {
+			return ((base->clk >> shift) + distance) << shift;
+		}
+
+		base->tvn_map[level] &= ~(1ull << index);
+	}
+
+	return UINT64_MAX;
+}
+
+uint64_t timer_base_next_expiry(struct timer_base *base)
+{
+	uint64_t next;
+	uint64_t flags;
+	unsigned int level;
+
+	spin_lock_irqsave(&base->lock, &flags);
+	next = tv1_next_expiry(base);
+	for (level = 0; level < TVN_LEVELS; level++) {
+		uint64_t expiry = tvn_next_expiry(base, level);
+
+		if (expiry < next) {
+			next = expiry;
+		}
+	}
+	spin_unlock_irqrestore(&base->lock, flags);
+
+	return next;
+}
+
+void timer_init(struct timer_list *timer, timer_func_t func, void *data)
+{
+	if (timer == 0) {
+		return;
+	}
+
+	timer->expires = 0;
+	timer->func = func;
+	timer->data = data;
+	timer->next = 0;
+	timer->pprev = 0;
+	timer->base = 0;
+}
+
+void add_timer(struct timer_list *timer)
 {
-	tick_count++;
+	if (timer == 0 || timer_pending(timer)) {
+		panic("add_timer on a pending timer");
+	}
 
-	if (tick_count <= 3) {
+	timer_base_mod(&timer_wheel, timer, timer->expires);
+}
+
+int mod_timer(struct timer_list *timer, uint64_t expires)
+{
+	return timer_base_mod(&timer_wheel, timer, expires);
+}
+
+int del_timer(struct timer_list *timer)
+{
+	struct timer_base *base;
+	uint64_t flags;
+	int pending;
+
+	if (timer == 0 || timer->base == 0) {
+		return 0;
+	}
+
+	base = timer->base;
+	spin_lock_irqsave(&base->lock, &flags);
+	pending = timer_pending(timer);
+	if (pending) {
+		timer_detach(timer);
+	}
+	spin_unlock_irqrestore(&base->lock, flags);
+
+	return pending;
+}
+
+void timer_advance(uint64_t ticks)
+{
+	if (ticks == 0) {
+		return;
+	}
+
+	while (ticks != 0 && tick_count < 3) {
+		tick_count++;
+		ticks--;
 		pr_info("timer tick=%llu\n", (unsigned long long)tick_count);
 	}
 
+	tick_count += ticks;
+	timer_base_run(&timer_wheel, tick_count);
 	sched_tick(tick_count);
 }
 
@@ -21,3 +413,8 @@ uint64_t timer_ticks(void)
 {
 	return tick_count;
 }
+
+uint64_t timer_next_expiry(void)
+{
+	return timer_base_next_expiry(&timer_wheel);
+}
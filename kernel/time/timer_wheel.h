@@ -0,0 +1,100 @@
+#ifndef KERNEL_TIME_TIMER_WHEEL_H
+#define KERNEL_TIME_TIMER_WHEEL_H
+
+#include <stdint.h>
+
+#include <tianole/spinlock.h>
+#include <tianole/timer.h>
+
+/*
+ * The first level has one slot per tick for the next 256 ticks. Each of
+ * the four outer levels has 64 slots, each 64 times coarser than a slot
+ * of the level below; together they span 2^32 ticks.
+ */
+#define TVR_BITS 8u
+#define TVN_BITS 6u
+#define TVR_SIZE (1u << TVR_BITS)
+#define TVN_SIZE (1u << TVN_BITS)
+#define TVR_MASK (TVR_SIZE - 1u)
+#define TVN_MASK (TVN_SIZE - 1u)
+#define TVN_LEVELS 4u
+#define TV1_MAP_WORDS (TVR_SIZE / 64u)
+
+/**
+ * struct timer_base - One hierarchical timer wheel.
+ * @lock: Protects the slots and @clk.
+ * @clk: Next tick the wheel will process.
+ * @tv1: Per-tick slots of the first level.
+ * @tvn: Coarser outer levels.
+ * @tv1_map: Bit per @tv1 slot that may be occupied.
+ * @tvn_map: Bit per @tvn slot that may be occupied, one word per level.
+ *
+ * Insert and delete touch one slot. When the first level wraps, the due
+ * slot of the next level is cascaded down into finer slots, so every
+ * timer is moved at most once per level before it fires.
+ *
+ * A slot's bit is set when a timer is linked in and cleared when the slot
+ * is emptied by running or cascading it, or found empty by a lookup; a
+ * clear bit always means an empty slot.
+ */
+struct timer_base {
+	struct spinlock lock;
+	uint64_t clk;
+	struct timer_list *tv1[TVR_SIZE];
+	struct timer_list *tvn[TVN_LEVELS][TVN_SIZE];
+	uint64_t tv1_map[TV1_MAP_WORDS];
+	uint64_t tvn_map[TVN_LEVELS];
+};
+
+/**
+ * timer_base_init() - Empty a wheel and set its clock.
+ * @base: Wheel storage.
+ * @clk: First tick the wheel will process.
+ */
+void timer_base_init(struct timer_base *base, uint64_t clk);
+
+/**
+ * timer_base_mod() - Queue or move a timer on a specific wheel.
+ * @base: Wheel.
+ * @timer: Initialized timer.
+ * @expires: Expiry tick.
+ *
+ * Return: 1 if the timer was pending, 0 otherwise.
+ */
+int timer_base_mod(struct timer_base *base, struct timer_list *timer,
+	uint64_t expires);
+
+/**
+ * timer_base_run() - Process every tick up to and including @now.
+ * @base: Wheel.
+ * @now: Current tick.
+ *
+ * Callbacks run with @base->lock dropped.
+ */
+void timer_base_run(struct timer_base *base, uint64_t now);
+
+/**
+ * timer_base_next_expiry() - Find the earliest pending expiry on a wheel.
+ * @base: Wheel.
+ *
+ * Finds the first occupied slot of each level from the occupancy bitmaps,
+ * without walking slots or timers. First-level expiries are exact. An
+ * outer slot only bounds its timers from below, so for those the start of
+ * the slot is returned; waking then cascades the slot and the next lookup
+ * is exact.
+ *
+ * Return: Earliest expiry tick or a lower bound for it, never later than
+ * the earliest pending timer, or UINT64_MAX if nothing is pending.
+ */
+uint64_t timer_base_next_expiry(struct timer_base *base);
+
+/**
+ * timer_advance() - Count ticks that have passed on the global wheel.
+ * @ticks: Ticks since the last call; 1 for a normal periodic tick.
+ *
+ * Runs every global timer that expired, then the scheduler tick. The tick
+ * code calls this with a larger @ticks after the periodic tick was stopped.
+ */
+void timer_advance(uint64_t ticks);
+
+#endif
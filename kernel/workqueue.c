@@ -9,17 +9,19 @@
  * @wait: Wait queue used as both event wait and list lock.
  * @head: Oldest pending work item.
  * @tail: Newest pending work item.
+ * @running: Item whose callback the worker is executing, or NULL.
  * @started: Non-zero once the worker thread exists.
  * @initialized: Non-zero after workqueue_init().
  *
  * This is intentionally small: one global worker, FIFO ordering and caller
  * owned work items. The shape mirrors Linux workqueue boundaries without
- * bringing in per-CPU pools, attributes or cancellation yet.
+ * bringing in per-CPU pools or attributes yet.
  */
 struct workqueue {
 	struct wait_queue wait;
 	struct work_struct *head;
 	struct work_struct *tail;
+	struct work_struct *running;
 	int started;
 	int initialized;
 };
@@ -38,6 +40,9 @@ static int workqueue_has_work(void *arg)
 /**
  * workqueue_pop() - Remove one pending work item from the system queue.
  *
+ * The item popped becomes the running one, and the previous running item
+ * is finished.
+ *
  * Return: Next work item, or NULL when the queue is empty.
  */
 static struct work_struct *workqueue_pop(void)
@@ -47,6 +52,7 @@ static struct work_struct *workqueue_pop(void)
 
 	wait_queue_lock_irqsave(&system_workqueue.wait, &flags);
 	work = system_workqueue.head;
+	system_workqueue.running = work;
 	if (work != 0) {
 		system_workqueue.head = work->next;
 		if (system_workqueue.head == 0) {
@@ -119,6 +125,7 @@ void workqueue_init(void)
 	wait_queue_init(&system_workqueue.wait);
 	system_workqueue.head = 0;
 	system_workqueue.tail = 0;
+	system_workqueue.running = 0;
 	system_workqueue.started = 0;
 	system_workqueue.initialized = 1;
 	workqueue_selftest_done = 0;
@@ -171,3 +178,42 @@ int queue_work(struct work_struct *work)
 
 	return 0;
 }
+
+int cancel_work_sync(struct work_struct *work)
+{
+	struct work_struct **link;
+	uint64_t flags;
+	int pending = 0;
+
+	if (system_workqueue.initialized == 0 || work == 0) {
+		return 0;
+	}
+
+	wait_queue_lock_irqsave(&system_workqueue.wait, &flags);
+	if (work->pending != 0) {
+		struct work_struct *prev = 0;
+
+		link = &system_workqueue.head;
+		while (*link != work) {
+			prev = *link;
+			link = &(*link)->next;
+		}
+
+		*link = work->next;
+		if (system_workqueue.tail == work) {
+			system_workqueue.tail = prev;
+		}
+		work->next = 0;
+		work->pending = 0;
+		pending = 1;
+	}
+
+	while (system_workqueue.running == work) {
+		wait_queue_unlock_irqrestore(&system_workqueue.wait, flags);
+		sched_yield();
+		wait_queue_lock_irqsave(&system_workqueue.wait, &flags);
+	}
+	wait_queue_unlock_irqrestore(&system_workqueue.wait, flags);
+
+	return pending;
+}
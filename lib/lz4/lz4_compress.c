@@ -0,0 +1,150 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tianole/errno.h>
+#include <tianole/lz4.h>
+
+#include "lz4_defs.h"
+
+static uint32_t read32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+		((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t lz4_hash(uint32_t sequence)
+{
+	return (sequence * 2654435761u) >> (32u - LZ4_HASH_LOG);
+}
+
+/**
+ * emit_length() - Write the 255-byte continuation of a length field.
+ * @op: Output cursor.
+ * @length: Length beyond the 15 held by the token nibble.
+ *
+ * Return: Cursor after the continuation bytes.
+ */
+static uint8_t *emit_length(uint8_t *op, size_t length)
+{
+	while (length >= 255) {
+		*op++ = 255;
+		length -= 255;
+	}
+
+	*op++ = (uint8_t)length;
+	return op;
+}
+
+/**
+ * emit_sequence() - Append literals and, optionally, one match.
+ * @op: Output cursor.
+ * @end: End of the output buffer.
+ * @literals: First literal byte.
+ * @literal_len: Literal bytes.
+ * @offset: Match distance, or 0 for the final literal-only sequence.
+ * @match_len: Match bytes, at least LZ4_MIN_MATCH when @offset is set.
+ *
+ * Return: Cursor after the sequence, or NULL if it does not fit.
+ */
+static uint8_t *emit_sequence(uint8_t *op, const uint8_t *end,
+	const uint8_t *literals, size_t literal_len, size_t offset,
+	size_t match_len)
+{
+	size_t extra = match_len - LZ4_MIN_MATCH;
+	size_t need = 1 + literal_len + literal_len / 255 + 1;
+	uint8_t *token = op;
+	size_t index;
+
+	if (offset != 0) {
+		need += 2 + extra / 255 + 1;
+	}
+
+	if ((size_t)(end - op) < need) {
+		return 0;
+	}
+
+	op++;
+	*token = (uint8_t)((literal_len < LZ4_RUN_MASK ? literal_len :
+		LZ4_RUN_MASK) << LZ4_ML_BITS);
+	if (literal_len >= LZ4_RUN_MASK) {
+		op = emit_length(op, literal_len - LZ4_RUN_MASK);
+	}
+
+	for (index = 0; index < literal_len; index++) {
+		*op++ = literals[index];
+	}
+
+	if (offset == 0) {
+		return op;
+	}
+
+	*op++ = (uint8_t)offset;
+	*op++ = (uint8_t)(offset >> 8);
+	*token |= (uint8_t)(extra < LZ4_ML_MASK ? extra : LZ4_ML_MASK);
+	if (extra >= LZ4_ML_MASK) {
+		op = emit_length(op, extra - LZ4_ML_MASK);
+	}
+
+	return op;
+}
+
+int lz4_compress(const void *src, size_t src_len, void *dst, size_t dst_cap,
+	void *wrkmem)
+{
+	const uint8_t *in = src;
+	uint8_t *out = dst;
+	uint8_t *op = out;
+	const uint8_t *end = out + dst_cap;
+	uint16_t *table = wrkmem;
+	size_t anchor = 0;
+	size_t ip = 0;
+	size_t index;
+
+	if (src == 0 || dst == 0 || wrkmem == 0 ||
+		src_len > LZ4_MAX_INPUT_SIZE) {
+		return -EINVAL;
+	}
+
+	for (index = 0; index < (1u << LZ4_HASH_LOG); index++) {
+		table[index] = 0;
+	}
+
+	/*
+	 * The last match has to start LZ4_MF_LIMIT bytes before the end and
+	 * leave LZ4_LAST_LITERALS bytes of literals behind it.
+	 */
+	while (src_len > LZ4_MF_LIMIT && ip < src_len - LZ4_MF_LIMIT) {
+		uint32_t sequence = read32(in + ip);
+		uint32_t hash = lz4_hash(sequence);
+		size_t ref = table[hash];
+		size_t length = LZ4_MIN_MATCH;
+
+		table[hash] = (uint16_t)ip;
+		if (ref >= ip || ip - ref > LZ4_MAX_DISTANCE ||
+			read32(in + ref) != sequence) {
+			ip++;
+			continue;
+		}
+
+		while (ip + length < src_len - LZ4_LAST_LITERALS &&
+			in[ref + length] == in[ip + length]) {
+			length++;
+		}
+
+		op = emit_sequence(op, end, in + anchor, ip - anchor,
+			ip - ref, length);
+		if (op == 0) {
+			return -ENOSPC;
+		}
+
+		ip += length;
+		anchor = ip;
+	}
+
+	op = emit_sequence(op, end, in + anchor, src_len - anchor, 0, 0);
+	if (op == 0) {
+		return -ENOSPC;
+	}
+
+	return (int)(op - out);
+}
@@ -0,0 +1,107 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tianole/errno.h>
+#include <tianole/lz4.h>
+
+#include "lz4_defs.h"
+
+/**
+ * read_length() - Decode the 255-byte continuation of a length field.
+ * @src: Compressed block.
+ * @src_len: Block size.
+ * @ip: Input cursor, advanced past the continuation.
+ * @length: Length so far, extended in place.
+ *
+ * Return: 0, or -EINVAL if the block ends inside the field.
+ */
+static int read_length(const uint8_t *src, size_t src_len, size_t *ip,
+	size_t *length)
+{
+	uint8_t byte;
+
+	do {
+		if (*ip >= src_len) {
+			return -EINVAL;
+		}
+
+		byte = src[(*ip)++];
+		*length += byte;
+	} while (byte == 255);
+
+	return 0;
+}
+
+int lz4_decompress(const void *src, size_t src_len, void *dst,
+	size_t dst_cap)
+{
+	const uint8_t *in = src;
+	uint8_t *out = dst;
+	size_t ip = 0;
+	size_t op = 0;
+
+	if (src == 0 || dst == 0) {
+		return -EINVAL;
+	}
+
+	for (;;) {
+		size_t literal_len;
+		size_t match_len;
+		size_t offset;
+		size_t index;
+		uint8_t token;
+
+		if (ip >= src_len) {
+			return -EINVAL;
+		}
+
+		token = in[ip++];
+		literal_len = token >> LZ4_ML_BITS;
+		if (literal_len == LZ4_RUN_MASK &&
+			read_length(in, src_len, &ip, &literal_len) != 0) {
+			return -EINVAL;
+		}
+
+		if (literal_len > src_len - ip || literal_len > dst_cap - op) {
+			return -EINVAL;
+		}
+
+		for (index = 0; index < literal_len; index++) {
+			out[op++] = in[ip++];
+		}
+
+		/* Only the final sequence ends without a match. */
+		if (ip == src_len) {
+			break;
+		}
+
+		if (src_len - ip < 2) {
+			return -EINVAL;
+		}
+
+		offset = (size_t)in[ip] | ((size_t)in[ip + 1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > op) {
+			return -EINVAL;
+		}
+
+		match_len = token & LZ4_ML_MASK;
+		if (match_len == LZ4_ML_MASK &&
+			read_length(in, src_len, &ip, &match_len) != 0) {
+			return -EINVAL;
+		}
+
+		match_len += LZ4_MIN_MATCH;
+		if (match_len > dst_cap - op) {
+			return -EINVAL;
+		}
+
+		/* Byte copy: an offset shorter than the match repeats it. */
+		for (index = 0; index < match_len; index++) {
+			out[op] = out[op - offset];
+			op++;
+		}
+	}
+
+	return (int)op;
+}
@@ -0,0 +1,13 @@
+#ifndef LIB_LZ4_DEFS_H
+#define LIB_LZ4_DEFS_H
+
+/* LZ4 block format constants shared by the compressor and decompressor. */
+#define LZ4_MIN_MATCH 4u
+#define LZ4_MF_LIMIT 12u
+#define LZ4_LAST_LITERALS 5u
+#define LZ4_MAX_DISTANCE 0xffffu
+#define LZ4_ML_BITS 4u
+#define LZ4_ML_MASK ((1u << LZ4_ML_BITS) - 1u)
+#define LZ4_RUN_MASK ((1u << (8u - LZ4_ML_BITS)) - 1u)
+
+#endif
@@ -0,0 +1,294 @@
+#include <stddef.h>
+
+#include <tianole/rbtree.h>
+
+static int rb_is_red(const struct rb_node *node)
+{
+	return node != 0 && node->red;
+}
+
+/**
+ * rb_change_child() - Point whatever referenced @old at @new instead.
+ * @old: Node being replaced.
+ * @new: Replacement, or NULL.
+ * @parent: Parent of @old, or NULL if @old is the root.
+ * @root: Tree containing @old.
+ */
+static void rb_change_child(struct rb_node *old, struct rb_node *new,
+	struct rb_node *parent, struct rb_root *root)
+{
+	if (parent == 0) {
+		root->node = new;
+	} else if (parent->left == old) {
+		parent->left = new;
+	} else {
+		parent->right = new;
+	}
+}
+
+static void rb_rotate_left(struct rb_node *node, struct rb_root *root)
+{
+	struct rb_node *right = node->right;
+
+	node->right = right->left;
+	if (right->left != 0) {
+		right->left->parent = node;
+	}
+
+	right->parent = node->parent;
+	rb_change_child(node, right, node->parent, root);
+	right->left = node;
+	node->parent = right;
+}
+
+static void rb_rotate_right(struct rb_node *node, struct rb_root *root)
+{
+	struct rb_node *left = node->left;
+
+	node->left = left->right;
+	if (left->right != 0) {
+		left->right->parent = node;
+	}
+
+	left->parent = node->parent;
+	rb_change_child(node, left, node->parent, root);
+	left->right = node;
+	node->parent = left;
+}
+
+void rb_insert_color(struct rb_node *node, struct rb_root *root)
+{
+	struct rb_node *parent;
+
+	while ((parent = node->parent) != 0 && parent->red) {
+		/* A red parent is never the root, so the grandparent exists. */
+		struct rb_node *gparent = parent->parent;
+		struct rb_node *uncle;
+
+		if (parent == gparent->left) {
+			uncle = gparent->right;
+			if (rb_is_red(uncle)) {
+				parent->red = 0;
+				uncle->red = 0;
+				gparent->red = 1;
+				node = gparent;
+				continue;
+			}
+
+			if (node == parent->right) {
+				rb_rotate_left(parent, root);
+				node = parent;
+				parent = node->parent;
+			}
+
+			parent->red = 0;
+			gparent->red = 1;
+			rb_rotate_right(gparent, root);
+		} else {
+			uncle = gparent->left;
+			if (rb_is_red(uncle)) {
+				parent->red = 0;
+				uncle->red = 0;
+				gparent->red = 1;
+				node = gparent;
+				continue;
+			}
+
+			if (node == parent->left) {
+				rb_rotate_right(parent, root);
+				node = parent;
+				parent = node->parent;
+			}
+
+			parent->red = 0;
+			gparent->red = 1;
+			rb_rotate_left(gparent, root);
+		}
+	}
+
+	root->node->red = 0;
+}
+
+/**
+ * rb_erase_fixup() - Restore black heights after removing a black node.
+ * @node: Node that took the removed node's place, possibly NULL.
+ * @parent: Parent of that place.
+ * @root: Tree being repaired.
+ *
+ * The path through @node is one black node short. Since @node can be
+ * NULL, its parent is passed separately.
+ */
+static void rb_erase_fixup(struct rb_node *node, struct rb_node *parent,
+	struct rb_root *root)
+{
+	struct rb_node *sibling;
+
+	while (node != root->node && !rb_is_red(node)) {
+		if (node == parent->left) {
+			sibling = parent->right;
+			if (sibling->red) {
+				sibling->red = 0;
+				parent->red = 1;
+				rb_rotate_left(parent, root);
+				sibling = parent->right;
+			}
+
+			if (!rb_is_red(sibling->left) &&
+				!rb_is_red(sibling->right)) {
+				sibling->red = 1;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+
+			if (!rb_is_red(sibling->right)) {
+				sibling->left->red = 0;
+				sibling->red = 1;
+				rb_rotate_right(sibling, root);
+				sibling = parent->right;
+			}
+
+			sibling->red = parent->red;
+			parent->red = 0;
+			sibling->right->red = 0;
+			rb_rotate_left(parent, root);
+		} else {
+			sibling = parent->left;
+			if (sibling->red) {
+				sibling->red = 0;
+				parent->red = 1;
+				rb_rotate_right(parent, root);
+				sibling = parent->left;
+			}
+
+			if (!rb_is_red(sibling->left) &&
+				!rb_is_red(sibling->right)) {
+				sibling->red = 1;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+
+			if (!rb_is_red(sibling->left)) {
+				sibling->right->red = 0;
+				sibling->red = 1;
+				rb_rotate_left(sibling, root);
+				sibling = parent->left;
+			}
+
+			sibling->red = parent->red;
+			parent->red = 0;
+			sibling->left->red = 0;
+			rb_rotate_right(parent, root);
+		}
+
+		node = root->node;
+		break;
+	}
+
+	if (node != 0) {
+		node->red = 0;
+	}
+}
+
+void rb_erase(struct rb_node *node, struct rb_root *root)
+{
+	struct rb_node *child;
+	struct rb_node *parent;
+	int red;
+
+	if (node->left == 0 || node->right == 0) {
+		child = node->left != 0 ? node->left : node->right;
+		parent = node->parent;
+		red = node->red;
+		if (child != 0) {
+			child->parent = parent;
+		}
+
+		rb_change_child(node, child, parent, root);
+	} else {
+		/* Move the in-order successor, which has no left child. */
+		struct rb_node *successor = node->right;
+
+		while (successor->left != 0) {
+			successor = successor->left;
+		}
+
+		child = successor->right;
+		red = successor->red;
+		if (successor->parent == node) {
+			parent = successor;
+		} else {
+			parent = successor->parent;
+			if (child != 0) {
+				child->parent = parent;
+			}
+
+			parent->left = child;
+			successor->right = node->right;
+			node->right->parent = successor;
+		}
+
+		successor->left = node->left;
+		node->left->parent = successor;
+		successor->parent = node->parent;
+		successor->red = node->red;
+		rb_change_child(node, successor, node->parent, root);
+	}
+
+	if (!red) {
+		rb_erase_fixup(child, parent, root);
+	}
+}
+
+struct rb_node *rb_first(const struct rb_root *root)
+{
+	struct rb_node *node = root->node;
+
+	if (node == 0) {
+		return 0;
+	}
+
+	while (node->left != 0) {
+		node = node->left;
+	}
+
+	return node;
+}
+
+struct rb_node *rb_next(const struct rb_node *node)
+{
+	if (node->right != 0) {
+		node = node->right;
+		while (node->left != 0) {
+			node = node->left;
+		}
+
+		return (struct rb_node *)node;
+	}
+
+	while (node->parent != 0 && node == node->parent->right) {
+		node = node->parent;
+	}
+
+	return node->parent;
+}
+
+void rb_insert_color_cached(struct rb_node *node,
+	struct rb_root_cached *root, int leftmost)
+{
+	if (leftmost) {
+		root->leftmost = node;
+	}
+
+	rb_insert_color(node, &root->root);
+}
+
+void rb_erase_cached(struct rb_node *node, struct rb_root_cached *root)
+{
+	if (root->leftmost == node) {
+		root->leftmost = rb_next(node);
+	}
+
+	rb_erase(node, &root->root);
+}
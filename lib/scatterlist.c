@@ -0,0 +1,57 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tianole/errno.h>
+#include <tianole/mm.h>
+#include <tianole/scatterlist.h>
+
+void sg_init_table(struct scatterlist *sgl, unsigned int nents)
+{
+	unsigned int index;
+
+	for (index = 0; index < nents; index++) {
+		sg_set_phys(&sgl[index], 0, 0);
+	}
+}
+
+int sg_init_buffer(struct scatterlist *sgl, unsigned int nents,
+	const void *buf, size_t length)
+{
+	virt_addr_t virt = (virt_addr_t)(uintptr_t)buf;
+	unsigned int used = 0;
+
+	if (sgl == 0 || nents == 0 || buf == 0 || length == 0 ||
+		virt + length < virt) {
+		return -EINVAL;
+	}
+
+	while (length != 0) {
+		uint64_t chunk = PAGE_SIZE - (virt & (PAGE_SIZE - 1));
+		struct scatterlist *last = used != 0 ? &sgl[used - 1] : 0;
+		phys_addr_t phys;
+		int ret;
+
+		if (chunk > length) {
+			chunk = length;
+		}
+
+		ret = virt_to_phys(virt, &phys);
+		if (ret != 0) {
+			return ret;
+		}
+
+		if (last != 0 && last->phys + last->length == phys &&
+			last->length <= UINT32_MAX - chunk) {
+			last->length += (uint32_t)chunk;
+		} else if (used == nents) {
+			return -ENOSPC;
+		} else {
+			sg_set_phys(&sgl[used++], phys, (uint32_t)chunk);
+		}
+
+		virt += chunk;
+		length -= chunk;
+	}
+
+	return (int)used;
+}
@@ -5,9 +5,51 @@
 #include <tianole/mm.h>
 #include <tianole/panic.h>
 #include <tianole/printk.h>
+#include <tianole/shrinker.h>
+#include <tianole/slab.h>
+#include <tianole/spinlock.h>
+#include <tianole/vmalloc.h>
+
+#include "heap.h"
+
+/*
+ * kmalloc size classes. Each class is a slab cache, so a small allocation
+ * costs a bounded class lookup plus a freelist pop regardless of how many
+ * objects are live.
+ */
+static const struct {
+	size_t size;
+	const char *name;
+} kmalloc_classes[] = {
+	{ 16, "kmalloc-16" },
+	{ 32, "kmalloc-32" },
+	{ 64, "kmalloc-64" },
+	{ 96, "kmalloc-96" },
+	{ 128, "kmalloc-128" },
+	{ 192, "kmalloc-192" },
+	{ 256, "kmalloc-256" },
+	{ 512, "kmalloc-512" },
+	{ 1024, "kmalloc-1024" },
+	{ KMALLOC_MAX_CACHE_SIZE, "kmalloc-2048" },
+};
+
+/*
+ * Trim hysteresis: the free tail must reach HEAP_TRIM_THRESHOLD before any
+ * page is unmapped, and HEAP_TRIM_RETAIN stays mapped afterwards so a free
+ * followed by a similar allocation does not remap the same pages.
+ */
+#define HEAP_TRIM_THRESHOLD (PAGE_SIZE * 16u)
+#define HEAP_TRIM_RETAIN (PAGE_SIZE * 4u)
 
-#define HEAP_BASE 0xffffff2000000000ull
-#define HEAP_ALIGNMENT 16u
+/*
+ * The arena grows by at least HEAP_EXTEND_MIN of address space at a time.
+ * Growing only moves the end of the heap's demand-fault region, so the
+ * reservation is free until its pages are touched.
+ */
+#define HEAP_EXTEND_MIN (PAGE_SIZE * 256u)
+
+#define KMALLOC_CLASS_COUNT                                                    \
+	(sizeof(kmalloc_classes) / sizeof(kmalloc_classes[0]))
 
 struct heap_block {
 	size_t size;
@@ -20,6 +62,32 @@ static struct heap_block *heap_first;
 static struct heap_block *heap_last;
 static virt_addr_t heap_end = HEAP_BASE;
 static int heap_ready;
+static uint64_t heap_trimmed_pages;
+
+/* Live page-backed kmalloc() memory, for heap_report(). */
+static uint64_t kmalloc_large_pages;
+static uint64_t kmalloc_vmalloc_areas;
+
+/*
+ * Serializes the arena between threads and the reclaim thread's shrinker.
+ * Arena code may demand-fault block headers while holding it; the fault
+ * path never enters the arena.
+ */
+static struct spinlock heap_lock = SPINLOCK_INITIALIZER;
+static struct kmem_cache *kmalloc_caches[KMALLOC_CLASS_COUNT];
+
+/*
+ * The arena is [HEAP_BASE, heap_end), backed on first touch. Aligned
+ * 2 MiB spans fault in as one large leaf when an order-9 block is free.
+ */
+static struct vm_region heap_region = {
+	.start = HEAP_BASE,
+	.end = HEAP_BASE,
+	.page_flags = PAGE_WRITABLE | PAGE_NO_EXECUTE,
+	.owner = PAGE_OWNER_HEAP,
+	.flags = VM_REGION_LARGE,
+	.name = "heap",
+};
 
 static size_t align_up_size(size_t value, size_t alignment)
 {
@@ -80,29 +148,52 @@ static void block_split(struct heap_block *block, size_t size)
 	block_insert_after(block, next);
 }
 
-static int map_heap_range(virt_addr_t start, size_t bytes)
+static void heap_release_frames(phys_addr_t phys, uint64_t size, void *data)
 {
-	virt_addr_t current;
-	virt_addr_t end = start + bytes;
+	uint64_t *pages = data;
 
-	for (current = start; current < end; current += PAGE_SIZE) {
-		phys_addr_t page = alloc_page();
-		int ret;
+	*pages += size / PAGE_SIZE;
+	if (size == PAGE_SIZE_2M) {
+		free_pages(phys, PAGE_ORDER_2M);
+	} else {
+		free_page(phys);
+	}
+}
 
-		if (page == 0) {
-			return -ENOMEM;
-		}
+/**
+ * unmap_heap_range() - Unmap heap pages and return their frames.
+ * @start: Page-aligned first virtual address.
+ * @end: Page-aligned end virtual address.
+ *
+ * Pages never touched were never mapped and are skipped. Whole 2 MiB leaves
+ * go back to the buddy allocator as one block. A range edge inside a leaf
+ * splits it, and its pages are then freed one by one.
+ *
+ * Return: Number of 4 KiB pages freed.
+ */
+static uint64_t unmap_heap_range(virt_addr_t start, virt_addr_t end)
+{
+	uint64_t pages = 0;
+	int ret;
 
-		ret = map_page(current, page, PAGE_WRITABLE | PAGE_NO_EXECUTE);
-		if (ret != 0) {
-			free_page(page);
-			return ret;
-		}
+	ret = unmap_range(start, end - start, heap_release_frames, &pages);
+	if (ret != 0 && ret != -ENOENT) {
+		panic("kernel heap unmap failed");
 	}
 
-	return 0;
+	return pages;
 }
 
+/**
+ * heap_extend() - Grow the arena by a free block of at least @min_size.
+ * @min_size: Payload bytes the new block must hold.
+ *
+ * Only the region end moves; the new span is backed page by page, or by
+ * 2 MiB leaves, as it is touched. kmalloc() no longer allocates here, so
+ * no caller depends on the arena failing cleanly when frames run out.
+ *
+ * Return: 0 on success, or -EEXIST if the arena ran into another region.
+ */
 static int heap_extend(size_t min_size)
 {
 	size_t bytes =
@@ -110,7 +201,11 @@ static int heap_extend(size_t min_size)
 	struct heap_block *block = (struct heap_block *)(uintptr_t)heap_end;
 	int ret;
 
-	ret = map_heap_range(heap_end, bytes);
+	if (bytes < HEAP_EXTEND_MIN) {
+		bytes = HEAP_EXTEND_MIN;
+	}
+
+	ret = vm_region_resize(&heap_region, heap_end + bytes);
 	if (ret != 0) {
 		return ret;
 	}
@@ -137,6 +232,76 @@ static int heap_extend(size_t min_size)
 	return 0;
 }
 
+/**
+ * heap_trim_tail() - Return free pages at the end of the heap arena.
+ * @retain: Bytes of free tail to keep mapped as slack.
+ *
+ * Only the last block can shrink the arena, because heap_end must stay the
+ * end of the block list. A page-aligned free tail block is dropped entirely;
+ * otherwise its header page stays mapped and the block is shortened.
+ *
+ * The heap region shrinks first, so a stray access above the new end faults
+ * instead of quietly mapping a fresh page.
+ *
+ * Return: Number of pages unmapped and freed.
+ */
+static uint64_t heap_trim_tail(uint64_t retain)
+{
+	struct heap_block *block = heap_last;
+	virt_addr_t start;
+	virt_addr_t new_end;
+	uint64_t pages;
+
+	if (block == 0 || block->free == 0) {
+		return 0;
+	}
+
+	start = (virt_addr_t)(uintptr_t)block;
+	if ((start & (PAGE_SIZE - 1)) != 0) {
+		start = align_up_addr((virt_addr_t)(uintptr_t)(block + 1),
+			PAGE_SIZE);
+	}
+
+	new_end = align_up_addr(start + retain, PAGE_SIZE);
+	if (new_end >= heap_end) {
+		return 0;
+	}
+
+	if (new_end == (virt_addr_t)(uintptr_t)block) {
+		heap_last = block->prev;
+		if (heap_last != 0) {
+			heap_last->next = 0;
+		} else {
+			heap_first = 0;
+		}
+	} else {
+		block->size = new_end - (virt_addr_t)(uintptr_t)(block + 1);
+	}
+
+	if (vm_region_resize(&heap_region, new_end) != 0) {
+		panic("kernel heap region shrink failed");
+	}
+
+	pages = unmap_heap_range(new_end, heap_end);
+	heap_end = new_end;
+	heap_trimmed_pages += pages;
+	return pages;
+}
+
+/**
+ * heap_free_tail_bytes() - Measure the free block at the end of the arena.
+ *
+ * Return: Free bytes between the tail block's payload and heap_end.
+ */
+static uint64_t heap_free_tail_bytes(void)
+{
+	if (heap_last == 0 || heap_last->free == 0) {
+		return 0;
+	}
+
+	return heap_last->size;
+}
+
 static struct heap_block *find_free_block(size_t size)
 {
 	struct heap_block *block;
@@ -150,14 +315,10 @@ static struct heap_block *find_free_block(size_t size)
 	return 0;
 }
 
-void *kmalloc(size_t size)
+static void *arena_alloc_locked(size_t size)
 {
 	struct heap_block *block;
 
-	if (size == 0) {
-		return 0;
-	}
-
 	size = align_up_size(size, HEAP_ALIGNMENT);
 	block = find_free_block(size);
 
@@ -178,23 +339,446 @@ void *kmalloc(size_t size)
 	return block + 1;
 }
 
+static void arena_free_locked(void *ptr)
+{
+	struct heap_block *block = (struct heap_block *)ptr - 1;
+
+	block->free = 1;
+
+	block_merge_next(block);
+	if (block->prev != 0 && block->prev->free != 0) {
+		block_merge_next(block->prev);
+	}
+
+	if (heap_free_tail_bytes() >= HEAP_TRIM_THRESHOLD) {
+		heap_trim_tail(HEAP_TRIM_RETAIN);
+	}
+}
+
+void *heap_arena_alloc(size_t size)
+{
+	uint64_t flags;
+	void *ptr;
+
+	if (size == 0) {
+		return 0;
+	}
+
+	spin_lock_irqsave(&heap_lock, &flags);
+	ptr = arena_alloc_locked(size);
+	spin_unlock_irqrestore(&heap_lock, flags);
+	return ptr;
+}
+
+void heap_arena_free(void *ptr)
+{
+	uint64_t flags;
+
+	if (ptr == 0) {
+		return;
+	}
+
+	spin_lock_irqsave(&heap_lock, &flags);
+	arena_free_locked(ptr);
+	spin_unlock_irqrestore(&heap_lock, flags);
+}
+
+static uint64_t heap_count_pages(struct shrinker *shrinker)
+{
+	(void)shrinker;
+
+	return heap_free_tail_bytes() / PAGE_SIZE;
+}
+
+/**
+ * heap_scan() - Trim the free tail of the arena, slack included.
+ * @shrinker: Heap shrinker.
+ * @nr_to_scan: Pages wanted.
+ *
+ * Counted tail pages that were never touched are not mapped, so the pages
+ * actually freed can be fewer than asked for.
+ *
+ * Return: Pages freed.
+ */
+static uint64_t heap_scan(struct shrinker *shrinker, uint64_t nr_to_scan)
+{
+	uint64_t tail;
+	uint64_t retain = 0;
+	uint64_t pages;
+	uint64_t flags;
+
+	(void)shrinker;
+
+	spin_lock_irqsave(&heap_lock, &flags);
+	tail = heap_free_tail_bytes();
+	if (nr_to_scan < tail / PAGE_SIZE) {
+		retain = tail - nr_to_scan * PAGE_SIZE;
+	}
+
+	pages = heap_trim_tail(retain);
+	spin_unlock_irqrestore(&heap_lock, flags);
+	return pages;
+}
+
+static struct shrinker heap_shrinker = {
+	.name = "heap",
+	.count = heap_count_pages,
+	.scan = heap_scan,
+};
+
+static struct kmem_cache *kmalloc_cache_for(size_t size)
+{
+	unsigned int index;
+
+	for (index = 0; index < KMALLOC_CLASS_COUNT; index++) {
+		if (size <= kmalloc_classes[index].size) {
+			return kmalloc_caches[index];
+		}
+	}
+
+	return 0;
+}
+
+static void *kmalloc_vmalloc(size_t size)
+{
+	void *ptr = vmalloc_mapped(size);
+
+	if (ptr != 0) {
+		__atomic_add_fetch(&kmalloc_vmalloc_areas, 1, __ATOMIC_RELAXED);
+	}
+
+	return ptr;
+}
+
+/**
+ * kmalloc_large() - Serve a request too big for the size classes.
+ * @size: Bytes requested, above KMALLOC_MAX_CACHE_SIZE.
+ *
+ * The smallest buddy block that fits is handed out through the direct map,
+ * with its head page tagged PG_KMALLOC so kfree() can free it by order.
+ * Requests beyond PAGE_MAX_ORDER, or for which no contiguous block is left,
+ * get a vmalloc_mapped() area instead.
+ *
+ * Return: Kernel virtual pointer, or NULL when memory is exhausted.
+ */
+static void *kmalloc_large(size_t size)
+{
+	unsigned int order = 0;
+	struct page *head;
+	phys_addr_t block;
+	uint64_t index;
+
+	while (order <= PAGE_MAX_ORDER && ((size_t)PAGE_SIZE << order) < size) {
+		order++;
+	}
+
+	if (order > PAGE_MAX_ORDER) {
+		return kmalloc_vmalloc(size);
+	}
+
+	block = alloc_pages(order);
+	if (block == 0) {
+		return order != 0 ? kmalloc_vmalloc(size) : 0;
+	}
+
+	head = phys_to_page(block);
+	for (index = 0; index < (1ull << order); index++) {
+		head[index].owner = PAGE_OWNER_HEAP;
+	}
+
+	head->flags |= PG_KMALLOC;
+	__atomic_add_fetch(&kmalloc_large_pages, 1ull << order,
+		__ATOMIC_RELAXED);
+	return phys_to_virt(block);
+}
+
+/**
+ * kmalloc() - Allocate kernel memory from a size class or whole pages.
+ * @size: Number of bytes requested.
+ *
+ * Requests up to KMALLOC_MAX_CACHE_SIZE come from the matching slab cache.
+ * Larger requests take whole pages, so their cost does not depend on how
+ * many other allocations are live.
+ *
+ * Return: Kernel virtual pointer, or NULL when allocation fails.
+ */
+void *kmalloc(size_t size)
+{
+	void *ptr;
+
+	if (size == 0) {
+		return 0;
+	}
+
+	if (size <= KMALLOC_MAX_CACHE_SIZE) {
+		ptr = kmem_cache_alloc(kmalloc_cache_for(size));
+	} else {
+		ptr = kmalloc_large(size);
+	}
+
+	heap_profile_alloc(ptr, size, __builtin_return_address(0));
+	return ptr;
+}
+
+/**
+ * kfree() - Free memory returned by kmalloc().
+ * @ptr: Pointer returned by kmalloc(), or NULL.
+ *
+ * A vmalloc window address is a large fallback area. Anything else must be
+ * in the direct map, where the struct page tells a page-backed block from a
+ * slab object of a size-class cache.
+ */
 void kfree(void *ptr)
 {
-	struct heap_block *block;
+	uint64_t pfn;
+	struct page *page;
 
 	if (ptr == 0) {
 		return;
 	}
 
-	block = (struct heap_block *)ptr - 1;
-	block->free = 1;
+	heap_profile_free(ptr);
+	if (vmalloc_contains(ptr)) {
+		vfree(ptr);
+		__atomic_sub_fetch(&kmalloc_vmalloc_areas, 1, __ATOMIC_RELAXED);
+		return;
+	}
 
-	block_merge_next(block);
-	if (block->prev != 0 && block->prev->free != 0) {
-		block_merge_next(block->prev);
+	if (!physmap_contains(ptr)) {
+		panic("kfree of unknown pointer");
+	}
+
+	pfn = physmap_to_phys(ptr) >> PAGE_SHIFT;
+	if (!pfn_valid(pfn)) {
+		panic("kfree of unknown pointer");
+	}
+
+	page = pfn_to_page(pfn);
+	if ((page->flags & PG_KMALLOC) != 0) {
+		if (((uintptr_t)ptr & (PAGE_SIZE - 1)) != 0) {
+			panic("kfree of unknown pointer");
+		}
+
+		page->flags &= ~PG_KMALLOC;
+		__atomic_sub_fetch(&kmalloc_large_pages, 1ull << page->order,
+			__ATOMIC_RELAXED);
+		free_pages(pfn << PAGE_SHIFT, page->order);
+		return;
+	}
+
+	if ((page->flags & PG_SLAB) == 0) {
+		panic("kfree of unknown pointer");
+	}
+
+	kmem_cache_free(page->slab_cache, ptr);
+}
+
+/*
+ * Free-block histogram buckets: bucket n counts free blocks spanning
+ * [2^n, 2^(n+1)) pages, header included. Bucket 0 also takes sub-page
+ * blocks and the last bucket everything larger. heap_report() names every
+ * bucket in its format string, so the two must change together.
+ */
+#define HEAP_HISTOGRAM_BUCKETS 10u
+
+/**
+ * struct heap_frag_stats - Snapshot of the arena's block list.
+ * @arena_bytes: Bytes between HEAP_BASE and heap_end.
+ * @used_bytes: Payload bytes of allocated blocks.
+ * @free_bytes: Payload bytes of free blocks.
+ * @blocks: Blocks on the list.
+ * @free_blocks: Free blocks on the list.
+ * @largest_free: Payload bytes of the largest free block.
+ * @histogram: Free blocks per size bucket.
+ */
+struct heap_frag_stats {
+	uint64_t arena_bytes;
+	uint64_t used_bytes;
+	uint64_t free_bytes;
+	uint64_t blocks;
+	uint64_t free_blocks;
+	uint64_t largest_free;
+	uint64_t histogram[HEAP_HISTOGRAM_BUCKETS];
+};
+
+static unsigned int histogram_bucket(uint64_t size)
+{
+	uint64_t pages = (size + sizeof(struct heap_block)) / PAGE_SIZE;
+	unsigned int bucket = 0;
+
+	while (pages > 1 && bucket < HEAP_HISTOGRAM_BUCKETS - 1) {
+		pages >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+static void heap_frag_snapshot(struct heap_frag_stats *stats)
+{
+	struct heap_block *block;
+	unsigned int bucket;
+	uint64_t flags;
+
+	stats->used_bytes = 0;
+	stats->free_bytes = 0;
+	stats->blocks = 0;
+	stats->free_blocks = 0;
+	stats->largest_free = 0;
+	for (bucket = 0; bucket < HEAP_HISTOGRAM_BUCKETS; bucket++) {
+		stats->histogram[bucket] = 0;
 	}
+
+	spin_lock_irqsave(&heap_lock, &flags);
+	stats->arena_bytes = heap_end - HEAP_BASE;
+	for (block = heap_first; block != 0; block = block->next) {
+		stats->blocks++;
+		if (block->free == 0) {
+			stats->used_bytes += block->size;
+			continue;
+		}
+
+		stats->free_blocks++;
+		stats->free_bytes += block->size;
+		stats->histogram[histogram_bucket(block->size)]++;
+		if (block->size > stats->largest_free) {
+			stats->largest_free = block->size;
+		}
+	}
+	spin_unlock_irqrestore(&heap_lock, flags);
 }
 
+void heap_report(void)
+{
+	struct heap_frag_stats stats;
+	const uint64_t *hist = stats.histogram;
+	unsigned int index;
+	uint64_t frag = 0;
+
+	for (index = 0; index < KMALLOC_CLASS_COUNT; index++) {
+		struct kmem_cache_stats class;
+
+		kmem_cache_get_stats(kmalloc_caches[index], &class);
+		pr_info("heap class %s inuse=%llu total=%llu slabs=%llu "
+			"waste=%llu\n",
+			class.name,
+			(unsigned long long)class.objects_inuse,
+			(unsigned long long)(class.slabs *
+				class.objects_per_slab),
+			(unsigned long long)class.slabs,
+			(unsigned long long)class.waste_bytes);
+	}
+
+	pr_info("heap large pages=%llu vmalloc areas=%llu\n",
+		(unsigned long long)__atomic_load_n(&kmalloc_large_pages,
+			__ATOMIC_RELAXED),
+		(unsigned long long)__atomic_load_n(&kmalloc_vmalloc_areas,
+			__ATOMIC_RELAXED));
+
+	heap_frag_snapshot(&stats);
+	if (stats.free_bytes != 0) {
+		frag = 100 - stats.largest_free * 100 / stats.free_bytes;
+	}
+
+	pr_info("heap arena bytes=%llu used=%llu free=%llu blocks=%llu "
+		"free blocks=%llu largest free=%llu frag=%llu%%\n",
+		(unsigned long long)stats.arena_bytes,
+		(unsigned long long)stats.used_bytes,
+		(unsigned long long)stats.free_bytes,
+		(unsigned long long)stats.blocks,
+		(unsigned long long)stats.free_blocks,
+		(unsigned long long)stats.largest_free,
+		(unsigned long long)frag);
+
+	pr_info("heap free histogram pages: 1:%llu 2:%llu 4:%llu 8:%llu "
+		"16:%llu 32:%llu 64:%llu 128:%llu 256:%llu 512:%llu\n",
+		(unsigned long long)hist[0],
+		(unsigned long long)hist[1],
+		(unsigned long long)hist[2],
+		(unsigned long long)hist[3],
+		(unsigned long long)hist[4],
+		(unsigned long long)hist[5],
+		(unsigned long long)hist[6],
+		(unsigned long long)hist[7],
+		(unsigned long long)hist[8],
+		(unsigned long long)hist[9]);
+
+#if KERNEL_HEAP_PROFILE
+	heap_profile_report();
+#else
+	pr_info("heap profile off; build with KERNEL_HEAP_PROFILE=1\n");
+#endif
+}
+
+static void kmalloc_caches_init(void)
+{
+	unsigned int index;
+
+	for (index = 0; index < KMALLOC_CLASS_COUNT; index++) {
+		kmalloc_caches[index] =
+			kmem_cache_create(kmalloc_classes[index].name,
+				kmalloc_classes[index].size,
+				HEAP_ALIGNMENT,
+				0);
+		if (kmalloc_caches[index] == 0) {
+			panic("kmalloc cache creation failed");
+		}
+	}
+}
+
+/**
+ * heap_trim_selftest() - Check that a transient burst is handed back.
+ *
+ * An arena allocation larger than the reserved slack grows the arena;
+ * freeing it must unmap the pages it touched and shrink heap_end back to
+ * within the retained slack of its previous value.
+ */
+static void heap_trim_selftest(void)
+{
+	const size_t size = HEAP_EXTEND_MIN * 2;
+	virt_addr_t before = heap_end;
+	uint64_t trimmed_before = heap_trimmed_pages;
+	uint8_t *burst = heap_arena_alloc(size);
+
+	if (burst == 0 || heap_end <= before) {
+		panic("kernel heap trim selftest growth failed");
+	}
+
+	burst[0] = 1;
+	burst[size - 1] = 2;
+	heap_arena_free(burst);
+
+	if (heap_trimmed_pages == trimmed_before ||
+		heap_end > before + HEAP_TRIM_RETAIN + PAGE_SIZE) {
+		panic("kernel heap trim selftest failed");
+	}
+}
+
+#if KERNEL_HEAP_PROFILE
+/**
+ * heap_profile_selftest() - Check that live bytes follow kmalloc()/kfree().
+ *
+ * Covers one size-class and one page-backed allocation.
+ */
+static void heap_profile_selftest(void)
+{
+	uint64_t before = heap_profile_live_bytes();
+	void *small = kmalloc(100);
+	void *large = kmalloc(KMALLOC_MAX_CACHE_SIZE * 2);
+
+	if (small == 0 || large == 0 || heap_profile_live_bytes() !=
+		before + 100 + KMALLOC_MAX_CACHE_SIZE * 2) {
+		panic("kernel heap profile selftest failed");
+	}
+
+	kfree(large);
+	kfree(small);
+	if (heap_profile_live_bytes() != before) {
+		panic("kernel heap profile selftest free failed");
+	}
+}
+#endif
+
 static void heap_selftest(void)
 {
 	uint64_t *first = kmalloc(sizeof(*first));
@@ -223,6 +807,10 @@ static void heap_selftest(void)
 	kfree(third);
 	kfree(second);
 
+	heap_trim_selftest();
+#if KERNEL_HEAP_PROFILE
+	heap_profile_selftest();
+#endif
 	pr_info("kernel heap selftest ok\n");
 }
 
@@ -233,11 +821,22 @@ void heap_init(void)
 	}
 
 	heap_end = align_up_addr(heap_end, PAGE_SIZE);
-	if (heap_extend(PAGE_SIZE - sizeof(struct heap_block)) != 0) {
+	if (vm_region_register(&heap_region) != 0 ||
+		heap_extend(PAGE_SIZE - sizeof(struct heap_block)) != 0) {
 		panic("kernel heap initialization failed");
 	}
 
+	kmalloc_caches_init();
+	if (register_shrinker(&heap_shrinker) != 0) {
+		panic("kernel heap shrinker registration failed");
+	}
 	heap_ready = 1;
 	pr_info("kernel heap initialized\n");
 	heap_selftest();
+	kmalloc_selftest();
+	pr_info("kernel heap end=%p faulted pages=%llu trimmed pages=%llu\n",
+		(void *)(uintptr_t)heap_end,
+		(unsigned long long)heap_region.pages,
+		(unsigned long long)heap_trimmed_pages);
+	heap_report();
 }
@@ -0,0 +1,92 @@
+#ifndef MM_HEAP_H
+#define MM_HEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tianole/mm.h>
+
+#define HEAP_BASE 0xffffff2000000000ull
+#define HEAP_ALIGNMENT 16u
+
+/**
+ * KMALLOC_MAX_CACHE_SIZE - Largest request served by a kmalloc size class.
+ *
+ * Larger requests get a whole buddy block through the direct map, or a
+ * vmalloc_mapped() area when no single block is big enough.
+ */
+#define KMALLOC_MAX_CACHE_SIZE 2048u
+
+/**
+ * heap_arena_alloc() - Allocate from the first-fit virtual heap arena.
+ * @size: Bytes requested; not rounded to pages by this function.
+ *
+ * Not behind kmalloc(); kept as the first-fit baseline that selftests
+ * compare the size-class front end against.
+ * Arena pages are faulted in on first touch, and a fault that finds no free
+ * frame panics, so the arena is only fit for boot-time selftests.
+ *
+ * Return: Arena pointer, or NULL when the arena cannot grow.
+ */
+void *heap_arena_alloc(size_t size);
+
+/**
+ * heap_arena_free() - Return an arena allocation and merge neighbours.
+ * @ptr: Pointer returned by heap_arena_alloc().
+ */
+void heap_arena_free(void *ptr);
+
+#if KERNEL_HEAP_PROFILE
+
+/**
+ * heap_profile_alloc() - Record a live kmalloc() allocation.
+ * @ptr: Returned pointer; NULL is ignored.
+ * @size: Requested size.
+ * @caller: Return address of the kmalloc() call.
+ */
+void heap_profile_alloc(const void *ptr, size_t size, const void *caller);
+
+/**
+ * heap_profile_free() - Forget an allocation passed to kfree().
+ * @ptr: Pointer being freed.
+ */
+void heap_profile_free(const void *ptr);
+
+/**
+ * heap_profile_live_bytes() - Sum the requested sizes of live allocations.
+ *
+ * Return: Bytes held by tracked allocations.
+ */
+uint64_t heap_profile_live_bytes(void);
+
+/**
+ * heap_profile_report() - Log per-call-site live allocation totals.
+ */
+void heap_profile_report(void);
+
+#else
+
+static inline void heap_profile_alloc(const void *ptr, size_t size,
+	const void *caller)
+{
+	(void)ptr;
+	(void)size;
+	(void)caller;
+}
+
+static inline void heap_profile_free(const void *ptr)
+{
+	(void)ptr;
+}
+
+#endif
+
+/**
+ * kmalloc_selftest() - Check size-class dispatch and benchmark kmalloc().
+ *
+ * Logs per-operation cycle counts of the size-class path and of the
+ * first-fit arena under the same live population.
+ */
+void kmalloc_selftest(void);
+
+#endif
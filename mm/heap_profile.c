@@ -0,0 +1,251 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tianole/printk.h>
+#include <tianole/spinlock.h>
+
+#include "heap.h"
+
+#if KERNEL_HEAP_PROFILE
+
+/*
+ * Live allocations sit in an open-addressed table keyed by pointer and
+ * call sites in a fixed array, both static so recording never allocates.
+ * Allocations that find either one full are only counted as untracked.
+ * The live table counts as full with one slot still empty, so every probe
+ * sequence ends at an empty slot.
+ */
+#define PROFILE_LIVE_SHIFT 12u
+#define PROFILE_LIVE_SLOTS (1u << PROFILE_LIVE_SHIFT)
+#define PROFILE_SITES 64u
+#define PROFILE_REPORT_SITES 16u
+
+/**
+ * struct profile_site - Allocation statistics of one kmalloc() caller.
+ * @caller: Return address of the kmalloc() call.
+ * @live_bytes: Requested bytes still allocated.
+ * @live_count: Allocations still live.
+ * @peak_bytes: Highest @live_bytes seen.
+ * @allocs: Allocations made over the site's lifetime.
+ */
+struct profile_site {
+	const void *caller;
+	uint64_t live_bytes;
+	uint64_t live_count;
+	uint64_t peak_bytes;
+	uint64_t allocs;
+};
+
+/**
+ * struct profile_entry - One live allocation.
+ * @ptr: Pointer returned to the caller; NULL marks an empty slot.
+ * @size: Requested size.
+ * @site: Index into profile_sites.
+ */
+struct profile_entry {
+	const void *ptr;
+	uint64_t size;
+	uint32_t site;
+};
+
+static struct profile_entry profile_live[PROFILE_LIVE_SLOTS];
+static struct profile_site profile_sites[PROFILE_SITES];
+static uint32_t profile_nr_sites;
+static uint32_t profile_nr_live;
+static uint64_t profile_live_bytes;
+static uint64_t profile_untracked;
+static struct spinlock profile_lock = SPINLOCK_INITIALIZER;
+
+static uint32_t profile_slot(const void *ptr)
+{
+	uint64_t key = (uint64_t)(uintptr_t)ptr >> 4;
+
+	return (uint32_t)((key * 0x9e3779b97f4a7c15ull) >>
+		(64u - PROFILE_LIVE_SHIFT));
+}
+
+/**
+ * profile_site_index() - Find or add the site of @caller.
+ * @caller: kmalloc() return address.
+ *
+ * Return: Site index, or PROFILE_SITES when the array is full.
+ */
+static uint32_t profile_site_index(const void *caller)
+{
+	uint32_t index;
+
+	for (index = 0; index < profile_nr_sites; index++) {
+		if (profile_sites[index].caller == caller) {
+			return index;
+		}
+	}
+
+	if (profile_nr_sites == PROFILE_SITES) {
+		return PROFILE_SITES;
+	}
+
+	profile_sites[profile_nr_sites].caller = caller;
+	return profile_nr_sites++;
+}
+
+/**
+ * profile_remove_slot() - Empty a slot without breaking probe chains.
+ * @hole: Slot to empty.
+ *
+ * Later entries of the same cluster move back into the hole unless their
+ * home slot lies cyclically after it, so lookups never need tombstones.
+ */
+static void profile_remove_slot(uint32_t hole)
+{
+	uint32_t next = hole;
+
+	for (;;) {
+		uint32_t home;
+
+		next = (next + 1) & (PROFILE_LIVE_SLOTS - 1);
+		if (profile_live[next].ptr == 0) {
+			break;
+		}
+
+		home = profile_slot(profile_live[next].ptr);
+		if (hole <= next ? (hole < home && home <= next) :
+			(hole < home || home <= next)) {
+			continue;
+		}
+
+		profile_live[hole] = profile_live[next];
+		hole = next;
+	}
+
+	profile_live[hole].ptr = 0;
+}
+
+void heap_profile_alloc(const void *ptr, size_t size, const void *caller)
+{
+	struct profile_site *site;
+	uint32_t slot;
+	uint32_t index;
+	uint64_t flags;
+
+	if (ptr == 0) {
+		return;
+	}
+
+	spin_lock_irqsave(&profile_lock, &flags);
+	index = profile_site_index(caller);
+	if (index == PROFILE_SITES ||
+		profile_nr_live == PROFILE_LIVE_SLOTS - 1) {
+		profile_untracked++;
+		spin_unlock_irqrestore(&profile_lock, flags);
+		return;
+	}
+
+	slot = profile_slot(ptr);
+	while (profile_live[slot].ptr != 0) {
+		slot = (slot + 1) & (PROFILE_LIVE_SLOTS - 1);
+	}
+
+	profile_nr_live++;
+	profile_live[slot].ptr = ptr;
+	profile_live[slot].size = size;
+	profile_live[slot].site = index;
+
+	site = &profile_sites[index];
+	site->live_bytes += size;
+	site->live_count++;
+	site->allocs++;
+	if (site->live_bytes > site->peak_bytes) {
+		site->peak_bytes = site->live_bytes;
+	}
+	profile_live_bytes += size;
+	spin_unlock_irqrestore(&profile_lock, flags);
+}
+
+void heap_profile_free(const void *ptr)
+{
+	struct profile_site *site;
+	uint32_t slot;
+	uint64_t flags;
+
+	spin_lock_irqsave(&profile_lock, &flags);
+	slot = profile_slot(ptr);
+	while (profile_live[slot].ptr != 0 && profile_live[slot].ptr != ptr) {
+		slot = (slot + 1) & (PROFILE_LIVE_SLOTS - 1);
+	}
+
+	/* Untracked allocations have no entry. */
+	if (profile_live[slot].ptr == 0) {
+		spin_unlock_irqrestore(&profile_lock, flags);
+		return;
+	}
+
+	site = &profile_sites[profile_live[slot].site];
+	site->live_bytes -= profile_live[slot].size;
+	site->live_count--;
+	profile_live_bytes -= profile_live[slot].size;
+	profile_nr_live--;
+	profile_remove_slot(slot);
+	spin_unlock_irqrestore(&profile_lock, flags);
+}
+
+uint64_t heap_profile_live_bytes(void)
+{
+	return profile_live_bytes;
+}
+
+/**
+ * heap_profile_report() - Log the call sites holding the most memory.
+ *
+ * Sites are printed by descending live bytes, at most PROFILE_REPORT_SITES
+ * of them; sites with nothing live are skipped.
+ */
+void heap_profile_report(void)
+{
+	struct profile_site snapshot[PROFILE_SITES];
+	uint32_t nr_sites;
+	uint32_t shown;
+	uint64_t untracked;
+	uint64_t live;
+	uint64_t flags;
+
+	spin_lock_irqsave(&profile_lock, &flags);
+	nr_sites = profile_nr_sites;
+	for (shown = 0; shown < nr_sites; shown++) {
+		snapshot[shown] = profile_sites[shown];
+	}
+	untracked = profile_untracked;
+	live = profile_live_bytes;
+	spin_unlock_irqrestore(&profile_lock, flags);
+
+	pr_info("heap profile sites=%u live=%llu untracked=%llu\n",
+		nr_sites,
+		(unsigned long long)live,
+		(unsigned long long)untracked);
+
+	for (shown = 0; shown < PROFILE_REPORT_SITES; shown++) {
+		struct profile_site *top = 0;
+		uint32_t index;
+
+		for (index = 0; index < nr_sites; index++) {
+			if (snapshot[index].live_count != 0 && (top == 0 ||
+				snapshot[index].live_bytes > top->live_bytes)) {
+				top = &snapshot[index];
+			}
+		}
+
+		if (top == 0) {
+			break;
+		}
+
+		pr_info("heap site %p live=%llu objects=%llu peak=%llu "
+			"allocs=%llu\n",
+			top->caller,
+			(unsigned long long)top->live_bytes,
+			(unsigned long long)top->live_count,
+			(unsigned long long)top->peak_bytes,
+			(unsigned long long)top->allocs);
+		top->live_count = 0;
+	}
+}
+
+#endif
@@ -0,0 +1,220 @@
+#include <stdint.h>
+
+#include <tianole/memblock.h>
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+
+/**
+ * struct memblock_type - Sorted, merged table of physical ranges.
+ * @regions: Ranges ordered by base address, never overlapping or touching.
+ * @count: Number of valid entries in @regions.
+ */
+struct memblock_type {
+	struct memblock_region regions[MEMBLOCK_MAX_REGIONS];
+	uint64_t count;
+};
+
+static struct memblock_type memblock_memory;
+static struct memblock_type memblock_reserved;
+
+static uint64_t align_down(uint64_t value, uint64_t alignment)
+{
+	return value & ~(alignment - 1);
+}
+
+static uint64_t align_up(uint64_t value, uint64_t alignment)
+{
+	return align_down(value + alignment - 1, alignment);
+}
+
+static phys_addr_t region_end(const struct memblock_region *region)
+{
+	return region->base + region->size;
+}
+
+static void remove_region(struct memblock_type *type, uint64_t index)
+{
+	for (; index + 1 < type->count; index++) {
+		type->regions[index] = type->regions[index + 1];
+	}
+
+	type->count--;
+}
+
+/**
+ * insert_range() - Add a range to a table, keeping it sorted and merged.
+ * @type: Table to update.
+ * @start: Page-aligned physical start.
+ * @end: Page-aligned physical end.
+ *
+ * The new range absorbs every existing range it overlaps or touches, so a
+ * table never holds two entries that could be described by one.
+ */
+static void insert_range(struct memblock_type *type,
+	phys_addr_t start,
+	phys_addr_t end)
+{
+	uint64_t index = 0;
+	uint64_t slot;
+
+	if (start >= end) {
+		return;
+	}
+
+	while (index < type->count &&
+		region_end(&type->regions[index]) < start) {
+		index++;
+	}
+
+	while (index < type->count && type->regions[index].base <= end) {
+		struct memblock_region *region = &type->regions[index];
+
+		if (region->base < start) {
+			start = region->base;
+		}
+
+		if (region_end(region) > end) {
+			end = region_end(region);
+		}
+
+		remove_region(type, index);
+	}
+
+	if (type->count >= MEMBLOCK_MAX_REGIONS) {
+		panic("memblock region table full");
+	}
+
+	for (slot = type->count; slot > index; slot--) {
+		type->regions[slot] = type->regions[slot - 1];
+	}
+
+	type->regions[index].base = start;
+	type->regions[index].size = end - start;
+	type->count++;
+}
+
+void memblock_reset(void)
+{
+	memblock_memory.count = 0;
+	memblock_reserved.count = 0;
+}
+
+void memblock_add(phys_addr_t base, uint64_t size)
+{
+	insert_range(&memblock_memory,
+		align_up(base, PAGE_SIZE),
+		align_down(base + size, PAGE_SIZE));
+}
+
+void memblock_reserve(phys_addr_t base, uint64_t size)
+{
+	insert_range(&memblock_reserved,
+		align_down(base, PAGE_SIZE),
+		align_up(base + size, PAGE_SIZE));
+}
+
+void memblock_for_each_free_range(memblock_range_fn_t fn, void *data)
+{
+	uint64_t memory_index;
+	uint64_t first_reserved = 0;
+
+	for (memory_index = 0; memory_index < memblock_memory.count;
+		memory_index++) {
+		const struct memblock_region *memory =
+			&memblock_memory.regions[memory_index];
+		phys_addr_t start = memory->base;
+		phys_addr_t end = region_end(memory);
+		const struct memblock_region *reserved;
+		uint64_t index;
+
+		while (first_reserved < memblock_reserved.count) {
+			reserved = &memblock_reserved.regions[first_reserved];
+			if (region_end(reserved) > start) {
+				break;
+			}
+			first_reserved++;
+		}
+
+		for (index = first_reserved; start < end; index++) {
+			if (index >= memblock_reserved.count ||
+				memblock_reserved.regions[index].base >= end) {
+				fn(start, end, data);
+				break;
+			}
+
+			reserved = &memblock_reserved.regions[index];
+			if (reserved->base > start) {
+				fn(start, reserved->base, data);
+			}
+
+			if (region_end(reserved) > start) {
+				start = region_end(reserved);
+			}
+		}
+	}
+}
+
+/**
+ * struct memblock_alloc_request - State threaded through a first-fit search.
+ * @size: Requested length in bytes.
+ * @align: Requested alignment.
+ * @base: First fitting base found so far, or 0.
+ */
+struct memblock_alloc_request {
+	uint64_t size;
+	uint64_t align;
+	phys_addr_t base;
+};
+
+static void alloc_from_range(phys_addr_t start, phys_addr_t end, void *data)
+{
+	struct memblock_alloc_request *request = data;
+	phys_addr_t base;
+
+	if (request->base != 0) {
+		return;
+	}
+
+	/* Physical address 0 is the allocation failure value. */
+	if (start == 0) {
+		start = PAGE_SIZE;
+	}
+
+	base = align_up(start, request->align);
+	if (base < end && end - base >= request->size) {
+		request->base = base;
+	}
+}
+
+phys_addr_t memblock_alloc(uint64_t size, uint64_t align)
+{
+	struct memblock_alloc_request request;
+
+	if (align < PAGE_SIZE) {
+		align = PAGE_SIZE;
+	}
+
+	request.size = align_up(size, PAGE_SIZE);
+	request.align = align;
+	request.base = 0;
+
+	if (request.size == 0) {
+		return 0;
+	}
+
+	memblock_for_each_free_range(alloc_from_range, &request);
+	if (request.base != 0) {
+		memblock_reserve(request.base, request.size);
+	}
+
+	return request.base;
+}
+
+uint64_t memblock_region_count(int reserved)
+{
+	if (reserved != 0) {
+		return memblock_reserved.count;
+	}
+
+	return memblock_memory.count;
+}
@@ -0,0 +1,184 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tianole/mempool.h>
+#include <tianole/mm.h>
+#include <tianole/slab.h>
+#include <tianole/spinlock.h>
+#include <tianole/workqueue.h>
+
+/**
+ * struct mempool - Slab cache plus a reserve of pre-allocated elements.
+ * @cache: Cache that elements are allocated from and returned to.
+ * @reserve: Free elements, linked through their first word.
+ * @min_nr: Reserve size the pool is rebalanced to.
+ * @curr_nr: Elements currently on @reserve.
+ * @lock: Protects the reserve against IRQ-context allocation and free.
+ * @refill_work: Workqueue item that runs mempool_refill().
+ */
+struct mempool {
+	struct kmem_cache *cache;
+	void *reserve;
+	uint32_t min_nr;
+	uint32_t curr_nr;
+	struct spinlock lock;
+	struct work_struct refill_work;
+};
+
+static void mempool_refill_work(struct work_struct *work)
+{
+	(void)mempool_refill(work->data);
+}
+
+/**
+ * reserve_pop() - Take an element from the reserve.
+ * @pool: Pool to take from.
+ *
+ * Return: Element, or NULL if the reserve is empty.
+ */
+static void *reserve_pop(struct mempool *pool)
+{
+	void *element;
+	uint64_t flags;
+
+	spin_lock_irqsave(&pool->lock, &flags);
+	element = pool->reserve;
+	if (element != 0) {
+		pool->reserve = *(void **)element;
+		pool->curr_nr--;
+	}
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	return element;
+}
+
+/**
+ * reserve_push() - Put an element on the reserve.
+ * @pool: Pool to add to.
+ * @element: Free element.
+ *
+ * Return: Reserve size after the push.
+ */
+static uint32_t reserve_push(struct mempool *pool, void *element)
+{
+	uint32_t curr_nr;
+	uint64_t flags;
+
+	spin_lock_irqsave(&pool->lock, &flags);
+	*(void **)element = pool->reserve;
+	pool->reserve = element;
+	curr_nr = ++pool->curr_nr;
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	return curr_nr;
+}
+
+struct mempool *mempool_create(const char *name, size_t size,
+	uint32_t min_nr)
+{
+	struct mempool *pool;
+
+	if (size == 0 || min_nr == 0) {
+		return 0;
+	}
+
+	if (size < sizeof(void *)) {
+		size = sizeof(void *);
+	}
+
+	pool = kmalloc(sizeof(*pool));
+	if (pool == 0) {
+		return 0;
+	}
+
+	pool->cache = kmem_cache_create(name, size, 0, 0);
+	if (pool->cache == 0) {
+		kfree(pool);
+		return 0;
+	}
+
+	pool->reserve = 0;
+	pool->min_nr = min_nr;
+	pool->curr_nr = 0;
+	pool->lock = (struct spinlock)SPINLOCK_INITIALIZER;
+	work_init(&pool->refill_work, mempool_refill_work, pool);
+
+	if (mempool_refill(pool) != min_nr) {
+		mempool_destroy(pool);
+		return 0;
+	}
+
+	return pool;
+}
+
+void mempool_destroy(struct mempool *pool)
+{
+	void *element;
+
+	if (pool == 0) {
+		return;
+	}
+
+	(void)cancel_work_sync(&pool->refill_work);
+	while ((element = reserve_pop(pool)) != 0) {
+		kmem_cache_free(pool->cache, element);
+	}
+
+	kmem_cache_destroy(pool->cache);
+	kfree(pool);
+}
+
+void *mempool_alloc(struct mempool *pool, gfp_t gfp)
+{
+	void *element = 0;
+
+	if ((gfp & GFP_ATOMIC) == 0) {
+		element = kmem_cache_alloc(pool->cache);
+		if (element != 0) {
+			return element;
+		}
+	}
+
+	element = reserve_pop(pool);
+	if (pool->curr_nr < pool->min_nr) {
+		(void)queue_work(&pool->refill_work);
+	}
+
+	return element;
+}
+
+void mempool_free(struct mempool *pool, void *element)
+{
+	if (element == 0) {
+		return;
+	}
+
+	if (reserve_push(pool, element) > pool->min_nr) {
+		(void)queue_work(&pool->refill_work);
+	}
+}
+
+uint32_t mempool_refill(struct mempool *pool)
+{
+	void *element;
+
+	while (pool->curr_nr > pool->min_nr) {
+		element = reserve_pop(pool);
+		if (element == 0) {
+			break;
+		}
+
+		kmem_cache_free(pool->cache, element);
+	}
+
+	while (pool->curr_nr < pool->min_nr) {
+		element = kmem_cache_alloc(pool->cache);
+		if (element == 0) {
+			break;
+		}
+
+		(void)reserve_push(pool, element);
+	}
+
+	return pool->curr_nr;
+}
@@ -1,19 +1,87 @@
 #include <stdint.h>
 
 #include <tianole/arch.h>
+#include <tianole/memblock.h>
+#include <tianole/mempool.h>
 #include <tianole/mm.h>
 #include <tianole/panic.h>
 #include <tianole/printk.h>
+#include <tianole/shrinker.h>
+#include <tianole/slab.h>
+#include <tianole/spinlock.h>
+#include <tianole/vmalloc.h>
+
+/**
+ * struct free_area - Free blocks of one buddy order.
+ * @head: Head page of the first free block of this order.
+ * @nr_free: Number of blocks on @head.
+ *
+ * Blocks are linked through struct page::next/prev of their head page, so
+ * free memory itself is never written by the allocator.
+ */
+struct free_area {
+	struct page *head;
+	uint64_t nr_free;
+};
 
-struct page_node {
-	struct page_node *next;
+/**
+ * struct zone - Buddy allocator state of one physical address range.
+ * @name: Diagnostic name.
+ * @start_pfn: First frame of the zone.
+ * @end_pfn: Frame after the last one in the zone.
+ * @free_areas: Free blocks per buddy order.
+ * @free_pages: Free base pages across @free_areas.
+ * @managed_pages: Pages ever handed to the allocator in this zone.
+ *
+ * Zone boundaries are aligned to the largest buddy block, so a block and
+ * its buddy always sit in the same zone and the zone of any frame follows
+ * from its PFN alone.
+ */
+struct zone {
+	const char *name;
+	uint64_t start_pfn;
+	uint64_t end_pfn;
+	struct free_area free_areas[PAGE_MAX_ORDER + 1];
+	uint64_t free_pages;
+	uint64_t managed_pages;
 };
 
+#if (ZONE_DMA32_LIMIT >> PAGE_SHIFT) % (1u << PAGE_MAX_ORDER) != 0
+#error "zone boundary must be aligned to the largest buddy block"
+#endif
+
+/*
+ * The low watermark is 1/64 of boot memory, clamped so tiny machines still
+ * keep some headroom and large ones do not hoard it; high is twice low.
+ */
+#define WMARK_LOW_DIVISOR 64u
+#define WMARK_LOW_MIN_PAGES 32u
+#define WMARK_LOW_MAX_PAGES 8192u
+
 extern char __kernel_start[];
 extern char __kernel_end[];
 
-static struct page_node *free_pages;
+struct page *mem_map;
+uint64_t mem_map_base_pfn;
+uint64_t mem_map_end_pfn;
+
+static struct zone zones[NR_ZONES] = {
+	[ZONE_DMA32] = { .name = "dma32" },
+	[ZONE_NORMAL] = { .name = "normal" },
+};
 static uint64_t free_page_count;
+/*
+ * Guards the free lists, the free counters and the ownership fields of
+ * allocated head pages. It is a leaf lock: reclaim is only woken after it
+ * has been dropped.
+ */
+static struct spinlock zone_lock = SPINLOCK_INITIALIZER;
+static uint64_t mem_map_bytes;
+static uint64_t boot_ram_start;
+static uint64_t boot_ram_end;
+static uint64_t boot_reclaimed_pages;
+static uint64_t watermarks[NR_WMARK];
+static boot_info_t boot_info_copy;
 
 static uint64_t align_down(uint64_t value, uint64_t alignment)
 {
@@ -25,158 +93,864 @@ static uint64_t align_up(uint64_t value, uint64_t alignment)
 	return align_down(value + alignment - 1, alignment);
 }
 
-static int ranges_overlap(uint64_t start,
-	uint64_t end,
-	uint64_t reserved_start,
-	uint64_t reserved_end)
+static const boot_memory_descriptor_t *memory_descriptor(
+	const void *map, uint64_t offset)
 {
-	return start < reserved_end && reserved_start < end;
+	return (const boot_memory_descriptor_t *)((const uint8_t *)map +
+		offset);
 }
 
-static int page_is_reserved(const boot_info_t *boot_info, uint64_t page)
+static uint64_t order_bytes(unsigned int order)
 {
-	uint64_t page_end = page + PAGE_SIZE;
-	uint64_t kernel_start =
-		align_down((uint64_t)(uintptr_t)__kernel_start, PAGE_SIZE);
-	uint64_t kernel_end =
-		align_up((uint64_t)(uintptr_t)__kernel_end, PAGE_SIZE);
-	uint64_t boot_info_start =
-		align_down((uint64_t)(uintptr_t)boot_info, PAGE_SIZE);
-	uint64_t boot_info_end = align_up(
-		(uint64_t)(uintptr_t)boot_info + sizeof(*boot_info), PAGE_SIZE);
-	uint64_t map_start = align_down(boot_info->memory_map, PAGE_SIZE);
-	uint64_t map_end = align_up(
-		boot_info->memory_map + boot_info->memory_map_size, PAGE_SIZE);
+	return (uint64_t)PAGE_SIZE << order;
+}
 
-	if (ranges_overlap(page, page_end, kernel_start, kernel_end)) {
-		return 1;
-	}
+static struct zone *pfn_zone(uint64_t pfn)
+{
+	return &zones[pfn < (ZONE_DMA32_LIMIT >> PAGE_SHIFT) ?
+		ZONE_DMA32 : ZONE_NORMAL];
+}
 
-	if (ranges_overlap(page, page_end, boot_info_start, boot_info_end)) {
-		return 1;
+static void free_area_add(struct page *page, unsigned int order)
+{
+	struct zone *zone = pfn_zone(page_to_pfn(page));
+	struct free_area *area = &zone->free_areas[order];
+
+	page->flags |= PG_BUDDY;
+	page->order = (uint8_t)order;
+	page->owner = PAGE_OWNER_FREE;
+	page->refcount = 0;
+	page->prev = 0;
+	page->next = area->head;
+	if (area->head != 0) {
+		area->head->prev = page;
 	}
 
-	if (ranges_overlap(page, page_end, map_start, map_end)) {
-		return 1;
+	area->head = page;
+	area->nr_free++;
+	zone->free_pages += 1ull << order;
+	free_page_count += 1ull << order;
+}
+
+static void free_area_del(struct page *page, unsigned int order)
+{
+	struct zone *zone = pfn_zone(page_to_pfn(page));
+	struct free_area *area = &zone->free_areas[order];
+
+	if (page->prev != 0) {
+		page->prev->next = page->next;
+	} else {
+		area->head = page->next;
 	}
 
-	if (arch_page_table_uses_page(page)) {
-		return 1;
+	if (page->next != 0) {
+		page->next->prev = page->prev;
 	}
 
-	return 0;
+	page->flags &= ~PG_BUDDY;
+	page->next = 0;
+	page->prev = 0;
+	area->nr_free--;
+	zone->free_pages -= 1ull << order;
+	free_page_count -= 1ull << order;
 }
 
-static void add_free_page(uint64_t page)
+/**
+ * page_is_free_buddy() - Test whether a PFN heads a free block of @order.
+ * @pfn: Candidate buddy frame number.
+ * @order: Order the buddy must currently be free at.
+ *
+ * Only the head page of a free block carries PG_BUDDY, so one metadata load
+ * answers the question that previously required walking a free list.
+ *
+ * Return: Non-zero if @pfn is a free buddy block of exactly @order.
+ */
+static int page_is_free_buddy(uint64_t pfn, unsigned int order)
 {
-	struct page_node *node = (struct page_node *)(uintptr_t)page;
+	struct page *page;
 
-	node->next = free_pages;
-	free_pages = node;
-	free_page_count++;
+	if (!pfn_valid(pfn)) {
+		return 0;
+	}
+
+	page = pfn_to_page(pfn);
+	return (page->flags & PG_BUDDY) != 0 && page->order == order;
 }
 
-static void add_conventional_range(
-	const boot_info_t *boot_info, uint64_t start, uint64_t pages)
+/**
+ * merge_free_block() - Insert a free block, coalescing it with free buddies.
+ * @pfn: First frame of the block, aligned to 2^@order frames.
+ * @order: Order of the block.
+ *
+ * The block is merged with its buddy for as long as the buddy is also free at
+ * the same order, so contiguous runs reassemble as blocks are released.
+ */
+static void merge_free_block(uint64_t pfn, unsigned int order)
 {
-	uint64_t page;
-	uint64_t first = align_up(start, PAGE_SIZE);
-	uint64_t end = start + pages * PAGE_SIZE;
-	uint64_t last;
+	while (order < PAGE_MAX_ORDER) {
+		uint64_t buddy_pfn = pfn ^ (1ull << order);
 
-	if (first + PAGE_SIZE > end) {
-		return;
+		if (!page_is_free_buddy(buddy_pfn, order)) {
+			break;
+		}
+
+		free_area_del(pfn_to_page(buddy_pfn), order);
+		if (buddy_pfn < pfn) {
+			pfn = buddy_pfn;
+		}
+		order++;
 	}
 
-	last = align_down(end - PAGE_SIZE, PAGE_SIZE);
+	free_area_add(pfn_to_page(pfn), order);
+}
 
-	for (page = last;; page -= PAGE_SIZE) {
-		if (!page_is_reserved(boot_info, page)) {
-			add_free_page(page);
-		}
+/**
+ * free_run() - Release a contiguous run as naturally aligned blocks.
+ * @start: Page-aligned physical start of the run.
+ * @end: Page-aligned physical end of the run.
+ *
+ * Inserts the largest aligned blocks that fit the run instead of freeing
+ * page by page. Each block still coalesces with free neighbours, so runs
+ * released in separate passes join into larger blocks.
+ */
+static void free_run(phys_addr_t start, phys_addr_t end)
+{
+	while (start < end) {
+		unsigned int order = PAGE_MAX_ORDER;
 
-		if (page == first) {
-			break;
+		while (order != 0 &&
+			((start & (order_bytes(order) - 1)) != 0 ||
+				start + order_bytes(order) > end)) {
+			order--;
 		}
+
+		merge_free_block(start >> PAGE_SHIFT, order);
+		start += order_bytes(order);
+	}
+}
+
+/**
+ * add_free_run() - Seed the buddy lists with one contiguous free run.
+ * @start: Page-aligned physical start of the run.
+ * @end: Page-aligned physical end of the run.
+ */
+static void add_free_run(phys_addr_t start, phys_addr_t end)
+{
+	phys_addr_t page;
+
+	for (page = start; page < end; page += PAGE_SIZE) {
+		phys_to_page(page)->flags &= ~PG_RESERVED;
+		pfn_zone(page >> PAGE_SHIFT)->managed_pages++;
 	}
+
+	free_run(start, end);
 }
 
-static void init_free_pages(const boot_info_t *boot_info)
+/**
+ * boot_memory_reclaimable() - Test whether a firmware type is reusable RAM.
+ * @type: Firmware memory type of a boot descriptor.
+ *
+ * Loader and boot-services memory holds only firmware and bootloader state
+ * after ExitBootServices(); runtime services and ACPI tables stay untouched.
+ *
+ * Return: Non-zero if the region can be reclaimed once unreferenced.
+ */
+static int boot_memory_reclaimable(uint32_t type)
 {
+	return type == BOOT_MEMORY_TYPE_LOADER_CODE ||
+		type == BOOT_MEMORY_TYPE_LOADER_DATA ||
+		type == BOOT_MEMORY_TYPE_BOOT_SERVICES_CODE ||
+		type == BOOT_MEMORY_TYPE_BOOT_SERVICES_DATA;
+}
+
+/**
+ * register_boot_memory() - Describe boot memory as memblock ranges.
+ * @boot_info: Boot handoff carrying the firmware memory map.
+ *
+ * Conventional descriptors become memory ranges. Page zero, the kernel image
+ * and active page-table pages become reservations, each recorded once as a
+ * range instead of being rechecked for every page. Reclaimable descriptors
+ * are not registered yet, but they widen the PFN span so the page array
+ * already covers them when reclaim_boot_memory() runs.
+ */
+static void register_boot_memory(const boot_info_t *boot_info)
+{
+	/* The direct map does not exist yet; use the firmware identity map. */
+	const void *map = (const void *)(uintptr_t)boot_info->memory_map;
 	uint64_t offset;
+	uint64_t kernel_start = (uint64_t)(uintptr_t)__kernel_start;
+	uint64_t kernel_end = (uint64_t)(uintptr_t)__kernel_end;
+
+	memblock_reset();
+	boot_ram_start = UINT64_MAX;
+	boot_ram_end = 0;
 
 	for (offset = 0; offset + sizeof(boot_memory_descriptor_t) <=
 		boot_info->memory_map_size;
 		offset += boot_info->memory_descriptor_size) {
 		const boot_memory_descriptor_t *descriptor =
-			(const boot_memory_descriptor_t
-					*)(uintptr_t)(boot_info->memory_map +
-				offset);
+			memory_descriptor(map, offset);
+		uint64_t start = descriptor->physical_start;
+		uint64_t end = start + descriptor->number_of_pages * PAGE_SIZE;
 
-		if (descriptor->type != BOOT_MEMORY_TYPE_CONVENTIONAL) {
+		if (descriptor->type != BOOT_MEMORY_TYPE_CONVENTIONAL &&
+			!boot_memory_reclaimable(descriptor->type)) {
 			continue;
 		}
 
-		add_conventional_range(boot_info,
-			descriptor->physical_start,
-			descriptor->number_of_pages);
+		if (descriptor->number_of_pages == 0) {
+			continue;
+		}
+
+		if (start < boot_ram_start) {
+			boot_ram_start = start;
+		}
+
+		if (end > boot_ram_end) {
+			boot_ram_end = end;
+		}
+
+		if (descriptor->type == BOOT_MEMORY_TYPE_CONVENTIONAL) {
+			memblock_add(start, end - start);
+		}
 	}
+
+	/* Physical address 0 doubles as the allocation failure value. */
+	memblock_reserve(0, PAGE_SIZE);
+	memblock_reserve(kernel_start, kernel_end - kernel_start);
+	arch_reserve_page_tables();
+	arch_reserve_low_memory();
 }
 
-phys_addr_t alloc_page(void)
+/**
+ * snapshot_boot_info() - Copy the boot handoff into kernel-owned memory.
+ * @boot_info: Handoff passed by the bootloader.
+ *
+ * The handoff lives on the bootloader stack and the memory map in a loader
+ * pool, both of which are reclaimed. The copy keeps them readable for the
+ * rest of the kernel's lifetime. Like register_boot_memory() this runs on
+ * the firmware identity map, before the direct map is built.
+ */
+static void snapshot_boot_info(const boot_info_t *boot_info)
+{
+	const uint8_t *source;
+	uint8_t *copy;
+	phys_addr_t map;
+	uint64_t index;
+
+	map = memblock_alloc(boot_info->memory_map_size, PAGE_SIZE);
+	if (map == 0) {
+		panic("boot memory map copy allocation failed");
+	}
+
+	source = (const uint8_t *)(uintptr_t)boot_info->memory_map;
+	copy = (uint8_t *)(uintptr_t)map;
+	for (index = 0; index < boot_info->memory_map_size; index++) {
+		copy[index] = source[index];
+	}
+
+	boot_info_copy = *boot_info;
+	boot_info_copy.memory_map = map;
+}
+
+static void add_free_range(phys_addr_t start, phys_addr_t end, void *data)
 {
-	struct page_node *node = free_pages;
+	(void)data;
+	add_free_run(start, end);
+}
+
+/**
+ * init_mem_map() - Carve and initialize the PFN-indexed page array.
+ *
+ * The array covers every PFN from the lowest to the highest usable boot RAM
+ * page, holes included, and is allocated from memblock before any page
+ * reaches the buddy lists. Every entry starts PG_RESERVED; seeding free
+ * ranges clears the flag for pages the allocator will manage, so holes can
+ * never look like free buddies.
+ */
+static void init_mem_map(void)
+{
+	uint64_t index;
+	uint64_t count;
+	phys_addr_t base;
+
+	mem_map_base_pfn = align_up(boot_ram_start, PAGE_SIZE) >> PAGE_SHIFT;
+	mem_map_end_pfn = boot_ram_end >> PAGE_SHIFT;
+	if (mem_map_end_pfn <= mem_map_base_pfn) {
+		panic("no conventional memory for page metadata");
+	}
 
-	if (node == 0) {
+	count = mem_map_end_pfn - mem_map_base_pfn;
+	mem_map_bytes = align_up(count * sizeof(*mem_map), PAGE_SIZE);
+	base = memblock_alloc(mem_map_bytes, PAGE_SIZE);
+	if (base == 0) {
+		panic("page metadata array allocation failed");
+	}
+
+	mem_map = phys_to_virt(base);
+	for (index = 0; index < count; index++) {
+		struct page *page = &mem_map[index];
+
+		page->flags = PG_RESERVED;
+		page->order = 0;
+		page->owner = PAGE_OWNER_RESERVED;
+		page->inuse = 0;
+		page->private = 0;
+		page->refcount = 0;
+		page->next = 0;
+		page->prev = 0;
+		page->slab_cache = 0;
+		page->freelist = 0;
+	}
+}
+
+/**
+ * reclaim_boot_memory() - Hand loader and boot-services memory to the buddy.
+ *
+ * Runs after the handoff has been copied, when nothing in the kernel still
+ * points into firmware or bootloader allocations. Conventional memory is
+ * already owned by the buddy allocator, so it is reserved before the
+ * reclaimable descriptors are registered; the following free-range pass then
+ * yields exactly the reclaimable pages minus the kernel image and the page
+ * tables that stay live.
+ */
+static void reclaim_boot_memory(void)
+{
+	const void *map = phys_to_virt(boot_info_copy.memory_map);
+	uint64_t offset;
+	uint64_t before = free_page_count;
+
+	for (offset = 0; offset + sizeof(boot_memory_descriptor_t) <=
+		boot_info_copy.memory_map_size;
+		offset += boot_info_copy.memory_descriptor_size) {
+		const boot_memory_descriptor_t *descriptor =
+			memory_descriptor(map, offset);
+		uint64_t bytes = descriptor->number_of_pages * PAGE_SIZE;
+
+		if (descriptor->type == BOOT_MEMORY_TYPE_CONVENTIONAL) {
+			memblock_reserve(descriptor->physical_start, bytes);
+		} else if (boot_memory_reclaimable(descriptor->type)) {
+			memblock_add(descriptor->physical_start, bytes);
+		}
+	}
+
+	memblock_for_each_free_range(add_free_range, 0);
+	boot_reclaimed_pages = free_page_count - before;
+}
+
+const boot_info_t *mm_boot_info(void)
+{
+	return &boot_info_copy;
+}
+
+uint64_t nr_boot_reclaimed_pages(void)
+{
+	return boot_reclaimed_pages;
+}
+
+/**
+ * zone_alloc() - Take a 2^@order block from one zone.
+ * @zone: Zone to allocate from.
+ * @order: Buddy order of the request.
+ *
+ * Takes the smallest free block that can satisfy @order and returns the
+ * unused halves to lower-order free lists while splitting it down.
+ *
+ * Return: Head page of the block, or NULL if @zone has no large enough block.
+ */
+static struct page *zone_alloc(struct zone *zone, unsigned int order)
+{
+	unsigned int current;
+	struct page *page;
+	uint64_t pfn;
+
+	for (current = order; current <= PAGE_MAX_ORDER; current++) {
+		if (zone->free_areas[current].head != 0) {
+			break;
+		}
+	}
+
+	if (current > PAGE_MAX_ORDER) {
 		return 0;
 	}
 
-	free_pages = node->next;
-	free_page_count--;
+	page = zone->free_areas[current].head;
+	free_area_del(page, current);
+	pfn = page_to_pfn(page);
 
-	return (phys_addr_t)(uintptr_t)node;
+	while (current > order) {
+		current--;
+		free_area_add(pfn_to_page(pfn + (1ull << current)), current);
+	}
+
+	return page;
 }
 
-void free_page(phys_addr_t page)
+/**
+ * claim_block_locked() - Mark a freshly allocated block as owned.
+ * @page: Head page of the block.
+ * @order: Order recorded in the head page.
+ *
+ * Called with zone_lock held. Falling below the low watermark means the
+ * caller should wake the reclaim thread once the lock is dropped; the
+ * caller is never made to reclaim itself.
+ *
+ * Return: Non-zero if free memory is below the low watermark.
+ */
+static int claim_block_locked(struct page *page, unsigned int order)
+{
+	page->order = (uint8_t)order;
+	page->owner = PAGE_OWNER_KERNEL;
+	page->refcount = 1;
+
+	return free_page_count < watermarks[WMARK_LOW];
+}
+
+/**
+ * alloc_pages_zone() - Allocate 2^@order pages from @zone or below.
+ * @order: Buddy order of the request.
+ * @zone: Highest zone the block may come from.
+ *
+ * Zones are tried from @zone downwards, so ordinary allocations only eat
+ * into DMA32 memory once everything above 4 GiB is gone. The head page
+ * records the allocation order and starts with one reference. Failing wakes
+ * the reclaim thread.
+ *
+ * Return: Physical base address, or 0 when no large enough block is free.
+ */
+phys_addr_t alloc_pages_zone(unsigned int order, enum zone_type zone)
+{
+	struct page *page = 0;
+	uint64_t flags;
+	int low;
+	int index;
+
+	if (order > PAGE_MAX_ORDER || (unsigned int)zone >= NR_ZONES) {
+		return 0;
+	}
+
+	spin_lock_irqsave(&zone_lock, &flags);
+	for (index = (int)zone; index >= 0 && page == 0; index--) {
+		page = zone_alloc(&zones[index], order);
+	}
+
+	low = page == 0 || claim_block_locked(page, order);
+	spin_unlock_irqrestore(&zone_lock, flags);
+
+	if (low) {
+		reclaim_wake();
+	}
+
+	return page != 0 ? page_to_phys(page) : 0;
+}
+
+phys_addr_t alloc_pages(unsigned int order)
+{
+	return alloc_pages_zone(order, ZONE_NORMAL);
+}
+
+/**
+ * find_contig_blocks() - Find adjacent free maximum-order blocks.
+ * @zone: Zone to search.
+ * @count: Number of adjacent blocks wanted.
+ *
+ * Steps through the zone one maximum-order block at a time, so the cost is
+ * one struct page load per 4 MiB rather than a walk of the free lists.
+ *
+ * Return: First PFN of the run, or 0 if @zone has no such run. PFN 0 is
+ * always reserved, so it cannot start a run.
+ */
+static uint64_t find_contig_blocks(const struct zone *zone, uint64_t count)
+{
+	uint64_t block = 1ull << PAGE_MAX_ORDER;
+	uint64_t pfn = align_up(zone->start_pfn, block);
+	uint64_t run = 0;
+
+	for (; pfn + block <= zone->end_pfn; pfn += block) {
+		if (!page_is_free_buddy(pfn, PAGE_MAX_ORDER)) {
+			run = 0;
+			continue;
+		}
+
+		run++;
+		if (run == count) {
+			return pfn - (count - 1) * block;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * alloc_contig_pages() - Allocate an arbitrary number of contiguous pages.
+ * @nr_pages: Pages wanted.
+ * @zone: Highest zone the run may come from.
+ *
+ * Runs that fit one buddy block are cut from the smallest covering block.
+ * Longer ones take adjacent free maximum-order blocks. Either way the pages
+ * past @nr_pages go straight back to the free lists.
+ *
+ * Return: Physical base address, or 0 when no large enough run is free.
+ */
+phys_addr_t alloc_contig_pages(uint64_t nr_pages, enum zone_type zone)
+{
+	uint64_t block = 1ull << PAGE_MAX_ORDER;
+	uint64_t start = 0;
+	uint64_t count;
+	uint64_t index;
+	uint64_t flags;
+	int current;
+	int low;
+
+	if (nr_pages == 0 || (unsigned int)zone >= NR_ZONES) {
+		return 0;
+	}
+
+	if (nr_pages <= block) {
+		unsigned int order = 0;
+		phys_addr_t base;
+
+		while ((1ull << order) < nr_pages) {
+			order++;
+		}
+
+		base = alloc_pages_zone(order, zone);
+		if (base != 0) {
+			spin_lock_irqsave(&zone_lock, &flags);
+			free_run(base + nr_pages * PAGE_SIZE,
+				base + order_bytes(order));
+			spin_unlock_irqrestore(&zone_lock, flags);
+		}
+
+		return base;
+	}
+
+	count = (nr_pages + block - 1) / block;
+	spin_lock_irqsave(&zone_lock, &flags);
+	for (current = (int)zone; current >= 0 && start == 0; current--) {
+		start = find_contig_blocks(&zones[current], count);
+	}
+
+	if (start == 0) {
+		spin_unlock_irqrestore(&zone_lock, flags);
+		reclaim_wake();
+		return 0;
+	}
+
+	for (index = 0; index < count; index++) {
+		free_area_del(pfn_to_page(start + index * block),
+			PAGE_MAX_ORDER);
+	}
+
+	free_run((start + nr_pages) << PAGE_SHIFT,
+		(start + count * block) << PAGE_SHIFT);
+	low = claim_block_locked(pfn_to_page(start), PAGE_MAX_ORDER);
+	spin_unlock_irqrestore(&zone_lock, flags);
+
+	if (low) {
+		reclaim_wake();
+	}
+
+	return start << PAGE_SHIFT;
+}
+
+/**
+ * free_contig_pages() - Release a run from alloc_contig_pages().
+ * @base: Physical base address returned by alloc_contig_pages().
+ * @nr_pages: Page count passed to alloc_contig_pages().
+ *
+ * A run may also be released piecewise, as long as every piece is freed
+ * exactly once.
+ */
+void free_contig_pages(phys_addr_t base, uint64_t nr_pages)
+{
+	uint64_t pfn = base >> PAGE_SHIFT;
+	uint64_t index;
+	uint64_t flags;
+
+	if (base == 0 || nr_pages == 0 || (base & (PAGE_SIZE - 1)) != 0 ||
+		!pfn_valid(pfn) || nr_pages > mem_map_end_pfn - pfn) {
+		panic("invalid contiguous page free");
+	}
+
+	spin_lock_irqsave(&zone_lock, &flags);
+	for (index = 0; index < nr_pages; index++) {
+		if ((pfn_to_page(pfn + index)->flags &
+			(PG_RESERVED | PG_BUDDY)) != 0) {
+			panic("physical page double free");
+		}
+	}
+
+	free_run(base, base + nr_pages * PAGE_SIZE);
+	spin_unlock_irqrestore(&zone_lock, flags);
+}
+
+/**
+ * free_pages() - Return a block to the buddy allocator and coalesce it.
+ * @page: Physical base address previously returned by alloc_pages().
+ * @order: Order that was passed to alloc_pages().
+ *
+ * The block is coalesced with free buddies. Freeing a page the allocator does
+ * not own, or one that is already free, panics instead of corrupting the free
+ * lists.
+ */
+void free_pages(phys_addr_t page, unsigned int order)
 {
-	if ((page & (PAGE_SIZE - 1)) != 0 || page == 0) {
+	uint64_t pfn = page >> PAGE_SHIFT;
+	struct page *head;
+	uint64_t flags;
+
+	if (page == 0 || order > PAGE_MAX_ORDER ||
+		(page & (order_bytes(order) - 1)) != 0 || !pfn_valid(pfn)) {
 		panic("invalid physical page free");
 	}
 
-	add_free_page(page);
+	head = pfn_to_page(pfn);
+	spin_lock_irqsave(&zone_lock, &flags);
+	if ((head->flags & (PG_RESERVED | PG_BUDDY)) != 0) {
+		panic("physical page double free");
+	}
+
+	merge_free_block(pfn, order);
+	spin_unlock_irqrestore(&zone_lock, flags);
 }
 
-static void page_allocator_selftest(void)
+phys_addr_t alloc_page(void)
 {
-	phys_addr_t first = alloc_page();
-	phys_addr_t second = alloc_page();
+	return alloc_pages(0);
+}
 
-	if (first == 0 || second == 0 || first == second) {
+void free_page(phys_addr_t page)
+{
+	free_pages(page, 0);
+}
+
+uint64_t nr_free_pages(void)
+{
+	return free_page_count;
+}
+
+uint64_t page_watermark(enum page_watermark mark)
+{
+	if ((unsigned int)mark >= NR_WMARK) {
+		return 0;
+	}
+
+	return watermarks[mark];
+}
+
+/**
+ * setup_watermarks() - Size the reclaim watermarks from boot memory.
+ */
+static void setup_watermarks(void)
+{
+	uint64_t low = free_page_count / WMARK_LOW_DIVISOR;
+
+	if (low < WMARK_LOW_MIN_PAGES) {
+		low = WMARK_LOW_MIN_PAGES;
+	}
+
+	if (low > WMARK_LOW_MAX_PAGES) {
+		low = WMARK_LOW_MAX_PAGES;
+	}
+
+	watermarks[WMARK_LOW] = low;
+	watermarks[WMARK_HIGH] = low * 2;
+}
+
+uint64_t nr_zone_free_pages(enum zone_type zone)
+{
+	if ((unsigned int)zone >= NR_ZONES) {
+		return 0;
+	}
+
+	return zones[zone].free_pages;
+}
+
+uint64_t nr_zone_managed_pages(enum zone_type zone)
+{
+	if ((unsigned int)zone >= NR_ZONES) {
+		return 0;
+	}
+
+	return zones[zone].managed_pages;
+}
+
+uint64_t nr_free_blocks(unsigned int order)
+{
+	uint64_t count = 0;
+	unsigned int zone;
+
+	if (order > PAGE_MAX_ORDER) {
+		return 0;
+	}
+
+	for (zone = 0; zone < NR_ZONES; zone++) {
+		count += zones[zone].free_areas[order].nr_free;
+	}
+
+	return count;
+}
+
+static void snapshot_free_blocks(uint64_t *counts)
+{
+	unsigned int order;
+
+	for (order = 0; order <= PAGE_MAX_ORDER; order++) {
+		counts[order] = nr_free_blocks(order);
+	}
+}
+
+static void report_free_areas(void)
+{
+	unsigned int order;
+	unsigned int zone;
+
+	pr_info("buddy free blocks:");
+	for (order = 0; order <= PAGE_MAX_ORDER; order++) {
+		pr_info(" %u:%llu",
+			order,
+			(unsigned long long)nr_free_blocks(order));
+	}
+	pr_info("\n");
+
+	pr_info("memory zones:");
+	for (zone = 0; zone < NR_ZONES; zone++) {
+		pr_info(" %s pfns=%llu-%llu managed=%llu free=%llu",
+			zones[zone].name,
+			(unsigned long long)zones[zone].start_pfn,
+			(unsigned long long)zones[zone].end_pfn,
+			(unsigned long long)zones[zone].managed_pages,
+			(unsigned long long)zones[zone].free_pages);
+	}
+	pr_info("\n");
+}
+
+/**
+ * init_zones() - Split the page array's PFN span at the DMA32 limit.
+ *
+ * A zone with no RAM in its range ends up empty, with equal start and end.
+ */
+static void init_zones(void)
+{
+	uint64_t limit = ZONE_DMA32_LIMIT >> PAGE_SHIFT;
+	uint64_t split = mem_map_end_pfn < limit ? mem_map_end_pfn : limit;
+
+	if (split < mem_map_base_pfn) {
+		split = mem_map_base_pfn;
+	}
+
+	zones[ZONE_DMA32].start_pfn = mem_map_base_pfn;
+	zones[ZONE_DMA32].end_pfn = split;
+	zones[ZONE_NORMAL].start_pfn = split;
+	zones[ZONE_NORMAL].end_pfn = mem_map_end_pfn;
+}
+
+/**
+ * page_allocator_selftest() - Check splitting and coalescing at boot.
+ *
+ * Allocations are released in reverse order, so full coalescing must restore
+ * the exact per-order free block counts observed before the test.
+ */
+static void page_allocator_selftest(void)
+{
+	uint64_t before[PAGE_MAX_ORDER + 1];
+	uint64_t after[PAGE_MAX_ORDER + 1];
+	phys_addr_t first;
+	phys_addr_t second;
+	phys_addr_t run;
+	phys_addr_t low;
+	unsigned int order;
+
+	snapshot_free_blocks(before);
+
+	first = alloc_page();
+	second = alloc_page();
+	run = alloc_pages(3);
+	low = alloc_pages_zone(2, ZONE_DMA32);
+
+	if (first == 0 || second == 0 || run == 0 || first == second) {
 		panic("physical page allocator selftest failed");
 	}
 
+	if (low == 0 || low + order_bytes(2) > ZONE_DMA32_LIMIT) {
+		panic("physical page allocator zone selftest failed");
+	}
+
+	if ((run & (order_bytes(3) - 1)) != 0) {
+		panic("physical page allocator alignment selftest failed");
+	}
+
+	if (phys_to_page(run)->order != 3 || phys_to_page(run)->refcount != 1 ||
+		page_to_phys(phys_to_page(first)) != first) {
+		panic("page metadata selftest failed");
+	}
+
+	free_pages(low, 2);
+	free_pages(run, 3);
 	free_page(second);
 	free_page(first);
 
+	snapshot_free_blocks(after);
+	for (order = 0; order <= PAGE_MAX_ORDER; order++) {
+		if (before[order] != after[order]) {
+			panic("physical page allocator merge selftest failed");
+		}
+	}
+
 	pr_info("physical page allocator selftest ok\n");
 }
 
 void mm_init(const boot_info_t *boot_info)
 {
+	unsigned int order;
+	unsigned int zone;
+
 	if (boot_info == 0 || boot_info->memory_map == 0 ||
 		boot_info->memory_descriptor_size == 0) {
 		panic("memory map unavailable");
 	}
 
-	free_pages = 0;
+	for (zone = 0; zone < NR_ZONES; zone++) {
+		for (order = 0; order <= PAGE_MAX_ORDER; order++) {
+			zones[zone].free_areas[order].head = 0;
+			zones[zone].free_areas[order].nr_free = 0;
+		}
+		zones[zone].free_pages = 0;
+		zones[zone].managed_pages = 0;
+	}
 	free_page_count = 0;
 
-	init_free_pages(boot_info);
-
+	register_boot_memory(boot_info);
+	snapshot_boot_info(boot_info);
+	arch_physmap_init(&boot_info_copy);
+	init_mem_map();
+	init_zones();
+	memblock_for_each_free_range(add_free_range, 0);
+	reclaim_boot_memory();
+	setup_watermarks();
+
+	pr_info("page metadata pfns=%llu bytes=%llu\n",
+		(unsigned long long)(mem_map_end_pfn - mem_map_base_pfn),
+		(unsigned long long)mem_map_bytes);
+	pr_info("memblock memory ranges=%llu reserved ranges=%llu\n",
+		(unsigned long long)memblock_region_count(0),
+		(unsigned long long)memblock_region_count(1));
 	pr_info("physical pages free=%llu\n",
 		(unsigned long long)free_page_count);
+	report_free_areas();
+	pr_info("page watermarks low=%llu high=%llu\n",
+		(unsigned long long)watermarks[WMARK_LOW],
+		(unsigned long long)watermarks[WMARK_HIGH]);
 
 	page_allocator_selftest();
 	page_table_selftest();
+	zero_pool_init();
 	heap_init();
+	slab_selftest();
+	vm_space_selftest();
+	vmalloc_selftest();
+	zero_pool_selftest();
+	mempool_selftest();
+	shrinker_selftest();
 }
@@ -0,0 +1,158 @@
+#include <stdint.h>
+
+#include <tianole/arch.h>
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/shrinker.h>
+#include <tianole/spinlock.h>
+
+/*
+ * Pages zeroed ahead of time, chained through struct page::next. The pool
+ * is capped because pooled pages are unavailable to every other user.
+ */
+#define ZERO_POOL_TARGET 64u
+
+static struct page *zero_pool;
+static uint64_t zero_pool_count;
+static uint64_t zero_pool_hits;
+static uint64_t zero_pool_misses;
+static struct spinlock zero_pool_lock = SPINLOCK_INITIALIZER;
+
+phys_addr_t alloc_zeroed_page(void)
+{
+	struct page *page;
+	phys_addr_t phys;
+	uint64_t flags;
+
+	spin_lock_irqsave(&zero_pool_lock, &flags);
+	page = zero_pool;
+	if (page != 0) {
+		zero_pool = page->next;
+		zero_pool_count--;
+		zero_pool_hits++;
+	} else {
+		zero_pool_misses++;
+	}
+	spin_unlock_irqrestore(&zero_pool_lock, flags);
+
+	if (page != 0) {
+		page->next = 0;
+		return page_to_phys(page);
+	}
+
+	phys = alloc_page();
+	if (phys != 0) {
+		arch_clear_page(phys_to_virt(phys));
+	}
+
+	return phys;
+}
+
+uint32_t zero_pool_refill(uint32_t budget)
+{
+	uint32_t added = 0;
+
+	while (added < budget) {
+		struct page *page;
+		phys_addr_t phys;
+		uint64_t flags;
+		int full;
+
+		spin_lock_irqsave(&zero_pool_lock, &flags);
+		full = zero_pool_count >= ZERO_POOL_TARGET;
+		spin_unlock_irqrestore(&zero_pool_lock, flags);
+		if (full != 0 ||
+			nr_free_pages() <= page_watermark(WMARK_HIGH)) {
+			break;
+		}
+
+		phys = alloc_page();
+		if (phys == 0) {
+			break;
+		}
+
+		arch_clear_page_nocache(phys_to_virt(phys));
+		page = phys_to_page(phys);
+
+		spin_lock_irqsave(&zero_pool_lock, &flags);
+		full = zero_pool_count >= ZERO_POOL_TARGET;
+		if (full == 0) {
+			page->next = zero_pool;
+			zero_pool = page;
+			zero_pool_count++;
+		}
+		spin_unlock_irqrestore(&zero_pool_lock, flags);
+
+		if (full != 0) {
+			free_page(phys);
+			break;
+		}
+
+		added++;
+	}
+
+	return added;
+}
+
+uint64_t nr_zero_pool_pages(void)
+{
+	return zero_pool_count;
+}
+
+static uint64_t zero_pool_count_pages(struct shrinker *shrinker)
+{
+	(void)shrinker;
+
+	return zero_pool_count;
+}
+
+/**
+ * zero_pool_scan() - Give pooled pages back to the buddy allocator.
+ * @shrinker: Zero pool shrinker.
+ * @nr_to_scan: Pages wanted.
+ *
+ * Return: Pages freed.
+ */
+static uint64_t zero_pool_scan(struct shrinker *shrinker, uint64_t nr_to_scan)
+{
+	uint64_t freed = 0;
+
+	(void)shrinker;
+
+	while (freed < nr_to_scan) {
+		struct page *page;
+		uint64_t flags;
+
+		spin_lock_irqsave(&zero_pool_lock, &flags);
+		page = zero_pool;
+		if (page != 0) {
+			zero_pool = page->next;
+			zero_pool_count--;
+		}
+		spin_unlock_irqrestore(&zero_pool_lock, flags);
+
+		if (page == 0) {
+			break;
+		}
+
+		page->next = 0;
+		free_page(page_to_phys(page));
+		freed++;
+	}
+
+	return freed;
+}
+
+/* Pooled pages only save zeroing time, so they are the first to go. */
+static struct shrinker zero_pool_shrinker = {
+	.name = "zero_pool",
+	.count = zero_pool_count_pages,
+	.scan = zero_pool_scan,
+};
+
+void zero_pool_init(void)
+{
+	if (register_shrinker(&zero_pool_shrinker) != 0) {
+		panic("zero pool shrinker registration failed");
+	}
+}
@@ -0,0 +1,213 @@
+#include <stdint.h>
+
+#include <tianole/errno.h>
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/printk.h>
+#include <tianole/sched.h>
+#include <tianole/shrinker.h>
+#include <tianole/spinlock.h>
+
+/*
+ * shrink_caches() pins up to SHRINK_BATCH shrinkers at a time through
+ * their active counts and calls them after dropping shrinker_lock.
+ */
+#define SHRINK_BATCH 8u
+
+static struct shrinker *shrinker_list;
+static struct spinlock shrinker_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * reclaim_wait doubles as the lock for reclaim_requested, so a wakeup
+ * between the thread's condition check and its sleep cannot be lost.
+ */
+static struct wait_queue reclaim_wait;
+static int reclaim_requested;
+
+int register_shrinker(struct shrinker *shrinker)
+{
+	struct shrinker **link;
+	uint64_t flags;
+
+	if (shrinker == 0 || shrinker->count == 0 || shrinker->scan == 0) {
+		return -EINVAL;
+	}
+
+	spin_lock_irqsave(&shrinker_lock, &flags);
+	link = &shrinker_list;
+	while (*link != 0) {
+		if (*link == shrinker) {
+			spin_unlock_irqrestore(&shrinker_lock, flags);
+			return -EEXIST;
+		}
+
+		link = &(*link)->next;
+	}
+
+	shrinker->freed = 0;
+	shrinker->active = 0;
+	shrinker->next = 0;
+	*link = shrinker;
+	spin_unlock_irqrestore(&shrinker_lock, flags);
+	return 0;
+}
+
+void unregister_shrinker(struct shrinker *shrinker)
+{
+	struct shrinker **link;
+	uint64_t flags;
+
+	spin_lock_irqsave(&shrinker_lock, &flags);
+	link = &shrinker_list;
+	while (*link != 0 && *link != shrinker) {
+		link = &(*link)->next;
+	}
+
+	if (*link != 0) {
+		*link = shrinker->next;
+	}
+
+	/* A pass that pinned the shrinker before it was unlinked. */
+	while (shrinker->active != 0) {
+		spin_unlock_irqrestore(&shrinker_lock, flags);
+		sched_yield();
+		spin_lock_irqsave(&shrinker_lock, &flags);
+	}
+	spin_unlock_irqrestore(&shrinker_lock, flags);
+}
+
+/**
+ * pin_batch() - Pin the next batch of registered shrinkers.
+ * @skip: Shrinkers already handled by this pass.
+ * @batch: Receives up to SHRINK_BATCH pinned shrinkers.
+ *
+ * The pass resumes by position, since a pinned shrinker may be unlinked
+ * while its callbacks run and its next pointer then goes stale.
+ *
+ * Return: Number of shrinkers pinned.
+ */
+static uint32_t pin_batch(uint32_t skip, struct shrinker **batch)
+{
+	struct shrinker *shrinker;
+	uint32_t pinned = 0;
+	uint64_t flags;
+
+	spin_lock_irqsave(&shrinker_lock, &flags);
+	shrinker = shrinker_list;
+	while (shrinker != 0 && skip != 0) {
+		shrinker = shrinker->next;
+		skip--;
+	}
+
+	while (shrinker != 0 && pinned < SHRINK_BATCH) {
+		shrinker->active++;
+		batch[pinned++] = shrinker;
+		shrinker = shrinker->next;
+	}
+	spin_unlock_irqrestore(&shrinker_lock, flags);
+
+	return pinned;
+}
+
+uint64_t shrink_caches(uint64_t nr_pages)
+{
+	struct shrinker *batch[SHRINK_BATCH];
+	uint64_t freed = 0;
+	uint32_t done = 0;
+	uint32_t pinned;
+	uint64_t flags;
+	uint32_t index;
+
+	do {
+		pinned = pin_batch(done, batch);
+		for (index = 0; index < pinned && freed < nr_pages; index++) {
+			struct shrinker *shrinker = batch[index];
+			uint64_t count = shrinker->count(shrinker);
+			uint64_t want = nr_pages - freed;
+			uint64_t pages;
+
+			if (count == 0) {
+				continue;
+			}
+
+			pages = shrinker->scan(shrinker,
+				count < want ? count : want);
+			__atomic_add_fetch(&shrinker->freed, pages,
+				__ATOMIC_RELAXED);
+			freed += pages;
+		}
+
+		spin_lock_irqsave(&shrinker_lock, &flags);
+		for (index = 0; index < pinned; index++) {
+			batch[index]->active--;
+		}
+		spin_unlock_irqrestore(&shrinker_lock, flags);
+
+		done += pinned;
+	} while (pinned == SHRINK_BATCH && freed < nr_pages);
+
+	return freed;
+}
+
+void reclaim_wake(void)
+{
+	uint64_t flags;
+
+	wait_queue_lock_irqsave(&reclaim_wait, &flags);
+	if (reclaim_requested == 0) {
+		reclaim_requested = 1;
+		wait_queue_wake_one_locked(&reclaim_wait);
+	}
+	wait_queue_unlock_irqrestore(&reclaim_wait, flags);
+}
+
+static int reclaim_pending(void *arg)
+{
+	(void)arg;
+
+	return reclaim_requested;
+}
+
+/**
+ * reclaim_thread() - Shrink caches whenever the allocator asks for it.
+ * @arg: Unused.
+ *
+ * The request flag is cleared before shrinking, so a shortfall the pass
+ * cannot fix is retried only when the allocator asks again, never in a
+ * busy loop.
+ */
+static void reclaim_thread(void *arg)
+{
+	(void)arg;
+
+	for (;;) {
+		uint64_t flags;
+
+		if (wait_queue_wait(&reclaim_wait, reclaim_pending, 0) != 0) {
+			panic("reclaim wait failed");
+		}
+
+		wait_queue_lock_irqsave(&reclaim_wait, &flags);
+		reclaim_requested = 0;
+		wait_queue_unlock_irqrestore(&reclaim_wait, flags);
+
+		while (nr_free_pages() < page_watermark(WMARK_HIGH)) {
+			if (shrink_caches(page_watermark(WMARK_HIGH) -
+				nr_free_pages()) == 0) {
+				break;
+			}
+		}
+	}
+}
+
+int reclaim_start(void)
+{
+	if (kernel_thread_create("reclaim", reclaim_thread, 0) == 0) {
+		return -ENOMEM;
+	}
+
+	pr_info("reclaim thread started low=%llu high=%llu\n",
+		(unsigned long long)page_watermark(WMARK_LOW),
+		(unsigned long long)page_watermark(WMARK_HIGH));
+	return 0;
+}
@@ -0,0 +1,439 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/printk.h>
+#include <tianole/slab.h>
+#include <tianole/spinlock.h>
+
+#define SLAB_MAX_ORDER 3u
+#define SLAB_MIN_OBJECTS 8u
+
+/**
+ * struct kmem_cache - Fixed-size object cache.
+ * @name: Diagnostic name.
+ * @object_size: Requested object size.
+ * @stride: Distance between objects, @object_size rounded up to alignment.
+ * @freeptr_offset: Offset of the freelist link inside a free object.
+ * @order: Buddy order of each slab.
+ * @objects_per_slab: Objects carved from one slab.
+ * @ctor: Optional constructor run when a slab is populated.
+ * @partial: Slabs with at least one free object, including empty slabs.
+ * @full: Slabs with no free object.
+ * @nr_slabs: Slabs owned by the cache.
+ * @nr_empty: Slabs on @partial with no allocated object.
+ * @nr_inuse: Allocated objects across all slabs.
+ * @lock: Protects the slab lists and counters.
+ * @next: Link on the global cache list.
+ *
+ * Slabs are chained through struct page::next/prev of their head page. The
+ * head page also holds the slab freelist and in-use count, so a slab's
+ * memory is used entirely for objects. Free objects store the freelist link
+ * in their first word, or just past the object when a constructor owns the
+ * object's contents.
+ */
+struct kmem_cache {
+	char name[SLAB_NAME_LENGTH];
+	size_t object_size;
+	size_t stride;
+	size_t freeptr_offset;
+	unsigned int order;
+	uint32_t objects_per_slab;
+	kmem_ctor_t ctor;
+	struct page *partial;
+	struct page *full;
+	uint64_t nr_slabs;
+	uint64_t nr_empty;
+	uint64_t nr_inuse;
+	struct spinlock lock;
+	struct kmem_cache *next;
+};
+
+/*
+ * Caches are themselves slab objects. The cache of caches is static so the
+ * first kmem_cache_create() call has somewhere to allocate from.
+ */
+static struct kmem_cache kmem_cache_cache = {
+	.name = "kmem_cache",
+	.object_size = sizeof(struct kmem_cache),
+	.stride = sizeof(struct kmem_cache),
+	.objects_per_slab = PAGE_SIZE / sizeof(struct kmem_cache),
+	.lock = SPINLOCK_INITIALIZER,
+};
+static struct kmem_cache *cache_list = &kmem_cache_cache;
+static struct spinlock cache_list_lock = SPINLOCK_INITIALIZER;
+
+static size_t align_up_size(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static void *slab_base(const struct page *slab)
+{
+	return phys_to_virt(page_to_phys(slab));
+}
+
+static void *get_freeptr(const struct kmem_cache *cache, void *object)
+{
+	return *(void **)((uint8_t *)object + cache->freeptr_offset);
+}
+
+static void set_freeptr(struct kmem_cache *cache, void *object, void *next)
+{
+	*(void **)((uint8_t *)object + cache->freeptr_offset) = next;
+}
+
+static void slab_list_add(struct page **head, struct page *slab)
+{
+	slab->prev = 0;
+	slab->next = *head;
+	if (*head != 0) {
+		(*head)->prev = slab;
+	}
+
+	*head = slab;
+}
+
+static void slab_list_del(struct page **head, struct page *slab)
+{
+	if (slab->prev != 0) {
+		slab->prev->next = slab->next;
+	} else {
+		*head = slab->next;
+	}
+
+	if (slab->next != 0) {
+		slab->next->prev = slab->prev;
+	}
+
+	slab->next = 0;
+	slab->prev = 0;
+}
+
+/**
+ * cache_layout() - Pick object stride and slab order for a cache.
+ * @cache: Cache with object_size and ctor already set.
+ * @align: Requested power-of-two alignment.
+ *
+ * The slab grows until it holds SLAB_MIN_OBJECTS objects or reaches
+ * SLAB_MAX_ORDER, keeping per-slab waste small relative to the slab.
+ *
+ * Return: 0 on success, or -1 when one object does not fit the largest slab.
+ */
+static int cache_layout(struct kmem_cache *cache, size_t align)
+{
+	size_t size = cache->object_size;
+
+	if (align < sizeof(void *)) {
+		align = sizeof(void *);
+	}
+
+	cache->freeptr_offset = 0;
+	if (cache->ctor != 0) {
+		cache->freeptr_offset = align_up_size(size, sizeof(void *));
+		size = cache->freeptr_offset + sizeof(void *);
+	}
+
+	if (size < sizeof(void *)) {
+		size = sizeof(void *);
+	}
+
+	cache->stride = align_up_size(size, align);
+	cache->order = 0;
+	while (cache->order < SLAB_MAX_ORDER &&
+		((uint64_t)PAGE_SIZE << cache->order) / cache->stride <
+			SLAB_MIN_OBJECTS) {
+		cache->order++;
+	}
+
+	cache->objects_per_slab =
+		(uint32_t)(((uint64_t)PAGE_SIZE << cache->order) /
+			cache->stride);
+	return cache->objects_per_slab == 0 ? -1 : 0;
+}
+
+/**
+ * slab_create() - Allocate and populate a new slab for @cache.
+ * @cache: Cache that will own the slab.
+ *
+ * Every frame of the slab points back at @cache so kmem_cache_free() can
+ * validate objects. Objects are chained in address order and constructed.
+ *
+ * Return: Head page of the new slab, or NULL when memory is exhausted.
+ */
+static struct page *slab_create(struct kmem_cache *cache)
+{
+	phys_addr_t base = alloc_pages(cache->order);
+	struct page *slab;
+	uint8_t *object;
+	uint64_t index;
+	uint32_t count;
+
+	if (base == 0) {
+		return 0;
+	}
+
+	slab = phys_to_page(base);
+	for (index = 0; index < (1ull << cache->order); index++) {
+		slab[index].flags |= PG_SLAB;
+		slab[index].owner = PAGE_OWNER_SLAB;
+		slab[index].slab_cache = cache;
+	}
+
+	object = slab_base(slab);
+	slab->freelist = object;
+	slab->inuse = 0;
+	for (count = 0; count < cache->objects_per_slab; count++) {
+		void *next = 0;
+
+		if (cache->ctor != 0) {
+			cache->ctor(object);
+		}
+
+		if (count + 1 < cache->objects_per_slab) {
+			next = object + cache->stride;
+		}
+
+		set_freeptr(cache, object, next);
+		object += cache->stride;
+	}
+
+	cache->nr_slabs++;
+	return slab;
+}
+
+static void slab_destroy(struct kmem_cache *cache, struct page *slab)
+{
+	uint64_t index;
+
+	for (index = 0; index < (1ull << cache->order); index++) {
+		slab[index].flags &= ~PG_SLAB;
+		slab[index].slab_cache = 0;
+	}
+
+	slab->freelist = 0;
+	cache->nr_slabs--;
+	free_pages(page_to_phys(slab), cache->order);
+}
+
+static void copy_cache_name(char *dest, const char *src)
+{
+	size_t index;
+
+	if (src == 0) {
+		src = "cache";
+	}
+
+	for (index = 0; index + 1 < SLAB_NAME_LENGTH && src[index] != '\0';
+		index++) {
+		dest[index] = src[index];
+	}
+
+	dest[index] = '\0';
+}
+
+struct kmem_cache *kmem_cache_create(
+	const char *name, size_t size, size_t align, kmem_ctor_t ctor)
+{
+	struct kmem_cache *cache;
+	uint64_t flags;
+
+	if (size == 0 || (align & (align - 1)) != 0) {
+		return 0;
+	}
+
+	cache = kmem_cache_alloc(&kmem_cache_cache);
+	if (cache == 0) {
+		return 0;
+	}
+
+	copy_cache_name(cache->name, name);
+	cache->object_size = size;
+	cache->ctor = ctor;
+	cache->partial = 0;
+	cache->full = 0;
+	cache->nr_slabs = 0;
+	cache->nr_empty = 0;
+	cache->nr_inuse = 0;
+	cache->lock = (struct spinlock)SPINLOCK_INITIALIZER;
+	if (cache_layout(cache, align) != 0) {
+		kmem_cache_free(&kmem_cache_cache, cache);
+		return 0;
+	}
+
+	spin_lock_irqsave(&cache_list_lock, &flags);
+	cache->next = cache_list;
+	cache_list = cache;
+	spin_unlock_irqrestore(&cache_list_lock, flags);
+
+	return cache;
+}
+
+void kmem_cache_destroy(struct kmem_cache *cache)
+{
+	struct kmem_cache **link;
+	uint64_t flags;
+
+	if (cache == 0 || cache == &kmem_cache_cache) {
+		return;
+	}
+
+	if (cache->nr_inuse != 0 || cache->full != 0) {
+		panic("kmem_cache_destroy with live objects");
+	}
+
+	spin_lock_irqsave(&cache_list_lock, &flags);
+	for (link = &cache_list; *link != 0; link = &(*link)->next) {
+		if (*link == cache) {
+			*link = cache->next;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&cache_list_lock, flags);
+
+	while (cache->partial != 0) {
+		struct page *slab = cache->partial;
+
+		slab_list_del(&cache->partial, slab);
+		slab_destroy(cache, slab);
+	}
+
+	kmem_cache_free(&kmem_cache_cache, cache);
+}
+
+void *kmem_cache_alloc(struct kmem_cache *cache)
+{
+	struct page *slab;
+	void *object;
+	uint64_t flags;
+
+	if (cache == 0) {
+		return 0;
+	}
+
+	spin_lock_irqsave(&cache->lock, &flags);
+	slab = cache->partial;
+	if (slab == 0) {
+		slab = slab_create(cache);
+		if (slab == 0) {
+			spin_unlock_irqrestore(&cache->lock, flags);
+			return 0;
+		}
+
+		slab_list_add(&cache->partial, slab);
+		cache->nr_empty++;
+	}
+
+	if (slab->inuse == 0) {
+		cache->nr_empty--;
+	}
+
+	object = slab->freelist;
+	slab->freelist = get_freeptr(cache, object);
+	slab->inuse++;
+	cache->nr_inuse++;
+
+	if (slab->freelist == 0) {
+		slab_list_del(&cache->partial, slab);
+		slab_list_add(&cache->full, slab);
+	}
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	return object;
+}
+
+void kmem_cache_free(struct kmem_cache *cache, void *object)
+{
+	struct page *page;
+	struct page *slab;
+	uint64_t pfn;
+	uint64_t flags;
+
+	if (object == 0) {
+		return;
+	}
+
+	if (cache == 0 || !physmap_contains(object)) {
+		panic("invalid kmem_cache_free");
+	}
+
+	pfn = physmap_to_phys(object) >> PAGE_SHIFT;
+	if (!pfn_valid(pfn)) {
+		panic("invalid kmem_cache_free");
+	}
+
+	page = pfn_to_page(pfn);
+	if ((page->flags & PG_SLAB) == 0 || page->slab_cache != cache) {
+		panic("kmem_cache_free cache mismatch");
+	}
+
+	slab = pfn_to_page(pfn & ~((1ull << cache->order) - 1));
+
+	spin_lock_irqsave(&cache->lock, &flags);
+	if (slab->freelist == 0) {
+		slab_list_del(&cache->full, slab);
+		slab_list_add(&cache->partial, slab);
+	}
+
+	set_freeptr(cache, object, slab->freelist);
+	slab->freelist = object;
+	slab->inuse--;
+	cache->nr_inuse--;
+
+	/* Keep one empty slab so alloc/free at a boundary does not thrash. */
+	if (slab->inuse == 0) {
+		if (cache->nr_empty != 0) {
+			slab_list_del(&cache->partial, slab);
+			slab_destroy(cache, slab);
+		} else {
+			cache->nr_empty++;
+		}
+	}
+	spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+void kmem_cache_get_stats(
+	struct kmem_cache *cache, struct kmem_cache_stats *stats)
+{
+	uint64_t flags;
+
+	if (cache == 0 || stats == 0) {
+		return;
+	}
+
+	spin_lock_irqsave(&cache->lock, &flags);
+	stats->name = cache->name;
+	stats->object_size = cache->object_size;
+	stats->stride = cache->stride;
+	stats->objects_per_slab = cache->objects_per_slab;
+	stats->slab_bytes = (uint64_t)PAGE_SIZE << cache->order;
+	stats->slabs = cache->nr_slabs;
+	stats->objects_inuse = cache->nr_inuse;
+	stats->waste_bytes = stats->slabs * stats->slab_bytes -
+		stats->objects_inuse * cache->object_size;
+	spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+void kmem_cache_dump(void)
+{
+	struct kmem_cache *cache;
+	uint64_t flags;
+
+	spin_lock_irqsave(&cache_list_lock, &flags);
+	for (cache = cache_list; cache != 0; cache = cache->next) {
+		struct kmem_cache_stats stats;
+
+		kmem_cache_get_stats(cache, &stats);
+		pr_info("slab %s size=%llu inuse=%llu total=%llu slabs=%llu "
+			"waste=%llu\n",
+			stats.name,
+			(unsigned long long)stats.object_size,
+			(unsigned long long)stats.objects_inuse,
+			(unsigned long long)(stats.slabs *
+				stats.objects_per_slab),
+			(unsigned long long)stats.slabs,
+			(unsigned long long)stats.waste_bytes);
+	}
+	spin_unlock_irqrestore(&cache_list_lock, flags);
+}
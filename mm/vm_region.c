@@ -0,0 +1,213 @@
+#include <stdint.h>
+
+#include <tianole/errno.h>
+#include <tianole/mm.h>
+#include <tianole/spinlock.h>
+
+/*
+ * Registered regions, sorted by start address: the heap arena plus one per
+ * live vmalloc() area. Lookups walk the list linearly.
+ */
+static struct vm_region *region_list;
+static struct spinlock region_lock = SPINLOCK_INITIALIZER;
+
+static int page_aligned(virt_addr_t addr)
+{
+	return (addr & (PAGE_SIZE - 1)) == 0;
+}
+
+static struct vm_region *find_region(virt_addr_t addr)
+{
+	struct vm_region *region;
+
+	for (region = region_list; region != 0; region = region->next) {
+		if (addr < region->start) {
+			return 0;
+		}
+
+		if (addr < region->end) {
+			return region;
+		}
+	}
+
+	return 0;
+}
+
+static void set_block_owner(phys_addr_t block, unsigned int order,
+	uint8_t owner)
+{
+	uint64_t index;
+
+	for (index = 0; index < (1ull << order); index++) {
+		pfn_to_page((block >> PAGE_SHIFT) + index)->owner = owner;
+	}
+}
+
+/**
+ * populate_large() - Try to back the 2 MiB span around @addr in one leaf.
+ * @region: Region with VM_REGION_LARGE set.
+ * @addr: Faulting address.
+ *
+ * Return: 0 if the span is now mapped, or a negative errno when the caller
+ * should fall back to a 4 KiB page.
+ */
+static int populate_large(struct vm_region *region, virt_addr_t addr)
+{
+	virt_addr_t span = addr & ~(PAGE_SIZE_2M - 1);
+	phys_addr_t block;
+	int ret;
+
+	if (span < region->start || region->end - span < PAGE_SIZE_2M) {
+		return -EINVAL;
+	}
+
+	block = alloc_pages(PAGE_ORDER_2M);
+	if (block == 0) {
+		return -ENOMEM;
+	}
+
+	set_block_owner(block, PAGE_ORDER_2M, region->owner);
+	ret = map_page_size(span, block, PAGE_SIZE_2M, region->page_flags);
+	if (ret != 0) {
+		free_pages(block, PAGE_ORDER_2M);
+		return ret;
+	}
+
+	region->pages += PAGE_SIZE_2M / PAGE_SIZE;
+	return 0;
+}
+
+/**
+ * populate_page() - Back the 4 KiB page holding @addr.
+ * @region: Region containing @addr.
+ * @addr: Faulting address.
+ *
+ * Return: 0 on success, including when the page is already mapped, or
+ * -ENOMEM.
+ */
+static int populate_page(struct vm_region *region, virt_addr_t addr)
+{
+	phys_addr_t page = alloc_page();
+	int ret;
+
+	if (page == 0) {
+		return -ENOMEM;
+	}
+
+	set_block_owner(page, 0, region->owner);
+	ret = map_page(addr & ~(virt_addr_t)(PAGE_SIZE - 1), page,
+		region->page_flags);
+	if (ret != 0) {
+		free_page(page);
+		return ret == -EEXIST ? 0 : ret;
+	}
+
+	region->pages++;
+	return 0;
+}
+
+int vm_region_register(struct vm_region *region)
+{
+	struct vm_region *prev = 0;
+	struct vm_region *next;
+	uint64_t flags;
+
+	if (region == 0 || !page_aligned(region->start) ||
+		!page_aligned(region->end) || region->end < region->start) {
+		return -EINVAL;
+	}
+
+	region->pages = 0;
+	spin_lock_irqsave(&region_lock, &flags);
+	next = region_list;
+	while (next != 0 && next->start < region->start) {
+		prev = next;
+		next = next->next;
+	}
+
+	if ((prev != 0 && prev->end > region->start) ||
+		(next != 0 && next->start < region->end)) {
+		spin_unlock_irqrestore(&region_lock, flags);
+		return -EEXIST;
+	}
+
+	region->next = next;
+	if (prev != 0) {
+		prev->next = region;
+	} else {
+		region_list = region;
+	}
+	spin_unlock_irqrestore(&region_lock, flags);
+	return 0;
+}
+
+void vm_region_unregister(struct vm_region *region)
+{
+	struct vm_region **link;
+	uint64_t flags;
+
+	spin_lock_irqsave(&region_lock, &flags);
+	link = &region_list;
+	while (*link != 0 && *link != region) {
+		link = &(*link)->next;
+	}
+
+	if (*link != 0) {
+		*link = region->next;
+	}
+	spin_unlock_irqrestore(&region_lock, flags);
+}
+
+int vm_region_resize(struct vm_region *region, virt_addr_t end)
+{
+	uint64_t flags;
+
+	if (!page_aligned(end) || end < region->start) {
+		return -EINVAL;
+	}
+
+	spin_lock_irqsave(&region_lock, &flags);
+	if (region->next != 0 && region->next->start < end) {
+		spin_unlock_irqrestore(&region_lock, flags);
+		return -EEXIST;
+	}
+
+	region->end = end;
+	spin_unlock_irqrestore(&region_lock, flags);
+	return 0;
+}
+
+/**
+ * vm_region_fault() - Back a faulting address inside a region.
+ * @addr: Faulting virtual address.
+ *
+ * The registry lock is held across the allocation and mapping so the
+ * region cannot be unregistered or shrunk underneath the fault.
+ *
+ * Return: 0 if the access can be retried, -EFAULT outside every region, or
+ * -ENOMEM.
+ */
+int vm_region_fault(virt_addr_t addr)
+{
+	struct vm_region *region;
+	uint64_t flags;
+	int ret;
+
+	spin_lock_irqsave(&region_lock, &flags);
+	region = find_region(addr);
+	if (region == 0) {
+		spin_unlock_irqrestore(&region_lock, flags);
+		return -EFAULT;
+	}
+
+	ret = -EINVAL;
+	if ((region->flags & VM_REGION_LARGE) != 0) {
+		ret = populate_large(region, addr);
+	}
+
+	if (ret != 0) {
+		ret = populate_page(region, addr);
+	}
+	spin_unlock_irqrestore(&region_lock, flags);
+	return ret;
+}
@@ -0,0 +1,260 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tianole/errno.h>
+#include <tianole/mm.h>
+#include <tianole/panic.h>
+#include <tianole/spinlock.h>
+#include <tianole/vmalloc.h>
+
+/* Kernel window handed out by vmalloc(); its own top-level slots. */
+#define VMALLOC_BASE 0xffffc90000000000ull
+#define VMALLOC_END (VMALLOC_BASE + (32ull << 30))
+#define VMALLOC_GUARD_SIZE PAGE_SIZE
+
+/**
+ * struct vmalloc_area - One live vmalloc() reservation.
+ * @region: Demand-fault region covering the usable pages.
+ * @next: Next area by address.
+ *
+ * Descriptors come from kmalloc()'s size classes, which live in the direct
+ * map, so the fault path never touches a demand-faulted descriptor.
+ */
+struct vmalloc_area {
+	struct vm_region region;
+	struct vmalloc_area *next;
+};
+
+static struct vmalloc_area *area_list;
+static struct spinlock vmalloc_lock = SPINLOCK_INITIALIZER;
+
+static void vmalloc_release_frames(phys_addr_t phys, uint64_t size,
+	void *data)
+{
+	(void)data;
+
+	if (size == PAGE_SIZE_2M) {
+		free_pages(phys, PAGE_ORDER_2M);
+	} else {
+		free_page(phys);
+	}
+}
+
+/**
+ * insert_area() - Find the lowest gap for an area and link it there.
+ * @area: Area whose region bounds are filled in on success.
+ * @bytes: Usable bytes, a multiple of PAGE_SIZE.
+ *
+ * Return: 0 on success or -ENOMEM if the window has no large enough gap.
+ */
+static int insert_area(struct vmalloc_area *area, uint64_t bytes)
+{
+	struct vmalloc_area **link = &area_list;
+	virt_addr_t start = VMALLOC_BASE;
+
+	while (*link != 0) {
+		if ((*link)->region.start - start >=
+			bytes + VMALLOC_GUARD_SIZE) {
+			break;
+		}
+
+		start = (*link)->region.end + VMALLOC_GUARD_SIZE;
+		link = &(*link)->next;
+	}
+
+	if (VMALLOC_END - start < bytes + VMALLOC_GUARD_SIZE) {
+		return -ENOMEM;
+	}
+
+	area->region.start = start;
+	area->region.end = start + bytes;
+	area->next = *link;
+	*link = area;
+	return 0;
+}
+
+static void remove_area(struct vmalloc_area *area)
+{
+	struct vmalloc_area **link = &area_list;
+
+	while (*link != area) {
+		link = &(*link)->next;
+	}
+
+	*link = area->next;
+}
+
+/**
+ * reserve_area() - Reserve and register a new area.
+ * @size: Bytes requested.
+ *
+ * Return: The area, or NULL on failure.
+ */
+static struct vmalloc_area *reserve_area(size_t size)
+{
+	uint64_t bytes = ((uint64_t)size + PAGE_SIZE - 1) &
+		~(uint64_t)(PAGE_SIZE - 1);
+	struct vmalloc_area *area;
+	uint64_t flags;
+	int ret;
+
+	if (size == 0 || bytes < size ||
+		bytes > VMALLOC_END - VMALLOC_BASE) {
+		return 0;
+	}
+
+	area = kmalloc(sizeof(*area));
+	if (area == 0) {
+		return 0;
+	}
+
+	area->region.page_flags = PAGE_WRITABLE | PAGE_NO_EXECUTE;
+	area->region.owner = PAGE_OWNER_VMALLOC;
+	area->region.flags = 0;
+	area->region.name = "vmalloc";
+
+	spin_lock_irqsave(&vmalloc_lock, &flags);
+	ret = insert_area(area, bytes);
+	if (ret == 0) {
+		ret = vm_region_register(&area->region);
+		if (ret != 0) {
+			remove_area(area);
+		}
+	}
+	spin_unlock_irqrestore(&vmalloc_lock, flags);
+
+	if (ret != 0) {
+		kfree(area);
+		return 0;
+	}
+
+	return area;
+}
+
+/**
+ * populate_area() - Map every page of an area now.
+ * @area: Freshly reserved area.
+ *
+ * Frames come in buddy blocks as large as the remaining length allows,
+ * each mapped with one map_range() call; smaller blocks are tried when
+ * memory is fragmented.
+ *
+ * Return: 0 on success or -ENOMEM; pages mapped so far stay mapped.
+ */
+static int populate_area(struct vmalloc_area *area)
+{
+	virt_addr_t virt = area->region.start;
+
+	while (virt < area->region.end) {
+		uint64_t left = area->region.end - virt;
+		unsigned int order = PAGE_MAX_ORDER;
+		phys_addr_t block = 0;
+		uint64_t index;
+		int ret;
+
+		while (order != 0 && ((uint64_t)PAGE_SIZE << order) > left) {
+			order--;
+		}
+
+		while ((block = alloc_pages(order)) == 0 && order != 0) {
+			order--;
+		}
+
+		if (block == 0) {
+			return -ENOMEM;
+		}
+
+		for (index = 0; index < (1ull << order); index++) {
+			pfn_to_page((block >> PAGE_SHIFT) + index)->owner =
+				PAGE_OWNER_VMALLOC;
+		}
+
+		ret = map_range(virt, block, (uint64_t)PAGE_SIZE << order,
+			area->region.page_flags);
+		if (ret != 0) {
+			free_pages(block, order);
+			return ret;
+		}
+
+		virt += (uint64_t)PAGE_SIZE << order;
+	}
+
+	return 0;
+}
+
+void *vmalloc(size_t size)
+{
+	struct vmalloc_area *area = reserve_area(size);
+
+	if (area == 0) {
+		return 0;
+	}
+
+	return (void *)(uintptr_t)area->region.start;
+}
+
+void *vmalloc_mapped(size_t size)
+{
+	struct vmalloc_area *area = reserve_area(size);
+	void *ptr;
+
+	if (area == 0) {
+		return 0;
+	}
+
+	ptr = (void *)(uintptr_t)area->region.start;
+	if (populate_area(area) != 0) {
+		vfree(ptr);
+		return 0;
+	}
+
+	return ptr;
+}
+
+int vmalloc_contains(const void *ptr)
+{
+	virt_addr_t address = (virt_addr_t)(uintptr_t)ptr;
+
+	return address >= VMALLOC_BASE && address < VMALLOC_END;
+}
+
+void vfree(void *ptr)
+{
+	virt_addr_t start = (virt_addr_t)(uintptr_t)ptr;
+	struct vmalloc_area *area;
+	uint64_t flags;
+	int ret;
+
+	if (ptr == 0) {
+		return;
+	}
+
+	spin_lock_irqsave(&vmalloc_lock, &flags);
+	area = area_list;
+	while (area != 0 && area->region.start != start) {
+		area = area->next;
+	}
+
+	if (area == 0) {
+		spin_unlock_irqrestore(&vmalloc_lock, flags);
+		panic("vfree of unknown pointer");
+	}
+
+	vm_region_unregister(&area->region);
+	spin_unlock_irqrestore(&vmalloc_lock, flags);
+
+	/* Never-touched pages are holes, so -ENOENT is expected. */
+	ret = unmap_range(area->region.start,
+		area->region.end - area->region.start,
+		vmalloc_release_frames,
+		0);
+	if (ret != 0 && ret != -ENOENT) {
+		panic("vfree unmap failed");
+	}
+
+	/* The range is reusable only once nothing is mapped in it. */
+	spin_lock_irqsave(&vmalloc_lock, &flags);
+	remove_area(area);
+	spin_unlock_irqrestore(&vmalloc_lock, flags);
+	kfree(area);
+}
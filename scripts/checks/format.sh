@@ -3,5 +3,5 @@ set -euo pipefail
 
 cd "$(dirname "$0")/../.."
 
-sources=$(find arch drivers fs include kernel mm \( -name '*.c' -o -name '*.h' \))
+sources=$(find arch block drivers fs include kernel lib mm \( -name '*.c' -o -name '*.h' \))
 clang-format --dry-run --Werror $sources
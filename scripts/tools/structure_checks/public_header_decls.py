@@ -16,12 +16,18 @@ def is_function_declaration_start(line: str) -> bool:
 	return True
 
 
+def is_macro_continuation(lines: list[str], index: int) -> bool:
+	return index > 0 and lines[index - 1].rstrip().endswith("\\")
+
+
 def collect_function_declarations(lines: list[str]) -> list[tuple[int, int, str]]:
 	decls = []
 	index = 0
 
 	while index < len(lines):
-		if not is_function_declaration_start(lines[index]):
+		if not is_function_declaration_start(lines[index]) or is_macro_continuation(
+			lines, index
+		):
 			index += 1
 			continue
 